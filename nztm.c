@@ -1,29 +1,14 @@
 #include "nztm.h"
 
-#include <math.h>
-
-/* Defines PI (from Abramowitz and Stegun Table 1.1) */
-
-#define PI 3.1415926535898
-#define TWOPI (2.0*PI)
-#define rad2deg (180/PI)
-
-/* Structure used to define a TM projection */
+#include "tmproj.h"
 
-typedef struct {
-	    double meridian;          /* Central meridian */
-	    double scalef;            /* Scale factor */
-	    double orglat;            /* Origin latitude */
-	    double falsee;            /* False easting */
-	    double falsen;            /* False northing */
-	    double utom;              /* Unit to metre conversion */
-
-	    double a, rf, f, e2, ep2;     /* Ellipsoid parameters */
-	    double om;                /* Intermediate calculation */
-	    } tmprojection;
+#include <math.h>
+#include <stdlib.h>
 
+#define PRECISE_BLOCK  256        /* Points refined at a time */
+#define FLOAT_BLOCK    256        /* Points widened at a time */
 
-static double meridian_arc( tmprojection *tm, double lt );
+static double meridian_arc( const tmprojection *tm, double lt );
 
 /* Initiallize the TM structure  */
 
@@ -31,6 +16,8 @@ static void define_tmprojection( tmprojection *tm, double a, double rf,
    double cm, double sf, double lto, double fe, double fn, double utom ) {
 
    double f;
+   double e2, e4, e6;
+   double n, n2, n3, n4;
 
    tm->meridian = cm;
    tm->scalef = sf;
@@ -45,6 +32,32 @@ static void define_tmprojection( tmprojection *tm, double a, double rf,
    tm->e2 = 2.0*f - f*f;
    tm->ep2 = tm->e2/( 1.0 - tm->e2 );
 
+   /* Meridian arc and foot point latitude series coefficients */
+
+   e2 = tm->e2;
+   e4 = e2*e2;
+   e6 = e4*e2;
+
+   tm->A0 = 1 - (e2/4.0) - (3.0*e4/64.0) - (5.0*e6/256.0);
+   tm->A2 = (3.0/8.0) * (e2+e4/4.0+15.0*e6/128.0);
+   tm->A4 = (15.0/256.0) * (e4 + 3.0*e6/4.0);
+   tm->A6 = 35.0*e6/3072.0;
+
+   n  = f/(2.0-f);
+   n2 = n*n;
+   n3 = n2*n;
+   n4 = n2*n2;
+
+   tm->g = a*(1.0-n)*(1.0-n2)*(1+9.0*n2/4.0+225.0*n4/64.0);
+   tm->p2 = 3.0*n/2.0 - 27.0*n3/32.0;
+   tm->p4 = 21.0*n2/16.0 - 55.0*n4/32.0;
+   tm->p6 = 151.0*n3/96.0;
+   tm->p8 = 1097.0*n4/512.0;
+
+   tm->ome2 = 1.0 - e2;
+   tm->rsf = 1.0/sf;
+   tm->rutom = 1.0/utom;
+
    tm->om = meridian_arc( tm, tm->orglat );
    }
 
@@ -66,25 +79,10 @@ static void define_tmprojection( tmprojection *tm, double a, double rf,
 /***************************************************************************/
 
 
-static double meridian_arc( tmprojection *tm, double lt ) {
-    double e2 = tm->e2;
+static double meridian_arc( const tmprojection *tm, double lt ) {
     double a = tm->a;
-    double e4;
-    double e6;
-    double A0;
-    double A2;
-    double A4;
-    double A6;
-
-    e4 = e2*e2;
-    e6 = e4*e2;
- 
-    A0 = 1 - (e2/4.0) - (3.0*e4/64.0) - (5.0*e6/256.0);
-    A2 = (3.0/8.0) * (e2+e4/4.0+15.0*e6/128.0);
-    A4 = (15.0/256.0) * (e4 + 3.0*e6/4.0);
-    A6 = 35.0*e6/3072.0;
-
-    return  a*(A0*lt-A2*sin(2*lt)+A4*sin(4*lt)-A6*sin(6*lt));
+
+    return  a*(tm->A0*lt-tm->A2*sin(2*lt)+tm->A4*sin(4*lt)-tm->A6*sin(6*lt));
     }
 
 /*************************************************************************/
@@ -103,34 +101,93 @@ static double meridian_arc( tmprojection *tm, double lt ) {
 /*************************************************************************/
 
 
-static double foot_point_lat( tmprojection *tm, double m ) {
-    double f = tm->f;
-    double a = tm->a;
-    double n;
-    double n2;
-    double n3;
-    double n4;
-    double g;
+static double foot_point_lat( const tmprojection *tm, double m ) {
     double sig;
     double phio;
  
-    n  = f/(2.0-f);
-    n2 = n*n;
-    n3 = n2*n;
-    n4 = n2*n2;
+    sig = m/tm->g;
  
-    g = a*(1.0-n)*(1.0-n2)*(1+9.0*n2/4.0+225.0*n4/64.0);
-    sig = m/g;
- 
-    phio = sig + (3.0*n/2.0 - 27.0*n3/32.0)*sin(2.0*sig)
-                    + (21.0*n2/16.0 - 55.0*n4/32.0)*sin(4.0*sig)
-                    + (151.0*n3/96.0) * sin(6.0*sig)
-                    + (1097.0*n4/512.0) * sin(8.0*sig);
+    phio = sig + tm->p2 * sin(2.0*sig)
+               + tm->p4 * sin(4.0*sig)
+               + tm->p6 * sin(6.0*sig)
+               + tm->p8 * sin(8.0*sig);
  
     return phio;
    }
 
 
+/***************************************************************************/
+/*                                                                         */
+/*   meridian_arc_cs, foot_point_lat_cs                                    */
+/*                                                                         */
+/*   Versions of meridian_arc and foot_point_lat for the NZTM_CLENSHAW     */
+/*   method.  They evaluate the same series, but the sin(2k*x) terms are   */
+/*   summed by Clenshaw recurrence from sin(x) and cos(x), so no further   */
+/*   transcendental functions are needed.                                  */
+/*                                                                         */
+/*   meridian_arc_cs takes the sine and cosine of the latitude, which      */
+/*   geod_tm needs anyway.  foot_point_lat_cs returns the sine and cosine */
+/*   of the foot point latitude, found from those of sig by the angle      */
+/*   addition formulae; the series correction is less than 0.003 rad so    */
+/*   its sine and cosine are taken from short Taylor series.               */
+/*                                                                         */
+/***************************************************************************/
+
+
+static double meridian_arc_cs( const tmprojection *tm, double lt,
+               double slt, double clt ) {
+    double s2 = 2.0*slt*clt;
+    double y = 2.0*(clt-slt)*(clt+slt);
+    double b1;
+    double b2;
+    double b3;
+
+    b3 = -tm->A6;
+    b2 = tm->A4 + y*b3;
+    b1 = -tm->A2 + y*b2 - b3;
+
+    return  tm->a*(tm->A0*lt + b1*s2);
+    }
+
+
+static double foot_point_lat_cs( const tmprojection *tm, double m,
+               double *sphi, double *cphi ) {
+    double sig;
+    double ssig;
+    double csig;
+    double s2;
+    double y;
+    double b1;
+    double b2;
+    double b3;
+    double b4;
+    double d;
+    double d2;
+    double sd;
+    double cd;
+
+    sig = m/tm->g;
+    ssig = sin(sig);
+    csig = cos(sig);
+    s2 = 2.0*ssig*csig;
+    y = 2.0*(csig-ssig)*(csig+ssig);
+
+    b4 = tm->p8;
+    b3 = tm->p6 + y*b4;
+    b2 = tm->p4 + y*b3 - b4;
+    b1 = tm->p2 + y*b2 - b3;
+    d = b1*s2;
+
+    d2 = d*d;
+    sd = d*(1.0 - d2/6.0*(1.0 - d2/20.0));
+    cd = 1.0 - d2/2.0*(1.0 - d2/12.0*(1.0 - d2/30.0));
+    *sphi = ssig*cd + csig*sd;
+    *cphi = csig*cd - ssig*sd;
+
+    return sig + d;
+    }
+
+
 
 
 
@@ -143,6 +200,7 @@ static double foot_point_lat( tmprojection *tm, double m ) {
 /*   manual at http://www.anzlic.org.au/icsm/gdatm/index.html              */
 /*                                                                         */
 /*   Takes parameters                                                      */
+/*      method (NZTM_REDFEARN or NZTM_CLENSHAW)                            */
 /*      input easting (metres)                                             */
 /*      input northing (metres)                                            */
 /*      output latitude (radians)                                          */
@@ -150,12 +208,14 @@ static double foot_point_lat( tmprojection *tm, double m ) {
 /*                                                                         */
 /***************************************************************************/
 
-static void tm_geod( tmprojection *tm,
+static void tm_geod( const tmprojection *tm, int method,
               double ce, double cn, double *ln, double *lt ) {
     double fn = tm->falsen;
     double fe = tm->falsee;
     double sf = tm->scalef;
+    double rsf = tm->rsf;
     double e2 = tm->e2;
+    double ome2 = tm->ome2;
     double a = tm->a;
     double cm = tm->meridian;
     double om = tm->om;
@@ -179,14 +239,19 @@ static void tm_geod( tmprojection *tm,
     double trm3;
     double trm4;
  
-    cn1  =  (cn - fn)*utom/sf + om;
-    fphi = foot_point_lat(tm, cn1);
-    slt = sin(fphi);
-    clt = cos(fphi);
+    cn1  =  (cn - fn)*utom*rsf + om;
+    if( method == NZTM_CLENSHAW ) {
+        fphi = foot_point_lat_cs(tm, cn1, &slt, &clt);
+        }
+    else {
+        fphi = foot_point_lat(tm, cn1);
+        slt = sin(fphi);
+        clt = cos(fphi);
+        }
  
     eslt = (1.0-e2*slt*slt);
     eta = a/sqrt(eslt);
-    rho = eta * (1.0-e2) / eslt;
+    rho = eta * ome2 / eslt;
     psi = eta/rho;
  
     E = (ce-fe)*utom;
@@ -238,6 +303,7 @@ static void tm_geod( tmprojection *tm,
 /*   Loosely based on FORTRAN source code by J.Hannah and A.Broadhurst.    */
 /*                                                                         */
 /*   Takes parameters                                                      */
+/*      method (NZTM_REDFEARN or NZTM_CLENSHAW)                            */
 /*      input latitude (radians)                                           */
 /*      input longitude (radians)                                          */
 /*      output easting  (metres)                                           */
@@ -246,16 +312,17 @@ static void tm_geod( tmprojection *tm,
 /***************************************************************************/
 
 
-static void geod_tm( tmprojection *tm,
+static void geod_tm( const tmprojection *tm, int method,
               double ln, double lt, double *ce, double *cn) {
     double fn = tm->falsen;
     double fe = tm->falsee;
     double sf = tm->scalef;
     double e2 = tm->e2;
+    double ome2 = tm->ome2;
     double a = tm->a;
     double cm = tm->meridian;
     double om = tm->om;
-    double utom = tm->utom;
+    double rutom = tm->rutom;
     double dlon;
     double m;
     double slt;
@@ -282,16 +349,19 @@ static void geod_tm( tmprojection *tm,
     while ( dlon > PI ) dlon -= TWOPI;
     while ( dlon < -PI ) dlon += TWOPI;
  
-    m = meridian_arc(tm,lt);
- 
     slt = sin(lt);
+    clt = cos(lt);
+ 
+    if( method == NZTM_CLENSHAW )
+        m = meridian_arc_cs(tm,lt,slt,clt);
+    else
+        m = meridian_arc(tm,lt);
  
     eslt = (1.0-e2*slt*slt);
     eta = a/sqrt(eslt);
-    rho = eta * (1.0-e2) / eslt;
+    rho = eta * ome2 / eslt;
     psi = eta/rho;
  
-    clt = cos(lt);
     w = dlon;
  
     wc = clt*w;
@@ -311,7 +381,7 @@ static void geod_tm( tmprojection *tm,
     trm3 = (61 - 479.0*t2 + 179.0*t4 - t6)/5040.0;
  
     gce = (sf*eta*dlon*clt)*(((trm3*wc2+trm2)*wc2+trm1)*wc2+1.0);
-    *ce = gce/utom+fe;
+    *ce = gce*rutom+fe;
  
     trm1 = 1.0/2.0;
  
@@ -326,29 +396,209 @@ static void geod_tm( tmprojection *tm,
     trm4 = (1385.0-3111.0*t2+543.0*t4-t6)/40320.0;
  
     gcn = (eta*t)*((((trm4*wc2+trm3)*wc2+trm2)*wc2+trm1)*wc2);
-    *cn = (gcn+m-om)*sf/utom+fn;
+    *cn = (gcn+m-om)*sf*rutom+fn;
 
    return;
    }
 
-/* Define a static implementation of tmprojection */
-/* Note: for some implementations it may be better to create this
-   dynamically and develop modified versions of the transformation
-   functions to take this as a parameter */
+/***************************************************************************/
+/*                                                                         */
+/*   tm_geod_fast, geod_tm_fast                                            */
+/*                                                                         */
+/*   The NZTM_FAST method: tm_geod and geod_tm with the Clenshaw arc and   */
+/*   foot point, without the highest order terms of the latitude and      */
+/*   northing series (x^8 and w^8) and of the easting series (w^7), and    */
+/*   with rho, psi and the ratios to them rewritten in terms of eslt so   */
+/*   that each point needs two divisions rather than four.                */
+/*                                                                         */
+/***************************************************************************/
+
+static void tm_geod_fast( const tmprojection *tm,
+              double ce, double cn, double *ln, double *lt ) {
+    double rome2 = 1.0/tm->ome2;
+    double rasf = 1.0/(tm->a*tm->scalef);
+    double cn1;
+    double fphi;
+    double slt;
+    double clt;
+    double rclt;
+    double eslt;
+    double psi;
+    double x;
+    double x2;
+    double t;
+    double t2;
+    double t4;
+    double trm2;
+    double trm3;
+    double trm4;
+
+    cn1 = (cn - tm->falsen)*tm->utom*tm->rsf + tm->om;
+    fphi = foot_point_lat_cs(tm, cn1, &slt, &clt);
+
+    eslt = (1.0-tm->e2*slt*slt);
+    psi = eslt*rome2;
+    x = (ce-tm->falsee)*tm->utom*sqrt(eslt)*rasf;
+    x2 = x*x;
+
+    rclt = 1.0/clt;
+    t = slt*rclt;
+    t2 = t*t;
+    t4 = t2*t2;
+
+    trm2 = ((-4.0*psi
+                 +9.0*(1-t2))*psi
+                 +12.0*t2)/24.0;
+
+    trm3 = ((((8.0*(11.0-24.0*t2)*psi
+                  -12.0*(21.0-71.0*t2))*psi
+                  +15.0*((15.0*t2-98.0)*t2+15))*psi
+                  +180.0*((-3.0*t2+5.0)*t2))*psi + 360.0*t4)/720.0;
+
+    *lt = fphi+(t*x2*psi)*((trm2-trm3*x2)*x2-0.5);
+
+    trm2 = (psi+2.0*t2)/6.0;
 
-static tmprojection nztm_projection;
-static int initiallized = 0;
+    trm3 = (((-4.0*(1.0-6.0*t2)*psi
+               +(9.0-68.0*t2))*psi
+               +72.0*t2)*psi
+               +24.0*t4)/120.0;
 
-static tmprojection *get_nztm_projection( void )
+    trm4 = (((720.0*t2+1320.0)*t2+662.0)*t2+61.0)/5040.0;
+
+    *ln = tm->meridian - (x*rclt)*(((trm4*x2-trm3)*x2+trm2)*x2-1.0);
+    }
+
+static void geod_tm_fast( const tmprojection *tm,
+              double ln, double lt, double *ce, double *cn) {
+    double rome2 = 1.0/tm->ome2;
+    double dlon;
+    double m;
+    double slt;
+    double clt;
+    double eslt;
+    double eta;
+    double psi;
+    double wc;
+    double wc2;
+    double t;
+    double t2;
+    double t4;
+    double trm1;
+    double trm2;
+    double trm3;
+
+    dlon  =  ln - tm->meridian;
+    while ( dlon > PI ) dlon -= TWOPI;
+    while ( dlon < -PI ) dlon += TWOPI;
+
+    slt = sin(lt);
+    clt = cos(lt);
+    m = meridian_arc_cs(tm,lt,slt,clt);
+
+    eslt = (1.0-tm->e2*slt*slt);
+    eta = tm->a/sqrt(eslt);
+    psi = eslt*rome2;
+
+    wc = clt*dlon;
+    wc2 = wc*wc;
+
+    t = slt/clt;
+    t2 = t*t;
+    t4 = t2*t2;
+
+    trm1 = (psi-t2)/6.0;
+
+    trm2 = (((4.0*(1.0-6.0*t2)*psi
+                  + (1.0+8.0*t2))*psi
+                  - 2.0*t2)*psi+t4)/120.0;
+
+    *ce = (tm->scalef*eta*wc)*((trm2*wc2+trm1)*wc2+1.0)*tm->rutom+tm->falsee;
+
+    trm2 = ((4.0*psi+1)*psi-t2)/24.0;
+
+    trm3 = ((((8.0*(11.0-24.0*t2)*psi
+                -28.0*(1.0-6.0*t2))*psi
+                +(1.0-32.0*t2))*psi
+                -2.0*t2)*psi
+                +t4)/720.0;
+
+    *cn = ((eta*t)*(((trm3*wc2+trm2)*wc2+0.5)*wc2)+m-tm->om)*
+          tm->scalef*tm->rutom+tm->falsen;
+    }
+
+/* The NZTM projection.  The derived values are those that
+   define_tmprojection would set, written as constant expressions so
+   that the projection is statically initialised and needs no run time
+   set up; om is zero as the origin latitude is the equator. */
+
+#define NZTM_F    (1.0/NZTM_RF)
+#define NZTM_E2   (2.0*NZTM_F - NZTM_F*NZTM_F)
+#define NZTM_E4   (NZTM_E2*NZTM_E2)
+#define NZTM_E6   (NZTM_E4*NZTM_E2)
+#define NZTM_N    (NZTM_F/(2.0-NZTM_F))
+#define NZTM_N2   (NZTM_N*NZTM_N)
+#define NZTM_N3   (NZTM_N2*NZTM_N)
+#define NZTM_N4   (NZTM_N2*NZTM_N2)
+
+const tmprojection nztm_projection = {
+   NZTM_CM/rad2deg, NZTM_SF, NZTM_OLAT/rad2deg, NZTM_FE, NZTM_FN, 1.0,
+   NZTM_A, NZTM_RF, NZTM_F, NZTM_E2, NZTM_E2/( 1.0 - NZTM_E2 ),
+   0.0,
+   1 - (NZTM_E2/4.0) - (3.0*NZTM_E4/64.0) - (5.0*NZTM_E6/256.0),
+   (3.0/8.0) * (NZTM_E2+NZTM_E4/4.0+15.0*NZTM_E6/128.0),
+   (15.0/256.0) * (NZTM_E4 + 3.0*NZTM_E6/4.0),
+   35.0*NZTM_E6/3072.0,
+   NZTM_A*(1.0-NZTM_N)*(1.0-NZTM_N2)*(1+9.0*NZTM_N2/4.0+225.0*NZTM_N4/64.0),
+   3.0*NZTM_N/2.0 - 27.0*NZTM_N3/32.0,
+   21.0*NZTM_N2/16.0 - 55.0*NZTM_N4/32.0,
+   151.0*NZTM_N3/96.0,
+   1097.0*NZTM_N4/512.0,
+   1.0 - NZTM_E2,
+   1.0/NZTM_SF,
+   1.0
+   };
+
+/* Projection handles.  A projection is not modified after it is
+   created, so handles can be shared between threads without locking. */
+
+tmprojection *tm_create( double a, double rf, double cm, double sf,
+   double lto, double fe, double fn, double utom )
 {
-   if( ! initiallized )
-   {
-       define_tmprojection( &nztm_projection, NZTM_A, NZTM_RF,
-           NZTM_CM/rad2deg, NZTM_SF, NZTM_OLAT/rad2deg, NZTM_FE, NZTM_FN,
-           1.0);
-       initiallized = 1;
-   }
-   return &nztm_projection;
+   tmprojection *tm = (tmprojection *) malloc( sizeof(tmprojection) );
+   if( tm ) define_tmprojection( tm, a, rf, cm, sf, lto, fe, fn, utom );
+   return tm;
+}
+
+void tm_destroy( tmprojection *tm )
+{
+   free( tm );
+}
+
+void tm_define( tmprojection *tm, double a, double rf, double cm, double sf,
+   double lto, double fe, double fn, double utom )
+{
+   define_tmprojection( tm, a, rf, cm, sf, lto, fe, fn, utom );
+}
+
+void tm_geod_h( const tmprojection *tm, double n, double e,
+   double *lt, double *ln )
+{
+   TM_STATS_BEGIN
+   TM_STATS_INVERSE( tm, &e, &n, 1, 1 );
+   TM_STATS_START;
+   tm_geod( tm, NZTM_REDFEARN, e, n, ln, lt );
+   TM_STATS_END( NZTM_STAT_TM_GEOD, 1 );
+}
+
+void geod_tm_h( const tmprojection *tm, double lt, double ln,
+   double *n, double *e )
+{
+   TM_STATS_BEGIN
+   TM_STATS_FORWARD( tm, &ln, &lt, 1, 1 );
+   TM_STATS_START;
+   geod_tm( tm, NZTM_REDFEARN, ln, lt, e, n );
+   TM_STATS_END( NZTM_STAT_GEOD_TM, 1 );
 }
 
 /* Functions implementation the TM projection specifically for the
@@ -357,14 +607,386 @@ static tmprojection *get_nztm_projection( void )
 
 void nztm_geod( double n, double e, double *lt, double *ln )
 {
-   tmprojection *nztm = get_nztm_projection();
-   tm_geod( nztm, e, n, ln, lt );
+   TM_STATS_BEGIN
+   TM_STATS_INVERSE( &nztm_projection, &e, &n, 1, 1 );
+   TM_STATS_START;
+   tm_geod( &nztm_projection, NZTM_REDFEARN, e, n, ln, lt );
+   TM_STATS_END( NZTM_STAT_TM_GEOD, 1 );
 }
 
 void geod_nztm( double lt, double ln, double *n, double *e )
 {
-   tmprojection *nztm = get_nztm_projection();
-   geod_tm( nztm, ln, lt, e, n );
+   TM_STATS_BEGIN
+   TM_STATS_FORWARD( &nztm_projection, &ln, &lt, 1, 1 );
+   TM_STATS_START;
+   geod_tm( &nztm_projection, NZTM_REDFEARN, ln, lt, e, n );
+   TM_STATS_END( NZTM_STAT_GEOD_TM, 1 );
+}
+
+/* Batch implementations.  The projection is copied into a local once
+   per call so that its constants can be held in registers for the
+   whole loop rather than reloaded for each point.  Where the processor
+   supports it the work is passed to the SIMD kernels in nztm_simd.c. */
+
+void tm_geod_batch( const tmprojection *proj, int method,
+              const double *ce, const double *cn, size_t instride,
+              double *ln, double *lt, size_t outstride, size_t count ) {
+    tmprojection tm = *proj;
+    size_t i;
+
+    if( method == NZTM_CLENSHAW ) {
+        for( i = 0; i < count; i++ ) {
+            tm_geod( &tm, NZTM_CLENSHAW, ce[i*instride], cn[i*instride],
+                     &ln[i*outstride], &lt[i*outstride] );
+            }
+        }
+    else if( method == NZTM_FAST ) {
+        for( i = 0; i < count; i++ ) {
+            tm_geod_fast( &tm, ce[i*instride], cn[i*instride],
+                     &ln[i*outstride], &lt[i*outstride] );
+            }
+        }
+    else {
+        for( i = 0; i < count; i++ ) {
+            tm_geod( &tm, NZTM_REDFEARN, ce[i*instride], cn[i*instride],
+                     &ln[i*outstride], &lt[i*outstride] );
+            }
+        }
+    }
+
+void geod_tm_batch( const tmprojection *proj, int method,
+              const double *ln, const double *lt, size_t instride,
+              double *ce, double *cn, size_t outstride, size_t count ) {
+    tmprojection tm = *proj;
+    size_t i;
+
+    if( method == NZTM_CLENSHAW ) {
+        for( i = 0; i < count; i++ ) {
+            geod_tm( &tm, NZTM_CLENSHAW, ln[i*instride], lt[i*instride],
+                     &ce[i*outstride], &cn[i*outstride] );
+            }
+        }
+    else if( method == NZTM_FAST ) {
+        for( i = 0; i < count; i++ ) {
+            geod_tm_fast( &tm, ln[i*instride], lt[i*instride],
+                     &ce[i*outstride], &cn[i*outstride] );
+            }
+        }
+    else {
+        for( i = 0; i < count; i++ ) {
+            geod_tm( &tm, NZTM_REDFEARN, ln[i*instride], lt[i*instride],
+                     &ce[i*outstride], &cn[i*outstride] );
+            }
+        }
+    }
+
+static void tm_geod_run( int isa, int method, const tmprojection *tm,
+              const double *ce, const double *cn, size_t instride,
+              double *ln, double *lt, size_t outstride, size_t count ) {
+    if( isa == NZTM_ISA_SCALAR )
+        tm_geod_batch( tm, method, ce, cn, instride, ln, lt, outstride, count );
+    else
+        tm_geod_simd( isa, method, tm, ce, cn, instride,
+            ln, lt, outstride, count );
+    }
+
+static void geod_tm_run( int isa, int method, const tmprojection *tm,
+              const double *ln, const double *lt, size_t instride,
+              double *ce, double *cn, size_t outstride, size_t count ) {
+    if( isa == NZTM_ISA_SCALAR )
+        geod_tm_batch( tm, method, ln, lt, instride, ce, cn, outstride, count );
+    else
+        geod_tm_simd( isa, method, tm, ln, lt, instride,
+            ce, cn, outstride, count );
+    }
+
+
+/***************************************************************************/
+/*                                                                         */
+/*   tm_geod_precise                                                       */
+/*                                                                         */
+/*   The NZTM_PRECISE method: the Redfearn inverse followed by one Newton  */
+/*   step making it consistent with geod_tm.  The point found is          */
+/*   projected forward and moved by the residual in easting and northing  */
+/*   through the inverse of the Jacobian of geod_tm.  As the projection   */
+/*   is conformal the Jacobian follows from the derivatives with respect  */
+/*   to longitude, (a,b) = d(E,N)/dlon, as                                */
+/*                                                                         */
+/*      d(E,N)/dlat = (rho/(nu cos lat)) (-b,a)                            */
+/*                                                                         */
+/*   and a and b are taken to the first order in w = dlon cos lat, which  */
+/*   is ample as the step is well under a millimetre.  The input is       */
+/*   copied a block at a time so the output may overwrite it.             */
+/*                                                                         */
+/***************************************************************************/
+
+static void tm_geod_precise( int isa, const tmprojection *tm,
+              const double *ce, const double *cn, size_t instride,
+              double *ln, double *lt, size_t outstride, size_t count ) {
+    double bce[PRECISE_BLOCK];
+    double bcn[PRECISE_BLOCK];
+    double bln[PRECISE_BLOCK];
+    double blt[PRECISE_BLOCK];
+    double fce[PRECISE_BLOCK];
+    double fcn[PRECISE_BLOCK];
+    double slt, clt, eslt, eta, s, w, t2, a, b, d, de, dn;
+    size_t i, j, nb;
+
+    for( i = 0; i < count; i += nb ) {
+        nb = count - i < PRECISE_BLOCK ? count - i : PRECISE_BLOCK;
+        for( j = 0; j < nb; j++ ) {
+            bce[j] = ce[(i+j)*instride];
+            bcn[j] = cn[(i+j)*instride];
+            }
+        tm_geod_run( isa, NZTM_REDFEARN, tm, bce, bcn, 1, bln, blt, 1, nb );
+        geod_tm_run( isa, NZTM_REDFEARN, tm, bln, blt, 1, fce, fcn, 1, nb );
+
+        for( j = 0; j < nb; j++ ) {
+            slt = sin(blt[j]);
+            clt = cos(blt[j]);
+            eslt = 1.0 - tm->e2*slt*slt;
+            eta = tm->a/sqrt(eslt);
+            s = tm->ome2/(eslt*clt);                   /* rho/(nu cos lat) */
+            w = (bln[j] - tm->meridian)*clt;
+            t2 = slt*slt/(clt*clt);
+            a = tm->scalef*eta*clt*(1.0 + 0.5*(eslt/tm->ome2 - t2)*w*w);
+            b = tm->scalef*eta*slt*w;
+            d = a*a + b*b;
+            de = (bce[j] - fce[j])*tm->utom;
+            dn = (bcn[j] - fcn[j])*tm->utom;
+            lt[(i+j)*outstride] = blt[j] + (a*dn - b*de)/(s*d);
+            ln[(i+j)*outstride] = bln[j] + (a*de + b*dn)/d;
+            }
+        }
+    }
+
+void tm_geod_isa( int isa, int method, const tmprojection *tm,
+   const double *ce, const double *cn, size_t instride,
+   double *ln, double *lt, size_t outstride, size_t count )
+{
+   TM_STATS_BEGIN
+   TM_STATS_INVERSE( tm, ce, cn, instride, count );
+   TM_STATS_START;
+   if( method == NZTM_PRECISE )
+      tm_geod_precise( isa, tm, ce, cn, instride, ln, lt, outstride, count );
+   else
+      tm_geod_run( isa, method, tm, ce, cn, instride, ln, lt, outstride, count );
+   TM_STATS_END( NZTM_STAT_TM_GEOD_N, count );
+}
+
+/* geod_tm defines the projection, so NZTM_PRECISE is NZTM_REDFEARN */
+
+void geod_tm_isa( int isa, int method, const tmprojection *tm,
+   const double *ln, const double *lt, size_t instride,
+   double *ce, double *cn, size_t outstride, size_t count )
+{
+   TM_STATS_BEGIN
+   TM_STATS_FORWARD( tm, ln, lt, instride, count );
+   TM_STATS_START;
+   if( method == NZTM_PRECISE ) method = NZTM_REDFEARN;
+   geod_tm_run( isa, method, tm, ln, lt, instride, ce, cn, outstride, count );
+   TM_STATS_END( NZTM_STAT_GEOD_TM_N, count );
+}
+
+double tm_meridian_arc( const tmprojection *tm, double lt )
+{
+   return meridian_arc( tm, lt );
+}
+
+double tm_foot_point_lat( const tmprojection *tm, double m )
+{
+   return foot_point_lat( tm, m );
+}
+
+int nztm_isa( void )
+{
+   return tm_simd_isa();
+}
+
+void tm_geod_hn( const tmprojection *tm, const double *n, const double *e,
+   double *lt, double *ln, size_t count )
+{
+   tm_geod_isa( tm_simd_isa(), NZTM_REDFEARN, tm,
+       e, n, 1, ln, lt, 1, count );
+}
+
+void geod_tm_hn( const tmprojection *tm, const double *lt, const double *ln,
+   double *n, double *e, size_t count )
+{
+   geod_tm_isa( tm_simd_isa(), NZTM_REDFEARN, tm,
+       ln, lt, 1, e, n, 1, count );
+}
+
+void tm_geod_hm( const tmprojection *tm, int method,
+   const double *n, const double *e, size_t instride,
+   double *lt, double *ln, size_t outstride, size_t count )
+{
+   tm_geod_isa( tm_simd_isa(), method, tm,
+       e, n, instride, ln, lt, outstride, count );
+}
+
+void geod_tm_hm( const tmprojection *tm, int method,
+   const double *lt, const double *ln, size_t instride,
+   double *n, double *e, size_t outstride, size_t count )
+{
+   geod_tm_isa( tm_simd_isa(), method, tm,
+       ln, lt, instride, e, n, outstride, count );
+}
+
+void nztm_geod_n( const double *n, const double *e,
+   double *lt, double *ln, size_t count )
+{
+   tm_geod_hn( &nztm_projection, n, e, lt, ln, count );
+}
+
+void geod_nztm_n( const double *lt, const double *ln,
+   double *n, double *e, size_t count )
+{
+   geod_tm_hn( &nztm_projection, lt, ln, n, e, count );
+}
+
+void nztm_geod_s( const double *n, const double *e, size_t instride,
+   double *lt, double *ln, size_t outstride, size_t count )
+{
+   tm_geod_hm( &nztm_projection, NZTM_REDFEARN,
+       n, e, instride, lt, ln, outstride, count );
+}
+
+void geod_nztm_s( const double *lt, const double *ln, size_t instride,
+   double *n, double *e, size_t outstride, size_t count )
+{
+   geod_tm_hm( &nztm_projection, NZTM_REDFEARN,
+       lt, ln, instride, n, e, outstride, count );
+}
+
+void nztm_geod_m( int method, const double *n, const double *e,
+   size_t instride, double *lt, double *ln, size_t outstride, size_t count )
+{
+   tm_geod_hm( &nztm_projection, method,
+       n, e, instride, lt, ln, outstride, count );
+}
+
+void geod_nztm_m( int method, const double *lt, const double *ln,
+   size_t instride, double *n, double *e, size_t outstride, size_t count )
+{
+   geod_tm_hm( &nztm_projection, method,
+       lt, ln, instride, n, e, outstride, count );
+}
+
+/***************************************************************************/
+/*                                                                         */
+/*   The single precision variants                                         */
+/*                                                                         */
+/*   Each block of points is widened into arrays on the stack, small     */
+/*   enough to stay in the first level cache, converted there by the     */
+/*   double precision batch routines and narrowed (or copied) to the      */
+/*   output.  A block is read in full before any of it is written, so    */
+/*   float output may overwrite the input.                                */
+/*                                                                         */
+/***************************************************************************/
+
+static void tm_geod_float( const tmprojection *tm, int method,
+              const float *n, const float *e, size_t instride,
+              float *ltf, float *lnf, double *ltd, double *lnd,
+              size_t outstride, size_t count ) {
+    double bn[FLOAT_BLOCK], be[FLOAT_BLOCK];
+    double blt[FLOAT_BLOCK], bln[FLOAT_BLOCK];
+    int isa = tm_simd_isa();
+    size_t i, j, nb, k;
+
+    for( i = 0; i < count; i += nb ) {
+        nb = count - i < FLOAT_BLOCK ? count - i : FLOAT_BLOCK;
+        for( j = 0; j < nb; j++ ) {
+            bn[j] = n[(i+j)*instride];
+            be[j] = e[(i+j)*instride];
+            }
+        tm_geod_isa( isa, method, tm, be, bn, 1, bln, blt, 1, nb );
+        for( j = 0, k = i*outstride; j < nb; j++, k += outstride ) {
+            if( ltf ) {
+                ltf[k] = (float) (blt[j]*rad2deg);
+                lnf[k] = (float) (bln[j]*rad2deg);
+                }
+            else {
+                ltd[k] = blt[j]*rad2deg;
+                lnd[k] = bln[j]*rad2deg;
+                }
+            }
+        }
+    }
+
+static void geod_tm_float( const tmprojection *tm, int method,
+              const float *lt, const float *ln, size_t instride,
+              float *nf, float *ef, double *nd, double *ed,
+              size_t outstride, size_t count ) {
+    double blt[FLOAT_BLOCK], bln[FLOAT_BLOCK];
+    double bn[FLOAT_BLOCK], be[FLOAT_BLOCK];
+    int isa = tm_simd_isa();
+    size_t i, j, nb, k;
+
+    for( i = 0; i < count; i += nb ) {
+        nb = count - i < FLOAT_BLOCK ? count - i : FLOAT_BLOCK;
+        for( j = 0; j < nb; j++ ) {
+            blt[j] = lt[(i+j)*instride]/rad2deg;
+            bln[j] = ln[(i+j)*instride]/rad2deg;
+            }
+        geod_tm_isa( isa, method, tm, bln, blt, 1, be, bn, 1, nb );
+        for( j = 0, k = i*outstride; j < nb; j++, k += outstride ) {
+            if( nf ) {
+                nf[k] = (float) bn[j];
+                ef[k] = (float) be[j];
+                }
+            else {
+                nd[k] = bn[j];
+                ed[k] = be[j];
+                }
+            }
+        }
+    }
+
+void tm_geod_deg_f( const tmprojection *tm, int method,
+   const float *n, const float *e, size_t instride,
+   float *lt, float *ln, size_t outstride, size_t count )
+{
+   tm_geod_float( tm, method, n, e, instride, lt, ln, NULL, NULL,
+       outstride, count );
+}
+
+void geod_tm_deg_f( const tmprojection *tm, int method,
+   const float *lt, const float *ln, size_t instride,
+   float *n, float *e, size_t outstride, size_t count )
+{
+   geod_tm_float( tm, method, lt, ln, instride, n, e, NULL, NULL,
+       outstride, count );
+}
+
+void tm_geod_deg_fd( const tmprojection *tm, int method,
+   const float *n, const float *e, size_t instride,
+   double *lt, double *ln, size_t outstride, size_t count )
+{
+   tm_geod_float( tm, method, n, e, instride, NULL, NULL, lt, ln,
+       outstride, count );
+}
+
+void geod_tm_deg_fd( const tmprojection *tm, int method,
+   const float *lt, const float *ln, size_t instride,
+   double *n, double *e, size_t outstride, size_t count )
+{
+   geod_tm_float( tm, method, lt, ln, instride, NULL, NULL, n, e,
+       outstride, count );
+}
+
+void nztm_geod_deg_f( const float *n, const float *e, size_t instride,
+   float *lt, float *ln, size_t outstride, size_t count )
+{
+   tm_geod_deg_f( &nztm_projection, NZTM_REDFEARN,
+       n, e, instride, lt, ln, outstride, count );
+}
+
+void geod_nztm_deg_f( const float *lt, const float *ln, size_t instride,
+   float *n, float *e, size_t outstride, size_t count )
+{
+   geod_tm_deg_f( &nztm_projection, NZTM_REDFEARN,
+       lt, ln, instride, n, e, outstride, count );
 }
 
 #ifdef TEST_NZTM
@@ -372,7 +994,7 @@ void geod_nztm( double lt, double ln, double *n, double *e )
 #include <stdio.h>
 
 int main( int argc, char *argv[] ) {
-  double e, n, lt, ln, e1, n1;
+  double e, n, lt, ln, e1, n1, lt2, ln2, e2, n2;
   while(1) {
      printf("Enter NZTM easting, northing: ");
      if( scanf("%lf%lf",&e,&n) != 2 ) break;
@@ -381,7 +1003,15 @@ int main( int argc, char *argv[] ) {
      printf("\nInput NZTM e,n:  %12.3lf %12.3lf\n",e,n);
      printf("Output Lat/Long: %12.6lf %12.6lf\n",lt*rad2deg,ln*rad2deg);
      printf("Output NZTM e,n: %12.3lf %12.3lf\n",e1,n1);
-     printf("Difference:      %12.3lf %12.3lf\n\n",e1-e,n1-n);
+     printf("Difference:      %12.3lf %12.3lf\n",e1-e,n1-n);
+     nztm_geod_m( NZTM_CLENSHAW, &n, &e, 1, &lt2, &ln2, 1, 1 );
+     geod_nztm_m( NZTM_CLENSHAW, &lt2, &ln2, 1, &n2, &e2, 1, 1 );
+     printf("Clenshaw Lat/Long diff: %12.3le %12.3le\n",
+        (lt2-lt)*rad2deg,(ln2-ln)*rad2deg);
+     printf("Clenshaw NZTM e,n diff: %12.3le %12.3le\n",e2-e1,n2-n1);
+     nztm_geod_m( NZTM_PRECISE, &n, &e, 1, &lt2, &ln2, 1, 1 );
+     geod_nztm( lt2, ln2, &n2, &e2 );
+     printf("Precise round trip diff: %12.3le %12.3le\n\n",e2-e,n2-n);
      }
   return 0;
   }
@@ -0,0 +1,260 @@
+#ifndef _NZTM_HPP
+#define _NZTM_HPP
+
+/* Header only C++ (C++14) version of the TM projection in nztm.c,
+   specialised at compile time.
+
+   TransverseMercator<Params> takes the ellipsoid and projection
+   parameters as constexpr members of Params, so the series
+   coefficients derived from them are compile time constants and the
+   conversions can be inlined and folded into the caller's loops.  The
+   arithmetic is that of tm_geod and geod_tm (Redfearn's formulae), so
+   the results are the same as the C routines in nztm.h, which remain
+   the interface for C callers.  nztm_accuracy.c, compiled as C++,
+   checks both directions against them for NZTM and UTM zone 27.
+
+   Params must provide, as static constexpr doubles,
+      a, rf      ellipsoid semi major axis (metres), inverse flattening
+      cm, lto    central meridian, origin latitude (degrees)
+      sf         scale factor
+      fe, fn     false easting and northing
+      utom       metres per projection unit
+
+   For example
+
+      nztm::NZTM::geod_tm( lt, ln, n, e );
+
+   converts latitude and longitude (radians) to NZTM as geod_nztm. */
+
+#include <cmath>
+#include <cstddef>
+
+#include "nztm.h"
+
+namespace nztm {
+
+/* The NZTM parameters from nztm.h */
+
+struct NZTMParams {
+    static constexpr double a = NZTM_A;
+    static constexpr double rf = NZTM_RF;
+    static constexpr double cm = NZTM_CM;
+    static constexpr double lto = NZTM_OLAT;
+    static constexpr double sf = NZTM_SF;
+    static constexpr double fe = NZTM_FE;
+    static constexpr double fn = NZTM_FN;
+    static constexpr double utom = 1.0;
+    };
+
+namespace detail {
+
+/* PI as used in nztm.c (from Abramowitz and Stegun Table 1.1) */
+
+constexpr double PI = 3.1415926535898;
+constexpr double TWOPI = 2.0*PI;
+constexpr double rad2deg = 180/PI;
+
+/* Sine by Taylor series, for the compile time meridian arc at the
+   origin latitude only.  The argument is first reduced to [-pi,pi]
+   using the exact value of 2*pi split in two parts. */
+
+constexpr double csin( double x ) {
+    const double twopi_hi = 6.28318530717958623200;
+    const double twopi_lo = 2.44929359829470635445e-16;
+    double k = x/twopi_hi;
+    long n = (long)( k < 0.0 ? k - 0.5 : k + 0.5 );
+    double r = (x - n*twopi_hi) - n*twopi_lo;
+    double term = r;
+    double sum = r;
+
+    for( int i = 1; i < 30; i++ ) {
+        term *= -r*r/((2*i)*(2*i+1));
+        sum += term;
+        }
+    return sum;
+    }
+
+}
+
+template <class P>
+class TransverseMercator {
+public:
+
+    /* Projection and ellipsoid parameters, as in tmprojection */
+
+    static constexpr double meridian = P::cm/detail::rad2deg;
+    static constexpr double orglat = P::lto/detail::rad2deg;
+    static constexpr double scalef = P::sf;
+    static constexpr double falsee = P::fe;
+    static constexpr double falsen = P::fn;
+    static constexpr double utom = P::utom;
+    static constexpr double a = P::a;
+    static constexpr double f = P::rf != 0.0 ? 1.0/P::rf : 0.0;
+    static constexpr double e2 = 2.0*f - f*f;
+
+    /* Series coefficients, as derived by define_tmprojection */
+
+    static constexpr double e4 = e2*e2;
+    static constexpr double e6 = e4*e2;
+    static constexpr double A0 = 1 - (e2/4.0) - (3.0*e4/64.0) - (5.0*e6/256.0);
+    static constexpr double A2 = (3.0/8.0) * (e2+e4/4.0+15.0*e6/128.0);
+    static constexpr double A4 = (15.0/256.0) * (e4 + 3.0*e6/4.0);
+    static constexpr double A6 = 35.0*e6/3072.0;
+
+    static constexpr double n1 = f/(2.0-f);
+    static constexpr double n2 = n1*n1;
+    static constexpr double n3 = n2*n1;
+    static constexpr double n4 = n2*n2;
+    static constexpr double g = a*(1.0-n1)*(1.0-n2)*(1+9.0*n2/4.0+225.0*n4/64.0);
+    static constexpr double p2 = 3.0*n1/2.0 - 27.0*n3/32.0;
+    static constexpr double p4 = 21.0*n2/16.0 - 55.0*n4/32.0;
+    static constexpr double p6 = 151.0*n3/96.0;
+    static constexpr double p8 = 1097.0*n4/512.0;
+
+    static constexpr double ome2 = 1.0 - e2;
+    static constexpr double rsf = 1.0/scalef;
+    static constexpr double rutom = 1.0/utom;
+
+    static constexpr double om = orglat == 0.0 ? 0.0 :
+        a*(A0*orglat - A2*detail::csin(2*orglat)
+           + A4*detail::csin(4*orglat) - A6*detail::csin(6*orglat));
+
+    /* Length of meridional arc (metres) to latitude lt (radians) */
+
+    static inline double meridian_arc( double lt ) {
+        return  a*(A0*lt-A2*std::sin(2*lt)+A4*std::sin(4*lt)-A6*std::sin(6*lt));
+        }
+
+    /* Foot point latitude (radians) of meridional arc m (metres) */
+
+    static inline double foot_point_lat( double m ) {
+        double sig = m/g;
+
+        return sig + p2 * std::sin(2.0*sig)
+                   + p4 * std::sin(4.0*sig)
+                   + p6 * std::sin(6.0*sig)
+                   + p8 * std::sin(8.0*sig);
+        }
+
+    /* Northing n and easting e to latitude lt and longitude ln
+       (radians), as tm_geod_h */
+
+    static inline void tm_geod( double n, double e, double &lt, double &ln ) {
+        double cn1 = (n - falsen)*utom*rsf + om;
+        double fphi = foot_point_lat(cn1);
+        double slt = std::sin(fphi);
+        double clt = std::cos(fphi);
+
+        double eslt = (1.0-e2*slt*slt);
+        double eta = a/std::sqrt(eslt);
+        double rho = eta * ome2 / eslt;
+        double psi = eta/rho;
+
+        double E = (e-falsee)*utom;
+        double x = E/(eta*scalef);
+        double x2 = x*x;
+
+        double t = slt/clt;
+        double t2 = t*t;
+        double t4 = t2*t2;
+
+        double trm1 = 1.0/2.0;
+
+        double trm2 = ((-4.0*psi
+                     +9.0*(1-t2))*psi
+                     +12.0*t2)/24.0;
+
+        double trm3 = ((((8.0*(11.0-24.0*t2)*psi
+                      -12.0*(21.0-71.0*t2))*psi
+                      +15.0*((15.0*t2-98.0)*t2+15))*psi
+                      +180.0*((-3.0*t2+5.0)*t2))*psi + 360.0*t4)/720.0;
+
+        double trm4 = (((1575.0*t2+4095.0)*t2+3633.0)*t2+1385.0)/40320.0;
+
+        lt = fphi+(t*x*E/(scalef*rho))*(((trm4*x2-trm3)*x2+trm2)*x2-trm1);
+
+        trm1 = 1.0;
+
+        trm2 = (psi+2.0*t2)/6.0;
+
+        trm3 = (((-4.0*(1.0-6.0*t2)*psi
+                   +(9.0-68.0*t2))*psi
+                   +72.0*t2)*psi
+                   +24.0*t4)/120.0;
+
+        trm4 = (((720.0*t2+1320.0)*t2+662.0)*t2+61.0)/5040.0;
+
+        ln = meridian - (x/clt)*(((trm4*x2-trm3)*x2+trm2)*x2-trm1);
+        }
+
+    /* Latitude lt and longitude ln (radians) to northing n and
+       easting e, as geod_tm_h */
+
+    static inline void geod_tm( double lt, double ln, double &n, double &e ) {
+        double dlon = ln - meridian;
+        while ( dlon > detail::PI ) dlon -= detail::TWOPI;
+        while ( dlon < -detail::PI ) dlon += detail::TWOPI;
+
+        double m = meridian_arc(lt);
+        double slt = std::sin(lt);
+        double clt = std::cos(lt);
+
+        double eslt = (1.0-e2*slt*slt);
+        double eta = a/std::sqrt(eslt);
+        double rho = eta * ome2 / eslt;
+        double psi = eta/rho;
+
+        double wc = clt*dlon;
+        double wc2 = wc*wc;
+
+        double t = slt/clt;
+        double t2 = t*t;
+        double t4 = t2*t2;
+        double t6 = t2*t4;
+
+        double trm1 = (psi-t2)/6.0;
+
+        double trm2 = (((4.0*(1.0-6.0*t2)*psi
+                      + (1.0+8.0*t2))*psi
+                      - 2.0*t2)*psi+t4)/120.0;
+
+        double trm3 = (61 - 479.0*t2 + 179.0*t4 - t6)/5040.0;
+
+        double gce = (scalef*eta*dlon*clt)*(((trm3*wc2+trm2)*wc2+trm1)*wc2+1.0);
+        e = gce*rutom+falsee;
+
+        trm1 = 1.0/2.0;
+
+        trm2 = ((4.0*psi+1)*psi-t2)/24.0;
+
+        trm3 = ((((8.0*(11.0-24.0*t2)*psi
+                    -28.0*(1.0-6.0*t2))*psi
+                    +(1.0-32.0*t2))*psi
+                    -2.0*t2)*psi
+                    +t4)/720.0;
+
+        double trm4 = (1385.0-3111.0*t2+543.0*t4-t6)/40320.0;
+
+        double gcn = (eta*t)*((((trm4*wc2+trm3)*wc2+trm2)*wc2+trm1)*wc2);
+        n = (gcn+m-om)*scalef*rutom+falsen;
+        }
+
+    /* Batch versions with the same array conventions as tm_geod_hn
+       and geod_tm_hn */
+
+    static void tm_geod( const double *n, const double *e,
+                         double *lt, double *ln, std::size_t count ) {
+        for( std::size_t i = 0; i < count; i++ ) tm_geod( n[i], e[i], lt[i], ln[i] );
+        }
+
+    static void geod_tm( const double *lt, const double *ln,
+                         double *n, double *e, std::size_t count ) {
+        for( std::size_t i = 0; i < count; i++ ) geod_tm( lt[i], ln[i], n[i], e[i] );
+        }
+    };
+
+typedef TransverseMercator<NZTMParams> NZTM;
+
+}
+
+#endif
@@ -0,0 +1,870 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Differential accuracy tests of the projection routines.  Build with
+
+      cc -O2 -o nztm_accuracy nztm_accuracy.c nztm.c nztm_simd.c \
+         nztm_bulk.c nztm_pool.c nztm_cheb.c nztm_coast.c nztm_csv.c \
+         -lm -lpthread
+
+   or, to add the variants of the header only C++ projection nztm.hpp,
+   with this file compiled as C++ and the others as C
+
+      cc -O2 -c nztm.c nztm_simd.c nztm_bulk.c nztm_pool.c nztm_cheb.c \
+         nztm_coast.c nztm_csv.c
+      c++ -O2 -o nztm_accuracy -x c++ nztm_accuracy.c -x none nztm.o \
+         nztm_simd.o nztm_bulk.o nztm_pool.o nztm_cheb.o nztm_coast.o \
+         nztm_csv.o -lm -lpthread
+
+   and run as
+
+      nztm_accuracy [-t seconds] [-n points] [-j threads] [-d datadir]
+                    [-f filter] > accuracy_output.txt
+
+   Every variant of geod_tm and tm_geod timed by nztm_bench (batch
+   routines for each method, the SIMD and threaded paths, the float
+   routines and Chebyshev tables, and when built as C++ nztm.hpp)
+   converts each of the data sets
+
+      nz_uniform   points uniformly random over the NZTM domain
+                   (eastings 1000000 to 2200000, northings 4700000 to
+                   6300000), n of them (default 2^21)
+      nz_coast     the points of newzealand.bin (NZTM)
+      spring       the kastad and hift positions of spring.csv, in
+                   UTM zone 27N
+
+   and its results are compared, point by point, with
+
+      the reference, the single point Redfearn routines geod_tm_h and
+      tm_geod_h, which define the projection for this library
+
+      an oracle, the exact Transverse Mercator projection computed in
+      long double by Krueger's series in the third flattening to sixth
+      order (Karney, J Geodesy 85, 2011), whose truncation error at
+      these distances from the central meridian is far below a
+      nanometre, with the inverse of the conformal latitude solved by
+      Newton's method
+
+      for inverse conversions, the input itself after converting the
+      result back with geod_tm_h (the round trip of nztm.h)
+
+   Errors are distances in metres, for latitudes and longitudes along
+   the ellipsoid.  The float variants are compared with the reference
+   and the oracle at their float inputs, so the input rounding is not
+   counted but the output rounding is.
+
+   The largest and 99th percentile errors and the points per second of
+   each variant and data set are written to standard output as JSON, as
+   nztm_bench does, and each is checked against the bound of its
+   variant, taken from the accuracy tiers documented in nztm.h,
+   nztm_cheb.h and the float routines.  The exit status is 1 if any
+   bound is exceeded, so the suite can guard optimisations of the
+   routines against loss of accuracy.  Only variants whose name
+   (routine/variant/dataset) contains filter are run. */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nztm.h"
+#ifdef __cplusplus
+#include "nztm.hpp"               /* Before tmproj.h, which defines PI */
+#endif
+#include "tmproj.h"
+#include "nztm_bulk.h"
+#include "nztm_cheb.h"
+#include "nztm_coast.h"
+#include "nztm_csv.h"
+
+#define ACC_ORDER    6            /* Order of the oracle's series */
+#define ACC_NEWTON   8            /* Most Newton steps of the oracle */
+
+#define ACC_NZTM     0            /* Domains of the data sets */
+#define ACC_OTHER    1
+
+/* The exact projection, for the oracle */
+
+typedef struct {
+        long double e, e2;
+        long double ka;           /* Scale factor times rectifying radius */
+        long double alpha[ACC_ORDER + 1], beta[ACC_ORDER + 1];
+        long double cm, fe, fn, utom;
+        long double xi0;          /* xi of the origin latitude */
+        } acc_oracle;
+
+typedef struct {
+        const char *name;
+        const tmprojection *tm;
+        int domain;               /* ACC_NZTM or ACC_OTHER */
+        acc_oracle oracle;
+        double oracle_trip;       /* Largest oracle round trip (metres) */
+        size_t n;
+        double *lt, *ln;          /* Geodetic points (radians) */
+        double *nn, *ee;          /* The same points projected, by the oracle */
+        double *r1, *r2;          /* Reference conversions of lt, ln */
+        double *r3, *r4;          /* Reference conversions of nn, ee */
+        double *o1, *o2;          /* Outputs */
+        double *err;
+        float *flt, *fln;         /* Geodetic inputs (degrees) as floats */
+        float *fnn, *fee;         /* Projected inputs as floats */
+        float *fo1, *fo2;
+        nztm_cheb *fcheb, *icheb;     /* Tables over the data */
+        } acc_data;
+
+typedef void (*acc_fn)( acc_data *d );
+
+static nztm_pool *acc_pool;
+
+static double acc_now( void ) {
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+    }
+
+/*************************************************************************/
+/*                                                                       */
+/*   Oracle                                                              */
+/*                                                                       */
+/*************************************************************************/
+
+static void oracle_xi( const acc_oracle *o, long double phi, long double lam,
+        long double *xi, long double *eta ) {
+    long double s = sinl( phi ), c = cosl( lam );
+    long double tau = sinhl( atanhl( s ) - o->e*atanhl( o->e*s ) );
+    long double xip = atan2l( tau, c );
+    long double etap = asinhl( sinl( lam )/sqrtl( tau*tau + c*c ) );
+    int j;
+
+    *xi = xip;
+    *eta = etap;
+    for( j = 1; j <= ACC_ORDER; j++ ) {
+        *xi += o->alpha[j]*sinl( 2*j*xip )*coshl( 2*j*etap );
+        *eta += o->alpha[j]*cosl( 2*j*xip )*sinhl( 2*j*etap );
+        }
+    }
+
+static void oracle_init( acc_oracle *o, const tmprojection *tm ) {
+    long double f = 1.0L/tm->rf, n = f/(2.0L - f);
+    long double n2 = n*n, n3 = n2*n, n4 = n3*n, n5 = n4*n, n6 = n5*n;
+    long double eta;
+
+    o->e2 = f*(2.0L - f);
+    o->e = sqrtl( o->e2 );
+    o->ka = tm->scalef*tm->a/(1.0L + n)*(1.0L + n2/4 + n4/64 + n6/256);
+    o->alpha[1] = n/2 - 2*n2/3 + 5*n3/16 + 41*n4/180 - 127*n5/288
+        + 7891*n6/37800;
+    o->alpha[2] = 13*n2/48 - 3*n3/5 + 557*n4/1440 + 281*n5/630
+        - 1983433*n6/1935360;
+    o->alpha[3] = 61*n3/240 - 103*n4/140 + 15061*n5/26880 + 167603*n6/181440;
+    o->alpha[4] = 49561*n4/161280 - 179*n5/168 + 6601661*n6/7257600;
+    o->alpha[5] = 34729*n5/80640 - 3418889*n6/1995840;
+    o->alpha[6] = 212378941*n6/319334400;
+    o->beta[1] = n/2 - 2*n2/3 + 37*n3/96 - n4/360 - 81*n5/512 + 96199*n6/604800;
+    o->beta[2] = n2/48 + n3/15 - 437*n4/1440 + 46*n5/105 - 1118711*n6/3870720;
+    o->beta[3] = 17*n3/480 - 37*n4/840 - 209*n5/4480 + 5569*n6/90720;
+    o->beta[4] = 4397*n4/161280 - 11*n5/504 - 830251*n6/7257600;
+    o->beta[5] = 4583*n5/161280 - 108847*n6/3991680;
+    o->beta[6] = 20648693*n6/638668800;
+    o->cm = tm->meridian;
+    o->fe = tm->falsee;
+    o->fn = tm->falsen;
+    o->utom = tm->utom;
+    oracle_xi( o, tm->orglat, 0.0L, &o->xi0, &eta );
+    }
+
+static void oracle_geod_tm( const acc_oracle *o, double lt, double ln,
+        double *n, double *e ) {
+    long double lam = ln - o->cm, xi, eta;
+
+    while( lam > PI ) lam -= TWOPI;
+    while( lam < -PI ) lam += TWOPI;
+    oracle_xi( o, lt, lam, &xi, &eta );
+    *n = (double) (o->fn + o->ka*(xi - o->xi0)/o->utom);
+    *e = (double) (o->fe + o->ka*eta/o->utom);
+    }
+
+static void oracle_tm_geod( const acc_oracle *o, double n, double e,
+        double *lt, double *ln ) {
+    long double xi = (n - o->fn)*o->utom/o->ka + o->xi0;
+    long double eta = (e - o->fe)*o->utom/o->ka;
+    long double xip = xi, etap = eta, taup, tau, sig, taui, dtau;
+    int j;
+
+    for( j = 1; j <= ACC_ORDER; j++ ) {
+        xip -= o->beta[j]*sinl( 2*j*xi )*coshl( 2*j*eta );
+        etap -= o->beta[j]*cosl( 2*j*xi )*sinhl( 2*j*eta );
+        }
+    taup = sinl( xip )/
+        sqrtl( sinhl( etap )*sinhl( etap ) + cosl( xip )*cosl( xip ) );
+    tau = taup/(1.0L - o->e2);
+    for( j = 0; j < ACC_NEWTON; j++ ) {
+        sig = sinhl( o->e*atanhl( o->e*tau/sqrtl( 1.0L + tau*tau ) ) );
+        taui = tau*sqrtl( 1.0L + sig*sig ) - sig*sqrtl( 1.0L + tau*tau );
+        dtau = (taup - taui)*(1.0L + (1.0L - o->e2)*tau*tau)/
+            ((1.0L - o->e2)*sqrtl( 1.0L + taui*taui )*sqrtl( 1.0L + tau*tau ));
+        tau += dtau;
+        if( fabsl( dtau ) < 1.0e-18L*(1.0L + fabsl( tau )) ) break;
+        }
+    *lt = (double) atanl( tau );
+    *ln = (double) (o->cm + atan2l( sinhl( etap ), cosl( xip ) ));
+    }
+
+/*************************************************************************/
+/*                                                                       */
+/*   Variants                                                            */
+/*                                                                       */
+/*************************************************************************/
+
+/* The variants write o1 and o2: n and e, or lt and ln in radians */
+
+static void a_geod_single( acc_data *d ) {
+    size_t i;
+    for( i = 0; i < d->n; i++ )
+        geod_tm_h( d->tm, d->lt[i], d->ln[i], &d->o1[i], &d->o2[i] );
+    }
+
+static void a_tm_single( acc_data *d ) {
+    size_t i;
+    for( i = 0; i < d->n; i++ )
+        tm_geod_h( d->tm, d->nn[i], d->ee[i], &d->o1[i], &d->o2[i] );
+    }
+
+static void a_geod_scalar( acc_data *d ) {
+    geod_tm_isa( NZTM_ISA_SCALAR, NZTM_REDFEARN, d->tm,
+        d->ln, d->lt, 1, d->o2, d->o1, 1, d->n );
+    }
+
+static void a_tm_scalar( acc_data *d ) {
+    tm_geod_isa( NZTM_ISA_SCALAR, NZTM_REDFEARN, d->tm,
+        d->ee, d->nn, 1, d->o2, d->o1, 1, d->n );
+    }
+
+static void a_geod_simd( acc_data *d ) {
+    geod_tm_hm( d->tm, NZTM_REDFEARN, d->lt, d->ln, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void a_tm_simd( acc_data *d ) {
+    tm_geod_hm( d->tm, NZTM_REDFEARN, d->nn, d->ee, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void a_geod_clenshaw( acc_data *d ) {
+    geod_tm_hm( d->tm, NZTM_CLENSHAW, d->lt, d->ln, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void a_tm_clenshaw( acc_data *d ) {
+    tm_geod_hm( d->tm, NZTM_CLENSHAW, d->nn, d->ee, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void a_geod_fast( acc_data *d ) {
+    geod_tm_hm( d->tm, NZTM_FAST, d->lt, d->ln, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void a_tm_fast( acc_data *d ) {
+    tm_geod_hm( d->tm, NZTM_FAST, d->nn, d->ee, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void a_tm_precise( acc_data *d ) {
+    tm_geod_hm( d->tm, NZTM_PRECISE, d->nn, d->ee, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void a_geod_threads( acc_data *d ) {
+    geod_tm_bulk( acc_pool, d->tm, NZTM_REDFEARN, NZTM_ISA_BEST,
+        d->lt, d->ln, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void a_tm_threads( acc_data *d ) {
+    tm_geod_bulk( acc_pool, d->tm, NZTM_REDFEARN, NZTM_ISA_BEST,
+        d->nn, d->ee, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void a_geod_float( acc_data *d ) {
+    size_t i;
+    geod_tm_deg_f( d->tm, NZTM_REDFEARN, d->flt, d->fln, 1,
+        d->fo1, d->fo2, 1, d->n );
+    for( i = 0; i < d->n; i++ ) {
+        d->o1[i] = d->fo1[i];
+        d->o2[i] = d->fo2[i];
+        }
+    }
+
+static void a_tm_float( acc_data *d ) {
+    size_t i;
+    tm_geod_deg_f( d->tm, NZTM_REDFEARN, d->fnn, d->fee, 1,
+        d->fo1, d->fo2, 1, d->n );
+    for( i = 0; i < d->n; i++ ) {
+        d->o1[i] = d->fo1[i]/rad2deg;
+        d->o2[i] = d->fo2[i]/rad2deg;
+        }
+    }
+
+static void a_geod_float_double( acc_data *d ) {
+    geod_tm_deg_fd( d->tm, NZTM_REDFEARN, d->flt, d->fln, 1,
+        d->o1, d->o2, 1, d->n );
+    }
+
+static void a_tm_float_double( acc_data *d ) {
+    size_t i;
+    tm_geod_deg_fd( d->tm, NZTM_REDFEARN, d->fnn, d->fee, 1,
+        d->o1, d->o2, 1, d->n );
+    for( i = 0; i < d->n; i++ ) {
+        d->o1[i] /= rad2deg;
+        d->o2[i] /= rad2deg;
+        }
+    }
+
+static void a_geod_cheb( acc_data *d ) {
+    nztm_cheb_eval( d->fcheb, d->lt, d->ln, d->o1, d->o2, d->n );
+    }
+
+static void a_tm_cheb( acc_data *d ) {
+    nztm_cheb_eval( d->icheb, d->nn, d->ee, d->o1, d->o2, d->n );
+    }
+
+#ifdef __cplusplus
+
+/* nztm.hpp, with the projection of the data set as its compile time
+   parameters: NZTM, or for spring, the only other data set, UTM zone
+   27 */
+
+struct acc_utm27 {
+        static constexpr double a = NZTM_A;
+        static constexpr double rf = NZTM_RF;
+        static constexpr double cm = -21.0;
+        static constexpr double lto = 0.0;
+        static constexpr double sf = 0.9996;
+        static constexpr double fe = 500000.0;
+        static constexpr double fn = 0.0;
+        static constexpr double utom = 1.0;
+        };
+
+typedef nztm::TransverseMercator<acc_utm27> acc_UTM27;
+
+static void a_geod_hpp( acc_data *d ) {
+    if( d->domain == ACC_NZTM )
+        nztm::NZTM::geod_tm( d->lt, d->ln, d->o1, d->o2, d->n );
+    else
+        acc_UTM27::geod_tm( d->lt, d->ln, d->o1, d->o2, d->n );
+    }
+
+static void a_tm_hpp( acc_data *d ) {
+    if( d->domain == ACC_NZTM )
+        nztm::NZTM::tm_geod( d->nn, d->ee, d->o1, d->o2, d->n );
+    else
+        acc_UTM27::tm_geod( d->nn, d->ee, d->o1, d->o2, d->n );
+    }
+
+#endif
+
+/* The bounds (metres) on the largest error from the reference and, for
+   inverse conversions, on the largest round trip error (0 for none),
+   over the NZTM domain and over spring.csv.  Over the NZTM domain they
+   are the tiers of nztm.h:
+
+      the Redfearn batch routines, SIMD, threaded and Clenshaw paths
+      and nztm.hpp agree with the reference to rounding, bounded here by a
+      micrometre, and round trip to 3.8 mm
+
+      NZTM_FAST is within 2.2 cm forward and round trips to 1.6 cm,
+      so is within 1.9 cm of the reference inverse
+
+      NZTM_PRECISE round trips to 2.2 micrometres, so differs from the
+      reference inverse by the reference's own 3.8 mm
+
+      the float routines narrow their results, to half a unit in the
+      last place: 0.25 m in northing and 0.125 m in easting, 0.28 m
+      together, in the NZTM domain, and for angles of up to 180 degrees
+      2^-17 degrees, 0.85 m on the ground; the _deg_fd routines keep
+      double results, as the reference
+
+      the Chebyshev tables are within their certificates, well under a
+      millimetre with the default cells and degree (nztm_cheb.h),
+      bounded here by a millimetre
+
+   The spring positions, at latitudes 63 to 67 degrees and up to 8
+   degrees from the central meridian of UTM zone 27, are outside the
+   domain of nztm.h, where the Redfearn inverse round trips to about
+   3 cm; the bounds there are the errors of this release, rounded up,
+   so that they catch regressions. */
+
+#define ACC_EXACT    1.0e-6
+#define ACC_TRIP     3.8e-3
+#define ACC_TRIP_IS  3.1e-2       /* Round trip of the inverse, spring */
+
+static const struct {
+        const char *routine;
+        const char *variant;
+        int inverse;
+        int single;               /* Float inputs */
+        acc_fn fn;
+        double bound[2];          /* Largest error from the reference */
+        double tripbound[2];      /* Largest round trip error */
+        } variants[] = {
+        { "geod_tm", "single", 0, 0, a_geod_single,
+          { ACC_EXACT, ACC_EXACT }, { 0.0, 0.0 } },
+        { "geod_tm", "scalar", 0, 0, a_geod_scalar,
+          { ACC_EXACT, ACC_EXACT }, { 0.0, 0.0 } },
+        { "geod_tm", "simd", 0, 0, a_geod_simd,
+          { ACC_EXACT, ACC_EXACT }, { 0.0, 0.0 } },
+        { "geod_tm", "clenshaw", 0, 0, a_geod_clenshaw,
+          { ACC_EXACT, ACC_EXACT }, { 0.0, 0.0 } },
+        { "geod_tm", "fast", 0, 0, a_geod_fast,
+          { 0.022, 0.022 }, { 0.0, 0.0 } },
+        { "geod_tm", "threads", 0, 0, a_geod_threads,
+          { ACC_EXACT, ACC_EXACT }, { 0.0, 0.0 } },
+        { "geod_tm", "float", 0, 1, a_geod_float,
+          { 0.28, 0.5 }, { 0.0, 0.0 } },
+        { "geod_tm", "float_double", 0, 1, a_geod_float_double,
+          { ACC_EXACT, ACC_EXACT }, { 0.0, 0.0 } },
+        { "geod_tm", "cheb", 0, 0, a_geod_cheb,
+          { 1.0e-3, 1.0e-3 }, { 0.0, 0.0 } },
+#ifdef __cplusplus
+        { "geod_tm", "hpp", 0, 0, a_geod_hpp,
+          { ACC_EXACT, ACC_EXACT }, { 0.0, 0.0 } },
+#endif
+        { "tm_geod", "single", 1, 0, a_tm_single,
+          { ACC_EXACT, ACC_EXACT }, { ACC_TRIP, ACC_TRIP_IS } },
+        { "tm_geod", "scalar", 1, 0, a_tm_scalar,
+          { ACC_EXACT, ACC_EXACT }, { ACC_TRIP, ACC_TRIP_IS } },
+        { "tm_geod", "simd", 1, 0, a_tm_simd,
+          { ACC_EXACT, ACC_EXACT }, { ACC_TRIP, ACC_TRIP_IS } },
+        { "tm_geod", "clenshaw", 1, 0, a_tm_clenshaw,
+          { ACC_EXACT, ACC_EXACT }, { ACC_TRIP, ACC_TRIP_IS } },
+        { "tm_geod", "fast", 1, 0, a_tm_fast,
+          { 0.019, 0.075 }, { 0.016, 0.075 } },
+        { "tm_geod", "precise", 1, 0, a_tm_precise,
+          { ACC_TRIP, ACC_TRIP_IS }, { 2.2e-6, 3.0e-6 } },
+        { "tm_geod", "threads", 1, 0, a_tm_threads,
+          { ACC_EXACT, ACC_EXACT }, { ACC_TRIP, ACC_TRIP_IS } },
+        { "tm_geod", "float", 1, 1, a_tm_float,
+          { 0.85, 0.85 }, { 0.0, 0.0 } },
+        { "tm_geod", "float_double", 1, 1, a_tm_float_double,
+          { ACC_EXACT, ACC_EXACT }, { ACC_TRIP, ACC_TRIP_IS } },
+        { "tm_geod", "cheb", 1, 0, a_tm_cheb,
+          { 1.0e-3, 1.0e-3 }, { ACC_TRIP + 1.0e-3, ACC_TRIP_IS + 1.0e-3 } },
+#ifdef __cplusplus
+        { "tm_geod", "hpp", 1, 0, a_tm_hpp,
+          { ACC_EXACT, ACC_EXACT }, { ACC_TRIP, ACC_TRIP_IS } },
+#endif
+        };
+
+/*************************************************************************/
+/*                                                                       */
+/*   Errors                                                              */
+/*                                                                       */
+/*************************************************************************/
+
+#define ACC_REFERENCE 0
+#define ACC_ORACLE    1
+#define ACC_ROUNDTRIP 2
+
+/* Distance (metres) between two nearby points on the ellipsoid */
+
+static double acc_geodist( const tmprojection *tm, double lt, double ln,
+        double lt2, double ln2 ) {
+    double s = sin( lt ), w = 1.0 - tm->e2*s*s;
+    double nu = tm->a/sqrt( w ), rho = tm->a*(1.0 - tm->e2)/(w*sqrt( w ));
+
+    return hypot( (lt2 - lt)*rho, (ln2 - ln)*nu*cos( lt ) );
+    }
+
+/* Fills d->err with the errors of kind of the outputs of variant v */
+
+static void acc_errors( acc_data *d, int v, int kind ) {
+    int inverse = variants[v].inverse, single = variants[v].single;
+    double x, y, t1, t2;
+    size_t i;
+
+    for( i = 0; i < d->n; i++ ) {
+        if( single ) {
+            x = inverse ? d->fnn[i] : d->flt[i]/rad2deg;
+            y = inverse ? d->fee[i] : d->fln[i]/rad2deg;
+            }
+        else {
+            x = inverse ? d->nn[i] : d->lt[i];
+            y = inverse ? d->ee[i] : d->ln[i];
+            }
+        if( kind == ACC_ROUNDTRIP ) {
+            geod_tm_h( d->tm, d->o1[i], d->o2[i], &t1, &t2 );
+            d->err[i] = hypot( t1 - x, t2 - y );
+            continue;
+            }
+        if( kind == ACC_REFERENCE && ! single ) {
+            t1 = inverse ? d->r3[i] : d->r1[i];
+            t2 = inverse ? d->r4[i] : d->r2[i];
+            }
+        else if( kind == ACC_REFERENCE ) {
+            if( inverse ) tm_geod_h( d->tm, x, y, &t1, &t2 );
+            else geod_tm_h( d->tm, x, y, &t1, &t2 );
+            }
+        else if( ! single ) {
+            t1 = inverse ? d->lt[i] : d->nn[i];
+            t2 = inverse ? d->ln[i] : d->ee[i];
+            }
+        else {
+            if( inverse ) oracle_tm_geod( &d->oracle, x, y, &t1, &t2 );
+            else oracle_geod_tm( &d->oracle, x, y, &t1, &t2 );
+            }
+        d->err[i] = inverse ? acc_geodist( d->tm, t1, t2, d->o1[i], d->o2[i] ) :
+            hypot( d->o1[i] - t1, d->o2[i] - t2 );
+        }
+    }
+
+/* The k'th smallest of the n values of v, which are reordered */
+
+static double acc_select( double *v, size_t n, size_t k ) {
+    size_t lo = 0, hi = n - 1, i, j;
+    double p, t;
+
+    while( lo < hi ) {
+        p = v[lo + (hi - lo)/2];
+        i = lo;
+        j = hi;
+        while( i <= j ) {
+            while( v[i] < p ) i++;
+            while( v[j] > p ) j--;
+            if( i <= j ) {
+                t = v[i]; v[i] = v[j]; v[j] = t;
+                i++;
+                if( j == 0 ) break;
+                j--;
+                }
+            }
+        if( k <= j ) hi = j;
+        else if( k >= i ) lo = i;
+        else break;
+        }
+    return v[k];
+    }
+
+/* The largest and 99th percentile of d->err */
+
+static void acc_stats( acc_data *d, double *max, double *p99 ) {
+    size_t i;
+
+    *max = 0.0;
+    for( i = 0; i < d->n; i++ )
+        if( ! ( d->err[i] <= *max ) ) *max = d->err[i];
+    *p99 = acc_select( d->err, d->n, (size_t) (0.99*(d->n - 1)) );
+    }
+
+/*************************************************************************/
+/*                                                                       */
+/*   Data sets                                                           */
+/*                                                                       */
+/*************************************************************************/
+
+static int acc_alloc( acc_data *d, size_t n ) {
+    d->n = n;
+    d->lt = (double *) malloc( 11*n*sizeof(double) + 6*n*sizeof(float) );
+    if( ! d->lt ) return -1;
+    d->ln = d->lt + n;
+    d->nn = d->ln + n;
+    d->ee = d->nn + n;
+    d->r1 = d->ee + n;
+    d->r2 = d->r1 + n;
+    d->r3 = d->r2 + n;
+    d->r4 = d->r3 + n;
+    d->o1 = d->r4 + n;
+    d->o2 = d->o1 + n;
+    d->err = d->o2 + n;
+    d->flt = (float *) (d->err + n);
+    d->fln = d->flt + n;
+    d->fnn = d->fln + n;
+    d->fee = d->fnn + n;
+    d->fo1 = d->fee + n;
+    d->fo2 = d->fo1 + n;
+    return 0;
+    }
+
+/* Completes d once lt, ln, nn and ee are set: the reference
+   conversions, float copies and Chebyshev tables */
+
+static int acc_prepare( acc_data *d ) {
+    double box[4], t1, t2;
+    size_t i;
+
+    box[0] = box[1] = HUGE_VAL;
+    box[2] = box[3] = -HUGE_VAL;
+    d->oracle_trip = 0.0;
+    for( i = 0; i < d->n; i++ ) {
+        geod_tm_h( d->tm, d->lt[i], d->ln[i], &d->r1[i], &d->r2[i] );
+        tm_geod_h( d->tm, d->nn[i], d->ee[i], &d->r3[i], &d->r4[i] );
+        d->flt[i] = (float) (d->lt[i]*rad2deg);
+        d->fln[i] = (float) (d->ln[i]*rad2deg);
+        d->fnn[i] = (float) d->nn[i];
+        d->fee[i] = (float) d->ee[i];
+        if( d->lt[i] < box[0] ) box[0] = d->lt[i];
+        if( d->ln[i] < box[1] ) box[1] = d->ln[i];
+        if( d->lt[i] > box[2] ) box[2] = d->lt[i];
+        if( d->ln[i] > box[3] ) box[3] = d->ln[i];
+        oracle_geod_tm( &d->oracle, d->lt[i], d->ln[i], &t1, &t2 );
+        t1 = hypot( t1 - d->nn[i], t2 - d->ee[i] );
+        if( t1 > d->oracle_trip ) d->oracle_trip = t1;
+        }
+    d->fcheb = nztm_cheb_create( d->tm, NZTM_CHEB_FORWARD, box, 0, 0, 0 );
+
+    box[0] = box[1] = HUGE_VAL;
+    box[2] = box[3] = -HUGE_VAL;
+    for( i = 0; i < d->n; i++ ) {
+        if( d->nn[i] < box[0] ) box[0] = d->nn[i];
+        if( d->ee[i] < box[1] ) box[1] = d->ee[i];
+        if( d->nn[i] > box[2] ) box[2] = d->nn[i];
+        if( d->ee[i] > box[3] ) box[3] = d->ee[i];
+        }
+    d->icheb = nztm_cheb_create( d->tm, NZTM_CHEB_INVERSE, box, 0, 0, 0 );
+    return d->fcheb && d->icheb ? 0 : -1;
+    }
+
+/* Points uniform over the NZTM domain, projected to geodetic by the
+   oracle */
+
+static int acc_uniform( acc_data *d, size_t n ) {
+    unsigned long long s = 88172645463325252ULL;
+    size_t i;
+
+    d->name = "nz_uniform";
+    d->tm = &nztm_projection;
+    d->domain = ACC_NZTM;
+    oracle_init( &d->oracle, d->tm );
+    if( acc_alloc( d, n ) ) return -1;
+    for( i = 0; i < n; i++ ) {
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        d->nn[i] = 4700000.0 + 1600000.0*((s >> 11)*(1.0/9007199254740992.0));
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        d->ee[i] = 1000000.0 + 1200000.0*((s >> 11)*(1.0/9007199254740992.0));
+        oracle_tm_geod( &d->oracle, d->nn[i], d->ee[i], &d->lt[i], &d->ln[i] );
+        }
+    return acc_prepare( d );
+    }
+
+/* Geodetic points at lt and ln, projected by the oracle */
+
+static int acc_geodetic( acc_data *d ) {
+    size_t i;
+
+    for( i = 0; i < d->n; i++ )
+        oracle_geod_tm( &d->oracle, d->lt[i], d->ln[i], &d->nn[i], &d->ee[i] );
+    return acc_prepare( d );
+    }
+
+static int acc_coast( acc_data *d, const char *path ) {
+    nztm_coast c;
+    size_t i, k;
+    int p;
+
+    d->name = "nz_coast";
+    d->tm = &nztm_projection;
+    d->domain = ACC_NZTM;
+    oracle_init( &d->oracle, d->tm );
+    if( nztm_coast_open( &c, path ) != 0 ) return -1;
+    if( acc_alloc( d, c.npoints ) ) { nztm_coast_close( &c ); return -1; }
+    k = 0;
+    for( p = 0; p < c.nparts; p++ ) {
+        for( i = 0; i < c.part[p].n; i++, k++ ) {
+            d->lt[k] = c.part[p].lat[i]/rad2deg;
+            d->ln[k] = c.part[p].lon[i]/rad2deg;
+            }
+        }
+    nztm_coast_close( &c );
+    return acc_geodetic( d );
+    }
+
+/* Reads the kastad and hift positions of spring.csv, skipping records
+   where either value of a pair is missing */
+
+static int acc_spring( acc_data *d, const char *path,
+   const tmprojection *utm ) {
+    static const char *cols[4] = { "kastad_breidd", "kastad_lengd",
+                                   "hift_breidd", "hift_lengd" };
+    nztm_csv_field f[64];
+    int col[4];
+    size_t max = 0, n = 0, i;
+    double lt, ln, *pos = NULL, *p;
+    nztm_csv *c;
+    FILE *in;
+    int nf, k, j;
+
+    d->name = "spring";
+    d->tm = utm;
+    d->domain = ACC_OTHER;
+    d->lt = NULL;
+    if( ! utm || ! ( in = fopen( path, "rb" ) ) ) return -1;
+    oracle_init( &d->oracle, d->tm );
+    if( ! ( c = nztm_csv_open( in, 0 ) ) ) { fclose( in ); return -1; }
+
+    nf = nztm_csv_read( c, f, 64 );
+    for( j = 0; j < 4; j++ ) {
+        col[j] = -1;
+        for( k = 0; k < nf && k < 64; k++ )
+            if( f[k].len == strlen( cols[j] ) &&
+                memcmp( f[k].p, cols[j], f[k].len ) == 0 ) col[j] = k;
+        }
+    if( col[0] < 0 || col[1] < 0 || col[2] < 0 || col[3] < 0 ) nf = -1;
+
+    while( nf > 0 && ( nf = nztm_csv_read( c, f, 64 ) ) > 0 ) {
+        for( j = 0; j < 4; j += 2 ) {
+            if( col[j] >= nf || col[j+1] >= nf ||
+                ! nztm_csv_double( f[col[j]].p, f[col[j]].len, &lt ) ||
+                ! nztm_csv_double( f[col[j+1]].p, f[col[j+1]].len, &ln ) )
+                continue;
+            if( n == max ) {
+                p = (double *) realloc( pos,
+                    2*(max ? 2*max : 4096)*sizeof(double) );
+                if( ! p ) { nf = -1; break; }
+                max = max ? 2*max : 4096;
+                pos = p;
+                }
+            pos[2*n] = lt/rad2deg;
+            pos[2*n+1] = ln/rad2deg;
+            n++;
+            }
+        }
+    nztm_csv_close( c );
+    fclose( in );
+
+    if( nf < 0 || n == 0 || acc_alloc( d, n ) ) { free( pos ); return -1; }
+    for( i = 0; i < n; i++ ) {
+        d->lt[i] = pos[2*i];
+        d->ln[i] = pos[2*i+1];
+        }
+    free( pos );
+    return acc_geodetic( d );
+    }
+
+/* Runs fn over d repeatedly for at least mintime seconds, returning
+   the points converted per second */
+
+static double acc_rate( acc_fn fn, acc_data *d, double mintime ) {
+    double t0, t;
+    long iter = 0;
+
+    t0 = acc_now();
+    do {
+        fn( d );
+        iter++;
+        t = acc_now() - t0;
+        } while( t < mintime );
+    return iter*(double) d->n/t;
+    }
+
+int main( int argc, char *argv[] ) {
+  acc_data data[3];
+  int ndata = 0;
+  double mintime = 0.2;
+  size_t npoints = 1 << 21;
+  int nthread = 0;
+  const char *dir = ".";
+  const char *filter = "";
+  tmprojection *utm;
+  char path[4096];
+  char name[128];
+  double rmax, rp99, omax, op99, tmax = 0.0, tp99 = 0.0, rate;
+  double bound, tripbound;
+  int first = 1, nfail = 0, pass;
+  int i, k;
+
+  for( i = 1; i < argc; i++ ) {
+     if( strcmp( argv[i], "-t" ) == 0 && i + 1 < argc )
+        mintime = atof( argv[++i] );
+     else if( strcmp( argv[i], "-n" ) == 0 && i + 1 < argc )
+        npoints = (size_t) atol( argv[++i] );
+     else if( strcmp( argv[i], "-j" ) == 0 && i + 1 < argc )
+        nthread = atoi( argv[++i] );
+     else if( strcmp( argv[i], "-d" ) == 0 && i + 1 < argc ) dir = argv[++i];
+     else if( strcmp( argv[i], "-f" ) == 0 && i + 1 < argc ) filter = argv[++i];
+     else {
+        fprintf( stderr, "Usage: nztm_accuracy [-t seconds] [-n points] "
+           "[-j threads] [-d datadir] [-f filter]\n" );
+        return 1;
+        }
+     }
+  if( npoints == 0 ) npoints = 1;
+
+  utm = tm_create( NZTM_A, NZTM_RF, -21.0/rad2deg, 0.9996, 0.0,
+     500000.0, 0.0, 1.0 );
+  acc_pool = nztm_pool_create( nthread );
+
+  if( acc_uniform( &data[ndata], npoints ) == 0 ) ndata++;
+  else fprintf( stderr, "nztm_accuracy: skipping nz_uniform, "
+     "cannot allocate memory\n" );
+  sprintf( path, "%.4000s/newzealand.bin", dir );
+  if( acc_coast( &data[ndata], path ) == 0 ) ndata++;
+  else fprintf( stderr, "nztm_accuracy: skipping nz_coast, cannot read %s\n",
+     path );
+  sprintf( path, "%.4000s/spring.csv", dir );
+  if( acc_spring( &data[ndata], path, utm ) == 0 ) ndata++;
+  else fprintf( stderr, "nztm_accuracy: skipping spring, cannot read %s\n",
+     path );
+
+  printf( "{\n  \"context\": {\n" );
+  printf( "    \"oracle\": \"Krueger series order %d, long double\",\n",
+     ACC_ORDER );
+  printf( "    \"oracle_roundtrip_m\": {" );
+  for( k = 0; k < ndata; k++ )
+     printf( "%s \"%s\": %.3e", k ? "," : "", data[k].name,
+        data[k].oracle_trip );
+  printf( " },\n" );
+  printf( "    \"threads\": %d,\n", nztm_pool_size( acc_pool ) );
+  printf( "    \"min_time\": %g\n  },\n", mintime );
+  printf( "  \"variants\": [" );
+
+  for( k = 0; k < ndata; k++ ) {
+     for( i = 0; i < (int) (sizeof(variants)/sizeof(variants[0])); i++ ) {
+        sprintf( name, "%s/%s/%s", variants[i].routine, variants[i].variant,
+           data[k].name );
+        if( ! strstr( name, filter ) ) continue;
+        rate = acc_rate( variants[i].fn, &data[k], mintime );
+        acc_errors( &data[k], i, ACC_REFERENCE );
+        acc_stats( &data[k], &rmax, &rp99 );
+        acc_errors( &data[k], i, ACC_ORACLE );
+        acc_stats( &data[k], &omax, &op99 );
+        if( variants[i].inverse ) {
+           acc_errors( &data[k], i, ACC_ROUNDTRIP );
+           acc_stats( &data[k], &tmax, &tp99 );
+           }
+        bound = variants[i].bound[data[k].domain];
+        tripbound = variants[i].tripbound[data[k].domain];
+        pass = rmax <= bound &&
+           ( tripbound == 0.0 || tmax <= tripbound );
+        printf( "%s\n    {\n", first ? "" : "," );
+        printf( "      \"name\": \"%s\",\n", name );
+        printf( "      \"points\": %lu,\n", (unsigned long) data[k].n );
+        printf( "      \"reference_max_m\": %.3e,\n", rmax );
+        printf( "      \"reference_p99_m\": %.3e,\n", rp99 );
+        printf( "      \"oracle_max_m\": %.3e,\n", omax );
+        printf( "      \"oracle_p99_m\": %.3e,\n", op99 );
+        if( variants[i].inverse ) {
+           printf( "      \"roundtrip_max_m\": %.3e,\n", tmax );
+           printf( "      \"roundtrip_p99_m\": %.3e,\n", tp99 );
+           }
+        printf( "      \"bound_m\": %.3e,\n", bound );
+        if( tripbound > 0.0 )
+           printf( "      \"roundtrip_bound_m\": %.3e,\n", tripbound );
+        printf( "      \"points_per_second\": %.6e,\n", rate );
+        printf( "      \"pass\": %s\n    }", pass ? "true" : "false" );
+        fflush( stdout );
+        if( ! pass ) {
+           fprintf( stderr, "nztm_accuracy: %s exceeds its bound: %.3e m "
+              "(bound %.3e m)", name, rmax, bound );
+           if( variants[i].inverse )
+              fprintf( stderr, ", round trip %.3e m (bound %.3e m)", tmax,
+                 tripbound );
+           fprintf( stderr, "\n" );
+           nfail++;
+           }
+        first = 0;
+        }
+     }
+  printf( "\n  ]\n}\n" );
+
+  for( k = 0; k < ndata; k++ ) {
+     nztm_cheb_destroy( data[k].fcheb );
+     nztm_cheb_destroy( data[k].icheb );
+     free( data[k].lt );
+     }
+  nztm_pool_destroy( acc_pool );
+  tm_destroy( utm );
+  return nfail != 0;
+  }
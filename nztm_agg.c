@@ -0,0 +1,358 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "nztm_agg.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AGG_BLOCK    NZTM_TOW_BLOCK   /* Rows decoded at a time */
+#define AGG_CELLS    4096             /* Cells per merge item */
+
+#define AGG_MISSING  INT64_MIN        /* Decoded NaN key */
+#define AGG_NONE     ((size_t) -1)    /* Cell of a row with a missing key */
+
+/* Passes over the rows */
+
+#define AGG_RANGE    0            /* Ranges of the keys */
+#define AGG_SUM      1            /* Counts and sums */
+#define AGG_M2       2            /* Squared differences from the means */
+
+/* An aggregation, shared by the pool threads.  The arrays of partial
+   results have one entry (lo, hi, bad, skipped) or ncells entries (cnt,
+   acc) for each slice. */
+
+typedef struct {
+        const nztm_tow *t;
+        nztm_agg *a;
+        int keys[NZTM_AGG_MAXKEYS];
+        int value;
+        int pass;
+        size_t nslices;
+        int64_t *lo, *hi;
+        int *bad;
+        size_t *skipped;
+        uint64_t *cnt;
+        double *acc;
+        } agg_job;
+
+/* Decodes count values of key column col from row first, as AGG_MISSING
+   where NaN.  Sets *bad if a value is not a whole number. */
+
+static void agg_key( const nztm_tow *t, int col, size_t first, size_t count,
+   int64_t *out, int *bad ) {
+    const double *d;
+    size_t i;
+
+    if( nztm_tow_type( t, col ) == NZTM_TOW_INT ) {
+        nztm_tow_int( t, col, first, count, out );
+        return;
+        }
+    d = nztm_tow_double( t, col ) + first;
+    for( i = 0; i < count; i++ ) {
+        if( isnan( d[i] ) ) out[i] = AGG_MISSING;
+        else if( d[i] != floor( d[i] ) || fabs( d[i] ) > 9007199254740992.0 ) {
+            out[i] = AGG_MISSING;
+            *bad = 1;
+            }
+        else out[i] = (int64_t) d[i];
+        }
+    }
+
+/* The count values of the value column from row first, either in place
+   or decoded into buf */
+
+static const double *agg_value( const nztm_tow *t, int col, size_t first,
+   size_t count, int64_t *ibuf, double *buf ) {
+    size_t i;
+
+    if( nztm_tow_type( t, col ) == NZTM_TOW_DOUBLE )
+        return nztm_tow_double( t, col ) + first;
+    nztm_tow_int( t, col, first, count, ibuf );
+    for( i = 0; i < count; i++ ) buf[i] = (double) ibuf[i];
+    return buf;
+    }
+
+/* Runs the current pass over slice item, rows [first,end) with both
+   multiples of AGG_BLOCK except at the end of the table */
+
+static void agg_slice( void *ctx, size_t item, int thread ) {
+    agg_job *job = (agg_job *) ctx;
+    const nztm_tow *t = job->t;
+    const nztm_agg *a = job->a;
+    int nkeys = a->nkeys;
+    int64_t kv[NZTM_AGG_MAXKEYS][AGG_BLOCK];
+    int64_t ibuf[AGG_BLOCK];
+    double vbuf[AGG_BLOCK];
+    size_t cell[AGG_BLOCK];
+    size_t nblocks = (t->nrows + AGG_BLOCK - 1)/AGG_BLOCK;
+    size_t first = AGG_BLOCK*(nblocks*item/job->nslices);
+    size_t end = AGG_BLOCK*(nblocks*(item + 1)/job->nslices);
+    int64_t *lo = job->lo + item*nkeys, *hi = job->hi + item*nkeys;
+    uint64_t *cnt = job->cnt + item*a->ncells;
+    double *acc = job->acc + item*a->ncells;
+    const double *v;
+    size_t b, n, j, c;
+    double d;
+    int k;
+
+    (void) thread;
+    if( end > t->nrows ) end = t->nrows;
+    for( b = first; b < end; b += n ) {
+        n = end - b < AGG_BLOCK ? end - b : AGG_BLOCK;
+        for( k = 0; k < nkeys; k++ )
+            agg_key( t, job->keys[k], b, n, kv[k], &job->bad[item] );
+
+        if( job->pass == AGG_RANGE ) {
+            for( k = 0; k < nkeys; k++ )
+                for( j = 0; j < n; j++ ) {
+                    if( kv[k][j] == AGG_MISSING ) continue;
+                    if( kv[k][j] < lo[k] ) lo[k] = kv[k][j];
+                    if( kv[k][j] > hi[k] ) hi[k] = kv[k][j];
+                    }
+            continue;
+            }
+
+        for( j = 0; j < n; j++ ) {
+            for( k = 0, c = 0; k < nkeys; k++ ) {
+                if( kv[k][j] == AGG_MISSING ) break;
+                c = c*(size_t) a->dim[k] + (size_t) (kv[k][j] - a->min[k]);
+                }
+            cell[j] = k < nkeys ? AGG_NONE : c;
+            }
+
+        v = agg_value( t, job->value, b, n, ibuf, vbuf );
+        if( job->pass == AGG_SUM ) {
+            for( j = 0; j < n; j++ ) {
+                if( cell[j] == AGG_NONE ) { job->skipped[item]++; continue; }
+                if( isnan( v[j] ) ) continue;
+                cnt[cell[j]]++;
+                acc[cell[j]] += v[j];
+                }
+            }
+        else {
+            for( j = 0; j < n; j++ ) {
+                if( cell[j] == AGG_NONE || isnan( v[j] ) ) continue;
+                d = v[j] - a->mean[cell[j]];
+                acc[cell[j]] += d*d;
+                }
+            }
+        }
+    }
+
+/* Merges the partial results of the slices for the cells of item,
+   clearing them for the next pass */
+
+static void agg_merge( void *ctx, size_t item, int thread ) {
+    agg_job *job = (agg_job *) ctx;
+    nztm_agg *a = job->a;
+    size_t i0 = item*AGG_CELLS;
+    size_t i1 = a->ncells - i0 < AGG_CELLS ? a->ncells : i0 + AGG_CELLS;
+    size_t i, s, p;
+    uint64_t n;
+    double sum;
+
+    (void) thread;
+    for( i = i0; i < i1; i++ ) {
+        n = 0;
+        sum = 0.0;
+        for( s = 0; s < job->nslices; s++ ) {
+            p = s*a->ncells + i;
+            n += job->cnt[p];
+            sum += job->acc[p];
+            job->acc[p] = 0.0;
+            }
+        if( job->pass == AGG_SUM ) {
+            a->count[i] = n;
+            a->sum[i] = sum;
+            a->mean[i] = n > 0 ? sum/n : NAN;
+            }
+        else a->var[i] = a->count[i] > 1 ? sum/(a->count[i] - 1) : NAN;
+        }
+    }
+
+static void agg_pass( agg_job *job, int pass, nztm_pool *pool ) {
+    job->pass = pass;
+    nztm_pool_run( pool, job->nslices, agg_slice, job );
+    if( pass != AGG_RANGE )
+        nztm_pool_run( pool, (job->a->ncells + AGG_CELLS - 1)/AGG_CELLS,
+            agg_merge, job );
+    }
+
+int nztm_agg_run( nztm_agg *a, const nztm_tow *t, const int *keys,
+   int nkeys, int value, nztm_pool *pool )
+{
+   agg_job job;
+   size_t s, nc;
+   int64_t lo, hi;
+   int k, bad = 0, status = -1;
+
+   memset( a, 0, sizeof(*a) );
+   if( nkeys < 1 || nkeys > NZTM_AGG_MAXKEYS || nztm_tow_type( t, value ) < 0 )
+      return -1;
+   for( k = 0; k < nkeys; k++ )
+      if( nztm_tow_type( t, keys[k] ) < 0 ) return -1;
+
+   memset( &job, 0, sizeof(job) );
+   job.t = t;
+   job.a = a;
+   memcpy( job.keys, keys, nkeys*sizeof(int) );
+   job.value = value;
+   job.nslices = pool ? (size_t) nztm_pool_size( pool ) : 1;
+   a->nkeys = nkeys;
+
+   job.lo = (int64_t *) malloc( 2*job.nslices*nkeys*sizeof(int64_t) );
+   job.bad = (int *) calloc( job.nslices, sizeof(int) );
+   job.skipped = (size_t *) calloc( job.nslices, sizeof(size_t) );
+   if( ! job.lo || ! job.bad || ! job.skipped ) goto done;
+   job.hi = job.lo + job.nslices*nkeys;
+   for( s = 0; s < job.nslices*nkeys; s++ ) {
+      job.lo[s] = INT64_MAX;
+      job.hi[s] = INT64_MIN;
+      }
+   agg_pass( &job, AGG_RANGE, pool );
+
+   /* The cells */
+
+   nc = 1;
+   for( s = 0; s < job.nslices; s++ ) bad |= job.bad[s];
+   for( k = 0; k < nkeys && ! bad; k++ ) {
+      lo = INT64_MAX;
+      hi = INT64_MIN;
+      for( s = 0; s < job.nslices; s++ ) {
+         if( job.lo[s*nkeys+k] < lo ) lo = job.lo[s*nkeys+k];
+         if( job.hi[s*nkeys+k] > hi ) hi = job.hi[s*nkeys+k];
+         }
+      if( lo > hi ) { lo = 0; hi = -1; }
+      else if( hi - lo >= NZTM_AGG_MAXCELLS ) bad = 1;
+      a->min[k] = lo;
+      a->dim[k] = hi - lo + 1;
+      nc *= (size_t) a->dim[k];
+      if( nc > NZTM_AGG_MAXCELLS ) bad = 1;
+      }
+   if( bad ) goto done;
+   a->ncells = nc;
+
+   a->count = (uint64_t *) malloc( ( nc ? nc : 1 )*sizeof(uint64_t) );
+   a->sum = (double *) malloc( 3*( nc ? nc : 1 )*sizeof(double) );
+   job.cnt = (uint64_t *) calloc( job.nslices*nc + 1, sizeof(uint64_t) );
+   job.acc = (double *) calloc( job.nslices*nc + 1, sizeof(double) );
+   if( ! a->count || ! a->sum || ! job.cnt || ! job.acc ) goto done;
+   a->mean = a->sum + nc;
+   a->var = a->mean + nc;
+
+   agg_pass( &job, AGG_SUM, pool );
+   agg_pass( &job, AGG_M2, pool );
+   for( s = 0; s < job.nslices; s++ ) a->skipped += job.skipped[s];
+   status = 0;
+
+done:
+   free( job.lo );
+   free( job.bad );
+   free( job.skipped );
+   free( job.cnt );
+   free( job.acc );
+   if( status != 0 ) nztm_agg_free( a );
+   return status;
+}
+
+void nztm_agg_free( nztm_agg *a )
+{
+   free( a->count );
+   free( a->sum );
+   memset( a, 0, sizeof(*a) );
+}
+
+long nztm_agg_cell( const nztm_agg *a, const int64_t *key )
+{
+   size_t c = 0;
+   int k;
+
+   for( k = 0; k < a->nkeys; k++ ) {
+      if( key[k] < a->min[k] || key[k] - a->min[k] >= a->dim[k] ) return -1;
+      c = c*(size_t) a->dim[k] + (size_t) (key[k] - a->min[k]);
+      }
+   return (long) c;
+}
+
+void nztm_agg_key( const nztm_agg *a, size_t cell, int64_t *key )
+{
+   int k;
+
+   for( k = a->nkeys - 1; k >= 0; k-- ) {
+      key[k] = a->min[k] + (int64_t) (cell % (size_t) a->dim[k]);
+      cell /= (size_t) a->dim[k];
+      }
+}
+
+#ifdef NZTM_AGG_TOOL
+
+/* Aggregates a column of a tow file, writing CSV of the cells with any
+   values.  Build with
+      cc -O2 -DNZTM_AGG_TOOL -o nztm_agg nztm_agg.c nztm_tow.c nztm_csv.c \
+         nztm_pool.c nztm.c nztm_simd.c -lm -lpthread
+   and run as
+      nztm_agg [-t threads] file.tow value key [key ...]
+   for example
+      nztm_agg spring.tow catch reitur smareitur */
+
+#include <stdio.h>
+#include <time.h>
+
+int main( int argc, char *argv[] ) {
+  int keys[NZTM_AGG_MAXKEYS];
+  int64_t key[NZTM_AGG_MAXKEYS];
+  struct timespec t0, t1;
+  int nthread = 0, nkeys, value, i, k;
+  nztm_pool *pool;
+  nztm_tow t;
+  nztm_agg a;
+  size_t c;
+
+  i = 1;
+  if( argc > 2 && strcmp( argv[1], "-t" ) == 0 ) {
+     nthread = atoi( argv[2] );
+     i = 3;
+     }
+  nkeys = argc - i - 2;
+  if( nkeys < 1 || nkeys > NZTM_AGG_MAXKEYS ) {
+     fprintf( stderr, "Usage: nztm_agg [-t threads] file.tow value key [key ...]\n" );
+     return 1;
+     }
+  if( nztm_tow_open( &t, argv[i] ) != 0 ) {
+     fprintf( stderr, "nztm_agg: %s is not a valid tow file\n", argv[i] );
+     return 1;
+     }
+  value = nztm_tow_column( &t, argv[i+1] );
+  for( k = 0; k < nkeys; k++ ) keys[k] = nztm_tow_column( &t, argv[i+2+k] );
+
+  pool = nztm_pool_create( nthread );
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  if( nztm_agg_run( &a, &t, keys, nkeys, value, pool ) != 0 ) {
+     fprintf( stderr, "nztm_agg: cannot aggregate %s by those columns\n",
+        argv[i+1] );
+     return 1;
+     }
+  clock_gettime( CLOCK_MONOTONIC, &t1 );
+  fprintf( stderr, "%lu rows, %lu cells, %lu rows skipped, %d threads,"
+     " %.3f ms\n", (unsigned long) t.nrows, (unsigned long) a.ncells,
+     (unsigned long) a.skipped, nztm_pool_size( pool ),
+     ((t1.tv_sec - t0.tv_sec) + 1.0e-9*(t1.tv_nsec - t0.tv_nsec))*1.0e3 );
+
+  for( k = 0; k < nkeys; k++ ) printf( "%s,", argv[i+2+k] );
+  printf( "count,sum,mean,var\n" );
+  for( c = 0; c < a.ncells; c++ ) {
+     if( a.count[c] == 0 ) continue;
+     nztm_agg_key( &a, c, key );
+     for( k = 0; k < nkeys; k++ ) printf( "%ld,", (long) key[k] );
+     printf( "%lu,%.10g,%.10g,%.10g\n", (unsigned long) a.count[c], a.sum[c],
+        a.mean[c], a.var[c] );
+     }
+
+  nztm_agg_free( &a );
+  nztm_pool_destroy( pool );
+  nztm_tow_close( &t );
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef _NZTM_AGG_H
+#define _NZTM_AGG_H
+
+/* Group by aggregation of a column of a tow file (nztm_tow.h), such as
+   the catch of spring.csv by reitur and smareitur or by tow_station.
+
+   The groups are the combinations of the values of up to
+   NZTM_AGG_MAXKEYS key columns, which must hold whole numbers from a
+   small range: each key is offset by its smallest value and the cells
+   are numbered densely, the last key varying fastest, so the results
+   are plain arrays indexed by cell with no hashing.  For each cell
+   nztm_agg_run finds the count, sum, mean and sample variance of the
+   values that are not NaN.  Rows with a missing (NaN) key are skipped.
+
+   The rows are divided into one contiguous slice for each thread of the
+   pool, and each slice is decoded in blocks of NZTM_TOW_BLOCK rows into
+   buffers that stay in the first level cache and summed into arrays of
+   its own, so there are no shared writes; the partial results are then
+   merged in the order of the slices.  The variance is found in a second
+   pass, about the means, rather than from sums of squares.  The results
+   depend only on the file and the size of the pool.  As with nztm_tow,
+   the nztm_agg structure is owned by the caller. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nztm_pool.h"
+#include "nztm_tow.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_AGG_MAXKEYS   4
+#define NZTM_AGG_MAXCELLS  (1 << 20)
+
+typedef struct {
+        int nkeys;
+        int64_t min[NZTM_AGG_MAXKEYS];   /* Smallest value of each key */
+        int64_t dim[NZTM_AGG_MAXKEYS];   /* Range of values of each key */
+        size_t ncells;            /* Product of dim */
+        size_t skipped;           /* Rows with a missing key */
+        uint64_t *count;          /* Values that are not NaN */
+        double *sum;
+        double *mean;             /* NaN if count is 0 */
+        double *var;              /* NaN if count is less than 2 */
+        } nztm_agg;
+
+/* Aggregates column value of t over the cells of the nkeys columns in
+   keys, using pool (which may be NULL).  Returns 0, or -1 if a column is
+   invalid, a key is not a whole number, there would be more than
+   NZTM_AGG_MAXCELLS cells or memory cannot be allocated. */
+
+int nztm_agg_run( nztm_agg *a, const nztm_tow *t, const int *keys,
+   int nkeys, int value, nztm_pool *pool );
+void nztm_agg_free( nztm_agg *a );
+
+/* The cell of the key values key[0..nkeys-1], or -1 if outside the
+   table, and the reverse */
+
+long nztm_agg_cell( const nztm_agg *a, const int64_t *key );
+void nztm_agg_key( const nztm_agg *a, size_t cell, int64_t *key );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,328 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Arenas of memory.
+
+   The chunks of an arena are a list, in the order they were obtained,
+   with cur the one being given out; when it is used up the arena moves
+   to the next, obtaining one if there is none, and a reset returns it
+   to the first.  A block from nztm_arena_get is preceded by
+   NZTM_ARENA_ALIGN bytes holding its class, ARENA_CLASSES for a large
+   block, and a freed block holds the next of the free list of its
+   class. */
+
+#include "nztm_arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_CLASSES 17          /* NZTM_ARENA_MIN << 0 .. 16 */
+
+typedef struct arena_chunk {
+        struct arena_chunk *next;
+        size_t size;              /* Bytes following the header */
+        } arena_chunk;
+
+struct nztm_arena {
+        arena_chunk *first, *cur;
+        char *pos, *end;          /* Unused part of cur */
+        size_t chunk;             /* Size of the next chunk obtained */
+        size_t used, reserved, mallocs;
+        void *free[ARENA_CLASSES];
+        nztm_allocator al;
+        };
+
+static char *arena_align( char *p ) {
+    return (char *) (((uintptr_t) p + NZTM_ARENA_ALIGN - 1) &
+        ~(uintptr_t) (NZTM_ARENA_ALIGN - 1));
+    }
+
+static void arena_use( nztm_arena *a, arena_chunk *c ) {
+    a->cur = c;
+    a->pos = (char *) (c + 1);
+    a->end = a->pos + c->size;
+    }
+
+/* Obtains a chunk of at least size bytes after the last */
+
+static arena_chunk *arena_chunk_new( nztm_arena *a, size_t size ) {
+    arena_chunk *c, *last;
+
+    if( size < a->chunk ) size = a->chunk;
+    c = (arena_chunk *) malloc( sizeof(arena_chunk) + size );
+    if( ! c ) return NULL;
+    c->next = NULL;
+    c->size = size;
+    if( a->first ) {
+        for( last = a->cur; last->next; last = last->next );
+        last->next = c;
+        }
+    else
+        a->first = c;
+    a->chunk = 2*size;
+    a->reserved += size;
+    a->mallocs++;
+    return c;
+    }
+
+static void *arena_al_alloc( void *ctx, size_t size ) {
+    return nztm_arena_get( (nztm_arena *) ctx, size );
+    }
+
+static void arena_al_free( void *ctx, void *p ) {
+    nztm_arena_put( (nztm_arena *) ctx, p );
+    }
+
+nztm_arena *nztm_arena_create( size_t chunk )
+{
+   nztm_arena *a = (nztm_arena *) calloc( 1, sizeof(nztm_arena) );
+
+   if( ! a ) return NULL;
+   a->chunk = chunk ? chunk : NZTM_ARENA_CHUNK;
+   if( ! arena_chunk_new( a, a->chunk ) ) {
+      free( a );
+      return NULL;
+      }
+   arena_use( a, a->first );
+   a->al.alloc = arena_al_alloc;
+   a->al.free = arena_al_free;
+   a->al.ctx = a;
+   return a;
+}
+
+void nztm_arena_destroy( nztm_arena *a )
+{
+   arena_chunk *c, *next;
+
+   if( ! a ) return;
+   for( c = a->first; c; c = next ) {
+      next = c->next;
+      free( c );
+      }
+   free( a );
+}
+
+void *nztm_arena_alloc( nztm_arena *a, size_t size )
+{
+   arena_chunk *c;
+   char *p;
+
+   size = (size + NZTM_ARENA_ALIGN - 1) & ~(size_t) (NZTM_ARENA_ALIGN - 1);
+   for( ;; ) {
+      p = arena_align( a->pos );
+      if( p <= a->end && (size_t) (a->end - p) >= size ) break;
+      if( ! ( c = a->cur->next ) && ! ( c = arena_chunk_new( a, size + NZTM_ARENA_ALIGN ) ) )
+         return NULL;
+      arena_use( a, c );
+      }
+   a->pos = p + size;
+   a->used += size;
+   return p;
+}
+
+void *nztm_arena_get( nztm_arena *a, size_t size )
+{
+   size_t k = 0;
+   char *p;
+
+   while( k < ARENA_CLASSES && ((size_t) NZTM_ARENA_MIN << k) < size ) k++;
+   if( k < ARENA_CLASSES && a->free[k] ) {
+      p = (char *) a->free[k];
+      a->free[k] = *(void **) p;
+      return p;
+      }
+   p = (char *) nztm_arena_alloc( a, NZTM_ARENA_ALIGN +
+      (k < ARENA_CLASSES ? (size_t) NZTM_ARENA_MIN << k : size) );
+   if( ! p ) return NULL;
+   *(size_t *) p = k;
+   return p + NZTM_ARENA_ALIGN;
+}
+
+void nztm_arena_put( nztm_arena *a, void *p )
+{
+   size_t k;
+
+   if( ! p ) return;
+   k = *(size_t *) ((char *) p - NZTM_ARENA_ALIGN);
+   if( k >= ARENA_CLASSES ) return;
+   *(void **) p = a->free[k];
+   a->free[k] = p;
+}
+
+void nztm_arena_reset( nztm_arena *a )
+{
+   arena_use( a, a->first );
+   a->used = 0;
+   memset( a->free, 0, sizeof(a->free) );
+}
+
+const nztm_allocator *nztm_arena_allocator( nztm_arena *a )
+{
+   return &a->al;
+}
+
+size_t nztm_arena_used( const nztm_arena *a )
+{
+   return a->used;
+}
+
+size_t nztm_arena_reserved( const nztm_arena *a )
+{
+   return a->reserved;
+}
+
+size_t nztm_arena_mallocs( const nztm_arena *a )
+{
+   return a->mallocs;
+}
+
+#ifdef TEST_NZTM_ARENA
+
+/* Builds the land mask of newzealand.bin, an R-tree and an ordering of
+   random points, and reprojects spring.csv repeatedly, with malloc and
+   with an arena reset before each request, checking that the results
+   agree and that the arena stops obtaining chunks after the first
+   request.  Build with
+      cc -O2 -DTEST_NZTM_ARENA nztm_arena.c nztm_land.c nztm_coast.c \
+         nztm_csv.c nztm_rtree.c nztm_order.c nztm_pool.c nztm.c \
+         nztm_simd.c -lm -lpthread
+   and run in the directory holding the data files. */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "nztm_csv.h"
+#include "nztm_land.h"
+#include "nztm_order.h"
+#include "nztm_rtree.h"
+
+#define TEST_ROUNDS 20
+#define TEST_POINTS 100000
+
+static double elapsed( struct timespec *t0 ) {
+    struct timespec t1;
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    return (t1.tv_sec - t0->tv_sec) + 1.0e-9*(t1.tv_nsec - t0->tv_nsec);
+    }
+
+/* Tests n points on a lattice over New Zealand, returning those on land */
+
+static size_t test_land( const nztm_land *l, size_t n ) {
+    size_t i, on = 0;
+
+    for( i = 0; i < n; i++ )
+        on += nztm_land_point( l, -47.5 + 13.0*(i % 100)/99.0,
+            166.0 + 13.0*(i / 100)/(n/100.0) );
+    return on;
+    }
+
+/* Builds an R-tree and an ordering of the points x, y with al,
+   returning a checksum of the nearest items to a few positions and of
+   the ordering, or 0 if either cannot be built */
+
+static uint64_t test_index( const double *x, const double *y, size_t n,
+   const nztm_allocator *al ) {
+    size_t items[8], i, j;
+    uint64_t sum = 1;
+    const uint64_t *rows;
+    nztm_rtree *t;
+    nztm_order *o;
+    long k;
+
+    if( ! ( t = nztm_rtree_build_a( NULL, x, y, NULL, NULL, n, 0, al ) ) )
+        return 0;
+    for( i = 0; i < 100; i++ ) {
+        k = nztm_rtree_nearest_a( t, x[i*97], y[i*97] + 0.5, 8, HUGE_VAL,
+            items, NULL, al );
+        for( j = 0; k > 0 && j < (size_t) k; j++ ) sum = sum*31 + items[j];
+        }
+    nztm_rtree_destroy( t );
+    if( ! ( o = nztm_order_build_a( NULL, NZTM_ORDER_HILBERT, x, y, NULL,
+            NULL, n, al ) ) )
+        return 0;
+    rows = nztm_order_rows( o );
+    for( i = 0; i < n; i++ ) sum = sum*31 + rows[i];
+    nztm_order_destroy( o );
+    return sum;
+    }
+
+int main( void ) {
+  static const nztm_csv_pair pairs[2] = {
+     { "kastad_breidd", "kastad_lengd", "kastad_n", "kastad_e" },
+     { "hift_breidd", "hift_lengd", "hift_n", "hift_e" } };
+  const nztm_allocator *al;
+  struct timespec t0;
+  nztm_arena *a;
+  nztm_coast c;
+  nztm_land *l;
+  size_t on[2] = { 0, 0 }, mallocs = 0, i;
+  uint64_t isum[2] = { 0, 0 }, seed = 1;
+  double *x, *y;
+  long nrec[2] = { 0, 0 };
+  double t[2];
+  FILE *in, *out;
+  int pass, r, bad = 0;
+
+  if( nztm_coast_open( &c, "newzealand.bin" ) != 0 ) {
+     fprintf( stderr, "Cannot open newzealand.bin\n" );
+     return 1;
+     }
+  if( ! ( out = fopen( "/dev/null", "w" ) ) ) return 1;
+  x = (double *) malloc( 2*TEST_POINTS*sizeof(double) );
+  if( ! x ) return 1;
+  y = x + TEST_POINTS;
+  for( i = 0; i < 2*TEST_POINTS; i++ ) {
+     seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+     x[i] = 1.0e6*(double) (seed >> 11)/9007199254740992.0;
+     }
+  a = nztm_arena_create( 0 );
+  al = nztm_arena_allocator( a );
+
+  for( pass = 0; pass < 2; pass++ ) {
+     clock_gettime( CLOCK_MONOTONIC, &t0 );
+     for( r = 0; r < TEST_ROUNDS; r++ ) {
+        if( pass ) {
+           nztm_arena_reset( a );
+           if( r == 1 ) mallocs = nztm_arena_mallocs( a );
+           }
+        l = nztm_land_create_a( &c, 0, pass ? al : NULL );
+        if( ! l ) return 1;
+        on[pass] = test_land( l, 10000 );
+        nztm_land_destroy( l );
+        isum[pass] = test_index( x, y, TEST_POINTS, pass ? al : NULL );
+        if( ( in = fopen( "spring.csv", "r" ) ) ) {
+           nrec[pass] = nztm_csv_project_a( in, out, &nztm_projection,
+              pairs, 2, 3, NULL, pass ? al : NULL );
+           fclose( in );
+           }
+        }
+     t[pass] = elapsed( &t0 )/TEST_ROUNDS;
+     }
+
+  printf( "land, index and csv request: malloc %.3f ms, arena %.3f ms\n",
+     t[0]*1.0e3, t[1]*1.0e3 );
+  printf( "arena: %lu chunks, %.1f MB reserved, %.1f MB used by the last request\n",
+     (unsigned long) nztm_arena_mallocs( a ), nztm_arena_reserved( a )*1.0e-6,
+     nztm_arena_used( a )*1.0e-6 );
+  if( on[0] != on[1] || nrec[0] != nrec[1] || nrec[0] <= 0 ||
+      isum[0] != isum[1] || isum[0] == 0 ) {
+     printf( "RESULTS DIFFER: %lu and %lu on land, %ld and %ld records, "
+        "indices %s\n", (unsigned long) on[0], (unsigned long) on[1],
+        nrec[0], nrec[1], isum[0] == isum[1] ? "agree" : "differ" );
+     bad = 1;
+     }
+  if( nztm_arena_mallocs( a ) != mallocs ) {
+     printf( "ARENA GREW after the first request: %lu chunks, then %lu\n",
+        (unsigned long) mallocs, (unsigned long) nztm_arena_mallocs( a ) );
+     bad = 1;
+     }
+  puts( bad ? "FAILED" : "passed" );
+  nztm_arena_destroy( a );
+  nztm_coast_close( &c );
+  fclose( out );
+  free( x );
+  return bad;
+  }
+
+#endif
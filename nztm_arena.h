@@ -0,0 +1,106 @@
+#ifndef _NZTM_ARENA_H
+#define _NZTM_ARENA_H
+
+/* Arenas of memory for short lived buffers, and the allocator
+   interface through which modules take them.
+
+   An nztm_allocator is a pair of functions and their context, passed
+   to the _a variants of routines that allocate (nztm_land_create_a,
+   nztm_csv_open_a, nztm_rtree_build_a, nztm_order_build_a, ...) in
+   place of malloc and free; a NULL allocator means malloc and free.
+   The memory a routine takes may be kept by the object it returns, so
+   the allocator must outlive it.  Routines that allocate on the
+   threads of a pool (nztm_grid_add, nztm_route_build) take none, as an
+   allocator is used by one thread at a time.
+
+   An nztm_arena gives out memory from large chunks obtained from
+   malloc, in two ways.  nztm_arena_alloc takes the next bytes of the
+   current chunk, and they are never given back singly.  nztm_arena_get
+   rounds the size up to a class, a power of two from NZTM_ARENA_MIN to
+   NZTM_ARENA_MAX bytes, and takes a block freed to that class by
+   nztm_arena_put if there is one, so a buffer grown and shrunk many
+   times reuses the same few blocks.  The allocator of an arena uses
+   get and put.  nztm_arena_reset releases everything at once, at the
+   end of a request say, keeping the chunks, so that a loop resetting
+   its arena between requests stops calling malloc once the first
+   requests have sized it.  All memory is aligned to NZTM_ARENA_ALIGN.
+
+   An arena is not safe to use from several threads at once: give each
+   thread its own, for example one for each thread of an nztm_pool,
+   indexed by the thread argument of the pool's function. */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_ARENA_CHUNK  (1 << 16)       /* Default first chunk (bytes) */
+#define NZTM_ARENA_ALIGN  16
+#define NZTM_ARENA_MIN    16              /* Smallest and largest classes */
+#define NZTM_ARENA_MAX    (1 << 20)
+
+typedef struct {
+        void *(*alloc)( void *ctx, size_t size );     /* NULL on failure */
+        void (*free)( void *ctx, void *p );           /* p may be NULL */
+        void *ctx;
+        } nztm_allocator;
+
+/* malloc, calloc and free through al, or the C library if al is NULL.
+   These are inline, so that modules taking an allocator need not be
+   linked with nztm_arena.c unless an arena is used. */
+
+static inline void *nztm_alloc( const nztm_allocator *al, size_t size ) {
+    return al ? al->alloc( al->ctx, size ) : malloc( size );
+    }
+
+static inline void *nztm_zalloc( const nztm_allocator *al, size_t size ) {
+    void *p;
+
+    if( ! al ) return calloc( 1, size );
+    if( ( p = al->alloc( al->ctx, size ) ) ) memset( p, 0, size );
+    return p;
+    }
+
+static inline void nztm_free( const nztm_allocator *al, void *p ) {
+    if( al ) al->free( al->ctx, p );
+    else free( p );
+    }
+
+typedef struct nztm_arena nztm_arena;
+
+/* Creates an arena whose first chunk is chunk bytes (0 for
+   NZTM_ARENA_CHUNK); later chunks double in size.  Returns NULL if
+   memory cannot be allocated. */
+
+nztm_arena *nztm_arena_create( size_t chunk );
+void nztm_arena_destroy( nztm_arena *a );
+
+/* Each returns NULL if memory cannot be allocated.  Blocks larger than
+   NZTM_ARENA_MAX are taken as by nztm_arena_alloc, and put drops
+   them. */
+
+void *nztm_arena_alloc( nztm_arena *a, size_t size );
+void *nztm_arena_get( nztm_arena *a, size_t size );
+void nztm_arena_put( nztm_arena *a, void *p );
+
+void nztm_arena_reset( nztm_arena *a );
+
+/* The allocator of a, valid until nztm_arena_destroy */
+
+const nztm_allocator *nztm_arena_allocator( nztm_arena *a );
+
+/* Bytes given out since the last reset, bytes held in chunks, and the
+   number of chunks obtained from malloc since creation */
+
+size_t nztm_arena_used( const nztm_arena *a );
+size_t nztm_arena_reserved( const nztm_arena *a );
+size_t nztm_arena_mallocs( const nztm_arena *a );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,438 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Benchmarks for the projection routines.  Build with
+
+      cc -O2 -o nztm_bench nztm_bench.c nztm.c nztm_simd.c nztm_bulk.c \
+         nztm_pool.c nztm_coast.c nztm_csv.c -lm -lpthread
+
+   and run as
+
+      nztm_bench [-t seconds] [-n points] [-j threads] [-d datadir]
+                 [-f filter] > bench_output.txt
+
+   Each benchmark converts a whole data set repeatedly for at least the
+   given time (default 0.5 s) and reports points per second.  The data
+   sets are
+
+      nz_uniform   uniformly random points over New Zealand (NZTM)
+      nz_coast     the points of newzealand.bin (NZTM)
+      spring       the kastad and hift positions of spring.csv, in
+                   UTM zone 27N
+
+   read from datadir (default the current directory); data sets whose
+   file is missing are skipped.  The routines are geod_tm (latitude and
+   longitude to northing and easting) and tm_geod (the inverse), each
+   as a single point call, the scalar and SIMD batch routines, the
+   Clenshaw method and bulk conversion across a thread pool, and the
+   meridian_arc and foot_point_lat series on their own.  Only
+   benchmarks whose name contains filter are run.
+
+   geod_tm and tm_geod are also timed with the NZTM_FAST and (for
+   tm_geod) NZTM_PRECISE accuracy tiers, and as the single precision
+   routines, reading and writing floats in degrees (the _deg_f
+   routines of nztm.h).
+
+   The results are written to standard output as JSON, with one entry
+   per benchmark named routine/variant/dataset, for comparison between
+   releases. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nztm.h"
+#include "tmproj.h"
+#include "nztm_bulk.h"
+#include "nztm_coast.h"
+#include "nztm_csv.h"
+
+typedef struct {
+        const char *name;
+        const tmprojection *tm;
+        size_t n;
+        double *lt, *ln;          /* Geodetic inputs (radians) */
+        double *nn, *ee;          /* Projected inputs */
+        double *o1, *o2;          /* Outputs */
+        float *flt, *fln;         /* Geodetic inputs (degrees) as floats */
+        float *fnn, *fee;         /* Projected inputs as floats */
+        float *fo1, *fo2;
+        } bench_data;
+
+typedef void (*bench_fn)( bench_data *d );
+
+static nztm_pool *bench_pool;
+static volatile double bench_sink;
+
+static double bench_now( void ) {
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+    }
+
+/* The benchmarked operations, each over the whole data set */
+
+static void b_geod_single( bench_data *d ) {
+    size_t i;
+    for( i = 0; i < d->n; i++ )
+        geod_tm_h( d->tm, d->lt[i], d->ln[i], &d->o1[i], &d->o2[i] );
+    }
+
+static void b_tm_single( bench_data *d ) {
+    size_t i;
+    for( i = 0; i < d->n; i++ )
+        tm_geod_h( d->tm, d->nn[i], d->ee[i], &d->o1[i], &d->o2[i] );
+    }
+
+static void b_geod_scalar( bench_data *d ) {
+    geod_tm_isa( NZTM_ISA_SCALAR, NZTM_REDFEARN, d->tm,
+        d->ln, d->lt, 1, d->o2, d->o1, 1, d->n );
+    }
+
+static void b_tm_scalar( bench_data *d ) {
+    tm_geod_isa( NZTM_ISA_SCALAR, NZTM_REDFEARN, d->tm,
+        d->ee, d->nn, 1, d->o2, d->o1, 1, d->n );
+    }
+
+static void b_geod_simd( bench_data *d ) {
+    geod_tm_hm( d->tm, NZTM_REDFEARN, d->lt, d->ln, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void b_tm_simd( bench_data *d ) {
+    tm_geod_hm( d->tm, NZTM_REDFEARN, d->nn, d->ee, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void b_geod_clenshaw( bench_data *d ) {
+    geod_tm_hm( d->tm, NZTM_CLENSHAW, d->lt, d->ln, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void b_tm_clenshaw( bench_data *d ) {
+    tm_geod_hm( d->tm, NZTM_CLENSHAW, d->nn, d->ee, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void b_geod_fast( bench_data *d ) {
+    geod_tm_hm( d->tm, NZTM_FAST, d->lt, d->ln, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void b_tm_fast( bench_data *d ) {
+    tm_geod_hm( d->tm, NZTM_FAST, d->nn, d->ee, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void b_tm_precise( bench_data *d ) {
+    tm_geod_hm( d->tm, NZTM_PRECISE, d->nn, d->ee, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void b_geod_float( bench_data *d ) {
+    geod_tm_deg_f( d->tm, NZTM_REDFEARN, d->flt, d->fln, 1,
+        d->fo1, d->fo2, 1, d->n );
+    }
+
+static void b_tm_float( bench_data *d ) {
+    tm_geod_deg_f( d->tm, NZTM_REDFEARN, d->fnn, d->fee, 1,
+        d->fo1, d->fo2, 1, d->n );
+    }
+
+static void b_geod_threads( bench_data *d ) {
+    geod_tm_bulk( bench_pool, d->tm, NZTM_REDFEARN, NZTM_ISA_BEST,
+        d->lt, d->ln, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void b_tm_threads( bench_data *d ) {
+    tm_geod_bulk( bench_pool, d->tm, NZTM_REDFEARN, NZTM_ISA_BEST,
+        d->nn, d->ee, 1, d->o1, d->o2, 1, d->n );
+    }
+
+static void b_meridian_arc( bench_data *d ) {
+    double s = 0.0;
+    size_t i;
+    for( i = 0; i < d->n; i++ ) s += tm_meridian_arc( d->tm, d->lt[i] );
+    bench_sink = s;
+    }
+
+/* The foot point latitude is taken of the arcs of the input northings,
+   as in tm_geod */
+
+static void b_foot_point_lat( bench_data *d ) {
+    const tmprojection *tm = d->tm;
+    double s = 0.0;
+    size_t i;
+    for( i = 0; i < d->n; i++ )
+        s += tm_foot_point_lat( tm, (d->nn[i] - tm->falsen)*tm->utom*tm->rsf + tm->om );
+    bench_sink = s;
+    }
+
+static const struct {
+        const char *routine;
+        const char *variant;
+        bench_fn fn;
+        } benchmarks[] = {
+        { "geod_tm", "single", b_geod_single },
+        { "geod_tm", "scalar", b_geod_scalar },
+        { "geod_tm", "simd", b_geod_simd },
+        { "geod_tm", "clenshaw", b_geod_clenshaw },
+        { "geod_tm", "fast", b_geod_fast },
+        { "geod_tm", "float", b_geod_float },
+        { "geod_tm", "threads", b_geod_threads },
+        { "tm_geod", "single", b_tm_single },
+        { "tm_geod", "scalar", b_tm_scalar },
+        { "tm_geod", "simd", b_tm_simd },
+        { "tm_geod", "clenshaw", b_tm_clenshaw },
+        { "tm_geod", "fast", b_tm_fast },
+        { "tm_geod", "precise", b_tm_precise },
+        { "tm_geod", "float", b_tm_float },
+        { "tm_geod", "threads", b_tm_threads },
+        { "meridian_arc", "single", b_meridian_arc },
+        { "foot_point_lat", "single", b_foot_point_lat },
+        };
+
+/* Allocates the arrays of d for n points */
+
+static int bench_alloc( bench_data *d, size_t n ) {
+    d->n = n;
+    d->lt = (double *) malloc( 6*n*sizeof(double) + 6*n*sizeof(float) );
+    if( ! d->lt ) return -1;
+    d->ln = d->lt + n;
+    d->nn = d->ln + n;
+    d->ee = d->nn + n;
+    d->o1 = d->ee + n;
+    d->o2 = d->o1 + n;
+    d->flt = (float *) (d->o2 + n);
+    d->fln = d->flt + n;
+    d->fnn = d->fln + n;
+    d->fee = d->fnn + n;
+    d->fo1 = d->fee + n;
+    d->fo2 = d->fo1 + n;
+    return 0;
+    }
+
+/* Completes d once lt and ln are set by projecting them for the
+   inverse inputs and making the float copies */
+
+static void bench_project( bench_data *d ) {
+    size_t i;
+
+    geod_tm_isa( NZTM_ISA_SCALAR, NZTM_REDFEARN, d->tm,
+        d->ln, d->lt, 1, d->ee, d->nn, 1, d->n );
+    for( i = 0; i < d->n; i++ ) {
+        d->flt[i] = (float) (d->lt[i]*rad2deg);
+        d->fln[i] = (float) (d->ln[i]*rad2deg);
+        d->fnn[i] = (float) d->nn[i];
+        d->fee[i] = (float) d->ee[i];
+        }
+    }
+
+static int bench_uniform( bench_data *d, size_t n ) {
+    unsigned long long s = 88172645463325252ULL;
+    size_t i;
+
+    d->name = "nz_uniform";
+    d->tm = &nztm_projection;
+    if( bench_alloc( d, n ) ) return -1;
+    for( i = 0; i < n; i++ ) {
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        d->lt[i] = (-47.5 + 13.5*((s >> 11)*(1.0/9007199254740992.0)))/rad2deg;
+        s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+        d->ln[i] = (166.0 + 12.7*((s >> 11)*(1.0/9007199254740992.0)))/rad2deg;
+        }
+    bench_project( d );
+    return 0;
+    }
+
+static int bench_coast( bench_data *d, const char *path ) {
+    nztm_coast c;
+    size_t i, k;
+    int p;
+
+    d->name = "nz_coast";
+    d->tm = &nztm_projection;
+    if( nztm_coast_open( &c, path ) != 0 ) return -1;
+    if( bench_alloc( d, c.npoints ) ) { nztm_coast_close( &c ); return -1; }
+    k = 0;
+    for( p = 0; p < c.nparts; p++ ) {
+        for( i = 0; i < c.part[p].n; i++, k++ ) {
+            d->lt[k] = c.part[p].lat[i]/rad2deg;
+            d->ln[k] = c.part[p].lon[i]/rad2deg;
+            }
+        }
+    nztm_coast_close( &c );
+    bench_project( d );
+    return 0;
+    }
+
+/* Reads the kastad and hift positions of spring.csv, skipping records
+   where either value of a pair is missing */
+
+static int bench_spring( bench_data *d, const char *path,
+   const tmprojection *utm ) {
+    static const char *cols[4] = { "kastad_breidd", "kastad_lengd",
+                                   "hift_breidd", "hift_lengd" };
+    nztm_csv_field f[64];
+    int col[4];
+    size_t max = 0;
+    double lt, ln;
+    nztm_csv *c;
+    FILE *in;
+    int nf, i, j;
+
+    d->name = "spring";
+    d->tm = utm;
+    d->n = 0;
+    d->lt = NULL;
+    if( ! utm || ! ( in = fopen( path, "rb" ) ) ) return -1;
+    if( ! ( c = nztm_csv_open( in, 0 ) ) ) { fclose( in ); return -1; }
+
+    nf = nztm_csv_read( c, f, 64 );
+    for( j = 0; j < 4; j++ ) {
+        col[j] = -1;
+        for( i = 0; i < nf && i < 64; i++ )
+            if( f[i].len == strlen( cols[j] ) &&
+                memcmp( f[i].p, cols[j], f[i].len ) == 0 ) col[j] = i;
+        }
+    if( col[0] < 0 || col[1] < 0 || col[2] < 0 || col[3] < 0 ) nf = -1;
+
+    while( nf > 0 && ( nf = nztm_csv_read( c, f, 64 ) ) > 0 ) {
+        for( j = 0; j < 4; j += 2 ) {
+            if( col[j] >= nf || col[j+1] >= nf ||
+                ! nztm_csv_double( f[col[j]].p, f[col[j]].len, &lt ) ||
+                ! nztm_csv_double( f[col[j+1]].p, f[col[j+1]].len, &ln ) )
+                continue;
+            if( d->n == max ) {
+                double *p = (double *) realloc( d->lt, 2*(max ? 2*max : 4096)*sizeof(double) );
+                if( ! p ) { nf = -1; break; }
+                max = max ? 2*max : 4096;
+                d->lt = p;
+                }
+            d->lt[2*d->n] = lt/rad2deg;
+            d->lt[2*d->n+1] = ln/rad2deg;
+            d->n++;
+            }
+        }
+    nztm_csv_close( c );
+    fclose( in );
+
+    if( nf < 0 || d->n == 0 ) { free( d->lt ); return -1; }
+
+    /* Copy the interleaved positions into the arrays used by the
+       benchmarks */
+    {
+        double *pos = d->lt;
+        size_t n = d->n;
+        if( bench_alloc( d, n ) ) { free( pos ); return -1; }
+        for( i = 0; (size_t) i < n; i++ ) {
+            d->lt[i] = pos[2*i];
+            d->ln[i] = pos[2*i+1];
+            }
+        free( pos );
+    }
+    bench_project( d );
+    return 0;
+    }
+
+/* Runs fn over d repeatedly for at least mintime seconds after one
+   untimed run, returning the number of runs and the time in *secs */
+
+static long bench_run( bench_fn fn, bench_data *d, double mintime,
+   double *secs ) {
+    double t0, t;
+    long iter = 0;
+
+    fn( d );
+    t0 = bench_now();
+    do {
+        fn( d );
+        iter++;
+        t = bench_now() - t0;
+        } while( t < mintime );
+    *secs = t;
+    return iter;
+    }
+
+static const char *isa_name( int isa ) {
+    switch( isa ) {
+        case NZTM_ISA_NEON: return "neon";
+        case NZTM_ISA_AVX2: return "avx2";
+        case NZTM_ISA_AVX512: return "avx512";
+        default: return "scalar";
+        }
+    }
+
+int main( int argc, char *argv[] ) {
+  bench_data data[3];
+  int ndata = 0;
+  double mintime = 0.5;
+  size_t npoints = 1 << 20;
+  int nthread = 0;
+  const char *dir = ".";
+  const char *filter = "";
+  tmprojection *utm;
+  char path[4096];
+  char name[128];
+  char date[64];
+  time_t now;
+  double secs;
+  long iter;
+  int first = 1;
+  int i, k;
+
+  for( i = 1; i < argc; i++ ) {
+     if( strcmp( argv[i], "-t" ) == 0 && i + 1 < argc ) mintime = atof( argv[++i] );
+     else if( strcmp( argv[i], "-n" ) == 0 && i + 1 < argc ) npoints = (size_t) atol( argv[++i] );
+     else if( strcmp( argv[i], "-j" ) == 0 && i + 1 < argc ) nthread = atoi( argv[++i] );
+     else if( strcmp( argv[i], "-d" ) == 0 && i + 1 < argc ) dir = argv[++i];
+     else if( strcmp( argv[i], "-f" ) == 0 && i + 1 < argc ) filter = argv[++i];
+     else {
+        fprintf( stderr, "Usage: nztm_bench [-t seconds] [-n points] [-j threads] "
+           "[-d datadir] [-f filter]\n" );
+        return 1;
+        }
+     }
+  if( npoints == 0 ) npoints = 1;
+
+  utm = tm_create( NZTM_A, NZTM_RF, -21.0/rad2deg, 0.9996, 0.0,
+     500000.0, 0.0, 1.0 );
+  bench_pool = nztm_pool_create( nthread );
+
+  if( bench_uniform( &data[ndata], npoints ) == 0 ) ndata++;
+  sprintf( path, "%.4000s/newzealand.bin", dir );
+  if( bench_coast( &data[ndata], path ) == 0 ) ndata++;
+  else fprintf( stderr, "nztm_bench: skipping nz_coast, cannot read %s\n", path );
+  sprintf( path, "%.4000s/spring.csv", dir );
+  if( bench_spring( &data[ndata], path, utm ) == 0 ) ndata++;
+  else fprintf( stderr, "nztm_bench: skipping spring, cannot read %s\n", path );
+
+  now = time( NULL );
+  strftime( date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime( &now ) );
+  printf( "{\n  \"context\": {\n" );
+  printf( "    \"date\": \"%s\",\n", date );
+  printf( "    \"isa\": \"%s\",\n", isa_name( nztm_isa() ) );
+  printf( "    \"threads\": %d,\n", nztm_pool_size( bench_pool ) );
+  printf( "    \"min_time\": %g\n  },\n", mintime );
+  printf( "  \"benchmarks\": [" );
+
+  for( k = 0; k < ndata; k++ ) {
+     for( i = 0; i < (int) (sizeof(benchmarks)/sizeof(benchmarks[0])); i++ ) {
+        sprintf( name, "%s/%s/%s", benchmarks[i].routine,
+            benchmarks[i].variant, data[k].name );
+        if( ! strstr( name, filter ) ) continue;
+        iter = bench_run( benchmarks[i].fn, &data[k], mintime, &secs );
+        printf( "%s\n    {\n", first ? "" : "," );
+        printf( "      \"name\": \"%s\",\n", name );
+        printf( "      \"routine\": \"%s\",\n", benchmarks[i].routine );
+        printf( "      \"variant\": \"%s\",\n", benchmarks[i].variant );
+        printf( "      \"dataset\": \"%s\",\n", data[k].name );
+        printf( "      \"points\": %lu,\n", (unsigned long) data[k].n );
+        printf( "      \"iterations\": %ld,\n", iter );
+        printf( "      \"ns_per_point\": %.4f,\n", secs*1.0e9/(iter*(double) data[k].n) );
+        printf( "      \"points_per_second\": %.6e\n    }", iter*(double) data[k].n/secs );
+        fflush( stdout );
+        first = 0;
+        }
+     }
+  printf( "\n  ]\n}\n" );
+
+  for( k = 0; k < ndata; k++ ) free( data[k].lt );
+  nztm_pool_destroy( bench_pool );
+  tm_destroy( utm );
+  return 0;
+  }
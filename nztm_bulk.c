@@ -0,0 +1,143 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "nztm_bulk.h"
+
+#include "tmproj.h"
+
+/* A bulk conversion job, shared by the pool threads */
+
+typedef struct {
+        const tmprojection *tm;
+        int method;
+        int isa;
+        int inverse;              /* tm_geod rather than geod_tm */
+        const double *in1, *in2;
+        size_t instride;
+        double *out1, *out2;
+        size_t outstride;
+        size_t count;
+        } bulk_job;
+
+static void bulk_chunk( void *ctx, size_t item, int thread ) {
+    bulk_job *job = (bulk_job *) ctx;
+    size_t i0 = item*NZTM_BULK_CHUNK;
+    size_t nc = job->count - i0 < NZTM_BULK_CHUNK ?
+                   job->count - i0 : NZTM_BULK_CHUNK;
+    const double *in1 = job->in1 + i0*job->instride;
+    const double *in2 = job->in2 + i0*job->instride;
+    double *out1 = job->out1 + i0*job->outstride;
+    double *out2 = job->out2 + i0*job->outstride;
+
+    (void) thread;
+    if( job->inverse )
+        tm_geod_isa( job->isa, job->method, job->tm, in1, in2,
+            job->instride, out1, out2, job->outstride, nc );
+    else
+        geod_tm_isa( job->isa, job->method, job->tm, in1, in2,
+            job->instride, out1, out2, job->outstride, nc );
+    }
+
+static void bulk_run( nztm_pool *pool, bulk_job *job ) {
+    if( ! tm_isa_supported( job->isa ) ) job->isa = tm_simd_isa();
+    nztm_pool_run( pool, (job->count + NZTM_BULK_CHUNK - 1)/NZTM_BULK_CHUNK,
+        bulk_chunk, job );
+    }
+
+void tm_geod_bulk( nztm_pool *pool, const tmprojection *tm,
+   int method, int isa, const double *n, const double *e, size_t instride,
+   double *lt, double *ln, size_t outstride, size_t count )
+{
+   bulk_job job;
+
+   job.tm = tm;
+   job.method = method;
+   job.isa = isa;
+   job.inverse = 1;
+   job.in1 = e;
+   job.in2 = n;
+   job.instride = instride;
+   job.out1 = ln;
+   job.out2 = lt;
+   job.outstride = outstride;
+   job.count = count;
+   bulk_run( pool, &job );
+}
+
+void geod_tm_bulk( nztm_pool *pool, const tmprojection *tm,
+   int method, int isa, const double *lt, const double *ln, size_t instride,
+   double *n, double *e, size_t outstride, size_t count )
+{
+   bulk_job job;
+
+   job.tm = tm;
+   job.method = method;
+   job.isa = isa;
+   job.inverse = 0;
+   job.in1 = ln;
+   job.in2 = lt;
+   job.instride = instride;
+   job.out1 = e;
+   job.out2 = n;
+   job.outstride = outstride;
+   job.count = count;
+   bulk_run( pool, &job );
+}
+
+#ifdef TEST_NZTM_BULK
+
+/* Converts random NZTM points with the bulk routines on pools of 1, 2,
+   4, ... threads up to the number of processors, checking that the
+   output is identical to the serial batch routines and reporting the
+   rate.  Build with
+      cc -O2 -DTEST_NZTM_BULK nztm_bulk.c nztm_pool.c nztm.c nztm_simd.c \
+         -lm -lpthread  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static double elapsed( struct timespec *t0 ) {
+    struct timespec t1;
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    return (t1.tv_sec - t0->tv_sec) + 1.0e-9*(t1.tv_nsec - t0->tv_nsec);
+    }
+
+int main( int argc, char *argv[] ) {
+  size_t count = argc > 1 ? (size_t) atol( argv[1] ) : 10000000;
+  int ncpu = (int) sysconf( _SC_NPROCESSORS_ONLN );
+  double *n = malloc( 6*count*sizeof(double) );
+  double *e = n + count, *lt = e + count, *ln = lt + count;
+  double *rlt = ln + count, *rln = rlt + count;
+  struct timespec t0;
+  nztm_pool *pool;
+  size_t i;
+  int nt;
+
+  srand( 1 );
+  for( i = 0; i < count; i++ ) {
+     n[i] = 4700000.0 + 1600000.0*rand()/RAND_MAX;
+     e[i] = 1000000.0 + 1200000.0*rand()/RAND_MAX;
+     }
+  nztm_geod_n( n, e, rlt, rln, count );
+
+  for( nt = 1; ; nt *= 2 ) {
+     if( nt > ncpu ) nt = ncpu;
+     pool = nztm_pool_create( nt );
+     clock_gettime( CLOCK_MONOTONIC, &t0 );
+     tm_geod_bulk( pool, &nztm_projection, NZTM_REDFEARN, NZTM_ISA_BEST,
+        n, e, 1, lt, ln, 1, count );
+     printf( "%3d threads  %8.2f Mpt/s  %s\n", nztm_pool_size( pool ),
+        count/elapsed( &t0 )*1.0e-6,
+        memcmp( lt, rlt, count*sizeof(double) ) == 0 &&
+        memcmp( ln, rln, count*sizeof(double) ) == 0 ?
+           "identical to serial" : "DIFFERS FROM SERIAL" );
+     nztm_pool_destroy( pool );
+     if( nt == ncpu ) break;
+     }
+  free( n );
+  return 0;
+  }
+
+#endif
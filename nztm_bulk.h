@@ -0,0 +1,42 @@
+#ifndef _NZTM_BULK_H
+#define _NZTM_BULK_H
+
+/* Bulk conversion of large arrays across the threads of a pool.
+
+   The arrays are split into chunks of NZTM_BULK_CHUNK points, sized so
+   that a chunk's inputs and outputs fit in the level 2 cache, and the
+   chunks are shared out between the pool's threads, each converting
+   them with the batch routines of nztm.h.  Arguments are as for
+   tm_geod_hm and geod_tm_hm, with the pool (which may be NULL to run
+   in the calling thread) and the instruction set isa to use.
+
+   Each point is converted independently of the others, so the output
+   does not depend on the pool size or on how the chunks are scheduled:
+   it is bit for bit that of the serial batch routine with the same isa.
+   NZTM_ISA_BEST uses the best instruction set of the processor; since
+   results differ in the last place between instruction sets, fixing
+   isa (NZTM_ISA_SCALAR to match nztm_geod and geod_nztm) makes output
+   reproducible across machines.  An isa the processor does not support
+   is replaced by the best it does. */
+
+#include "nztm.h"
+#include "nztm_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_BULK_CHUNK 4096
+
+void tm_geod_bulk( nztm_pool *pool, const tmprojection *tm,
+   int method, int isa, const double *n, const double *e, size_t instride,
+   double *lt, double *ln, size_t outstride, size_t count );
+void geod_tm_bulk( nztm_pool *pool, const tmprojection *tm,
+   int method, int isa, const double *lt, const double *ln, size_t instride,
+   double *n, double *e, size_t outstride, size_t count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
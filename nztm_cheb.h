@@ -0,0 +1,82 @@
+#ifndef _NZTM_CHEB_H
+#define _NZTM_CHEB_H
+
+/* Piecewise Chebyshev approximation of a TM projection over a bounded
+   domain, for bulk conversion where all the points lie in a known box
+   (for New Zealand about latitudes -48 to -34 and longitudes 166 to
+   179).
+
+   nztm_cheb_create divides the box into nx by ny cells and fits in each
+   the tensor product Chebyshev interpolant of degree degree in each
+   variable to geod_tm (NZTM_CHEB_FORWARD) or tm_geod
+   (NZTM_CHEB_INVERSE), at the Chebyshev points of the cell.  The
+   interpolants are converted to polynomials in the cell's own
+   coordinates, so evaluation is one table look up and Horner's rule:
+   multiplies and adds, with no transcendental functions and no
+   divisions.  Points outside the box, or with NaN, are converted by the
+   exact routines instead.
+
+   The certificate nztm_cheb_error is the largest difference from the
+   Redfearn routines (geod_tm_h and tm_geod_h) found when the table is
+   made, on a grid of 4(degree+1)^2 points over each cell including its
+   edges and corners, in metres (for the inverse, the distance on the
+   ellipsoid).  The interpolation error of a smooth function is largest
+   near the cell edges, which the grid covers.
+
+   A table is not modified after it is created and may be used from any
+   number of threads. */
+
+#include <stddef.h>
+
+#include "nztm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_CHEB_FORWARD  0      /* lt, ln to n, e */
+#define NZTM_CHEB_INVERSE  1      /* n, e to lt, ln */
+
+#define NZTM_CHEB_MAXDEGREE 12
+
+typedef struct nztm_cheb nztm_cheb;
+
+/* Makes a table for tm over box (in the input coordinates: south, west,
+   north, east in radians for the forward direction, or minimum
+   northing, minimum easting, maximum northing, maximum easting for the
+   inverse).  nx, ny or degree of 0 choose cells of about 1 degree or
+   100 km and degree 5, for which the NZTM certificates are about 6e-9 m
+   forward and 5e-8 m inverse; higher degrees gain little, as rounding
+   limits the certificate to about 1e-8 m.  Returns NULL if the
+   arguments are invalid or memory cannot be allocated. */
+
+nztm_cheb *nztm_cheb_create( const tmprojection *tm, int direction,
+   const double box[4], int nx, int ny, int degree );
+void nztm_cheb_destroy( nztm_cheb *c );
+
+/* Converts count points, in the argument order of geod_tm_hn or
+   tm_geod_hn according to the direction of the table.  Output arrays
+   may be the same as the input arrays. */
+
+void nztm_cheb_eval( const nztm_cheb *c, const double *in1,
+   const double *in2, double *out1, double *out2, size_t count );
+
+/* Converts the grid of points (u0 + r du, v0 + k dv), r in [0,nu)
+   and k in [0,nv), in the units of the first and second inputs, storing
+   the outputs of point (r,k) at out1[r*nv+k] and out2[r*nv+k].  The
+   polynomials are reduced along each row, so for rasters this is about
+   twice as fast as nztm_cheb_eval. */
+
+void nztm_cheb_grid( const nztm_cheb *c, double u0, double du, size_t nu,
+   double v0, double dv, size_t nv, double *out1, double *out2 );
+
+/* The certificate (metres) and the size of the table (bytes) */
+
+double nztm_cheb_error( const nztm_cheb *c );
+size_t nztm_cheb_size( const nztm_cheb *c );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+/* Memory mapped coastline files.  Needs POSIX mmap. */
+
+#include "nztm_coast.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Returns the value of v as a count if it is a whole number in
+   [1,max], otherwise 0 */
+
+static size_t coast_count( float v, size_t max ) {
+    size_t n;
+
+    if( ! ( v >= 1.0f && v <= (float) max ) ) return 0;
+    n = (size_t) v;
+    return (float) n == v ? n : 0;
+    }
+
+/* Describes a multi part file as newzealand.bin.  Returns 0, or -1 if
+   the header and part sizes are not consistent with nv values. */
+
+static int coast_parts( nztm_coast *c, const float *v, size_t nv ) {
+    size_t pos = 1;
+    size_t n;
+    int nparts;
+    int i;
+
+    if( nv < 1 ) return -1;
+    nparts = (int) coast_count( v[0], NZTM_COAST_MAXPARTS );
+    if( nparts == 0 ) return -1;
+
+    c->npoints = 0;
+    for( i = 0; i < nparts; i++ ) {
+        if( pos >= nv ) return -1;
+        n = coast_count( v[pos], (nv - pos - 1)/2 );
+        if( n == 0 ) return -1;
+        c->part[i].lon = v + pos + 1;
+        c->part[i].lat = v + pos + 1 + n;
+        c->part[i].n = n;
+        c->npoints += n;
+        pos += 1 + 2*n;
+        }
+
+    /* The trailing total is optional but must agree if present */
+
+    if( pos < nv && ( pos + 1 != nv || v[pos] != (float) c->npoints ) )
+        return -1;
+    c->nparts = nparts;
+    return 0;
+    }
+
+int nztm_coast_view( nztm_coast *c, const void *data, size_t size )
+{
+   const float *v = (const float *) data;
+   size_t nv = size/sizeof(float);
+
+   c->map = NULL;
+   c->size = size;
+   c->nparts = 0;
+   c->npoints = 0;
+   if( size % sizeof(float) != 0 || nv == 0 ) return -1;
+
+   if( coast_parts( c, v, nv ) == 0 ) return 0;
+
+   /* Otherwise a single ring of latitudes then longitudes, as
+      island.bin */
+
+   if( nv % 2 != 0 ) return -1;
+   c->part[0].lat = v;
+   c->part[0].lon = v + nv/2;
+   c->part[0].n = nv/2;
+   c->nparts = 1;
+   c->npoints = nv/2;
+   return 0;
+}
+
+int nztm_coast_open( nztm_coast *c, const char *path )
+{
+   struct stat st;
+   void *map;
+   int fd;
+
+   c->map = NULL;
+   c->nparts = 0;
+   fd = open( path, O_RDONLY );
+   if( fd < 0 ) return -1;
+   if( fstat( fd, &st ) != 0 || st.st_size <= 0 ) { close( fd ); return -1; }
+
+   map = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+   close( fd );
+   if( map == MAP_FAILED ) return -1;
+
+   if( nztm_coast_view( c, map, (size_t) st.st_size ) != 0 ) {
+      munmap( map, (size_t) st.st_size );
+      return -1;
+      }
+   c->map = map;
+   return 0;
+}
+
+void nztm_coast_close( nztm_coast *c )
+{
+   if( c->map ) munmap( c->map, c->size );
+   c->map = NULL;
+   c->nparts = 0;
+   c->npoints = 0;
+}
+
+#ifdef TEST_NZTM_COAST
+
+#include <stdio.h>
+
+/* Lists the parts of each file given, with their extents */
+
+int main( int argc, char *argv[] ) {
+  nztm_coast c;
+  const nztm_ring *r;
+  float lt0, lt1, ln0, ln1;
+  size_t j;
+  int i, k;
+
+  for( i = 1; i < argc; i++ ) {
+     if( nztm_coast_open( &c, argv[i] ) != 0 ) {
+        printf("%s: cannot open or not a coastline file\n",argv[i]);
+        continue;
+        }
+     printf("%s: %d parts, %zu points\n",argv[i],c.nparts,c.npoints);
+     for( k = 0; k < c.nparts; k++ ) {
+        r = &c.part[k];
+        lt0 = lt1 = r->lat[0];
+        ln0 = ln1 = r->lon[0];
+        for( j = 1; j < r->n; j++ ) {
+           if( r->lat[j] < lt0 ) lt0 = r->lat[j];
+           if( r->lat[j] > lt1 ) lt1 = r->lat[j];
+           if( r->lon[j] < ln0 ) ln0 = r->lon[j];
+           if( r->lon[j] > ln1 ) ln1 = r->lon[j];
+           }
+        printf("  %3d %6zu points  lat %10.5f %10.5f  lon %10.5f %10.5f%s\n",
+           k,r->n,lt0,lt1,ln0,ln1,
+           r->lat[0] == r->lat[r->n-1] && r->lon[0] == r->lon[r->n-1] ?
+              "  closed" : "");
+        }
+     nztm_coast_close( &c );
+     }
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef _NZTM_COAST_H
+#define _NZTM_COAST_H
+
+/* Zero copy access to the coastline files island.bin and
+   newzealand.bin.
+
+   Both files hold native (little endian) float32 values in degrees.
+
+      island.bin       one ring: n latitudes followed by n longitudes
+      newzealand.bin   the number of parts, then for each part its
+                       size n, n longitudes and n latitudes, then the
+                       total number of points
+
+   nztm_coast_open maps a file read only and describes each part as a
+   ring of pointers into the mapping, so opening costs no copying and
+   no heap allocation, and the pages are shared by every process using
+   the file.  nztm_coast_view does the same for data already in memory.
+   The format is recognised from the contents.  The nztm_coast structure
+   is owned by the caller and the rings remain valid until
+   nztm_coast_close. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_COAST_MAXPARTS  256   /* Parts described per file */
+
+/* A ring of n points; lat[i] and lon[i] are in degrees */
+
+typedef struct {
+        const float *lat;
+        const float *lon;
+        size_t n;
+        } nztm_ring;
+
+typedef struct {
+        void *map;                /* Mapping, or NULL for nztm_coast_view */
+        size_t size;              /* Size of the data (bytes) */
+        int nparts;
+        size_t npoints;           /* Total over all parts */
+        nztm_ring part[NZTM_COAST_MAXPARTS];
+        } nztm_coast;
+
+/* Each returns 0 on success, or -1 if the file cannot be mapped or its
+   contents are not in either format (or have more than
+   NZTM_COAST_MAXPARTS parts).  data must be aligned for float. */
+
+int nztm_coast_open( nztm_coast *c, const char *path );
+int nztm_coast_view( nztm_coast *c, const void *data, size_t size );
+void nztm_coast_close( nztm_coast *c );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
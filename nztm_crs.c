@@ -0,0 +1,411 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Registry of projected coordinate reference systems by EPSG code.
+   Needs POSIX threads for the one time initialisation. */
+
+#include "nztm_crs.h"
+
+#include "tmproj.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+#define WGS84_A   6378137.0
+#define WGS84_RF  298.257223563
+
+#define CRS_NCIRCUIT  28
+#define CRS_COUNT     (CRS_NCIRCUIT + 2 + 120)
+#define CRS_BLOCK     1024        /* Points grouped at a time */
+#define CRS_MAXGROUP  64          /* Distinct codes per block */
+
+struct nztm_crs {
+        int code;
+        int method;
+        char name[48];
+        tmprojection tm;          /* NZTM_CRS_TM */
+
+        double a, e;              /* NZTM_CRS_LCC */
+        double n, aF, rho0;
+        double lon0, fe, fn;
+        };
+
+/* The NZGD2000 meridional circuits (LINZS25002): origin latitude and
+   central meridian in degrees, minutes and seconds, and scale factor.
+   All have false easting 400000 and false northing 800000 m. */
+
+static const struct {
+        const char *name;
+        int latd, latm, lats;
+        int lond, lonm, lons;
+        double sf;
+        } crs_circuits[CRS_NCIRCUIT] = {
+        { "Mount Eden 2000",        36, 52, 47,  174, 45, 51, 0.9999 },
+        { "Bay of Plenty 2000",     37, 45, 40,  176, 27, 58, 1.0 },
+        { "Poverty Bay 2000",       38, 37, 28,  177, 53,  8, 1.0 },
+        { "Hawkes Bay 2000",        39, 39,  3,  176, 40, 25, 1.0 },
+        { "Taranaki 2000",          39,  8,  8,  174, 13, 40, 1.0 },
+        { "Tuhirangi 2000",         39, 30, 44,  175, 38, 24, 1.0 },
+        { "Wanganui 2000",          40, 14, 31,  175, 29, 17, 1.0 },
+        { "Wairarapa 2000",         40, 55, 31,  175, 38, 50, 1.0 },
+        { "Wellington 2000",        41, 18,  4,  174, 46, 35, 1.0 },
+        { "Collingwood 2000",       40, 42, 53,  172, 40, 19, 1.0 },
+        { "Nelson 2000",            41, 16, 28,  173, 17, 57, 1.0 },
+        { "Karamea 2000",           41, 17, 23,  172,  6, 32, 1.0 },
+        { "Buller 2000",            41, 48, 38,  171, 34, 52, 1.0 },
+        { "Grey 2000",              42, 20,  1,  171, 32, 59, 1.0 },
+        { "Amuri 2000",             42, 41, 20,  173,  0, 36, 1.0 },
+        { "Marlborough 2000",       41, 32, 40,  173, 48,  7, 1.0 },
+        { "Hokitika 2000",          42, 53, 10,  170, 58, 47, 1.0 },
+        { "Okarito 2000",           43,  6, 36,  170, 15, 39, 1.0 },
+        { "Jacksons Bay 2000",      43, 58, 40,  168, 36, 22, 1.0 },
+        { "Mount Pleasant 2000",    43, 35, 26,  172, 43, 37, 1.0 },
+        { "Gawler 2000",            43, 44, 55,  171, 21, 38, 1.0 },
+        { "Timaru 2000",            44, 24,  7,  171,  3, 26, 1.0 },
+        { "Lindis Peak 2000",       44, 44,  6,  169, 28,  3, 1.0 },
+        { "Mount Nicholas 2000",    45,  7, 58,  168, 23, 55, 1.0 },
+        { "Mount York 2000",        45, 33, 49,  167, 44, 19, 1.0 },
+        { "Observation Point 2000", 45, 48, 58,  170, 37, 42, 1.0 },
+        { "North Taieri 2000",      45, 51, 41,  170, 16, 57, 0.99996 },
+        { "Bluff 2000",             46, 36,  0,  168, 20, 34, 1.0 },
+        };
+
+static nztm_crs crs_table[CRS_COUNT];
+static pthread_once_t crs_once = PTHREAD_ONCE_INIT;
+
+/* Isometric latitude function t of Snyder (15-9) */
+
+static double lcc_t( double e, double lt ) {
+    double es = e*sin( lt );
+    return tan( PI/4.0 - lt/2.0 )/pow( (1.0 - es)/(1.0 + es), e/2.0 );
+    }
+
+/* Defines a Lambert conformal conic projection with standard parallels
+   lt1 and lt2 and origin (lt0,ln0), following Snyder, Map Projections -
+   A Working Manual, pp 107-109 */
+
+static void lcc_define( nztm_crs *c, double a, double rf, double lt1,
+   double lt2, double lt0, double ln0, double fe, double fn ) {
+    double f = 1.0/rf;
+    double e = sqrt( 2.0*f - f*f );
+    double m1 = cos( lt1 )/sqrt( 1.0 - e*e*sin( lt1 )*sin( lt1 ) );
+    double m2 = cos( lt2 )/sqrt( 1.0 - e*e*sin( lt2 )*sin( lt2 ) );
+    double t1 = lcc_t( e, lt1 ), t2 = lcc_t( e, lt2 ), t0 = lcc_t( e, lt0 );
+
+    c->method = NZTM_CRS_LCC;
+    c->a = a;
+    c->e = e;
+    c->n = (log( m1 ) - log( m2 ))/(log( t1 ) - log( t2 ));
+    c->aF = a*m1/(c->n*pow( t1, c->n ));
+    c->rho0 = c->aF*pow( t0, c->n );
+    c->lon0 = ln0;
+    c->fe = fe;
+    c->fn = fn;
+    }
+
+static void crs_init( void ) {
+    nztm_crs *c = crs_table;
+    double lt, ln;
+    int i;
+
+    for( i = 0; i < CRS_NCIRCUIT; i++, c++ ) {
+        c->code = 2105 + i;
+        c->method = NZTM_CRS_TM;
+        strcpy( c->name, "NZGD2000 / " );
+        strcat( c->name, crs_circuits[i].name );
+        lt = -(crs_circuits[i].latd + crs_circuits[i].latm/60.0 +
+               crs_circuits[i].lats/3600.0);
+        ln = crs_circuits[i].lond + crs_circuits[i].lonm/60.0 +
+             crs_circuits[i].lons/3600.0;
+        tm_define( &c->tm, NZTM_A, NZTM_RF, ln/rad2deg, crs_circuits[i].sf,
+            lt/rad2deg, 400000.0, 800000.0, 1.0 );
+        }
+
+    c->code = 2193;
+    c->method = NZTM_CRS_TM;
+    strcpy( c->name, "NZGD2000 / New Zealand Transverse Mercator 2000" );
+    c->tm = nztm_projection;
+    c++;
+
+    c->code = 3057;
+    strcpy( c->name, "ISN93 / Lambert 1993" );
+    lcc_define( c, NZTM_A, NZTM_RF, 64.25/rad2deg, 65.75/rad2deg,
+        65.0/rad2deg, -19.0/rad2deg, 500000.0, 500000.0 );
+    c++;
+
+    for( i = 0; i < 120; i++, c++ ) {
+        int zone = i % 60 + 1;
+        int south = i >= 60;
+        c->code = (south ? 32700 : 32600) + zone;
+        c->method = NZTM_CRS_TM;
+        strcpy( c->name, "WGS 84 / UTM zone " );
+        c->name[18] = (char) ('0' + zone/10);
+        c->name[19] = (char) ('0' + zone%10);
+        c->name[20] = south ? 'S' : 'N';
+        c->name[21] = '\0';
+        tm_define( &c->tm, WGS84_A, WGS84_RF, (6.0*zone - 183.0)/rad2deg,
+            0.9996, 0.0, 500000.0, south ? 10000000.0 : 0.0, 1.0 );
+        }
+    }
+
+const nztm_crs *nztm_crs_epsg( int code )
+{
+   int i;
+
+   if( code >= 2105 && code <= 2132 ) i = code - 2105;
+   else if( code == 2193 ) i = CRS_NCIRCUIT;
+   else if( code == 3057 ) i = CRS_NCIRCUIT + 1;
+   else if( code >= 32601 && code <= 32660 ) i = CRS_NCIRCUIT + 2 + code - 32601;
+   else if( code >= 32701 && code <= 32760 ) i = CRS_NCIRCUIT + 62 + code - 32701;
+   else return NULL;
+   pthread_once( &crs_once, crs_init );
+   return &crs_table[i];
+}
+
+int nztm_crs_code( const nztm_crs *crs )
+{
+   return crs->code;
+}
+
+int nztm_crs_method( const nztm_crs *crs )
+{
+   return crs->method;
+}
+
+const char *nztm_crs_name( const nztm_crs *crs )
+{
+   return crs->name;
+}
+
+const tmprojection *nztm_crs_tm( const nztm_crs *crs )
+{
+   return crs->method == NZTM_CRS_TM ? &crs->tm : NULL;
+}
+
+void nztm_crs_forward( const nztm_crs *crs, const double *lt,
+   const double *ln, double *n, double *e, size_t count )
+{
+   double rho, theta, dlon;
+   size_t i;
+
+   if( crs->method == NZTM_CRS_TM ) {
+      geod_tm_hn( &crs->tm, lt, ln, n, e, count );
+      return;
+      }
+   for( i = 0; i < count; i++ ) {
+      dlon = ln[i] - crs->lon0;
+      while( dlon > PI ) dlon -= TWOPI;
+      while( dlon < -PI ) dlon += TWOPI;
+      rho = crs->aF*pow( lcc_t( crs->e, lt[i] ), crs->n );
+      theta = crs->n*dlon;
+      e[i] = crs->fe + rho*sin( theta );
+      n[i] = crs->fn + crs->rho0 - rho*cos( theta );
+      }
+}
+
+void nztm_crs_inverse( const nztm_crs *crs, const double *n,
+   const double *e, double *lt, double *ln, size_t count )
+{
+   double x, y, rho, t, es, phi, prev, s;
+   size_t i;
+   int iter;
+
+   if( crs->method == NZTM_CRS_TM ) {
+      tm_geod_hn( &crs->tm, n, e, lt, ln, count );
+      return;
+      }
+   s = crs->n < 0.0 ? -1.0 : 1.0;
+   for( i = 0; i < count; i++ ) {
+      x = e[i] - crs->fe;
+      y = crs->rho0 - (n[i] - crs->fn);
+      rho = s*sqrt( x*x + y*y );
+      t = pow( rho/crs->aF, 1.0/crs->n );
+      ln[i] = atan2( s*x, s*y )/crs->n + crs->lon0;
+      phi = PI/2.0 - 2.0*atan( t );
+      for( iter = 0; iter < 20; iter++ ) {
+         prev = phi;
+         es = crs->e*sin( phi );
+         phi = PI/2.0 - 2.0*atan( t*pow( (1.0 - es)/(1.0 + es), crs->e/2.0 ) );
+         if( fabs( phi - prev ) < 1.0e-12 ) break;
+         }
+      lt[i] = phi;
+      }
+}
+
+/* Converts the points of one group, or sets NaN if code is unknown.
+   Returns the number of unknown points. */
+
+static size_t crs_group( int code, int inverse, const double *in1,
+   const double *in2, double *out1, double *out2, size_t count ) {
+    const nztm_crs *crs = nztm_crs_epsg( code );
+    size_t i;
+
+    if( ! crs ) {
+        for( i = 0; i < count; i++ ) out1[i] = out2[i] = NAN;
+        return count;
+        }
+    if( inverse ) nztm_crs_inverse( crs, in1, in2, out1, out2, count );
+    else nztm_crs_forward( crs, in1, in2, out1, out2, count );
+    return 0;
+    }
+
+/* Groups each block of points by code, converts the groups and
+   scatters the results back.  Points beyond the first CRS_MAXGROUP
+   distinct codes of a block are converted one at a time. */
+
+static long crs_mixed( const int *codes, int inverse, const double *in1,
+   const double *in2, double *out1, double *out2, size_t count ) {
+    double b1[CRS_BLOCK], b2[CRS_BLOCK], r1[CRS_BLOCK], r2[CRS_BLOCK];
+    short gid[CRS_BLOCK];
+    short order[CRS_BLOCK];
+    int gcode[CRS_MAXGROUP];
+    size_t gstart[CRS_MAXGROUP + 1];
+    size_t b, i, n, k;
+    long bad = 0;
+    int ng, g, last;
+
+    for( b = 0; b < count; b += n ) {
+        n = count - b < CRS_BLOCK ? count - b : CRS_BLOCK;
+
+        /* Give each point the group of its code */
+
+        ng = 0;
+        last = 0;
+        memset( gstart, 0, sizeof(gstart) );
+        for( i = 0; i < n; i++ ) {
+            if( ng == 0 || gcode[last] != codes[b+i] ) {
+                for( g = 0; g < ng && gcode[g] != codes[b+i]; g++ );
+                if( g == ng && ng < CRS_MAXGROUP ) gcode[ng++] = codes[b+i];
+                if( g == CRS_MAXGROUP ) {
+                    gid[i] = -1;
+                    bad += (long) crs_group( codes[b+i], inverse, in1 + b + i,
+                        in2 + b + i, out1 + b + i, out2 + b + i, 1 );
+                    continue;
+                    }
+                last = g;
+                }
+            gid[i] = (short) last;
+            gstart[last+1]++;
+            }
+        for( g = 0; g < ng; g++ ) gstart[g+1] += gstart[g];
+
+        /* Gather, convert each group and scatter */
+
+        for( i = 0; i < n; i++ ) {
+            if( gid[i] < 0 ) continue;
+            k = gstart[gid[i]]++;
+            order[k] = (short) i;
+            b1[k] = in1[b+i];
+            b2[k] = in2[b+i];
+            }
+        for( g = 0, k = 0; g < ng; g++ ) {
+            bad += (long) crs_group( gcode[g], inverse, b1 + k, b2 + k,
+                r1 + k, r2 + k, gstart[g] - k );
+            k = gstart[g];
+            }
+        for( i = 0; i < k; i++ ) {
+            out1[b+order[i]] = r1[i];
+            out2[b+order[i]] = r2[i];
+            }
+        }
+    return bad;
+    }
+
+long nztm_crs_forward_mixed( const int *codes, const double *lt,
+   const double *ln, double *n, double *e, size_t count )
+{
+   return crs_mixed( codes, 0, lt, ln, n, e, count );
+}
+
+long nztm_crs_inverse_mixed( const int *codes, const double *n,
+   const double *e, double *lt, double *ln, size_t count )
+{
+   return crs_mixed( codes, 1, n, e, lt, ln, count );
+}
+
+int nztm_utm_code( double lt, double ln )
+{
+   int zone;
+
+   if( isnan( lt ) || isnan( ln ) ) return 0;
+   ln = fmod( ln*rad2deg + 180.0, 360.0 );
+   if( ln < 0.0 ) ln += 360.0;
+   zone = (int) (ln/6.0) + 1;
+   if( zone > 60 ) zone = 60;
+   return (lt < 0.0 ? 32700 : 32600) + zone;
+}
+
+long geod_utm_n( const double *lt, const double *ln, double *n,
+   double *e, int *codes, size_t count )
+{
+   size_t i;
+
+   for( i = 0; i < count; i++ ) codes[i] = nztm_utm_code( lt[i], ln[i] );
+   return nztm_crs_forward_mixed( codes, lt, ln, n, e, count );
+}
+
+#ifdef TEST_NZTM_CRS
+
+/* Lists the registry with a round trip check at each origin, checks
+   ISN93 at its origin, and times mixed zone conversion of random
+   points over Iceland against converting them one at a time */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double test_now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+    }
+
+int main( void ) {
+  static const int codes[] = { 2193, 2105, 2113, 2131, 2132, 3057, 32626,
+     32627, 32628, 32760 };
+  static const double pts[][2] = { { -41.0, 173.0 }, { -36.88, 174.76 },
+     { -41.3, 174.78 }, { -45.86, 170.28 }, { -46.6, 168.34 },
+     { 65.0, -19.0 }, { 64.0, -27.0 }, { 64.0, -21.0 }, { 64.0, -15.0 },
+     { -45.0, 171.0 } };
+  size_t npt = 3000000, i;
+  double lt, ln, n, e, lt2, ln2, t0, t1, t2;
+  double *v = (double *) malloc( 6*npt*sizeof(double) );
+  int *zc = (int *) malloc( npt*sizeof(int) );
+  const nztm_crs *c;
+  long bad;
+  int k;
+
+  for( k = 0; k < (int) (sizeof(codes)/sizeof(codes[0])); k++ ) {
+     c = nztm_crs_epsg( codes[k] );
+     lt = pts[k][0]/rad2deg;
+     ln = pts[k][1]/rad2deg;
+     nztm_crs_forward( c, &lt, &ln, &n, &e, 1 );
+     nztm_crs_inverse( c, &n, &e, &lt2, &ln2, 1 );
+     printf( "%5d %-48s %12.3f %12.3f  round trip %.1e %.1e\n", nztm_crs_code( c ),
+        nztm_crs_name( c ), n, e, (lt2 - lt)*rad2deg, (ln2 - ln)*rad2deg );
+     }
+
+  for( i = 0; i < npt; i++ ) {
+     v[i] = (63.0 + 4.0*rand()/(RAND_MAX + 1.0))/rad2deg;
+     v[npt+i] = (-27.0 + 15.0*rand()/(RAND_MAX + 1.0))/rad2deg;
+     }
+  t0 = test_now();
+  bad = geod_utm_n( v, v + npt, v + 2*npt, v + 3*npt, zc, npt );
+  t1 = test_now();
+  for( i = 0; i < npt; i++ )
+     geod_tm_h( nztm_crs_tm( nztm_crs_epsg( zc[i] ) ), v[i], v[npt+i],
+        v + 4*npt + i, v + 5*npt + i );
+  t2 = test_now();
+  for( i = 0, n = 0.0; i < npt; i++ ) {
+     if( fabs( v[2*npt+i] - v[4*npt+i] ) > n ) n = fabs( v[2*npt+i] - v[4*npt+i] );
+     if( fabs( v[3*npt+i] - v[5*npt+i] ) > n ) n = fabs( v[3*npt+i] - v[5*npt+i] );
+     }
+  printf( "mixed zones 26N-28N: grouped %.1f Mpoint/s, one at a time %.1f Mpoint/s,"
+     " max difference %.2e m, %ld unknown\n", npt/(t1 - t0)*1.0e-6,
+     npt/(t2 - t1)*1.0e-6, n, bad );
+  free( v );
+  free( zc );
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef _NZTM_CRS_H
+#define _NZTM_CRS_H
+
+/* Registry of projected coordinate reference systems by EPSG code.
+
+   The registry holds, with their coefficients computed once on first
+   use and shared by all threads,
+
+      2193              NZGD2000 / New Zealand Transverse Mercator 2000
+      2105 - 2132       NZGD2000 meridional circuits (Mount Eden 2000
+                        to Bluff 2000)
+      3057              ISN93 / Lambert 1993 (Iceland)
+      32601 - 32660     WGS 84 / UTM zones 1N to 60N
+      32701 - 32760     WGS 84 / UTM zones 1S to 60S
+
+   All but ISN93 are Transverse Mercator projections, converted by the
+   routines of nztm.h; ISN93 is a Lambert conformal conic projection
+   with two standard parallels.  No datum shifts are applied: NZGD2000,
+   ISN93 and WGS 84 are taken to coincide, as they do to within a metre
+   or so.
+
+   nztm_crs_forward_mixed and nztm_crs_inverse_mixed convert points each
+   with its own code.  They take the input a block at a time, group the
+   points of the block by code and convert each group with one batch
+   call, so mixed inputs still run through homogeneous loops.
+   geod_utm_n chooses the standard UTM zone of each point (without the
+   exceptions around Norway and Svalbard) and converts it likewise; the
+   spring.csv tows, for example, fall in zones 26N to 28N.
+
+   Latitudes and longitudes are in radians. */
+
+#include <stddef.h>
+
+#include "nztm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Projection methods */
+
+#define NZTM_CRS_TM   0           /* Transverse Mercator */
+#define NZTM_CRS_LCC  1           /* Lambert conformal conic (2SP) */
+
+typedef struct nztm_crs nztm_crs;
+
+/* The system with EPSG code code, or NULL if it is not registered */
+
+const nztm_crs *nztm_crs_epsg( int code );
+
+int nztm_crs_code( const nztm_crs *crs );
+int nztm_crs_method( const nztm_crs *crs );
+const char *nztm_crs_name( const nztm_crs *crs );
+
+/* The projection of a Transverse Mercator system, for use with the
+   tm_ routines of nztm.h, or NULL for other methods */
+
+const tmprojection *nztm_crs_tm( const nztm_crs *crs );
+
+/* Latitude and longitude to northing and easting, and back */
+
+void nztm_crs_forward( const nztm_crs *crs, const double *lt,
+   const double *ln, double *n, double *e, size_t count );
+void nztm_crs_inverse( const nztm_crs *crs, const double *n,
+   const double *e, double *lt, double *ln, size_t count );
+
+/* Conversions of points with the codes in codes.  Points whose code is
+   not registered give NaN.  Return the number of such points. */
+
+long nztm_crs_forward_mixed( const int *codes, const double *lt,
+   const double *ln, double *n, double *e, size_t count );
+long nztm_crs_inverse_mixed( const int *codes, const double *n,
+   const double *e, double *lt, double *ln, size_t count );
+
+/* EPSG code of the UTM zone of (lt,ln), or 0 if either is NaN */
+
+int nztm_utm_code( double lt, double ln );
+
+/* Converts each point to its UTM zone, storing the codes of the zones
+   in codes.  Returns as nztm_crs_forward_mixed. */
+
+long geod_utm_n( const double *lt, const double *ln, double *n,
+   double *e, int *codes, size_t count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
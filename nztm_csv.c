@@ -0,0 +1,559 @@
+/* Streaming CSV reader and coordinate column reprojection */
+
+#include "nztm_csv.h"
+
+#include "tmproj.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct nztm_csv {
+        FILE *f;
+        char *buf;
+        char *own;                /* Buffer allocated for f */
+        const nztm_allocator *al;
+        size_t size;              /* Buffer size */
+        size_t pos;               /* Start of the unread data */
+        size_t end;               /* End of the data in the buffer */
+        int eof;                  /* No more data to read from f */
+        const char *rec;          /* Raw text of the current record */
+        size_t reclen;
+        int crlf;                 /* Current record ended with \r\n */
+        const char *err;
+        };
+
+#define CSV_MORE  (-2)            /* Record continues past the buffer */
+
+nztm_csv *nztm_csv_open( FILE *f, size_t bufsize )
+{
+   return nztm_csv_open_a( f, bufsize, NULL );
+}
+
+nztm_csv *nztm_csv_open_a( FILE *f, size_t bufsize, const nztm_allocator *al )
+{
+   nztm_csv *c = (nztm_csv *) nztm_zalloc( al, sizeof(nztm_csv) );
+
+   if( ! c ) return NULL;
+   c->al = al;
+   c->f = f;
+   if( ! f ) {
+      c->eof = 1;
+      return c;
+      }
+   c->size = bufsize ? bufsize : NZTM_CSV_BUFSIZE;
+   c->buf = c->own = (char *) nztm_alloc( al, c->size );
+   if( ! c->buf ) { nztm_free( al, c ); return NULL; }
+   return c;
+}
+
+void nztm_csv_close( nztm_csv *c )
+{
+   if( ! c ) return;
+   nztm_free( c->al, c->own );
+   nztm_free( c->al, c );
+}
+
+void nztm_csv_memory( nztm_csv *c, const char *p, size_t len )
+{
+   c->buf = (char *) p;
+   c->size = c->end = len;
+   c->pos = 0;
+   c->eof = 1;
+   c->err = NULL;
+}
+
+const char *nztm_csv_error( const nztm_csv *c )
+{
+   return c->err;
+}
+
+const char *nztm_csv_record( const nztm_csv *c, size_t *len )
+{
+   *len = c->reclen;
+   return c->rec;
+}
+
+/* Parses one record starting at c->pos.  Returns the field count, 0
+   at the end of the input, -1 on error, or CSV_MORE if the record is
+   not complete in the buffer and more input is available. */
+
+static int csv_parse( nztm_csv *c, nztm_csv_field *fields, int maxfields ) {
+    char *start = c->buf + c->pos;
+    char *e = c->buf + c->end;
+    char *p = start;
+    char *q;
+    char *fend;
+    int nf = 0;
+    int quoted;
+
+    if( p == e ) return c->eof ? 0 : CSV_MORE;
+
+    for( ;; ) {
+        quoted = 0;
+        if( *p == '"' ) {
+            quoted = 1;
+            q = p + 1;
+            for( ;; ) {
+                q = (char *) memchr( q, '"', e - q );
+                if( ! q || (q + 1 == e && ! c->eof) ) {
+                    if( c->eof ) { c->err = "unterminated quoted field"; return -1; }
+                    return CSV_MORE;
+                    }
+                if( q + 1 < e && q[1] == '"' ) { q += 2; continue; }
+                break;
+                }
+            fend = q;
+            p++;
+            q++;
+            }
+        else {
+            q = p;
+            while( q < e && *q != ',' && *q != '\n' ) q++;
+            fend = q;
+            }
+
+        if( q == e && ! c->eof ) return CSV_MORE;
+        if( q < e && *q != ',' && *q != '\n' &&
+            ! (*q == '\r' && ( q + 1 < e ? q[1] == '\n' : c->eof )) ) {
+            if( *q == '\r' && q + 1 == e && ! c->eof ) return CSV_MORE;
+            c->err = "text after closing quote";
+            return -1;
+            }
+
+        if( nf < maxfields ) {
+            fields[nf].p = p;
+            fields[nf].len = fend - p;
+            fields[nf].quoted = quoted;
+            }
+        nf++;
+
+        if( q < e && *q == ',' ) { p = q + 1; continue; }
+
+        /* End of record, at a line ending or the end of the input.  A
+           \r before either belongs to the line ending, not the field. */
+
+        c->crlf = 0;
+        if( q < e && *q == '\r' ) q++;
+        if( q > start && q[-1] == '\r' && ( q == e || *q == '\n' ) ) {
+            c->crlf = 1;
+            if( ! quoted && nf <= maxfields ) fields[nf-1].len--;
+            }
+        c->rec = start;
+        c->reclen = (q - start) - c->crlf;
+        c->pos = (q < e) ? (size_t)( (q + 1) - c->buf ) : c->end;
+        return nf;
+        }
+    }
+
+int nztm_csv_read( nztm_csv *c, nztm_csv_field *fields, int maxfields )
+{
+   size_t n;
+   int nf;
+
+   for( ;; ) {
+      nf = csv_parse( c, fields, maxfields );
+      if( nf != CSV_MORE ) return nf;
+
+      /* Move the partial record to the start of the buffer and refill */
+
+      memmove( c->buf, c->buf + c->pos, c->end - c->pos );
+      c->end -= c->pos;
+      c->pos = 0;
+      if( c->end == c->size ) {
+         c->err = "record longer than buffer";
+         return -1;
+         }
+      n = fread( c->buf + c->end, 1, c->size - c->end, c->f );
+      if( n == 0 ) {
+         if( ferror( c->f ) ) { c->err = "read error"; return -1; }
+         c->eof = 1;
+         }
+      c->end += n;
+      }
+}
+
+
+/***************************************************************************/
+/*                                                                         */
+/*   nztm_csv_double                                                       */
+/*                                                                         */
+/*   The digits are accumulated into a 64 bit integer m with a decimal     */
+/*   exponent x.  When m is at most 2^53 and |x| at most 22, both m and     */
+/*   10^|x| are exact doubles, so a single multiplication or division      */
+/*   gives the correctly rounded value (Clinger's fast path).  Anything    */
+/*   else, or any digits dropped beyond 19, is left to strtod, on a copy   */
+/*   of the field of any length.                                           */
+/*                                                                         */
+/***************************************************************************/
+
+
+static const double pow10tab[23] = {
+   1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+int nztm_csv_double( const char *p, size_t len, double *v )
+{
+   const char *s = p;
+   const char *e = p + len;
+   uint64_t m = 0;
+   int nd = 0;
+   int x = 0;
+   int xe = 0;
+   int xneg = 0;
+   int neg = 0;
+   int digits = 0;
+   int dropped = 0;
+   char tmp[128];
+   char *t;
+   char *te;
+   int ok;
+
+   if( s < e && (*s == '+' || *s == '-') ) neg = *s++ == '-';
+   for( ; s < e && *s >= '0' && *s <= '9'; s++ ) {
+      digits = 1;
+      if( m == 0 && *s == '0' ) continue;
+      if( nd < 19 ) { m = m*10 + (*s - '0'); nd++; }
+      else { x++; if( *s != '0' ) dropped = 1; }
+      }
+   if( s < e && *s == '.' ) {
+      for( s++; s < e && *s >= '0' && *s <= '9'; s++ ) {
+         digits = 1;
+         if( m == 0 && *s == '0' ) { x--; continue; }
+         if( nd < 19 ) { m = m*10 + (*s - '0'); nd++; x--; }
+         else if( *s != '0' ) dropped = 1;
+         }
+      }
+   if( ! digits ) return 0;
+   if( s < e && (*s == 'e' || *s == 'E') ) {
+      s++;
+      if( s < e && (*s == '+' || *s == '-') ) xneg = *s++ == '-';
+      if( s == e || *s < '0' || *s > '9' ) return 0;
+      for( ; s < e && *s >= '0' && *s <= '9'; s++ ) {
+         if( xe < 10000 ) xe = xe*10 + (*s - '0');
+         }
+      x += xneg ? -xe : xe;
+      }
+   if( s != e ) return 0;
+
+   if( ! dropped && m <= ((uint64_t) 1 << 53) && x >= -22 && x <= 22 ) {
+      *v = x >= 0 ? (double) m * pow10tab[x] : (double) m / pow10tab[-x];
+      if( neg ) *v = -*v;
+      return 1;
+      }
+
+   /* strtod needs a terminated copy; long fields, of many digits or
+      leading zeros, get one from the heap */
+
+   t = len < sizeof(tmp) ? tmp : (char *) malloc( len + 1 );
+   if( ! t ) return 0;
+   memcpy( t, p, len );
+   t[len] = 0;
+   *v = strtod( t, &te );
+   ok = te == t + len;
+   if( t != tmp ) free( t );
+   return ok;
+}
+
+/* Uses integer arithmetic on v scaled by 10^decimals where that fits
+   in 63 bits, and printf otherwise. */
+
+size_t nztm_csv_fixed( char *s, double v, int decimals )
+{
+   char t[32];
+   char *p = t + sizeof(t);
+   uint64_t u;
+   uint64_t ip;
+   uint64_t fp;
+   int i;
+
+   if( ! isfinite( v ) ) { memcpy( s, "NA", 2 ); return 2; }
+   if( decimals < 0 ) decimals = 0;
+   if( decimals > NZTM_CSV_MAXDEC ) decimals = NZTM_CSV_MAXDEC;
+   if( decimals > 15 || fabs( v )*pow10tab[decimals] >= 9.0e18 )
+      return (size_t) sprintf( s, "%.*f", decimals, v );
+
+   u = (uint64_t)( fabs( v )*pow10tab[decimals] + 0.5 );
+   ip = u / (uint64_t) pow10tab[decimals];
+   fp = u % (uint64_t) pow10tab[decimals];
+   if( decimals > 0 ) {
+      for( i = 0; i < decimals; i++ ) { *--p = '0' + fp % 10; fp /= 10; }
+      *--p = '.';
+      }
+   do { *--p = '0' + ip % 10; ip /= 10; } while( ip );
+   if( v < 0.0 && u != 0 ) *--p = '-';
+   memcpy( s, p, t + sizeof(t) - p );
+   return t + sizeof(t) - p;
+}
+
+
+/***************************************************************************/
+/*                                                                         */
+/*   nztm_csv_project                                                      */
+/*                                                                         */
+/*   Records are staged, with their coordinates parsed into per column     */
+/*   arrays, until NZTM_CSV_BATCH have been read or the staging buffer is  */
+/*   full.  The batch is then projected and written out.  Memory use is    */
+/*   fixed by the buffer sizes and the batch size.                         */
+/*                                                                         */
+/***************************************************************************/
+
+
+#define CSV_MAXCOLS 4096          /* Header fields searched for columns */
+#define CSV_OUTSIZE 65536         /* Output buffer size */
+
+typedef struct {
+        FILE *f;
+        char buf[CSV_OUTSIZE];
+        size_t len;
+        int failed;
+        } csv_writer;
+
+static void csv_flush( csv_writer *w ) {
+    if( w->len && fwrite( w->buf, 1, w->len, w->f ) != w->len ) w->failed = 1;
+    w->len = 0;
+    }
+
+static void csv_put( csv_writer *w, const char *p, size_t len ) {
+    size_t n;
+
+    while( len > 0 ) {
+        if( w->len == CSV_OUTSIZE ) csv_flush( w );
+        n = CSV_OUTSIZE - w->len < len ? CSV_OUTSIZE - w->len : len;
+        memcpy( w->buf + w->len, p, n );
+        w->len += n;
+        p += n;
+        len -= n;
+        }
+    }
+
+/* Appends v as nztm_csv_fixed */
+
+static void csv_put_fixed( csv_writer *w, double v, int decimals ) {
+    char s[NZTM_CSV_FIXEDLEN];
+
+    csv_put( w, s, nztm_csv_fixed( s, v, decimals ) );
+    }
+
+static void csv_put_name( csv_writer *w, const char *name, int quoted ) {
+    csv_put( w, ",", 1 );
+    if( quoted ) csv_put( w, "\"", 1 );
+    csv_put( w, name, strlen( name ) );
+    if( quoted ) csv_put( w, "\"", 1 );
+    }
+
+long nztm_csv_project( FILE *in, FILE *out, const tmprojection *tm,
+   const nztm_csv_pair *pairs, int npairs, int decimals,
+   const char **err )
+{
+   return nztm_csv_project_a( in, out, tm, pairs, npairs, decimals, err, NULL );
+}
+
+long nztm_csv_project_a( FILE *in, FILE *out, const tmprojection *tm,
+   const nztm_csv_pair *pairs, int npairs, int decimals,
+   const char **err, const nztm_allocator *al )
+{
+   nztm_csv *c = NULL;
+   nztm_csv_field *fields = NULL;
+   csv_writer *w = NULL;
+   char *stage = NULL;
+   size_t *stageoff = NULL;
+   unsigned char *stagecrlf = NULL;
+   size_t stagelen = 0;
+   double *coord = NULL;
+   int *col = NULL;
+   int maxcol = 0;
+   long nrec = 0;
+   const char *msg = NULL;
+   const char *rec;
+   size_t reclen;
+   size_t nb = 0;
+   size_t i;
+   int nf;
+   int full;
+   int k;
+   int j;
+   double v;
+
+   if( decimals < 0 ) decimals = 0;
+   c = nztm_csv_open_a( in, 0, al );
+   fields = (nztm_csv_field *) nztm_alloc( al, CSV_MAXCOLS*sizeof(nztm_csv_field) );
+   w = (csv_writer *) nztm_alloc( al, sizeof(csv_writer) );
+   stage = (char *) nztm_alloc( al, NZTM_CSV_BUFSIZE );
+   stageoff = (size_t *) nztm_alloc( al, (NZTM_CSV_BATCH+1)*sizeof(size_t) );
+   stagecrlf = (unsigned char *) nztm_alloc( al, NZTM_CSV_BATCH );
+   coord = (double *) nztm_alloc( al, 4*npairs*NZTM_CSV_BATCH*sizeof(double) );
+   col = (int *) nztm_alloc( al, 2*npairs*sizeof(int) + 1 );
+   if( ! c || ! fields || ! w || ! stage || ! stageoff || ! stagecrlf ||
+       ! coord || ! col ) {
+      msg = "out of memory";
+      goto done;
+      }
+   w->f = out;
+   w->len = 0;
+   w->failed = 0;
+
+   /* Header: find the coordinate columns and name the new ones */
+
+   nf = nztm_csv_read( c, fields, CSV_MAXCOLS );
+   if( nf <= 0 ) { msg = nf < 0 ? nztm_csv_error( c ) : "no header"; goto done; }
+   if( nf > CSV_MAXCOLS ) { msg = "too many columns"; goto done; }
+   for( k = 0; k < 2*npairs; k++ ) {
+      const char *name = k % 2 ? pairs[k/2].lon : pairs[k/2].lat;
+      for( j = 0; j < nf; j++ ) {
+         if( fields[j].len == strlen( name ) &&
+             memcmp( fields[j].p, name, fields[j].len ) == 0 ) break;
+         }
+      if( j == nf ) { msg = "coordinate column not found"; goto done; }
+      col[k] = j;
+      if( j + 1 > maxcol ) maxcol = j + 1;
+      }
+   rec = nztm_csv_record( c, &reclen );
+   csv_put( w, rec, reclen );
+   for( k = 0; k < npairs; k++ ) {
+      csv_put_name( w, pairs[k].n, fields[0].quoted );
+      csv_put_name( w, pairs[k].e, fields[0].quoted );
+      }
+   csv_put( w, c->crlf ? "\r\n" : "\n", c->crlf ? 2 : 1 );
+
+   /* Records, in batches.  coord holds for each pair the latitudes,
+      longitudes, northings and eastings of the batch. */
+
+   stageoff[0] = 0;
+   for( ;; ) {
+      nf = nztm_csv_read( c, fields, maxcol );
+      if( nf < 0 ) { msg = nztm_csv_error( c ); goto done; }
+
+      full = 0;
+      if( nf > 0 ) {
+         rec = nztm_csv_record( c, &reclen );
+         full = stagelen + reclen > NZTM_CSV_BUFSIZE;
+         }
+
+      /* Project and write out a full batch, or the last one */
+
+      if( nb > 0 && (nf == 0 || nb == NZTM_CSV_BATCH || full) ) {
+         for( k = 0; k < npairs; k++ ) {
+            double *q = coord + 4*k*NZTM_CSV_BATCH;
+            geod_tm_hn( tm, q, q + NZTM_CSV_BATCH,
+                q + 2*NZTM_CSV_BATCH, q + 3*NZTM_CSV_BATCH, nb );
+            }
+         for( i = 0; i < nb; i++ ) {
+            csv_put( w, stage + stageoff[i], stageoff[i+1] - stageoff[i] );
+            for( k = 0; k < npairs; k++ ) {
+               double *q = coord + 4*k*NZTM_CSV_BATCH;
+               csv_put( w, ",", 1 );
+               csv_put_fixed( w, q[2*NZTM_CSV_BATCH + i], decimals );
+               csv_put( w, ",", 1 );
+               csv_put_fixed( w, q[3*NZTM_CSV_BATCH + i], decimals );
+               }
+            csv_put( w, stagecrlf[i] ? "\r\n" : "\n", stagecrlf[i] ? 2 : 1 );
+            }
+         if( w->failed ) { msg = "write error"; goto done; }
+         nb = 0;
+         stagelen = 0;
+         }
+      if( nf == 0 ) break;
+
+      /* Stage the record and parse its coordinates */
+
+      memcpy( stage + stagelen, rec, reclen );
+      stagelen += reclen;
+      stageoff[nb+1] = stagelen;
+      stagecrlf[nb] = (unsigned char) c->crlf;
+      for( k = 0; k < 2*npairs; k++ ) {
+         double *q = coord + (4*(k/2) + k%2)*NZTM_CSV_BATCH;
+         if( col[k] < nf && nztm_csv_double( fields[col[k]].p,
+                                fields[col[k]].len, &v ) )
+            q[nb] = v/rad2deg;
+         else
+            q[nb] = NAN;
+         }
+      nb++;
+      nrec++;
+      }
+
+   csv_flush( w );
+   if( w->failed ) msg = "write error";
+
+done:
+   if( err ) *err = msg;
+   nztm_csv_close( c );
+   nztm_free( al, fields );
+   nztm_free( al, w );
+   nztm_free( al, stage );
+   nztm_free( al, stageoff );
+   nztm_free( al, stagecrlf );
+   nztm_free( al, coord );
+   nztm_free( al, col );
+   return msg ? -1 : nrec;
+}
+
+#ifdef NZTM_CSV_TOOL
+
+/* Command line reprojector.  Build with
+      cc -O2 -DNZTM_CSV_TOOL -o nztm_csv nztm_csv.c nztm.c nztm_simd.c -lm
+   and run as
+      nztm_csv [-utm zone[s]] [-d decimals] lat,lon,n,e ... < in > out
+   for example, for spring.csv in UTM zone 27N,
+      nztm_csv -utm 27 kastad_breidd,kastad_lengd,kastad_n,kastad_e \
+                       hift_breidd,hift_lengd,hift_n,hift_e
+   The default projection is NZTM; UTM zones are on the GRS80
+   ellipsoid, with s for the southern hemisphere. */
+
+int main( int argc, char *argv[] ) {
+  nztm_csv_pair pairs[64];
+  char *spec[64];
+  int npairs = 0;
+  int decimals = 3;
+  const tmprojection *tm = &nztm_projection;
+  tmprojection *utm = NULL;
+  const char *err;
+  long n;
+  int i;
+
+  for( i = 1; i < argc; i++ ) {
+     if( strcmp( argv[i], "-d" ) == 0 && i + 1 < argc ) {
+        decimals = atoi( argv[++i] );
+        }
+     else if( strcmp( argv[i], "-utm" ) == 0 && i + 1 < argc ) {
+        int zone = atoi( argv[++i] );
+        int south = strchr( argv[i], 's' ) || strchr( argv[i], 'S' );
+        if( zone < 1 || zone > 60 ) {
+           fprintf( stderr, "Invalid UTM zone %s\n", argv[i] );
+           return 1;
+           }
+        tm_destroy( utm );
+        tm = utm = tm_create( NZTM_A, NZTM_RF, (6.0*zone - 183.0)/rad2deg,
+           0.9996, 0.0, 500000.0, south ? 10000000.0 : 0.0, 1.0 );
+        }
+     else if( npairs < 64 ) {
+        spec[npairs] = argv[i];
+        pairs[npairs].lat = strtok( spec[npairs], "," );
+        pairs[npairs].lon = strtok( NULL, "," );
+        pairs[npairs].n = strtok( NULL, "," );
+        pairs[npairs].e = strtok( NULL, "," );
+        if( ! pairs[npairs].e ) {
+           fprintf( stderr, "Column pairs are given as lat,lon,n,e\n" );
+           return 1;
+           }
+        npairs++;
+        }
+     }
+  if( npairs == 0 || ! tm ) {
+     fprintf( stderr,
+        "Usage: nztm_csv [-utm zone[s]] [-d decimals] lat,lon,n,e ...\n" );
+     return 1;
+     }
+
+  n = nztm_csv_project( stdin, stdout, tm, pairs, npairs, decimals, &err );
+  tm_destroy( utm );
+  if( n < 0 ) {
+     fprintf( stderr, "nztm_csv: %s\n", err );
+     return 1;
+     }
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef _NZTM_CSV_H
+#define _NZTM_CSV_H
+
+/* Streaming CSV reading and reprojection of coordinate columns.
+
+   nztm_csv reads comma separated records (RFC 4180: fields may be
+   quoted, with "" for a quote, and may then contain commas and line
+   breaks) through a single fixed size buffer, so memory use does not
+   depend on the size of the input.  Fields are returned as views into
+   the buffer rather than copied.  A record must fit in the buffer.
+
+   nztm_csv_project copies a CSV stream, appending projected northing
+   and easting columns computed from pairs of latitude and longitude
+   columns in decimal degrees, such as kastad_breidd and kastad_lengd
+   in spring.csv.  Records are converted in batches with geod_tm_hn. */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "nztm.h"
+#include "nztm_arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_CSV_BUFSIZE  (1 << 20)   /* Default buffer size (bytes) */
+#define NZTM_CSV_BATCH    1024        /* Records projected per batch */
+
+/* A field of the current record.  p and len exclude the enclosing
+   quotes of a quoted field; any "" within it is left as is. */
+
+typedef struct {
+        const char *p;
+        size_t len;
+        int quoted;
+        } nztm_csv_field;
+
+typedef struct nztm_csv nztm_csv;
+
+/* Opens a reader on f with a buffer of bufsize bytes (0 for
+   NZTM_CSV_BUFSIZE).  Returns NULL if memory cannot be allocated. */
+
+nztm_csv *nztm_csv_open( FILE *f, size_t bufsize );
+void nztm_csv_close( nztm_csv *c );
+
+/* As nztm_csv_open, taking the reader's memory from al (nztm_arena.h),
+   which must outlive it */
+
+nztm_csv *nztm_csv_open_a( FILE *f, size_t bufsize, const nztm_allocator *al );
+
+/* Makes c read the records in the len bytes at p, which remain owned
+   by the caller and must not end within a record, instead of its
+   file; reading returns 0 at their end.  A reader opened with a NULL
+   file has no buffer of its own and is used only this way. */
+
+void nztm_csv_memory( nztm_csv *c, const char *p, size_t len );
+
+/* Reads the next record, storing up to maxfields fields.  Returns the
+   number of fields in the record (which may exceed maxfields), 0 at
+   the end of the input, or -1 on error.  The fields, and the raw text
+   of the record returned by nztm_csv_record (without its line ending),
+   remain valid until the next call. */
+
+int nztm_csv_read( nztm_csv *c, nztm_csv_field *fields, int maxfields );
+const char *nztm_csv_record( const nztm_csv *c, size_t *len );
+
+/* Description of the last error, or NULL */
+
+const char *nztm_csv_error( const nztm_csv *c );
+
+/* Parses a decimal number (with optional sign, fraction and exponent)
+   occupying the len characters at p.  Returns 1 and sets *v if the
+   whole text is a valid number, otherwise 0.  Numbers of up to 19
+   significant digits with small exponents, which covers those written
+   by R and most other tools, are converted directly with correct
+   rounding; others fall back to strtod. */
+
+int nztm_csv_double( const char *p, size_t len, double *v );
+
+/* Formats v with decimals decimals (at most NZTM_CSV_MAXDEC), or as NA
+   if it is not finite, into s, which must hold NZTM_CSV_FIXEDLEN
+   bytes, and returns its length.  There is no terminating NUL. */
+
+#define NZTM_CSV_MAXDEC    40
+#define NZTM_CSV_FIXEDLEN  (320 + NZTM_CSV_MAXDEC)
+
+size_t nztm_csv_fixed( char *s, double v, int decimals );
+
+/* Column pair for nztm_csv_project: names of the latitude and
+   longitude input columns and of the northing and easting columns to
+   append */
+
+typedef struct {
+        const char *lat;
+        const char *lon;
+        const char *n;
+        const char *e;
+        } nztm_csv_pair;
+
+/* Reads CSV with a header record from in and writes it to out with,
+   for each of the npairs column pairs, the northing and easting in
+   tm appended to every record with the given number of decimals
+   (at most NZTM_CSV_MAXDEC).
+   Fields that are empty or not numbers give NA.  The input records are
+   copied unchanged.  Returns the number of data records, or -1 on
+   error with *err (if not NULL) set to a description.
+   nztm_csv_project_a takes its buffers from al (nztm_arena.h). */
+
+long nztm_csv_project( FILE *in, FILE *out, const tmprojection *tm,
+   const nztm_csv_pair *pairs, int npairs, int decimals,
+   const char **err );
+long nztm_csv_project_a( FILE *in, FILE *out, const tmprojection *tm,
+   const nztm_csv_pair *pairs, int npairs, int decimals,
+   const char **err, const nztm_allocator *al );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,217 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Geodesic and planar distances on the ellipsoid of a TM projection */
+
+#include "nztm_dist.h"
+
+#include "tmproj.h"
+
+#include <math.h>
+
+#define DIST_BLOCK     256        /* Points projected at a time */
+#define DIST_MAXITER   100
+
+/*************************************************************************/
+/*                                                                       */
+/*   tm_geodesic                                                         */
+/*                                                                       */
+/*   Vincenty's inverse formulae (T. Vincenty, Survey Review 23(176),    */
+/*   1975), iterating on the longitude difference on the auxiliary       */
+/*   sphere until it changes by less than 1e-12 rad (about 0.006 mm).    */
+/*                                                                       */
+/*************************************************************************/
+
+double tm_geodesic( const tmprojection *tm, double lt1, double ln1,
+   double lt2, double ln2 )
+{
+   double f = tm->f;
+   double b = tm->a*(1.0 - f);
+   double L = ln2 - ln1;
+   double U1 = atan( (1.0 - f)*tan( lt1 ) );
+   double U2 = atan( (1.0 - f)*tan( lt2 ) );
+   double sinU1 = sin( U1 ), cosU1 = cos( U1 );
+   double sinU2 = sin( U2 ), cosU2 = cos( U2 );
+   double lambda = L, lambdap;
+   double sinl, cosl, sins, coss, sigma, sina, cos2a, cos2sm, C;
+   double u2, A, B, ds, t;
+   int iter;
+
+   for( iter = 0; ; iter++ ) {
+      if( iter == DIST_MAXITER || isnan( lambda ) ) return NAN;
+      sinl = sin( lambda );
+      cosl = cos( lambda );
+      t = cosU1*sinU2 - sinU1*cosU2*cosl;
+      sins = sqrt( (cosU2*sinl)*(cosU2*sinl) + t*t );
+      if( sins == 0.0 ) return 0.0;
+      coss = sinU1*sinU2 + cosU1*cosU2*cosl;
+      sigma = atan2( sins, coss );
+      sina = cosU1*cosU2*sinl/sins;
+      cos2a = 1.0 - sina*sina;
+      cos2sm = cos2a != 0.0 ? coss - 2.0*sinU1*sinU2/cos2a : 0.0;
+      C = f/16.0*cos2a*(4.0 + f*(4.0 - 3.0*cos2a));
+      lambdap = lambda;
+      lambda = L + (1.0 - C)*f*sina*
+         (sigma + C*sins*(cos2sm + C*coss*(-1.0 + 2.0*cos2sm*cos2sm)));
+      if( fabs( lambda - lambdap ) < 1.0e-12 ) break;
+      }
+
+   u2 = cos2a*tm->ep2;
+   A = 1.0 + u2/16384.0*(4096.0 + u2*(-768.0 + u2*(320.0 - 175.0*u2)));
+   B = u2/1024.0*(256.0 + u2*(-128.0 + u2*(74.0 - 47.0*u2)));
+   ds = B*sins*(cos2sm + B/4.0*(coss*(-1.0 + 2.0*cos2sm*cos2sm)
+        - B/6.0*cos2sm*(-3.0 + 4.0*sins*sins)*(-3.0 + 4.0*cos2sm*cos2sm)));
+   return b*A*(sigma - ds);
+}
+
+void tm_geodesic_n( const tmprojection *tm, const double *lt1,
+   const double *ln1, const double *lt2, const double *ln2,
+   double *s, size_t count )
+{
+   size_t i;
+
+   for( i = 0; i < count; i++ )
+      s[i] = tm_geodesic( tm, lt1[i], ln1[i], lt2[i], ln2[i] );
+}
+
+/*************************************************************************/
+/*                                                                       */
+/*   Planar distances                                                    */
+/*                                                                       */
+/*   The point scale factor of the projection at ground distance x from  */
+/*   the central meridian is                                             */
+/*                                                                       */
+/*      k = k0 (1 + x^2/(2 rho nu) + x^4/(24 rho^2 nu^2))                */
+/*                                                                       */
+/*   (GDA technical manual), and the line scale factor is found from     */
+/*   that at the ends and the mid point by Simpson's rule, with rho nu   */
+/*   taken at the mid latitude.                                          */
+/*                                                                       */
+/*************************************************************************/
+
+static double grid_distance( const tmprojection *tm, double lt, double n1,
+   double e1, double n2, double e2 ) {
+    double slt = sin( lt );
+    double eslt = 1.0 - tm->e2*slt*slt;
+    double r2 = tm->a*tm->a*tm->ome2/(eslt*eslt);         /* rho nu */
+    double x1 = (e1 - tm->falsee)*tm->utom*tm->rsf;
+    double x2 = (e2 - tm->falsee)*tm->utom*tm->rsf;
+    double xm = 0.5*(x1 + x2);
+    double q1 = x1*x1/r2, q2 = x2*x2/r2, qm = xm*xm/r2;
+    double k = tm->scalef*(1.0 + (q1 + 4.0*qm + q2)/12.0
+                               + (q1*q1 + 4.0*qm*qm + q2*q2)/144.0);
+    double dn = (n2 - n1)*tm->utom;
+    double de = (e2 - e1)*tm->utom;
+
+    return sqrt( dn*dn + de*de )/k;
+    }
+
+double tm_planar( const tmprojection *tm, double lt1, double ln1,
+   double lt2, double ln2 )
+{
+   double n1, e1, n2, e2;
+
+   geod_tm_h( tm, lt1, ln1, &n1, &e1 );
+   geod_tm_h( tm, lt2, ln2, &n2, &e2 );
+   return grid_distance( tm, 0.5*(lt1 + lt2), n1, e1, n2, e2 );
+}
+
+void tm_planar_n( const tmprojection *tm, const double *lt1,
+   const double *ln1, const double *lt2, const double *ln2,
+   double *s, size_t count )
+{
+   double n1[DIST_BLOCK], e1[DIST_BLOCK], n2[DIST_BLOCK], e2[DIST_BLOCK];
+   size_t b, i, n;
+
+   for( b = 0; b < count; b += n ) {
+      n = count - b < DIST_BLOCK ? count - b : DIST_BLOCK;
+      geod_tm_hn( tm, lt1 + b, ln1 + b, n1, e1, n );
+      geod_tm_hn( tm, lt2 + b, ln2 + b, n2, e2, n );
+      for( i = 0; i < n; i++ )
+         s[b+i] = grid_distance( tm, 0.5*(lt1[b+i] + lt2[b+i]),
+            n1[i], e1[i], n2[i], e2[i] );
+      }
+}
+
+/* The mid latitude is taken as the foot point latitude of the mean
+   northing, which differs from it by less than the scale factor needs */
+
+void tm_grid_distance_n( const tmprojection *tm, const double *n1,
+   const double *e1, const double *n2, const double *e2,
+   double *s, size_t count )
+{
+   double m;
+   size_t i;
+
+   for( i = 0; i < count; i++ ) {
+      m = (0.5*(n1[i] + n2[i]) - tm->falsen)*tm->utom*tm->rsf + tm->om;
+      s[i] = grid_distance( tm, tm_foot_point_lat( tm, m ),
+         n1[i], e1[i], n2[i], e2[i] );
+      }
+}
+
+#ifdef TEST_NZTM_DIST
+
+/* Checks tm_geodesic against the standard example of the GDA manual
+   (Flinders Peak to Buninyong) and compares the planar approximation
+   with it for random lines in UTM zone 27N */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double test_now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+    }
+
+static double dms( double d, double m, double s ) {
+    return (d < 0 ? -1 : 1)*(fabs( d ) + m/60.0 + s/3600.0)/rad2deg;
+    }
+
+int main( void ) {
+  size_t n = 2000000, i, len;
+  double *v = (double *) malloc( 7*n*sizeof(double) );
+  double *lt1 = v, *ln1 = v + n, *lt2 = v + 2*n, *ln2 = v + 3*n;
+  double *sg = v + 4*n, *sp = v + 5*n, *sq = v + 6*n;
+  double t0, t1, t2, err, maxerr, s;
+  tmprojection *utm = tm_create( NZTM_A, NZTM_RF, -21.0/rad2deg, 0.9996,
+     0.0, 500000.0, 0.0, 1.0 );
+
+  s = tm_geodesic( utm, dms( -37, 57, 3.72030 ), dms( 144, 25, 29.52440 ),
+     dms( -37, 39, 10.15610 ), dms( 143, 55, 35.38390 ) );
+  printf( "Flinders Peak to Buninyong: %.4f m (expected 54972.271)\n", s );
+
+  for( len = 1000; len <= 1000000; len *= 10 ) {
+     for( i = 0; i < n; i++ ) {
+        double a = TWOPI*rand()/(RAND_MAX + 1.0);
+        double d = len*(rand()/(RAND_MAX + 1.0));
+        lt1[i] = (63.0 + 4.0*rand()/(RAND_MAX + 1.0))/rad2deg;
+        ln1[i] = (-27.0 + 12.0*rand()/(RAND_MAX + 1.0))/rad2deg;
+        lt2[i] = lt1[i] + d*cos( a )/6.37e6;
+        ln2[i] = ln1[i] + d*sin( a )/(6.37e6*cos( lt1[i] ));
+        }
+     t0 = test_now();
+     tm_geodesic_n( utm, lt1, ln1, lt2, ln2, sg, n );
+     t1 = test_now();
+     tm_planar_n( utm, lt1, ln1, lt2, ln2, sp, n );
+     t2 = test_now();
+     geod_tm_hn( utm, lt1, ln1, lt1, ln1, n );
+     geod_tm_hn( utm, lt2, ln2, lt2, ln2, n );
+     tm_grid_distance_n( utm, lt1, ln1, lt2, ln2, sq, n );
+     for( i = 0, maxerr = 0.0; i < n; i++ ) {
+        err = fabs( sp[i] - sg[i] )/(sg[i] > 1.0 ? sg[i] : 1.0);
+        if( err > maxerr ) maxerr = err;
+        err = fabs( sq[i] - sg[i] )/(sg[i] > 1.0 ? sg[i] : 1.0);
+        if( err > maxerr ) maxerr = err;
+        }
+     printf( "lines up to %7lu m: geodesic %5.1f Mline/s, planar %5.1f Mline/s,"
+        " max relative difference %.2e\n", (unsigned long) len,
+        n/(t1 - t0)*1.0e-6, n/(t2 - t1)*1.0e-6, maxerr );
+     }
+  tm_destroy( utm );
+  free( v );
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef _NZTM_DIST_H
+#define _NZTM_DIST_H
+
+/* Distances between points on the ellipsoid of a TM projection (GRS80
+   for NZTM and the UTM projections made with tm_create).
+
+   tm_geodesic solves the inverse geodesic problem by Vincenty's
+   method, giving the ellipsoidal distance to well under a millimetre.
+   The iteration does not converge for nearly antipodal points, for
+   which NaN is returned.
+
+   tm_planar is a fast approximation for short lines such as tows: the
+   distance between the projected points divided by the mean scale
+   factor along the line (by Simpson's rule).  Within a few hundred
+   kilometres of the central meridian it agrees with tm_geodesic to
+   about 1 part in 10^6 for lines of tens of kilometres.  The batch
+   version projects the points a block at a time with the batch
+   routines of nztm.h.  tm_grid_distance_n does the same for points
+   already projected, such as the kastad_n/kastad_e columns of a tow
+   file.
+
+   Latitudes and longitudes are in radians, distances in metres and
+   northings and eastings in projection units.  Points with NaN give
+   NaN. */
+
+#include <stddef.h>
+
+#include "nztm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+double tm_geodesic( const tmprojection *tm, double lt1, double ln1,
+   double lt2, double ln2 );
+double tm_planar( const tmprojection *tm, double lt1, double ln1,
+   double lt2, double ln2 );
+
+void tm_geodesic_n( const tmprojection *tm, const double *lt1,
+   const double *ln1, const double *lt2, const double *ln2,
+   double *s, size_t count );
+void tm_planar_n( const tmprojection *tm, const double *lt1,
+   const double *ln1, const double *lt2, const double *ln2,
+   double *s, size_t count );
+void tm_grid_distance_n( const tmprojection *tm, const double *n1,
+   const double *e1, const double *n2, const double *e2,
+   double *s, size_t count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
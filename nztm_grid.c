@@ -0,0 +1,520 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Gridding of tows.  Needs POSIX mmap.
+
+   A file is laid out as
+
+      header                 grid_header, padded to GRID_ALIGN bytes
+      bands                  nx*ny doubles for each of NZTM_GRID_NBANDS
+
+   The walk of a segment follows Amanatides and Woo, "A fast voxel
+   traversal algorithm for ray tracing" (1987): in cell coordinates the
+   segment is a + t(b - a) for t in [0,1], clipped to the grid, and
+   tmaxx and tmaxy are the values of t at which it next crosses a
+   vertical and a horizontal cell edge.  Each step moves to the cell
+   across the nearer of the two, and the cell left receives the
+   fraction of the tow between successive crossings. */
+
+#include "nztm_grid.h"
+
+#include "tmproj.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define GRID_MAGIC    "NZTMGRD1"
+#define GRID_VERSION  1
+#define GRID_ALIGN    128         /* Offset of the bands */
+
+#define GRID_TCELLS   (NZTM_GRID_TILE*NZTM_GRID_TILE)
+
+typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t pad;
+        uint32_t nx, ny;
+        double x0, y0;
+        double cell;
+        double proj[8];           /* a, rf, cm, sf, lto, fe, fn, utom */
+        } grid_header;
+
+/* Sums of a slice over a tile: sum, length and count of each cell */
+
+typedef struct {
+        double v[3][GRID_TCELLS];
+        } grid_tile;
+
+/* A gridding, shared by the pool threads.  A slice's tiles are
+   tiles[slice*ntiles + tile], NULL until touched.  If tm is NULL the
+   tows are already projected: lt0 and ln0 are the northings and
+   eastings of their starts, and lt1 and ln1 of their ends. */
+
+typedef struct {
+        nztm_grid *g;
+        const tmprojection *tm;
+        const double *lt0, *ln0, *lt1, *ln1, *value;
+        size_t count;
+        size_t nslices;
+        int tx, ty;               /* Tiles across and up */
+        size_t ntiles;
+        grid_tile **tiles;
+        int failed;
+        } grid_job;
+
+/* Adds to cell (i,j) in the tiles of a slice */
+
+static void grid_put( grid_job *job, grid_tile **tiles, int i, int j,
+   double sum, double len ) {
+    size_t t = (size_t) (j/NZTM_GRID_TILE)*job->tx + i/NZTM_GRID_TILE;
+    size_t k = (size_t) (j%NZTM_GRID_TILE)*NZTM_GRID_TILE + i%NZTM_GRID_TILE;
+
+    if( ! tiles[t] && ! ( tiles[t] = (grid_tile *) calloc( 1, sizeof(grid_tile) ) ) ) {
+        job->failed = 1;
+        return;
+        }
+    tiles[t]->v[0][k] += sum;
+    tiles[t]->v[1][k] += len;
+    tiles[t]->v[2][k] += 1.0;
+    }
+
+/* Walks the tow from (e0,n0) to (e1,n1) with value v */
+
+static void grid_walk( grid_job *job, grid_tile **tiles, double e0,
+   double n0, double e1, double n1, double v ) {
+    const nztm_grid *g = job->g;
+    double ax = (e0 - g->x0)/g->cell, ay = (n0 - g->y0)/g->cell;
+    double dx = (e1 - e0)/g->cell, dy = (n1 - n0)/g->cell;
+    double len = hypot( e1 - e0, n1 - n0 );
+    double t0 = 0.0, t1 = 1.0, lo, hi, tmaxx, tmaxy, tdx, tdy, t, tn;
+    int i, j, sx, sy;
+
+    if( ! ( len > 0.0 ) ) {
+        if( ax >= 0.0 && ax < g->nx && ay >= 0.0 && ay < g->ny )
+            grid_put( job, tiles, (int) ax, (int) ay, v, 0.0 );
+        return;
+        }
+
+    /* Clip to the grid */
+
+    if( dx == 0.0 ) { if( ! ( ax >= 0.0 && ax < g->nx ) ) return; }
+    else {
+        lo = -ax/dx;
+        hi = (g->nx - ax)/dx;
+        if( lo > hi ) { t = lo; lo = hi; hi = t; }
+        if( lo > t0 ) t0 = lo;
+        if( hi < t1 ) t1 = hi;
+        }
+    if( dy == 0.0 ) { if( ! ( ay >= 0.0 && ay < g->ny ) ) return; }
+    else {
+        lo = -ay/dy;
+        hi = (g->ny - ay)/dy;
+        if( lo > hi ) { t = lo; lo = hi; hi = t; }
+        if( lo > t0 ) t0 = lo;
+        if( hi < t1 ) t1 = hi;
+        }
+    if( ! ( t0 < t1 ) ) return;
+
+    i = (int) floor( ax + t0*dx );
+    j = (int) floor( ay + t0*dy );
+    if( i < 0 ) i = 0; else if( i >= g->nx ) i = g->nx - 1;
+    if( j < 0 ) j = 0; else if( j >= g->ny ) j = g->ny - 1;
+    sx = dx > 0.0 ? 1 : -1;
+    sy = dy > 0.0 ? 1 : -1;
+    tdx = dx != 0.0 ? fabs( 1.0/dx ) : HUGE_VAL;
+    tdy = dy != 0.0 ? fabs( 1.0/dy ) : HUGE_VAL;
+    tmaxx = dx != 0.0 ? ((dx > 0.0 ? i + 1 : i) - ax)/dx : HUGE_VAL;
+    tmaxy = dy != 0.0 ? ((dy > 0.0 ? j + 1 : j) - ay)/dy : HUGE_VAL;
+
+    for( t = t0; ; ) {
+        tn = tmaxx < tmaxy ? tmaxx : tmaxy;
+        if( tn > t1 ) tn = t1;
+        if( tn > t ) grid_put( job, tiles, i, j, v*(tn - t), len*(tn - t) );
+        if( tn >= t1 ) break;
+        t = tn;
+        if( tmaxx < tmaxy ) {
+            i += sx;
+            tmaxx += tdx;
+            if( i < 0 || i >= g->nx ) break;
+            }
+        else {
+            j += sy;
+            tmaxy += tdy;
+            if( j < 0 || j >= g->ny ) break;
+            }
+        }
+    }
+
+/* Projects and walks the tows of slice item */
+
+static void grid_slice( void *ctx, size_t item, int thread ) {
+    grid_job *job = (grid_job *) ctx;
+    grid_tile **tiles = job->tiles + item*job->ntiles;
+    size_t first = job->count*item/job->nslices;
+    size_t end = job->count*(item + 1)/job->nslices;
+    double bn0[NZTM_GRID_BATCH], be0[NZTM_GRID_BATCH];
+    double bn1[NZTM_GRID_BATCH], be1[NZTM_GRID_BATCH];
+    const double *n0 = bn0, *e0 = be0, *n1 = bn1, *e1 = be1;
+    size_t b, m, k;
+    double v;
+
+    (void) thread;
+    for( b = first; b < end && ! job->failed; b += m ) {
+        m = end - b < NZTM_GRID_BATCH ? end - b : NZTM_GRID_BATCH;
+        if( ! job->tm ) {
+            n0 = job->lt0 + b;
+            e0 = job->ln0 + b;
+            if( job->lt1 ) {
+                n1 = job->lt1 + b;
+                e1 = job->ln1 + b;
+                }
+            }
+        else {
+            geod_tm_hn( job->tm, job->lt0 + b, job->ln0 + b, bn0, be0, m );
+            if( job->lt1 ) geod_tm_hn( job->tm, job->lt1 + b, job->ln1 + b, bn1, be1, m );
+            }
+        for( k = 0; k < m; k++ ) {
+            v = job->value[b+k];
+            if( isnan( v ) || isnan( e0[k] ) || isnan( n0[k] ) ) continue;
+            if( ! job->lt1 || isnan( e1[k] ) || isnan( n1[k] ) )
+                grid_walk( job, tiles, e0[k], n0[k], e0[k], n0[k], v );
+            else
+                grid_walk( job, tiles, e0[k], n0[k], e1[k], n1[k], v );
+            }
+        }
+    }
+
+/* Adds the tiles of all slices at tile item to the raster, in the
+   order of the slices, and updates its densities */
+
+static void grid_merge( void *ctx, size_t item, int thread ) {
+    grid_job *job = (grid_job *) ctx;
+    nztm_grid *g = job->g;
+    int ti = (int) (item % job->tx), tj = (int) (item / job->tx);
+    int i0 = ti*NZTM_GRID_TILE, j0 = tj*NZTM_GRID_TILE;
+    int i1 = i0 + NZTM_GRID_TILE < g->nx ? i0 + NZTM_GRID_TILE : g->nx;
+    int j1 = j0 + NZTM_GRID_TILE < g->ny ? j0 + NZTM_GRID_TILE : g->ny;
+    grid_tile *tile;
+    size_t s, c, k;
+    int i, j, touched = 0, b;
+
+    (void) thread;
+    for( s = 0; s < job->nslices; s++ ) {
+        if( ! ( tile = job->tiles[s*job->ntiles + item] ) ) continue;
+        touched = 1;
+        for( j = j0; j < j1; j++ )
+            for( i = i0; i < i1; i++ ) {
+                c = (size_t) j*g->nx + i;
+                k = (size_t) (j - j0)*NZTM_GRID_TILE + (i - i0);
+                for( b = 0; b < 3; b++ ) g->band[b][c] += tile->v[b][k];
+                }
+        }
+    if( ! touched ) return;
+    for( j = j0; j < j1; j++ )
+        for( i = i0; i < i1; i++ ) {
+            c = (size_t) j*g->nx + i;
+            g->band[NZTM_GRID_DENSITY][c] = g->band[NZTM_GRID_LENGTH][c] > 0.0 ?
+                g->band[NZTM_GRID_SUM][c]/g->band[NZTM_GRID_LENGTH][c] : NAN;
+            }
+    }
+
+/* Sets the fields of g from its mapping */
+
+static int grid_map( nztm_grid *g, void *map, size_t size ) {
+    const grid_header *h = (const grid_header *) map;
+    size_t ncells;
+    int b;
+
+    if( size < GRID_ALIGN || memcmp( h->magic, GRID_MAGIC, 8 ) != 0 ||
+        h->version != GRID_VERSION || h->nx == 0 || h->ny == 0 ||
+        ! ( h->cell > 0.0 ) ) return -1;
+    ncells = (size_t) h->nx*h->ny;
+    if( ncells > NZTM_GRID_MAXCELLS ||
+        size != GRID_ALIGN + NZTM_GRID_NBANDS*ncells*sizeof(double) ) return -1;
+    g->map = map;
+    g->size = size;
+    g->hdr = h;
+    g->nx = (int) h->nx;
+    g->ny = (int) h->ny;
+    g->x0 = h->x0;
+    g->y0 = h->y0;
+    g->cell = h->cell;
+    for( b = 0; b < NZTM_GRID_NBANDS; b++ )
+        g->band[b] = (double *) ((char *) map + GRID_ALIGN) + b*ncells;
+    return 0;
+    }
+
+int nztm_grid_create( nztm_grid *g, const char *path,
+   const tmprojection *tm, const double box[4], double cell )
+{
+   grid_header h;
+   double x0, y0, fx, fy;
+   size_t ncells, size, c;
+   void *map;
+   int fd;
+
+   memset( g, 0, sizeof(nztm_grid) );
+   if( ! tm ) tm = &nztm_projection;
+   if( ! ( cell > 0.0 ) ) return -1;
+   x0 = floor( box[0]/cell )*cell;
+   y0 = floor( box[1]/cell )*cell;
+   fx = floor( box[2]/cell ) + 1.0 - x0/cell;
+   fy = floor( box[3]/cell ) + 1.0 - y0/cell;
+   if( ! ( fx >= 1.0 && fy >= 1.0 && fx < 2147483648.0 && fy < 2147483648.0 &&
+           fx*fy <= (double) NZTM_GRID_MAXCELLS ) ) return -1;
+
+   memset( &h, 0, sizeof(h) );
+   memcpy( h.magic, GRID_MAGIC, 8 );
+   h.version = GRID_VERSION;
+   h.nx = (uint32_t) fx;
+   h.ny = (uint32_t) fy;
+   h.x0 = x0;
+   h.y0 = y0;
+   h.cell = cell;
+   h.proj[0] = tm->a;
+   h.proj[1] = tm->rf;
+   h.proj[2] = tm->meridian;
+   h.proj[3] = tm->scalef;
+   h.proj[4] = tm->orglat;
+   h.proj[5] = tm->falsee;
+   h.proj[6] = tm->falsen;
+   h.proj[7] = tm->utom;
+   ncells = (size_t) h.nx*h.ny;
+   size = GRID_ALIGN + NZTM_GRID_NBANDS*ncells*sizeof(double);
+
+   fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+   if( fd < 0 ) return -1;
+   if( ftruncate( fd, (off_t) size ) != 0 ) {
+      close( fd );
+      return -1;
+      }
+   map = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+   close( fd );
+   if( map == MAP_FAILED ) return -1;
+   memcpy( map, &h, sizeof(h) );
+   grid_map( g, map, size );
+   for( c = 0; c < ncells; c++ ) g->band[NZTM_GRID_DENSITY][c] = NAN;
+   return 0;
+}
+
+int nztm_grid_open( nztm_grid *g, const char *path )
+{
+   struct stat st;
+   void *map;
+   int fd;
+
+   memset( g, 0, sizeof(nztm_grid) );
+   fd = open( path, O_RDWR );
+   if( fd < 0 ) return -1;
+   if( fstat( fd, &st ) != 0 || (size_t) st.st_size < GRID_ALIGN ) {
+      close( fd );
+      return -1;
+      }
+   map = mmap( NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+      fd, 0 );
+   close( fd );
+   if( map == MAP_FAILED ) return -1;
+   if( grid_map( g, map, (size_t) st.st_size ) != 0 ) {
+      munmap( map, (size_t) st.st_size );
+      memset( g, 0, sizeof(nztm_grid) );
+      return -1;
+      }
+   return 0;
+}
+
+void nztm_grid_close( nztm_grid *g )
+{
+   if( g->map ) munmap( g->map, g->size );
+   memset( g, 0, sizeof(nztm_grid) );
+}
+
+int nztm_grid_sync( nztm_grid *g )
+{
+   return msync( g->map, g->size, MS_SYNC ) == 0 ? 0 : -1;
+}
+
+tmprojection *nztm_grid_projection( const nztm_grid *g )
+{
+   const double *p = ((const grid_header *) g->hdr)->proj;
+
+   return tm_create( p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7] );
+}
+
+/* Grids the tows of job, with tm (NULL if projected) */
+
+static int grid_run( nztm_grid *g, const tmprojection *tm,
+        const double *a0, const double *b0, const double *a1,
+        const double *b1, const double *value, size_t count,
+        nztm_pool *pool ) {
+    grid_job job;
+    size_t k;
+
+    memset( &job, 0, sizeof(job) );
+    job.g = g;
+    job.tm = tm;
+    job.lt0 = a0;
+    job.ln0 = b0;
+    job.lt1 = a1 && b1 ? a1 : NULL;
+    job.ln1 = b1;
+    job.value = value;
+    job.count = count;
+    job.nslices = pool ? (size_t) nztm_pool_size( pool ) : 1;
+    job.tx = (g->nx + NZTM_GRID_TILE - 1)/NZTM_GRID_TILE;
+    job.ty = (g->ny + NZTM_GRID_TILE - 1)/NZTM_GRID_TILE;
+    job.ntiles = (size_t) job.tx*job.ty;
+    job.tiles = (grid_tile **) calloc( job.nslices*job.ntiles, sizeof(grid_tile *) );
+    if( ! job.tiles ) return -1;
+
+    nztm_pool_run( pool, job.nslices, grid_slice, &job );
+    if( ! job.failed ) nztm_pool_run( pool, job.ntiles, grid_merge, &job );
+
+    for( k = 0; k < job.nslices*job.ntiles; k++ ) free( job.tiles[k] );
+    free( job.tiles );
+    return job.failed ? -1 : 0;
+    }
+
+int nztm_grid_add( nztm_grid *g, const double *lt0, const double *ln0,
+   const double *lt1, const double *ln1, const double *value,
+   size_t count, nztm_pool *pool )
+{
+   tmprojection *tm;
+   int result;
+
+   if( ! ( tm = nztm_grid_projection( g ) ) ) return -1;
+   result = grid_run( g, tm, lt0, ln0, lt1, ln1, value, count, pool );
+   tm_destroy( tm );
+   return result;
+}
+
+int nztm_grid_add_projected( nztm_grid *g, const double *n0,
+   const double *e0, const double *n1, const double *e1,
+   const double *value, size_t count, nztm_pool *pool )
+{
+   return grid_run( g, NULL, n0, e0, n1, e1, value, count, pool );
+}
+
+#ifdef NZTM_GRID_TOOL
+
+/* Grids a column of tow files.  Build with
+      cc -O2 -DNZTM_GRID_TOOL -o nztm_grid nztm_grid.c nztm_tow.c nztm_csv.c \
+         nztm_pool.c nztm.c nztm_simd.c -lm -lpthread
+   and run as
+      nztm_grid [-cell size] [-utm zone[s]] [-value column] out.grd file.tow ...
+   to add the tows of each file (columns kastad_breidd, kastad_lengd,
+   hift_breidd and hift_lengd) to out.grd, creating it over the extent
+   of the first file if it does not exist, for example
+      nztm_grid -cell 1000 -utm 27 catch.grd spring.tow */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "nztm_tow.h"
+
+static const char *grid_cols[4] = { "kastad_breidd", "kastad_lengd",
+   "hift_breidd", "hift_lengd" };
+
+int main( int argc, char *argv[] ) {
+  const char *value = "catch";
+  tmprojection *utm = NULL;
+  double cell = 1000.0;
+  double box[4], total;
+  struct timespec t0, t1;
+  nztm_pool *pool;
+  nztm_grid g;
+  size_t c;
+  int a, f, k;
+
+  for( a = 1; a + 1 < argc && argv[a][0] == '-'; a += 2 ) {
+     if( strcmp( argv[a], "-cell" ) == 0 ) cell = atof( argv[a+1] );
+     else if( strcmp( argv[a], "-value" ) == 0 ) value = argv[a+1];
+     else if( strcmp( argv[a], "-utm" ) == 0 ) {
+        int zone = atoi( argv[a+1] );
+        int south = strchr( argv[a+1], 's' ) || strchr( argv[a+1], 'S' );
+        if( zone < 1 || zone > 60 ) {
+           fprintf( stderr, "Invalid UTM zone %s\n", argv[a+1] );
+           return 1;
+           }
+        tm_destroy( utm );
+        utm = tm_create( NZTM_A, NZTM_RF, (6.0*zone - 183.0)/rad2deg,
+           0.9996, 0.0, 500000.0, south ? 10000000.0 : 0.0, 1.0 );
+        }
+     else break;
+     }
+  if( a + 2 > argc ) {
+     fprintf( stderr, "Usage: nztm_grid [-cell size] [-utm zone[s]] "
+        "[-value column] out.grd file.tow ...\n" );
+     return 1;
+     }
+
+  pool = nztm_pool_create( 0 );
+  for( f = a + 1; f < argc; f++ ) {
+     const double *col[4], *v;
+     double *ll;
+     nztm_tow t;
+     size_t i;
+
+     if( nztm_tow_open( &t, argv[f] ) != 0 ) {
+        fprintf( stderr, "nztm_grid: %s is not a valid tow file\n", argv[f] );
+        return 1;
+        }
+     for( k = 0; k < 4; k++ ) col[k] = nztm_tow_double( &t, nztm_tow_column( &t, grid_cols[k] ) );
+     v = nztm_tow_double( &t, nztm_tow_column( &t, value ) );
+     if( ! col[0] || ! col[1] || ! col[2] || ! col[3] || ! v ) {
+        fprintf( stderr, "nztm_grid: %s lacks the tow or value columns\n", argv[f] );
+        return 1;
+        }
+     ll = (double *) malloc( 4*t.nrows*sizeof(double) );
+     for( k = 0; k < 4; k++ )
+        for( i = 0; i < t.nrows; i++ ) ll[k*t.nrows+i] = col[k][i]/rad2deg;
+
+     if( f == a + 1 && nztm_grid_open( &g, argv[a] ) != 0 ) {
+        double *n = (double *) malloc( 2*t.nrows*sizeof(double) ), *e = n + t.nrows;
+        box[0] = box[1] = HUGE_VAL;
+        box[2] = box[3] = -HUGE_VAL;
+        for( k = 0; k < 4; k += 2 ) {
+           geod_tm_hn( utm ? utm : &nztm_projection, ll + k*t.nrows,
+              ll + (k+1)*t.nrows, n, e, t.nrows );
+           for( i = 0; i < t.nrows; i++ ) {
+              if( e[i] < box[0] ) box[0] = e[i];
+              if( n[i] < box[1] ) box[1] = n[i];
+              if( e[i] > box[2] ) box[2] = e[i];
+              if( n[i] > box[3] ) box[3] = n[i];
+              }
+           }
+        free( n );
+        if( nztm_grid_create( &g, argv[a], utm, box, cell ) != 0 ) {
+           fprintf( stderr, "nztm_grid: cannot create %s\n", argv[a] );
+           return 1;
+           }
+        }
+
+     clock_gettime( CLOCK_MONOTONIC, &t0 );
+     if( nztm_grid_add( &g, ll, ll + t.nrows, ll + 2*t.nrows, ll + 3*t.nrows,
+            v, t.nrows, pool ) != 0 ) {
+        fprintf( stderr, "nztm_grid: out of memory\n" );
+        return 1;
+        }
+     clock_gettime( CLOCK_MONOTONIC, &t1 );
+     for( i = 0, total = 0.0; i < t.nrows; i++ ) if( ! isnan( v[i] ) ) total += v[i];
+     fprintf( stderr, "%s: %lu tows, total %s %.6g, in %.3f ms\n", argv[f],
+        (unsigned long) t.nrows, value, total,
+        ((t1.tv_sec - t0.tv_sec) + 1.0e-9*(t1.tv_nsec - t0.tv_nsec))*1.0e3 );
+     free( ll );
+     nztm_tow_close( &t );
+     }
+
+  for( c = 0, total = 0.0; c < (size_t) g.nx*g.ny; c++ ) total += g.band[NZTM_GRID_SUM][c];
+  fprintf( stderr, "%s: %d x %d cells of %g, total %s %.6g\n", argv[a],
+     g.nx, g.ny, g.cell, value, total );
+  nztm_grid_close( &g );
+  nztm_pool_destroy( pool );
+  tm_destroy( utm );
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef _NZTM_GRID_H
+#define _NZTM_GRID_H
+
+/* Gridding of tows onto a regular raster of a TM projection, for
+   example the catch of spring.csv in 1 km cells.
+
+   A tow runs in a straight line in the projection from its start
+   (kastad_breidd, kastad_lengd) to its end (hift_breidd, hift_lengd),
+   and its value is spread evenly along it: each cell it crosses
+   receives the value times the fraction of the tow's length within the
+   cell.  The cells crossed are found by walking the segment through the
+   grid (the digital differential analyser of Amanatides and Woo), so
+   the work is proportional to the number of cells crossed.  A tow with
+   no end, or of zero length, puts all of its value in the cell of its
+   start.  Tows with a NaN value or start are skipped, as are the parts
+   of tows outside the grid.
+
+   The raster is a file mapped read and write, so grids larger than
+   memory can be built and grids of several years accumulated by
+   reopening the file.  Each cell has the bands
+
+      NZTM_GRID_SUM      the sum of the values
+      NZTM_GRID_LENGTH   the length of tows within it (projection units)
+      NZTM_GRID_COUNT    the number of tows crossing it
+      NZTM_GRID_DENSITY  sum/length, the value per unit length towed
+                         (NaN where length is 0)
+
+   each an array of nx*ny doubles, row by row from the south west.
+
+   nztm_grid_add divides the tows into one slice for each thread of the
+   pool.  Each slice projects its tows in batches of NZTM_GRID_BATCH
+   and accumulates into tiles of NZTM_GRID_TILE cells square, allocated
+   as the slice first touches them, so memory is in proportion to the
+   area the tows cover rather than to the grid.  The tiles are then
+   added to the raster in the order of the slices, so the results
+   depend only on the tows and the size of the pool.  As with nztm_tow,
+   the nztm_grid structure is owned by the caller. */
+
+#include <stddef.h>
+
+#include "nztm.h"
+#include "nztm_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_GRID_SUM       0
+#define NZTM_GRID_LENGTH    1
+#define NZTM_GRID_COUNT     2
+#define NZTM_GRID_DENSITY   3
+#define NZTM_GRID_NBANDS    4
+
+#define NZTM_GRID_TILE      64
+#define NZTM_GRID_BATCH     1024
+#define NZTM_GRID_MAXCELLS  ((size_t) 1 << 32)
+
+typedef struct {
+        void *map;
+        size_t size;
+        int nx, ny;
+        double x0, y0;            /* South west corner (easting, northing) */
+        double cell;              /* Size of the cells */
+        double *band[NZTM_GRID_NBANDS];
+        const void *hdr;
+        } nztm_grid;
+
+/* Creates the file path with a grid over box (minimum easting, minimum
+   northing, maximum easting, maximum northing) of tm (NULL for NZTM),
+   rounded out to whole cells of size cell, with every cell empty, and
+   maps it.  nztm_grid_open maps an existing grid.  Each returns 0, or
+   -1 if the arguments are invalid or the file cannot be created or
+   mapped or is not a valid grid. */
+
+int nztm_grid_create( nztm_grid *g, const char *path,
+   const tmprojection *tm, const double box[4], double cell );
+int nztm_grid_open( nztm_grid *g, const char *path );
+void nztm_grid_close( nztm_grid *g );
+
+/* The projection of the grid, created with tm_create (free with
+   tm_destroy) */
+
+tmprojection *nztm_grid_projection( const nztm_grid *g );
+
+/* Adds count tows from (lt0,ln0) to (lt1,ln1) (radians; lt1 and ln1
+   may be NULL for tows without ends) with values value, using pool
+   (which may be NULL).  Returns 0, or -1 if memory cannot be
+   allocated, in which case the raster is unchanged. */
+
+int nztm_grid_add( nztm_grid *g, const double *lt0, const double *ln0,
+   const double *lt1, const double *ln1, const double *value,
+   size_t count, nztm_pool *pool );
+
+/* As nztm_grid_add for tows already projected onto the grid's
+   projection, from (n0,e0) to (n1,e1), for example by geod_tm_offload
+   (nztm_offload.h).  n1 and e1 may be NULL, or NaN for a tow without
+   an end. */
+
+int nztm_grid_add_projected( nztm_grid *g, const double *n0,
+   const double *e0, const double *n1, const double *e1,
+   const double *value, size_t count, nztm_pool *pool );
+
+/* Writes the raster to the file */
+
+int nztm_grid_sync( nztm_grid *g );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
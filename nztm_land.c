@@ -0,0 +1,485 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Land mask over coastline rings */
+
+#include "nztm_land.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LAND_MINCELLS  256
+#define LAND_MAXCELLS  (1 << 22)
+#define LAND_SPLIT     16         /* Edges for a cell to be refined */
+#define LAND_BLOCK     256        /* Points per pass of nztm_land_test */
+
+/* A grid over box.  Coastal cells with more than LAND_SPLIT edges are
+   refined by a grid of their own, covering the cell, in child. */
+
+struct nztm_land {
+        int nx, ny;
+        double x0, y0;            /* South west corner (lon, lat) */
+        double sx, sy;            /* Cells per degree */
+        double box[4];
+        unsigned char *mask;      /* NZTM_LAND_ bits of each cell */
+        uint32_t *start;          /* Edges of cell k are start[k]..start[k+1] */
+        double *edges;            /* ax, ay, bx, by of each */
+        nztm_land **child;        /* Refinement of each cell, or NULL */
+        const nztm_allocator *al; /* Of this grid and its refinements */
+        };
+
+/* Parity of the number of edges i0..i1 crossing the segment from
+   (px,py) to (cx,cy).  A vertex exactly on the segment counts as being
+   to its left, so that the two edges meeting there are counted
+   consistently.  Most edges of a cell are rejected by the first test,
+   as they do not reach across the line through the segment. */
+
+static int land_cross( const nztm_land *l, size_t i0, size_t i1,
+   double px, double py, double cx, double cy ) {
+    const double *e = l->edges + 4*i0;
+    double dx = cx - px;
+    double dy = cy - py;
+    double d1, d2, d3, d4;
+    int parity = 0;
+    size_t i;
+
+    for( i = i0; i < i1; i++, e += 4 ) {
+        d3 = dx*(e[1] - py) - dy*(e[0] - px);
+        d4 = dx*(e[3] - py) - dy*(e[2] - px);
+        if( (d3 > 0.0) == (d4 > 0.0) ) continue;
+        d1 = (e[2] - e[0])*(py - e[1]) - (e[3] - e[1])*(px - e[0]);
+        d2 = (e[2] - e[0])*(cy - e[1]) - (e[3] - e[1])*(cx - e[0]);
+        parity ^= (d1 > 0.0) != (d2 > 0.0);
+        }
+    return parity;
+    }
+
+/* Cell index of (lon,lat), or -1 outside the grid */
+
+static long land_cell( const nztm_land *l, double lat, double lon ) {
+    double fx = (lon - l->x0)*l->sx;
+    double fy = (lat - l->y0)*l->sy;
+
+    if( ! ( fx >= 0.0 && fx < l->nx && fy >= 0.0 && fy < l->ny ) ) return -1;
+    return (long) fy*l->nx + (long) fx;
+    }
+
+static void land_centre( const nztm_land *l, long k, double *cx, double *cy ) {
+    *cx = l->x0 + ((int) (k % l->nx) + 0.5)/l->sx;
+    *cy = l->y0 + ((int) (k / l->nx) + 0.5)/l->sy;
+    }
+
+/* The status of a point in coastal cell k */
+
+static int land_coastal( const nztm_land *l, long k, double lat, double lon ) {
+    const nztm_land *c = l->child ? l->child[k] : NULL;
+    double cx, cy, fx, fy;
+    int ix, iy;
+
+    if( c ) {
+
+        /* The point is in the refined grid, up to rounding */
+
+        fx = (lon - c->x0)*c->sx;
+        fy = (lat - c->y0)*c->sy;
+        ix = fx <= 0.0 ? 0 : fx >= c->nx ? c->nx - 1 : (int) fx;
+        iy = fy <= 0.0 ? 0 : fy >= c->ny ? c->ny - 1 : (int) fy;
+        k = (long) iy*c->nx + ix;
+        if( ! ( c->mask[k] & NZTM_LAND_COAST ) )
+            return c->mask[k] & NZTM_LAND_CENTRE;
+        l = c;
+        }
+    land_centre( l, k, &cx, &cy );
+    return (l->mask[k] & NZTM_LAND_CENTRE) ^
+        land_cross( l, l->start[k], l->start[k+1], lon, lat, cx, cy );
+    }
+
+static int land_dcmp( const void *a, const void *b ) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+    }
+
+/* Range of cells covered by [v0,v1] on an axis of n cells from o with
+   s per unit */
+
+static void land_span( double v0, double v1, double o, double s, int n,
+   int *i0, int *i1 ) {
+    double t;
+
+    if( v1 < v0 ) { t = v0; v0 = v1; v1 = t; }
+    *i0 = (int) floor( (v0 - o)*s );
+    *i1 = (int) floor( (v1 - o)*s );
+    if( *i0 < 0 ) *i0 = 0;
+    if( *i1 > n - 1 ) *i1 = n - 1;
+    }
+
+/* Sets up the grid of l over its box with about cells cells, and
+   buckets the ne edges e (ax, ay, bx, by of each) in it.  Returns 0, or
+   -1 if memory cannot be allocated. */
+
+static int land_grid( nztm_land *l, const double *e, size_t ne, size_t cells,
+   double scale ) {
+    uint32_t *fill;
+    size_t ncell, i, k;
+    int ix, iy, ix0, ix1, iy0, iy1;
+    double w, h;
+
+    w = l->box[3] - l->box[1];
+    h = l->box[2] - l->box[0];
+    if( w <= 0.0 ) w = 1.0e-6;
+    if( h <= 0.0 ) h = 1.0e-6;
+    l->nx = (int) ceil( sqrt( cells*w/h ) );
+    if( l->nx < 1 ) l->nx = 1;
+    if( (size_t) l->nx > cells ) l->nx = (int) cells;
+    l->ny = (int) ((cells + l->nx - 1)/l->nx);
+    l->x0 = l->box[1];
+    l->y0 = l->box[0];
+    l->sx = l->nx/(w*scale);
+    l->sy = l->ny/(h*scale);
+    ncell = (size_t) l->nx*l->ny;
+
+    l->mask = (unsigned char *) nztm_zalloc( l->al, ncell );
+    l->start = (uint32_t *) nztm_zalloc( l->al, (ncell + 1)*sizeof(uint32_t) );
+    fill = (uint32_t *) nztm_alloc( l->al, (ncell + 1)*sizeof(uint32_t) );
+    if( ! l->mask || ! l->start || ! fill ) {
+        nztm_free( l->al, fill );
+        return -1;
+        }
+
+    /* Bucket each edge in the cells its bounding box covers */
+
+    for( i = 0; i < ne; i++ ) {
+        land_span( e[4*i], e[4*i+2], l->x0, l->sx, l->nx, &ix0, &ix1 );
+        land_span( e[4*i+1], e[4*i+3], l->y0, l->sy, l->ny, &iy0, &iy1 );
+        for( iy = iy0; iy <= iy1; iy++ )
+            for( ix = ix0; ix <= ix1; ix++ )
+                l->start[(size_t) iy*l->nx + ix + 1]++;
+        }
+    for( k = 0; k < ncell; k++ ) {
+        l->start[k+1] += l->start[k];
+        fill[k] = l->start[k];
+        if( l->start[k+1] > l->start[k] ) l->mask[k] = NZTM_LAND_COAST;
+        }
+    l->edges = (double *) nztm_alloc( l->al,
+        (4*(size_t) l->start[ncell] + 1)*sizeof(double) );
+    if( ! l->edges ) { nztm_free( l->al, fill ); return -1; }
+    for( i = 0; i < ne; i++ ) {
+        land_span( e[4*i], e[4*i+2], l->x0, l->sx, l->nx, &ix0, &ix1 );
+        land_span( e[4*i+1], e[4*i+3], l->y0, l->sy, l->ny, &iy0, &iy1 );
+        for( iy = iy0; iy <= iy1; iy++ ) {
+            for( ix = ix0; ix <= ix1; ix++ ) {
+                k = fill[(size_t) iy*l->nx + ix]++;
+                memcpy( l->edges + 4*k, e + 4*i, 4*sizeof(double) );
+                }
+            }
+        }
+    nztm_free( l->al, fill );
+    return 0;
+    }
+
+/* Refines the coastal cells of l having more than LAND_SPLIT edges.
+   The status of the centre of each refined cell is that of the centre
+   of the cell it is in, changed by the crossings between them. */
+
+static int land_refine( nztm_land *l ) {
+    size_t ncell = (size_t) l->nx*l->ny;
+    size_t k, m;
+    double cx, cy, sx, sy;
+    nztm_land *c;
+    long kk;
+
+    for( k = 0; k < ncell; k++ ) {
+        m = l->start[k+1] - l->start[k];
+        if( m <= LAND_SPLIT ) continue;
+        if( ! l->child && ! ( l->child = (nztm_land **)
+                nztm_zalloc( l->al, ncell*sizeof(nztm_land *) ) ) )
+            return -1;
+        c = l->child[k] = (nztm_land *) nztm_zalloc( l->al, sizeof(nztm_land) );
+        if( ! c ) return -1;
+        c->al = l->al;
+        c->box[0] = l->y0 + (double) (k / l->nx)/l->sy;
+        c->box[1] = l->x0 + (double) (k % l->nx)/l->sx;
+        c->box[2] = l->y0 + (double) (k / l->nx + 1)/l->sy;
+        c->box[3] = l->x0 + (double) (k % l->nx + 1)/l->sx;
+        if( land_grid( c, l->edges + 4*(size_t) l->start[k], m, 4*m,
+                1.0 ) != 0 )
+            return -1;
+        land_centre( l, (long) k, &cx, &cy );
+        for( kk = 0; kk < (long) c->nx*c->ny; kk++ ) {
+            land_centre( c, kk, &sx, &sy );
+            if( (l->mask[k] & NZTM_LAND_CENTRE) ^
+                land_cross( l, l->start[k], l->start[k+1], sx, sy, cx, cy ) )
+                c->mask[kk] |= NZTM_LAND_CENTRE;
+            }
+        }
+    return 0;
+    }
+
+nztm_land *nztm_land_create( const nztm_coast *c, size_t cells )
+{
+   return nztm_land_create_a( c, cells, NULL );
+}
+
+nztm_land *nztm_land_create_a( const nztm_coast *c, size_t cells,
+   const nztm_allocator *al )
+{
+   nztm_land *l;
+   double *e = NULL;
+   double *xs = NULL;
+   size_t ne = 0, i, j, nxs;
+   const nztm_ring *r;
+   double yc, x;
+   int p, ix, iy;
+   int inside;
+
+   l = (nztm_land *) nztm_zalloc( al, sizeof(nztm_land) );
+   if( ! l ) return NULL;
+   l->al = al;
+
+   /* Collect the edges and their extent, in (lon, lat) */
+
+   for( p = 0; p < c->nparts; p++ ) ne += c->part[p].n;
+   e = (double *) nztm_alloc( al, (4*ne + 1)*sizeof(double) );
+   if( ! e ) goto fail;
+   l->box[0] = l->box[1] = HUGE_VAL;
+   l->box[2] = l->box[3] = -HUGE_VAL;
+   ne = 0;
+   for( p = 0; p < c->nparts; p++ ) {
+      r = &c->part[p];
+      for( i = 0; i < r->n; i++ ) {
+         j = i + 1 < r->n ? i + 1 : 0;
+         if( r->lat[i] < l->box[0] ) l->box[0] = r->lat[i];
+         if( r->lon[i] < l->box[1] ) l->box[1] = r->lon[i];
+         if( r->lat[i] > l->box[2] ) l->box[2] = r->lat[i];
+         if( r->lon[i] > l->box[3] ) l->box[3] = r->lon[i];
+         if( r->lat[i] == r->lat[j] && r->lon[i] == r->lon[j] ) continue;
+         e[4*ne] = r->lon[i];
+         e[4*ne+1] = r->lat[i];
+         e[4*ne+2] = r->lon[j];
+         e[4*ne+3] = r->lat[j];
+         ne++;
+         }
+      }
+   if( ne == 0 ) goto fail;
+
+   /* A grid of roughly square cells (in degrees), slightly larger than
+      the extent so that its north and east edges are inside */
+
+   if( cells == 0 ) cells = 8*ne;
+   if( cells < LAND_MINCELLS ) cells = LAND_MINCELLS;
+   if( cells > LAND_MAXCELLS ) cells = LAND_MAXCELLS;
+   if( land_grid( l, e, ne, cells, 1.0 + 1.0e-9 ) != 0 ) goto fail;
+
+   /* The status of each cell centre, from the crossings of the
+      horizontal line through the centres of its row */
+
+   xs = (double *) nztm_alloc( al, (ne + 1)*sizeof(double) );
+   if( ! xs ) goto fail;
+   for( iy = 0; iy < l->ny; iy++ ) {
+      yc = l->y0 + (iy + 0.5)/l->sy;
+      for( i = 0, nxs = 0; i < ne; i++ ) {
+         if( (e[4*i+1] > yc) == (e[4*i+3] > yc) ) continue;
+         x = e[4*i] + (yc - e[4*i+1])*(e[4*i+2] - e[4*i])/(e[4*i+3] - e[4*i+1]);
+         xs[nxs++] = x;
+         }
+      qsort( xs, nxs, sizeof(double), land_dcmp );
+      inside = 0;
+      for( ix = 0, j = 0; ix < l->nx; ix++ ) {
+         x = l->x0 + (ix + 0.5)/l->sx;
+         while( j < nxs && xs[j] < x ) { inside ^= 1; j++; }
+         if( inside ) l->mask[(size_t) iy*l->nx + ix] |= NZTM_LAND_CENTRE;
+         }
+      }
+   if( land_refine( l ) != 0 ) goto fail;
+
+   nztm_free( al, e );
+   nztm_free( al, xs );
+   return l;
+
+fail:
+   nztm_free( al, e );
+   nztm_free( al, xs );
+   nztm_land_destroy( l );
+   return NULL;
+}
+
+void nztm_land_destroy( nztm_land *l )
+{
+   size_t k;
+
+   if( ! l ) return;
+   if( l->child )
+      for( k = 0; k < (size_t) l->nx*l->ny; k++ )
+         nztm_land_destroy( l->child[k] );
+   nztm_free( l->al, l->child );
+   nztm_free( l->al, l->mask );
+   nztm_free( l->al, l->start );
+   nztm_free( l->al, l->edges );
+   nztm_free( l->al, l );
+}
+
+int nztm_land_point( const nztm_land *l, double lat, double lon )
+{
+   long k = land_cell( l, lat, lon );
+
+   if( k < 0 ) return 0;
+   if( ! ( l->mask[k] & NZTM_LAND_COAST ) )
+      return l->mask[k] & NZTM_LAND_CENTRE;
+   return land_coastal( l, k, lat, lon );
+}
+
+/* Points are classified a block at a time: first every point from the
+   raster, in a loop without branches, then the few in coastal cells
+   from their edges */
+
+size_t nztm_land_test( const nztm_land *l, const double *lat,
+   const double *lon, unsigned char *out, size_t count )
+{
+   int32_t cell[LAND_BLOCK];
+   double fx, fy;
+   size_t nland = 0;
+   size_t b, i, n;
+   int in;
+
+   for( b = 0; b < count; b += n ) {
+      n = count - b < LAND_BLOCK ? count - b : LAND_BLOCK;
+      for( i = 0; i < n; i++ ) {
+         fx = (lon[b+i] - l->x0)*l->sx;
+         fy = (lat[b+i] - l->y0)*l->sy;
+         in = fx >= 0.0 && fx < l->nx && fy >= 0.0 && fy < l->ny;
+         cell[i] = in ? (int32_t) fy*l->nx + (int32_t) fx : -1;
+         }
+      for( i = 0; i < n; i++ ) {
+         unsigned char m = cell[i] < 0 ? 0 : l->mask[cell[i]];
+         out[b+i] = m & NZTM_LAND_CENTRE;
+         if( m & NZTM_LAND_COAST )
+            out[b+i] = (unsigned char)
+               land_coastal( l, cell[i], lat[b+i], lon[b+i] );
+         nland += out[b+i];
+         }
+      }
+   return nland;
+}
+
+size_t nztm_land_coarse( const nztm_land *l, const double *lat,
+   const double *lon, unsigned char *out, size_t count )
+{
+   size_t nland = 0;
+   size_t i;
+   long k;
+
+   for( i = 0; i < count; i++ ) {
+      k = land_cell( l, lat[i], lon[i] );
+      out[i] = k < 0 ? 0 : l->mask[k] & NZTM_LAND_CENTRE;
+      nland += out[i];
+      }
+   return nland;
+}
+
+const unsigned char *nztm_land_mask( const nztm_land *l, int *nx, int *ny,
+   double box[4] )
+{
+   *nx = l->nx;
+   *ny = l->ny;
+   if( box ) {
+      box[0] = l->y0;
+      box[1] = l->x0;
+      box[2] = l->y0 + l->ny/l->sy;
+      box[3] = l->x0 + l->nx/l->sx;
+      }
+   return l->mask;
+}
+
+#ifdef TEST_NZTM_LAND
+
+/* Checks nztm_land_test against a crossing number test over all edges
+   for random points in the extent of each coastline file given, and
+   times it */
+
+#include <stdio.h>
+#include <time.h>
+
+static double test_now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+    }
+
+static int test_slow( const nztm_coast *c, double lat, double lon ) {
+    const nztm_ring *r;
+    size_t i, j;
+    int p, inside = 0;
+
+    for( p = 0; p < c->nparts; p++ ) {
+        r = &c->part[p];
+        for( i = 0; i < r->n; i++ ) {
+            j = i + 1 < r->n ? i + 1 : 0;
+            if( (r->lat[i] > lat) != (r->lat[j] > lat) &&
+                lon < r->lon[i] + (lat - r->lat[i])*(r->lon[j] - r->lon[i])/
+                                  ((double) r->lat[j] - r->lat[i]) )
+                inside ^= 1;
+            }
+        }
+    return inside;
+    }
+
+int main( int argc, char *argv[] ) {
+  size_t n = 4000000, ncheck = 20000, i, nland, nbad, ncoarse;
+  double *lat = (double *) malloc( 2*n*sizeof(double) );
+  double *lon = lat + n;
+  unsigned char *out = (unsigned char *) malloc( 2*n );
+  unsigned char *out2 = out + n;
+  const unsigned char *mask;
+  double box[4], t0, t1, t2;
+  nztm_coast c;
+  nztm_land *l;
+  int a, nx, ny, bad = 0;
+
+  for( a = 1; a < argc; a++ ) {
+     if( nztm_coast_open( &c, argv[a] ) != 0 ) {
+        printf( "cannot open %s\n", argv[a] );
+        continue;
+        }
+     t0 = test_now();
+     l = nztm_land_create( &c, 0 );
+     t1 = test_now();
+     mask = nztm_land_mask( l, &nx, &ny, box );
+     for( i = 0, nland = 0; i < (size_t) nx*ny; i++ )
+        nland += (mask[i] & NZTM_LAND_COAST) != 0;
+     printf( "%s: %lu points, %d x %d grid (%lu coastal) built in %.3f s\n",
+        argv[a], (unsigned long) c.npoints, nx, ny, (unsigned long) nland,
+        t1 - t0 );
+
+     for( i = 0; i < n; i++ ) {
+        lat[i] = box[0] - 0.1
+           + (box[2] - box[0] + 0.2)*(rand()/(RAND_MAX + 1.0));
+        lon[i] = box[1] - 0.1
+           + (box[3] - box[1] + 0.2)*(rand()/(RAND_MAX + 1.0));
+        }
+     t0 = test_now();
+     nland = nztm_land_test( l, lat, lon, out, n );
+     t1 = test_now();
+     ncoarse = nztm_land_coarse( l, lat, lon, out2, n );
+     t2 = test_now();
+     for( i = 0, nbad = 0; i < ncheck; i++ ) {
+        if( out[i] != test_slow( &c, lat[i], lon[i] ) ) nbad++;
+        if( out[i] != nztm_land_point( l, lat[i], lon[i] ) ) nbad++;
+        }
+     printf( "  %.1f%% on land, %lu of %lu differ from a full crossing test\n",
+        100.0*nland/n, (unsigned long) nbad, (unsigned long) ncheck );
+     printf( "  exact %.1f Mpoint/s, coarse %.1f Mpoint/s (%.2f%% differ)\n",
+        n/(t1 - t0)*1.0e-6, n/(t2 - t1)*1.0e-6,
+        100.0*((double) ncoarse - nland)/n );
+     bad |= nbad != 0;
+     nztm_land_destroy( l );
+     nztm_coast_close( &c );
+     }
+  free( lat );
+  free( out );
+  return bad;
+  }
+
+#endif
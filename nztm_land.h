@@ -0,0 +1,68 @@
+#ifndef _NZTM_LAND_H
+#define _NZTM_LAND_H
+
+/* Land mask: whether points are inside the coastline rings of an
+   nztm_coast file, such as island.bin or newzealand.bin.
+
+   nztm_land_create divides the extent of the rings into a grid of
+   cells (about cells of them; 0 for a default) and records for each
+   the edges passing through it and whether its centre is on land.  A
+   point in a cell with no edges has the status of the centre; in a
+   cell with edges it has that status changed by each edge crossed by
+   the segment from the point to the centre.  Cells crossed by many
+   edges are refined in the same way by a grid of their own.  Only the
+   few edges of one cell are ever examined, and most points are
+   answered by a single look up.  Points are on land if inside an odd
+   number of rings, with each ring closed from its last point to its
+   first.
+
+   The grid can also be used on its own as a raster mask for coarse
+   queries, without reference to the edges. */
+
+#include <stddef.h>
+
+#include "nztm_arena.h"
+#include "nztm_coast.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bits of the raster mask cells */
+
+#define NZTM_LAND_CENTRE  1       /* The centre of the cell is on land */
+#define NZTM_LAND_COAST   2       /* The coastline passes through it */
+
+typedef struct nztm_land nztm_land;
+
+/* Returns NULL if memory cannot be allocated or c has no edges.
+   nztm_land_create_a takes the memory of the mask from al (nztm_arena.h),
+   which must outlive it. */
+
+nztm_land *nztm_land_create( const nztm_coast *c, size_t cells );
+nztm_land *nztm_land_create_a( const nztm_coast *c, size_t cells,
+   const nztm_allocator *al );
+void nztm_land_destroy( nztm_land *l );
+
+/* Sets out[i] to 1 for each point (lat[i],lon[i]) (degrees) on land and
+   0 otherwise, returning the number on land.  nztm_land_coarse uses
+   the raster only, answering for each point the status of the centre
+   of its cell. */
+
+int nztm_land_point( const nztm_land *l, double lat, double lon );
+size_t nztm_land_test( const nztm_land *l, const double *lat,
+   const double *lon, unsigned char *out, size_t count );
+size_t nztm_land_coarse( const nztm_land *l, const double *lat,
+   const double *lon, unsigned char *out, size_t count );
+
+/* The raster: nx by ny cells of NZTM_LAND_ bits, row by row from the
+   south west corner, covering box (south, west, north, east) */
+
+const unsigned char *nztm_land_mask( const nztm_land *l, int *nx, int *ny,
+   double box[4] );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
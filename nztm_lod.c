@@ -0,0 +1,425 @@
+/* Level of detail pyramid of coastline rings.  Needs POSIX mmap.
+
+   The file is
+
+      header           lod_header
+      boxes            double[4*nrings], minx miny maxx maxy
+      offsets          uint64[(nrings+1)*nlevels]
+      points           double[2*npoints], easting northing
+
+   where the points of ring r at level l run from offsets[(nrings+1)*l+r]
+   to offsets[(nrings+1)*l+r+1], the levels following one another.
+
+   Each ring is simplified once: every point is given the largest
+   tolerance at which Douglas-Peucker keeps it, capped by that of the
+   point that split the span it lies in, and a level keeps the points
+   whose value exceeds its tolerance.  That is exactly the result of
+   Douglas-Peucker at that tolerance, so the levels are nested and all
+   are found in the time of one simplification. */
+
+#include "nztm_lod.h"
+
+#include "tmproj.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOD_MAGIC     "NZTMLOD1"
+#define LOD_VERSION   1
+
+typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t nlevels;
+        uint32_t nrings;
+        uint32_t pad;
+        uint64_t npoints;         /* Over all levels */
+        double tolerance[NZTM_LOD_MAXLEVELS];
+        } lod_header;
+
+static const double lod_default[] = { 0.0, 5.0, 20.0, 80.0, 320.0, 1280.0, 5120.0 };
+
+/* Distance of point p from the segment a-b */
+
+static double lod_dist( const double *p, const double *a, const double *b ) {
+    double dx = b[0] - a[0], dy = b[1] - a[1];
+    double px = p[0] - a[0], py = p[1] - a[1];
+    double l2 = dx*dx + dy*dy, t;
+
+    if( l2 > 0.0 ) {
+        t = (px*dx + py*dy)/l2;
+        if( t > 1.0 ) t = 1.0;
+        if( t > 0.0 ) { px -= t*dx; py -= t*dy; }
+        }
+    return sqrt( px*px + py*py );
+    }
+
+/* Sets imp[i] for the n points of a closed ring xy.  The first point and
+   the one farthest from it are always kept; the spans between them are
+   split in turn, point n standing for point 0.  stack has room for 2n
+   spans. */
+
+static void lod_ring( const double *xy, size_t n, double *imp, size_t *stack ) {
+    size_t sp = 0, i, j, k, m;
+    double d, best, cap;
+
+    for( i = 0; i < n; i++ ) imp[i] = 0.0;
+    for( i = 1, k = 0, best = -1.0; i < n; i++ ) {
+        d = lod_dist( xy + 2*i, xy, xy );
+        if( d > best ) { best = d; k = i; }
+        }
+    imp[0] = HUGE_VAL;
+    if( n < 2 ) return;
+    imp[k] = HUGE_VAL;
+    stack[sp++] = 0; stack[sp++] = k;
+    stack[sp++] = k; stack[sp++] = n;
+
+    while( sp > 0 ) {
+        j = stack[--sp];
+        i = stack[--sp];
+        if( j - i < 2 ) continue;
+        cap = i == 0 ? imp[j % n] : imp[i] < imp[j % n] ? imp[i] : imp[j % n];
+        for( m = i + 1, k = m, best = -1.0; m < j; m++ ) {
+            d = lod_dist( xy + 2*m, xy + 2*i, xy + 2*(j % n) );
+            if( d > best ) { best = d; k = m; }
+            }
+        imp[k] = best < cap ? best : cap;
+        stack[sp++] = i; stack[sp++] = k;
+        stack[sp++] = k; stack[sp++] = j;
+        }
+    }
+
+/* Number of points of a ring kept at tolerance tol, 0 if fewer than 3 */
+
+static size_t lod_count( const double *imp, size_t n, double tol ) {
+    size_t i, k = 0;
+
+    if( tol <= 0.0 ) return n;
+    for( i = 0; i < n; i++ ) k += imp[i] > tol;
+    return k < 3 ? 0 : k;
+    }
+
+int nztm_lod_build( const nztm_coast *c, const tmprojection *tm,
+   const double *tol, int nlevels, const char *path )
+{
+   double *xy = NULL, *imp = NULL, *box = NULL;
+   uint64_t *offset = NULL;
+   size_t *stack = NULL;
+   size_t *first = NULL;
+   size_t i, j, k, cnt, maxn = 0;
+   const nztm_ring *r;
+   lod_header h;
+   FILE *f = NULL;
+   int l, p, ok = 0;
+
+   if( ! tm ) tm = &nztm_projection;
+   if( ! tol && nlevels == 0 ) {
+      tol = lod_default;
+      nlevels = (int) (sizeof(lod_default)/sizeof(lod_default[0]));
+      }
+   if( ! tol || nlevels < 1 || nlevels > NZTM_LOD_MAXLEVELS || c->nparts < 1 )
+      return -1;
+   for( l = 1; l < nlevels; l++ ) if( ! ( tol[l] > tol[l-1] ) ) return -1;
+
+   for( p = 0; p < c->nparts; p++ )
+      if( c->part[p].n > maxn ) maxn = c->part[p].n;
+   xy = (double *) malloc( 2*c->npoints*sizeof(double) );
+   imp = (double *) malloc( c->npoints*sizeof(double) );
+   box = (double *) malloc( 4*(size_t) c->nparts*sizeof(double) );
+   first = (size_t *) malloc( ((size_t) c->nparts + 1)*sizeof(size_t) );
+   offset = (uint64_t *) malloc( ((size_t) c->nparts + 1)*nlevels*sizeof(uint64_t) );
+   stack = (size_t *) malloc( 4*maxn*sizeof(size_t) + 4*sizeof(size_t) );
+   if( ! xy || ! imp || ! box || ! first || ! offset || ! stack ) goto done;
+
+   /* Project and simplify each ring */
+
+   for( p = 0, k = 0; p < c->nparts; p++ ) {
+      r = &c->part[p];
+      first[p] = k;
+      geod_tm_deg_fd( tm, NZTM_REDFEARN, r->lat, r->lon, 1, xy + 2*k + 1,
+         xy + 2*k, 2, r->n );
+      box[4*p] = box[4*p+2] = xy[2*k];
+      box[4*p+1] = box[4*p+3] = xy[2*k+1];
+      for( i = 1; i < r->n; i++ ) {
+         const double *q = xy + 2*(k+i);
+         if( q[0] < box[4*p] ) box[4*p] = q[0];
+         if( q[1] < box[4*p+1] ) box[4*p+1] = q[1];
+         if( q[0] > box[4*p+2] ) box[4*p+2] = q[0];
+         if( q[1] > box[4*p+3] ) box[4*p+3] = q[1];
+         }
+      lod_ring( xy + 2*k, r->n, imp + k, stack );
+      k += r->n;
+      }
+   first[c->nparts] = k;
+
+   /* Offsets of the rings at each level */
+
+   for( l = 0, k = 0; l < nlevels; l++ ) {
+      for( p = 0; p < c->nparts; p++ ) {
+         offset[(c->nparts + 1)*l + p] = k;
+         k += lod_count( imp + first[p], c->part[p].n, tol[l] );
+         }
+      offset[(c->nparts + 1)*l + c->nparts] = k;
+      }
+
+   memset( &h, 0, sizeof(h) );
+   memcpy( h.magic, LOD_MAGIC, 8 );
+   h.version = LOD_VERSION;
+   h.nlevels = (uint32_t) nlevels;
+   h.nrings = (uint32_t) c->nparts;
+   h.npoints = k;
+   for( l = 0; l < nlevels; l++ ) h.tolerance[l] = tol[l];
+
+   f = fopen( path, "wb" );
+   if( ! f ) goto done;
+   ok = fwrite( &h, sizeof(h), 1, f ) == 1 &&
+        fwrite( box, 4*sizeof(double), c->nparts, f ) == (size_t) c->nparts &&
+        fwrite( offset, sizeof(uint64_t)*(c->nparts + 1), nlevels, f ) == (size_t) nlevels;
+
+   for( l = 0; ok && l < nlevels; l++ )
+      for( p = 0; ok && p < c->nparts; p++ ) {
+         cnt = offset[(c->nparts + 1)*l + p + 1] - offset[(c->nparts + 1)*l + p];
+         k = first[p];
+         if( cnt == c->part[p].n )
+            ok = fwrite( xy + 2*k, 2*sizeof(double), cnt, f ) == cnt;
+         else if( cnt > 0 )               /* Else dropped, lod_count */
+            for( j = 0; ok && j < c->part[p].n; j++ )
+               if( imp[k+j] > tol[l] )
+                  ok = fwrite( xy + 2*(k+j), 2*sizeof(double), 1, f ) == 1;
+         }
+   if( fclose( f ) != 0 ) ok = 0;
+
+done:
+   free( xy );
+   free( imp );
+   free( box );
+   free( first );
+   free( offset );
+   free( stack );
+   return ok ? 0 : -1;
+}
+
+/* Checks the header and offsets of a mapped file */
+
+static int lod_check( const void *map, size_t size ) {
+    const lod_header *h = (const lod_header *) map;
+    const uint64_t *off;
+    uint64_t nr, no, prev;
+    size_t i;
+
+    if( size < sizeof(lod_header) || memcmp( h->magic, LOD_MAGIC, 8 ) != 0 ||
+        h->version != LOD_VERSION || h->nlevels < 1 ||
+        h->nlevels > NZTM_LOD_MAXLEVELS || h->nrings < 1 ) return -1;
+    nr = h->nrings;
+    no = (nr + 1)*h->nlevels;
+    if( h->npoints > size/16 ||
+        sizeof(lod_header) + 32*nr + 8*no + 16*h->npoints != size ) return -1;
+
+    /* Offsets must run from 0 to npoints without a break */
+
+    off = (const uint64_t *) ((const char *) map + sizeof(lod_header) + 32*nr);
+    for( i = 0, prev = 0; i < no; i++ ) {
+        if( off[i] < prev || ( i % (nr + 1) == 0 && off[i] != prev ) ) return -1;
+        prev = off[i];
+        }
+    return prev == h->npoints ? 0 : -1;
+    }
+
+int nztm_lod_open( nztm_lod *l, const char *path )
+{
+   const lod_header *h;
+   struct stat st;
+   void *map;
+   int fd;
+
+   l->map = NULL;
+   l->nlevels = l->nrings = 0;
+   fd = open( path, O_RDONLY );
+   if( fd < 0 ) return -1;
+   if( fstat( fd, &st ) != 0 || st.st_size <= 0 ) { close( fd ); return -1; }
+   map = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+   close( fd );
+   if( map == MAP_FAILED ) return -1;
+
+   if( lod_check( map, (size_t) st.st_size ) != 0 ) {
+      munmap( map, (size_t) st.st_size );
+      return -1;
+      }
+   h = (const lod_header *) map;
+   l->map = map;
+   l->size = (size_t) st.st_size;
+   l->nlevels = (int) h->nlevels;
+   l->nrings = (int) h->nrings;
+   l->tolerance = h->tolerance;
+   l->box = (const double *) (h + 1);
+   l->offset = (const uint64_t *) (l->box + 4*h->nrings);
+   l->xy = (const double *) (l->offset + (h->nrings + 1)*(uint64_t) h->nlevels);
+   return 0;
+}
+
+void nztm_lod_close( nztm_lod *l )
+{
+   if( l->map ) munmap( l->map, l->size );
+   l->map = NULL;
+   l->nlevels = l->nrings = 0;
+}
+
+int nztm_lod_level( const nztm_lod *l, double tol )
+{
+   int k = 0;
+
+   while( k + 1 < l->nlevels && l->tolerance[k+1] <= tol ) k++;
+   return k;
+}
+
+size_t nztm_lod_ring( const nztm_lod *l, int level, int r, const double **xy )
+{
+   const uint64_t *off = l->offset + (size_t) (l->nrings + 1)*level + r;
+
+   *xy = l->xy + 2*off[0];
+   return (size_t) (off[1] - off[0]);
+}
+
+size_t nztm_lod_points( const nztm_lod *l, int level )
+{
+   const uint64_t *off = l->offset + (size_t) (l->nrings + 1)*level;
+
+   return (size_t) (off[l->nrings] - off[0]);
+}
+
+#ifdef NZTM_LOD_TOOL
+
+/* Builder and lister.  Build with
+      cc -O2 -DNZTM_LOD_TOOL -o nztm_lod nztm_lod.c nztm_coast.c nztm.c nztm_simd.c -lm
+   and run as
+      nztm_lod [-utm zone] [-t tol,tol,...] newzealand.bin newzealand.lod
+   to build a pyramid (NZTM by default), or as
+      nztm_lod -l file.lod
+   to list its levels. */
+
+int main( int argc, char *argv[] ) {
+  double tol[NZTM_LOD_MAXLEVELS];
+  tmprojection *utm = NULL;
+  int nlevels = 0, i = 1, k, r;
+  nztm_coast c;
+  nztm_lod l;
+  char *p;
+
+  if( argc == 3 && strcmp( argv[1], "-l" ) == 0 ) {
+     if( nztm_lod_open( &l, argv[2] ) != 0 ) {
+        fprintf( stderr, "nztm_lod: %s is not a valid pyramid\n", argv[2] );
+        return 1;
+        }
+     printf( "%d rings, %d levels, %zu bytes\n", l.nrings, l.nlevels, l.size );
+     for( k = 0; k < l.nlevels; k++ ) {
+        for( r = 0, i = 0; r < l.nrings; r++ ) {
+           const double *xy;
+           i += nztm_lod_ring( &l, k, r, &xy ) > 0;
+           }
+        printf( "  level %2d  tolerance %8.1f m  %8zu points  %4d rings\n", k,
+           l.tolerance[k], nztm_lod_points( &l, k ), i );
+        }
+     nztm_lod_close( &l );
+     return 0;
+     }
+
+  for( ; i < argc - 2; i++ ) {
+     if( strcmp( argv[i], "-utm" ) == 0 && i + 1 < argc - 2 ) {
+        int zone = atoi( argv[++i] );
+        utm = tm_create( NZTM_A, NZTM_RF, (6.0*zone - 183.0)/rad2deg, 0.9996,
+           0.0, 500000.0, 0.0, 1.0 );
+        }
+     else if( strcmp( argv[i], "-t" ) == 0 && i + 1 < argc - 2 ) {
+        for( p = argv[++i]; nlevels < NZTM_LOD_MAXLEVELS; p++ ) {
+           tol[nlevels++] = strtod( p, &p );
+           if( *p != ',' ) break;
+           }
+        }
+     else break;
+     }
+  if( i != argc - 2 ) {
+     fprintf( stderr, "usage: nztm_lod [-utm zone] [-t tol,...] in.bin out.lod\n"
+                      "       nztm_lod -l file.lod\n" );
+     return 1;
+     }
+  if( nztm_coast_open( &c, argv[i] ) != 0 ) {
+     fprintf( stderr, "nztm_lod: %s is not a coastline file\n", argv[i] );
+     return 1;
+     }
+  k = nztm_lod_build( &c, utm, nlevels ? tol : NULL, nlevels, argv[i+1] );
+  if( k != 0 ) fprintf( stderr, "nztm_lod: cannot build %s\n", argv[i+1] );
+  nztm_coast_close( &c );
+  if( utm ) tm_destroy( utm );
+  return k != 0;
+  }
+
+#endif
+
+#ifdef TEST_NZTM_LOD
+
+/* Builds the default pyramid and a coarse one, whose tolerances leave
+   most rings fewer than three points and so drop them, from each
+   coastline file given, and checks that each opens with every ring of
+   every level empty or of at least three points inside its box.
+   Build with
+      cc -O2 -DTEST_NZTM_LOD nztm_lod.c nztm_coast.c nztm.c nztm_simd.c -lm
+   and run as
+      a.out newzealand.bin island.bin */
+
+static int test_pyramid( const nztm_coast *c, const double *tol,
+    int nlevels ) {
+    const double *xy, *b;
+    size_t n, i;
+    nztm_lod l;
+    int k, r, bad = 0, empty = 0;
+
+    if( nztm_lod_build( c, NULL, tol, nlevels, "test_lod.lod" ) != 0 ||
+        nztm_lod_open( &l, "test_lod.lod" ) != 0 ) {
+        printf( "  levels %d: cannot build or open the pyramid\n", nlevels );
+        remove( "test_lod.lod" );
+        return 1;
+        }
+    for( k = 0; k < l.nlevels; k++ )
+        for( r = 0; r < l.nrings; r++ ) {
+            n = nztm_lod_ring( &l, k, r, &xy );
+            b = l.box + 4*r;
+            empty += n == 0;
+            bad += n > 0 && n < 3;
+            for( i = 0; i < n; i++ )
+                bad += ! ( xy[2*i] >= b[0] && xy[2*i+1] >= b[1] &&
+                           xy[2*i] <= b[2] && xy[2*i+1] <= b[3] );
+            }
+    printf( "  %d levels, coarsest %.0f m: %zu points, %d rings dropped, "
+        "%d bad\n", l.nlevels, l.tolerance[l.nlevels-1],
+        nztm_lod_points( &l, l.nlevels - 1 ), empty, bad );
+    nztm_lod_close( &l );
+    remove( "test_lod.lod" );
+    return bad != 0;
+    }
+
+int main( int argc, char *argv[] ) {
+  static const double coarse[] = { 0.0, 100000.0, 400000.0 };
+  nztm_coast c;
+  int a, bad = 0;
+
+  for( a = 1; a < argc; a++ ) {
+     if( nztm_coast_open( &c, argv[a] ) != 0 ) {
+        printf( "cannot open %s\n", argv[a] );
+        bad = 1;
+        continue;
+        }
+     printf( "%s: %d rings\n", argv[a], c.nparts );
+     bad |= test_pyramid( &c, NULL, 0 );
+     bad |= test_pyramid( &c, coarse, 3 );
+     nztm_coast_close( &c );
+     }
+  return bad;
+  }
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _NZTM_LOD_H
+#define _NZTM_LOD_H
+
+/* Level of detail pyramid of projected coastline rings.
+
+   nztm_lod_build projects the rings of an nztm_coast file (island.bin
+   or newzealand.bin) with a TM projection and simplifies each by the
+   Douglas-Peucker method at a series of tolerances, writing every level
+   to one file.  Level 0 holds all the points; each later level, with a
+   larger tolerance, keeps a subset of the points of the one before.
+   Rings reduced to fewer than three points are left empty at that
+   level.
+
+   The file is mapped read only by nztm_lod_open and the points of a
+   ring at a level are a slice of the mapping, interleaved as easting,
+   northing pairs in projection units, so a tile server can choose a
+   level for its scale and pass the slices on without copying.  As with
+   nztm_coast, the nztm_lod structure is owned by the caller. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nztm.h"
+#include "nztm_coast.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_LOD_MAXLEVELS  16
+
+typedef struct {
+        void *map;
+        size_t size;
+        int nlevels;
+        int nrings;
+        const double *tolerance;  /* Of each level */
+        const double *box;        /* Of each ring: minx miny maxx maxy */
+        const uint64_t *offset;   /* Of ring r of level l at (nrings+1)*l + r */
+        const double *xy;         /* Points of all levels */
+        } nztm_lod;
+
+/* Writes the pyramid of the rings of c, projected with tm (NULL for
+   NZTM), at the nlevels tolerances in tol (metres, increasing, the
+   first normally 0 for no simplification).  tol NULL with nlevels 0
+   gives the default levels 0, 5, 20, 80, 320, 1280 and 5120 m.
+   Returns 0, or -1 if the arguments are invalid, memory cannot be
+   allocated or the file cannot be written. */
+
+int nztm_lod_build( const nztm_coast *c, const tmprojection *tm,
+   const double *tol, int nlevels, const char *path );
+
+/* Returns 0, or -1 if the file cannot be mapped or is not valid */
+
+int nztm_lod_open( nztm_lod *l, const char *path );
+void nztm_lod_close( nztm_lod *l );
+
+/* The coarsest level whose tolerance is at most tol, for example half
+   the size of a pixel in metres */
+
+int nztm_lod_level( const nztm_lod *l, double tol );
+
+/* Sets *xy to the points of ring r at level level and returns their
+   number */
+
+size_t nztm_lod_ring( const nztm_lod *l, int level, int r, const double **xy );
+
+/* Total number of points at a level */
+
+size_t nztm_lod_points( const nztm_lod *l, int level );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,444 @@
+/* Offload of bulk conversion.  Needs dlopen.
+
+   Each staging buffer holds the inputs of a chunk, as pairs, followed
+   by its outputs.  Chunks alternate between streams 0 and 1; before a
+   stream takes a new chunk, the chunk it last had is collected, so at
+   most two are in flight and a buffer is never refilled while the
+   device may still read it. */
+
+#include "nztm_offload.h"
+
+#include "nztm_bulk.h"
+#include "tmproj.h"
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OFFLOAD_SYMBOL  "nztm_offload_device_v1"
+#define OFFLOAD_METHODS (NZTM_PRECISE + 1)
+#define OFFLOAD_CHECK   64        /* Points in each check */
+
+struct nztm_offload {
+        const nztm_offload_device *device;     /* NULL on the CPU */
+        void *dev;
+        void *library;            /* From dlopen, or NULL */
+        double *stage[2];         /* 4*NZTM_OFFLOAD_CHUNK doubles each */
+        int active[2][OFFLOAD_METHODS];        /* By inverse and method */
+        };
+
+/* A conversion: in1 and in2 are lt and ln, or n and e if inverse, and
+   out1 and out2 the n and e, or lt and ln */
+
+typedef struct {
+        const tmprojection *tm;
+        int method;
+        int inverse;
+        double proj[8];
+        const double *in1, *in2;
+        size_t instride;
+        double *out1, *out2;
+        size_t outstride;
+        } offload_job;
+
+static void offload_proj( const tmprojection *tm, double proj[8] ) {
+    proj[0] = tm->a;
+    proj[1] = tm->rf;
+    proj[2] = tm->meridian;
+    proj[3] = tm->scalef;
+    proj[4] = tm->orglat;
+    proj[5] = tm->falsee;
+    proj[6] = tm->falsen;
+    proj[7] = tm->utom;
+    }
+
+/* Converts points [i0,i0+m) of job on the CPU */
+
+static void offload_cpu( nztm_pool *pool, int isa, const offload_job *job,
+        size_t i0, size_t m ) {
+    const double *in1 = job->in1 + i0*job->instride;
+    const double *in2 = job->in2 + i0*job->instride;
+    double *out1 = job->out1 + i0*job->outstride;
+    double *out2 = job->out2 + i0*job->outstride;
+
+    if( job->inverse )
+        tm_geod_bulk( pool, job->tm, job->method, isa, in1, in2,
+            job->instride, out1, out2, job->outstride, m );
+    else
+        geod_tm_bulk( pool, job->tm, job->method, isa, in1, in2,
+            job->instride, out1, out2, job->outstride, m );
+    }
+
+/* Converts the points of job on the device, or on the CPU from the
+   first failure.  Returns 0, or -1 if the device failed. */
+
+static int offload_device( nztm_offload *o, nztm_pool *pool,
+        const offload_job *job, size_t count ) {
+    const nztm_offload_device *d = o->device;
+    size_t start[2], size[2], next = 0, m, k;
+    const double *in1, *in2;
+    double *in, *out, *out1, *out2;
+    int s, failed = 0;
+
+    size[0] = size[1] = 0;
+    for( s = 0; ; s ^= 1 ) {
+
+        /* Collect the chunk on stream s */
+
+        if( size[s] ) {
+            if( d->wait( o->dev, s ) != 0 ) failed = 1;
+            if( failed )
+                offload_cpu( pool, NZTM_ISA_BEST, job, start[s], size[s] );
+            else {
+                out = o->stage[s] + 2*NZTM_OFFLOAD_CHUNK;
+                out1 = job->out1 + start[s]*job->outstride;
+                out2 = job->out2 + start[s]*job->outstride;
+                for( k = 0; k < size[s]; k++ ) {
+                    out1[k*job->outstride] = out[2*k];
+                    out2[k*job->outstride] = out[2*k+1];
+                    }
+                }
+            size[s] = 0;
+            }
+        if( next == count ) {
+            if( ! size[s^1] ) break;
+            continue;
+            }
+        if( failed ) {
+            offload_cpu( pool, NZTM_ISA_BEST, job, next, count - next );
+            next = count;
+            continue;
+            }
+
+        /* Give it the next */
+
+        m = count - next < NZTM_OFFLOAD_CHUNK ? count - next : NZTM_OFFLOAD_CHUNK;
+        in = o->stage[s];
+        in1 = job->in1 + next*job->instride;
+        in2 = job->in2 + next*job->instride;
+        for( k = 0; k < m; k++ ) {
+            in[2*k] = in1[k*job->instride];
+            in[2*k+1] = in2[k*job->instride];
+            }
+        if( d->submit( o->dev, s, job->inverse, job->method, job->proj,
+                in, in + 2*NZTM_OFFLOAD_CHUNK, m ) != 0 ) {
+            failed = 1;
+            offload_cpu( pool, NZTM_ISA_BEST, job, next, m );
+            }
+        else {
+            start[s] = next;
+            size[s] = m;
+            }
+        next += m;
+        }
+    return failed ? -1 : 0;
+    }
+
+static void offload_run( nztm_offload *o, nztm_pool *pool,
+        offload_job *job, size_t count ) {
+    int m;
+
+    if( ! o->device || job->method < 0 || job->method >= OFFLOAD_METHODS ||
+            ! o->active[job->inverse][job->method] ) {
+        offload_cpu( pool, NZTM_ISA_BEST, job, 0, count );
+        return;
+        }
+    offload_proj( job->tm, job->proj );
+    if( offload_device( o, pool, job, count ) != 0 ) {
+        for( m = 0; m < OFFLOAD_METHODS; m++ ) o->active[0][m] = o->active[1][m] = 0;
+        }
+    }
+
+/* Sets o->active by checking each method of the device against the
+   scalar routines, in NZTM and UTM zone 27 */
+
+static void offload_check( nztm_offload *o ) {
+    double lt[OFFLOAD_CHECK], ln[OFFLOAD_CHECK], n[OFFLOAD_CHECK], e[OFFLOAD_CHECK];
+    double r1[OFFLOAD_CHECK], r2[OFFLOAD_CHECK], o1[OFFLOAD_CHECK], o2[OFFLOAD_CHECK];
+    const tmprojection *tm;
+    tmprojection *utm;
+    offload_job job;
+    double tol;
+    int p, inverse, method, k, ok;
+
+    for( inverse = 0; inverse < 2; inverse++ )
+        for( method = 0; method < OFFLOAD_METHODS; method++ )
+            o->active[inverse][method] = 1;
+    utm = tm_create( NZTM_A, NZTM_RF, -21.0/rad2deg, 0.9996, 0.0,
+        500000.0, 0.0, 1.0 );
+    if( ! utm ) goto fail;
+
+    for( p = 0; p < 2; p++ ) {
+        tm = p ? utm : &nztm_projection;
+        for( k = 0; k < OFFLOAD_CHECK; k++ ) {
+            if( p ) {
+                lt[k] = (63.0 + 4.0*(k % 8)/7.0)/rad2deg;
+                ln[k] = (-25.0 + 12.0*(k / 8)/7.0)/rad2deg;
+                }
+            else {
+                lt[k] = (-34.0 - 13.0*(k % 8)/7.0)/rad2deg;
+                ln[k] = (166.0 + 13.0*(k / 8)/7.0)/rad2deg;
+                }
+            }
+        geod_tm_bulk( NULL, tm, NZTM_REDFEARN, NZTM_ISA_SCALAR,
+            lt, ln, 1, n, e, 1, OFFLOAD_CHECK );
+
+        for( inverse = 0; inverse < 2; inverse++ )
+            for( method = 0; method < OFFLOAD_METHODS; method++ ) {
+                if( ! o->active[inverse][method] ) continue;
+                job.tm = tm;
+                job.method = method;
+                job.inverse = inverse;
+                job.in1 = inverse ? n : lt;
+                job.in2 = inverse ? e : ln;
+                job.instride = job.outstride = 1;
+                job.out1 = r1;
+                job.out2 = r2;
+                offload_cpu( NULL, NZTM_ISA_SCALAR, &job, 0, OFFLOAD_CHECK );
+                job.out1 = o1;
+                job.out2 = o2;
+                offload_proj( tm, job.proj );
+                ok = offload_device( o, NULL, &job, OFFLOAD_CHECK ) == 0;
+                tol = inverse ? NZTM_OFFLOAD_TOL/tm->a : NZTM_OFFLOAD_TOL/tm->utom;
+                for( k = 0; k < OFFLOAD_CHECK && ok; k++ ) {
+                    if( isnan( r1[k] ) != isnan( o1[k] ) ||
+                            isnan( r2[k] ) != isnan( o2[k] ) ||
+                            fabs( o1[k] - r1[k] ) > tol ||
+                            fabs( o2[k] - r2[k] )*(inverse ? cos( r1[k] ) : 1.0) > tol )
+                        ok = 0;
+                    }
+                o->active[inverse][method] = ok;
+                }
+        }
+    tm_destroy( utm );
+    return;
+
+fail:
+    for( method = 0; method < OFFLOAD_METHODS; method++ )
+        o->active[0][method] = o->active[1][method] = 0;
+    }
+
+nztm_offload *nztm_offload_attach( const nztm_offload_device *device )
+{
+   nztm_offload *o;
+   int s;
+
+   o = (nztm_offload *) calloc( 1, sizeof(nztm_offload) );
+   if( ! o ) return NULL;
+   if( ! device || device->version != NZTM_OFFLOAD_VERSION ||
+         ! ( o->dev = device->open() ) )
+      return o;
+
+   o->device = device;
+   for( s = 0; s < 2; s++ ) {
+      o->stage[s] = (double *) device->host_alloc( o->dev,
+         4*NZTM_OFFLOAD_CHUNK*sizeof(double) );
+      if( ! o->stage[s] ) break;
+      }
+   if( s == 2 ) offload_check( o );
+   return o;
+}
+
+nztm_offload *nztm_offload_open( const char *library )
+{
+   const nztm_offload_device *device = NULL;
+   nztm_offload *o;
+   void *lib = NULL;
+
+   if( ! library ) library = getenv( "NZTM_OFFLOAD" );
+   if( library && *library && ( lib = dlopen( library, RTLD_NOW | RTLD_LOCAL ) ) )
+      device = (const nztm_offload_device *) dlsym( lib, OFFLOAD_SYMBOL );
+   o = nztm_offload_attach( device );
+   if( ! o || ! o->dev ) {
+      if( lib ) dlclose( lib );
+      return o;
+      }
+   o->library = lib;
+   return o;
+}
+
+void nztm_offload_close( nztm_offload *o )
+{
+   int s;
+
+   if( ! o ) return;
+   if( o->dev ) {
+      for( s = 0; s < 2; s++ )
+         if( o->stage[s] ) o->device->host_free( o->dev, o->stage[s] );
+      o->device->close( o->dev );
+      }
+   if( o->library ) dlclose( o->library );
+   free( o );
+}
+
+const char *nztm_offload_name( const nztm_offload *o )
+{
+   return o->device && o->device->name ? o->device->name : "cpu";
+}
+
+int nztm_offload_active( const nztm_offload *o, int method )
+{
+   return o->device && method >= 0 && method < OFFLOAD_METHODS &&
+      o->active[0][method] && o->active[1][method];
+}
+
+void tm_geod_offload( nztm_offload *o, nztm_pool *pool,
+   const tmprojection *tm, int method, const double *n, const double *e,
+   size_t instride, double *lt, double *ln, size_t outstride, size_t count )
+{
+   offload_job job;
+
+   job.tm = tm;
+   job.method = method;
+   job.inverse = 1;
+   job.in1 = n;
+   job.in2 = e;
+   job.instride = instride;
+   job.out1 = lt;
+   job.out2 = ln;
+   job.outstride = outstride;
+   offload_run( o, pool, &job, count );
+}
+
+void geod_tm_offload( nztm_offload *o, nztm_pool *pool,
+   const tmprojection *tm, int method, const double *lt, const double *ln,
+   size_t instride, double *n, double *e, size_t outstride, size_t count )
+{
+   offload_job job;
+
+   job.tm = tm;
+   job.method = method;
+   job.inverse = 0;
+   job.in1 = lt;
+   job.in2 = ln;
+   job.instride = instride;
+   job.out1 = n;
+   job.out2 = e;
+   job.outstride = outstride;
+   offload_run( o, pool, &job, count );
+}
+
+#ifdef TEST_NZTM_OFFLOAD
+
+/* Runs the pipeline with backends emulated on the host: one faithful,
+   one whose Clenshaw results are 1 mm out, which the check must
+   disable, and one that fails part way through, and checks each
+   against the scalar routines.  Build with
+      cc -O2 -DTEST_NZTM_OFFLOAD nztm_offload.c nztm_bulk.c nztm_pool.c \
+         nztm.c nztm_simd.c -lm -lpthread -ldl  */
+
+#include <stdio.h>
+
+typedef struct {
+        int bias;                 /* Perturb NZTM_CLENSHAW */
+        int fail;                 /* Fail at this submit, if positive */
+        int submits;
+        } host_dev;
+
+static host_dev host_state;
+
+static void *host_open( void ) {
+    host_state.submits = 0;
+    return &host_state;
+    }
+
+static void host_close( void *dev ) {
+    (void) dev;
+    }
+
+static void *host_alloc( void *dev, size_t bytes ) {
+    (void) dev;
+    return malloc( bytes );
+    }
+
+static void host_free( void *dev, void *p ) {
+    (void) dev;
+    free( p );
+    }
+
+static int host_submit( void *dev, int stream, int inverse, int method,
+        const double proj[8], const double *in, double *out, size_t count ) {
+    host_dev *h = (host_dev *) dev;
+    tmprojection *tm;
+    size_t k;
+
+    (void) stream;
+    if( ++h->submits == h->fail ) return -1;
+    tm = tm_create( proj[0], proj[1], proj[2], proj[3], proj[4], proj[5],
+        proj[6], proj[7] );
+    if( ! tm ) return -1;
+    if( inverse )
+        tm_geod_bulk( NULL, tm, method, NZTM_ISA_SCALAR, in, in + 1, 2,
+            out, out + 1, 2, count );
+    else
+        geod_tm_bulk( NULL, tm, method, NZTM_ISA_SCALAR, in, in + 1, 2,
+            out, out + 1, 2, count );
+    if( h->bias && method == NZTM_CLENSHAW && ! inverse )
+        for( k = 0; k < count; k++ ) out[2*k] += 1.0e-3;
+    tm_destroy( tm );
+    return 0;
+    }
+
+static int host_wait( void *dev, int stream ) {
+    (void) dev;
+    (void) stream;
+    return 0;
+    }
+
+static const nztm_offload_device host_device = { NZTM_OFFLOAD_VERSION,
+   "host", host_open, host_close, host_alloc, host_free, host_submit,
+   host_wait };
+
+static double maxdiff( const double *a, const double *b, size_t count ) {
+    double d = 0.0;
+    size_t i;
+
+    for( i = 0; i < count; i++ ) if( fabs( a[i] - b[i] ) > d ) d = fabs( a[i] - b[i] );
+    return d;
+    }
+
+int main( int argc, char *argv[] ) {
+  size_t count = argc > 1 ? (size_t) atol( argv[1] ) : 1000000;
+  double *lt = malloc( 6*count*sizeof(double) );
+  double *ln = lt + count, *n = ln + count, *e = n + count;
+  double *rn = e + count, *re = rn + count;
+  nztm_offload *o;
+  int test, bad = 0;
+  size_t i;
+
+  srand( 1 );
+  for( i = 0; i < count; i++ ) {
+     lt[i] = (-34.0 - 13.0*rand()/RAND_MAX)/rad2deg;
+     ln[i] = (166.0 + 13.0*rand()/RAND_MAX)/rad2deg;
+     }
+  geod_tm_bulk( NULL, &nztm_projection, NZTM_CLENSHAW, NZTM_ISA_SCALAR,
+     lt, ln, 1, rn, re, 1, count );
+
+  o = nztm_offload_open( NULL );
+  printf( "default backend %s\n", nztm_offload_name( o ) );
+  nztm_offload_close( o );
+
+  for( test = 0; test < 3; test++ ) {
+     host_state.bias = test == 1;
+     host_state.fail = test == 2 ? 16 + 1 : 0;   /* 16 in the checks */
+     o = nztm_offload_attach( &host_device );
+     memset( n, 0, 2*count*sizeof(double) );
+     geod_tm_offload( o, NULL, &nztm_projection, NZTM_CLENSHAW, lt, ln, 1,
+        n, e, 1, count );
+     printf( "%-8s clenshaw %s, max difference %.3g m, %.3g m, %d submits\n",
+        test == 0 ? "faithful" : test == 1 ? "biased" : "failing",
+        nztm_offload_active( o, NZTM_CLENSHAW ) ? "on device" : "now on cpu",
+        maxdiff( n, rn, count ), maxdiff( e, re, count ), host_state.submits );
+     if( maxdiff( n, rn, count ) > 1.0e-6 || maxdiff( e, re, count ) > 1.0e-6 ||
+           nztm_offload_active( o, NZTM_CLENSHAW ) != (test == 0) )
+        bad = 1;
+     nztm_offload_close( o );
+     }
+
+  puts( bad ? "FAILED" : "passed" );
+  free( lt );
+  return bad;
+  }
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef _NZTM_OFFLOAD_H
+#define _NZTM_OFFLOAD_H
+
+/* Offload of bulk conversion to an accelerator such as a GPU, with the
+   CPU routines of nztm_bulk.h as the fallback.
+
+   A device backend is a shared library, built separately with the
+   device's own compiler (CUDA, SYCL, ...), exporting an
+   nztm_offload_device named nztm_offload_device_v1.  nztm_offload_cl.c
+   is such a backend for OpenCL devices with double precision, built
+   only when NZTM_OFFLOAD_OPENCL is defined.  nztm_offload_open
+   loads it with dlopen; if there is no library, it exports no backend,
+   or its open finds no device, conversions run on the CPU instead, so
+   programs need not care whether a device is present.
+
+   Before a device is used its results are checked against the scalar
+   routines of nztm.c (NZTM_ISA_SCALAR) at points over New Zealand and
+   Iceland, in both directions and for each method; a method whose
+   results differ by more than NZTM_OFFLOAD_TOL metres, or the angular
+   equivalent, runs on the CPU.
+
+   The points are passed to the device in chunks of NZTM_OFFLOAD_CHUNK
+   through two staging buffers in page locked (pinned) host memory,
+   which the backend allocates, and two streams.  While the device
+   copies in, converts and copies out one chunk, the host gathers the
+   next chunk into the other buffer and scatters the results of the
+   previous one, so transfers overlap both computation and the host's
+   own work.  If the device fails part way the remaining points,
+   including those of chunks in flight, are converted on the CPU.
+
+   Tows are gridded on a device by projecting their ends with
+   geod_tm_offload and passing the results to nztm_grid_add_projected;
+   the walk through the grid runs on the CPU.
+
+   A handle converts one call at a time: its staging buffers and streams
+   are reused by every conversion, so a handle must not be used by two
+   threads at once.  Threads converting concurrently each open their
+   own, or share one under a lock.  Needs dlopen (link with -ldl on
+   older C libraries). */
+
+#include <stddef.h>
+
+#include "nztm.h"
+#include "nztm_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_OFFLOAD_VERSION 1
+#define NZTM_OFFLOAD_CHUNK   (1 << 18)
+#define NZTM_OFFLOAD_TOL     1.0e-6
+
+/* The interface of a backend.  Points are pairs of doubles in the
+   staging buffers: (lt,ln) in radians to (n,e) for geod_tm, and (n,e)
+   to (lt,ln) for tm_geod.  submit starts the conversion of count points
+   from in to out on stream 0 or 1, and wait returns when it is complete;
+   both return 0, or -1 if the device failed.  proj holds a, rf, cm,
+   sf, lto, fe, fn and utom as passed to tm_create. */
+
+typedef struct {
+        int version;              /* NZTM_OFFLOAD_VERSION */
+        const char *name;
+        void *(*open)( void );    /* NULL if there is no device */
+        void (*close)( void *dev );
+        void *(*host_alloc)( void *dev, size_t bytes );
+        void (*host_free)( void *dev, void *p );
+        int (*submit)( void *dev, int stream, int inverse, int method,
+           const double proj[8], const double *in, double *out, size_t count );
+        int (*wait)( void *dev, int stream );
+        } nztm_offload_device;
+
+typedef struct nztm_offload nztm_offload;
+
+/* Opens the backend in the shared library library, or that named by
+   the environment variable NZTM_OFFLOAD if library is NULL.
+   nztm_offload_attach uses a backend linked into the program instead.
+   Both return NULL only if memory cannot be allocated; without a
+   usable device the result converts on the CPU. */
+
+nztm_offload *nztm_offload_open( const char *library );
+nztm_offload *nztm_offload_attach( const nztm_offload_device *device );
+void nztm_offload_close( nztm_offload *o );
+
+/* The name of the backend, or "cpu", and whether both conversions by
+   method run on the device */
+
+const char *nztm_offload_name( const nztm_offload *o );
+int nztm_offload_active( const nztm_offload *o, int method );
+
+/* Conversions as tm_geod_bulk and geod_tm_bulk, with pool (which may
+   be NULL) used on the CPU. */
+
+void tm_geod_offload( nztm_offload *o, nztm_pool *pool,
+   const tmprojection *tm, int method, const double *n, const double *e,
+   size_t instride, double *lt, double *ln, size_t outstride, size_t count );
+void geod_tm_offload( nztm_offload *o, nztm_pool *pool,
+   const tmprojection *tm, int method, const double *lt, const double *ln,
+   size_t instride, double *n, double *e, size_t outstride, size_t count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,604 @@
+/* An OpenCL backend for nztm_offload.h, converting on the first GPU or
+   accelerator with double precision (cl_khr_fp64) that the installed
+   platforms report.  The kernels are the Redfearn series of nztm.c
+   with the NZTM_CLENSHAW, NZTM_FAST and NZTM_PRECISE variants, in
+   OpenCL C and compiled for the device when it is opened; the check in
+   nztm_offload.c still decides which of them run there.
+
+   The body is compiled only with NZTM_OFFLOAD_OPENCL defined, so the
+   programs need neither OpenCL headers nor the library.  Build the
+   backend with
+      cc -O2 -shared -fPIC -DNZTM_OFFLOAD_OPENCL -o libnztm_offload_cl.so \
+         nztm_offload_cl.c -lOpenCL
+   and select it by passing its path to nztm_offload_open, or in the
+   environment variable NZTM_OFFLOAD.
+
+   Each stream has its own command queue, device buffers and copy of the
+   projection, so the copy in, kernel and copy out of one chunk are
+   queued without waiting and may overlap those of the other stream.
+   The staging buffers are mapped from buffers allocated with
+   CL_MEM_ALLOC_HOST_PTR, which the common implementations pin. */
+
+#ifdef NZTM_OFFLOAD_OPENCL
+
+#define CL_TARGET_OPENCL_VERSION 120
+
+#include "nztm_offload.h"
+
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+
+#define CL_STAGES 4               /* Staging buffers mapped at once */
+
+/* The projection as the kernels take it, with the values that
+   tm_define derives from the parameters.  As the kernel source. */
+
+typedef struct {
+        cl_double meridian, scalef, falsee, falsen, utom;
+        cl_double a, e2, om, ome2, rsf, rutom;
+        cl_double A0, A2, A4, A6;
+        cl_double g, p2, p4, p6, p8;
+        } cl_tmc;
+
+typedef struct {
+        cl_context context;
+        cl_program program;
+        cl_kernel kernel[2];      /* geod_tm, tm_geod */
+        cl_command_queue queue[2];
+        cl_mem tm[2], in[2], out[2];
+        cl_tmc tmc[2];            /* Read by the queued copy */
+        cl_event done[2];         /* The copy out of a stream's chunk */
+        cl_mem stage[CL_STAGES];
+        void *map[CL_STAGES];
+        } cl_dev;
+
+/* The kernel source, a line to a string */
+
+static const char *cl_source[] = {
+   "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n",
+   "\n",
+   "#define PI 3.1415926535898\n",
+   "#define TWOPI (2.0*PI)\n",
+   "\n",
+   "#define NZTM_REDFEARN 0\n",
+   "#define NZTM_CLENSHAW 1\n",
+   "#define NZTM_FAST     2\n",
+   "#define NZTM_PRECISE  3\n",
+   "\n",
+   "typedef struct {\n",
+   "        double meridian, scalef, falsee, falsen, utom;\n",
+   "        double a, e2, om, ome2, rsf, rutom;\n",
+   "        double A0, A2, A4, A6;\n",
+   "        double g, p2, p4, p6, p8;\n",
+   "        } tmc;\n",
+   "\n",
+   "double meridian_arc( __constant const tmc *tm, double lt ) {\n",
+   "    return tm->a*(tm->A0*lt-tm->A2*sin(2*lt)+tm->A4*sin(4*lt)-tm->A6*sin(6*lt));\n",
+   "    }\n",
+   "\n",
+   "double foot_point_lat( __constant const tmc *tm, double m ) {\n",
+   "    double sig = m/tm->g;\n",
+   "\n",
+   "    return sig + tm->p2 * sin(2.0*sig)\n",
+   "               + tm->p4 * sin(4.0*sig)\n",
+   "               + tm->p6 * sin(6.0*sig)\n",
+   "               + tm->p8 * sin(8.0*sig);\n",
+   "    }\n",
+   "\n",
+   "double meridian_arc_cs( __constant const tmc *tm, double lt,\n",
+   "               double slt, double clt ) {\n",
+   "    double s2 = 2.0*slt*clt;\n",
+   "    double y = 2.0*(clt-slt)*(clt+slt);\n",
+   "    double b3 = -tm->A6;\n",
+   "    double b2 = tm->A4 + y*b3;\n",
+   "    double b1 = -tm->A2 + y*b2 - b3;\n",
+   "\n",
+   "    return tm->a*(tm->A0*lt + b1*s2);\n",
+   "    }\n",
+   "\n",
+   "double foot_point_lat_cs( __constant const tmc *tm, double m,\n",
+   "               double *sphi, double *cphi ) {\n",
+   "    double sig = m/tm->g;\n",
+   "    double ssig = sin(sig);\n",
+   "    double csig = cos(sig);\n",
+   "    double s2 = 2.0*ssig*csig;\n",
+   "    double y = 2.0*(csig-ssig)*(csig+ssig);\n",
+   "    double b4 = tm->p8;\n",
+   "    double b3 = tm->p6 + y*b4;\n",
+   "    double b2 = tm->p4 + y*b3 - b4;\n",
+   "    double b1 = tm->p2 + y*b2 - b3;\n",
+   "    double d = b1*s2;\n",
+   "    double d2 = d*d;\n",
+   "    double sd = d*(1.0 - d2/6.0*(1.0 - d2/20.0));\n",
+   "    double cd = 1.0 - d2/2.0*(1.0 - d2/12.0*(1.0 - d2/30.0));\n",
+   "\n",
+   "    *sphi = ssig*cd + csig*sd;\n",
+   "    *cphi = csig*cd - ssig*sd;\n",
+   "    return sig + d;\n",
+   "    }\n",
+   "\n",
+   "void tm_geod( __constant const tmc *tm, int method,\n",
+   "              double ce, double cn, double *ln, double *lt ) {\n",
+   "    double cn1, fphi, slt, clt, eslt, eta, rho, psi, E, x, x2, t, t2, t4;\n",
+   "    double trm1, trm2, trm3, trm4;\n",
+   "\n",
+   "    cn1 = (cn - tm->falsen)*tm->utom*tm->rsf + tm->om;\n",
+   "    if( method == NZTM_CLENSHAW ) {\n",
+   "        fphi = foot_point_lat_cs(tm, cn1, &slt, &clt);\n",
+   "        }\n",
+   "    else {\n",
+   "        fphi = foot_point_lat(tm, cn1);\n",
+   "        slt = sin(fphi);\n",
+   "        clt = cos(fphi);\n",
+   "        }\n",
+   "\n",
+   "    eslt = (1.0-tm->e2*slt*slt);\n",
+   "    eta = tm->a/sqrt(eslt);\n",
+   "    rho = eta * tm->ome2 / eslt;\n",
+   "    psi = eta/rho;\n",
+   "\n",
+   "    E = (ce-tm->falsee)*tm->utom;\n",
+   "    x = E/(eta*tm->scalef);\n",
+   "    x2 = x*x;\n",
+   "\n",
+   "    t = slt/clt;\n",
+   "    t2 = t*t;\n",
+   "    t4 = t2*t2;\n",
+   "\n",
+   "    trm1 = 1.0/2.0;\n",
+   "\n",
+   "    trm2 = ((-4.0*psi\n",
+   "                 +9.0*(1-t2))*psi\n",
+   "                 +12.0*t2)/24.0;\n",
+   "\n",
+   "    trm3 = ((((8.0*(11.0-24.0*t2)*psi\n",
+   "                  -12.0*(21.0-71.0*t2))*psi\n",
+   "                  +15.0*((15.0*t2-98.0)*t2+15))*psi\n",
+   "                  +180.0*((-3.0*t2+5.0)*t2))*psi + 360.0*t4)/720.0;\n",
+   "\n",
+   "    trm4 = (((1575.0*t2+4095.0)*t2+3633.0)*t2+1385.0)/40320.0;\n",
+   "\n",
+   "    *lt = fphi+(t*x*E/(tm->scalef*rho))*(((trm4*x2-trm3)*x2+trm2)*x2-trm1);\n",
+   "\n",
+   "    trm1 = 1.0;\n",
+   "\n",
+   "    trm2 = (psi+2.0*t2)/6.0;\n",
+   "\n",
+   "    trm3 = (((-4.0*(1.0-6.0*t2)*psi\n",
+   "               +(9.0-68.0*t2))*psi\n",
+   "               +72.0*t2)*psi\n",
+   "               +24.0*t4)/120.0;\n",
+   "\n",
+   "    trm4 = (((720.0*t2+1320.0)*t2+662.0)*t2+61.0)/5040.0;\n",
+   "\n",
+   "    *ln = tm->meridian - (x/clt)*(((trm4*x2-trm3)*x2+trm2)*x2-trm1);\n",
+   "    }\n",
+   "\n",
+   "void geod_tm( __constant const tmc *tm, int method,\n",
+   "              double ln, double lt, double *ce, double *cn ) {\n",
+   "    double dlon, m, slt, clt, eslt, eta, rho, psi, wc, wc2, t, t2, t4, t6;\n",
+   "    double trm1, trm2, trm3, trm4, gce, gcn;\n",
+   "\n",
+   "    dlon  =  ln - tm->meridian;\n",
+   "    while ( dlon > PI ) dlon -= TWOPI;\n",
+   "    while ( dlon < -PI ) dlon += TWOPI;\n",
+   "\n",
+   "    slt = sin(lt);\n",
+   "    clt = cos(lt);\n",
+   "\n",
+   "    if( method == NZTM_CLENSHAW )\n",
+   "        m = meridian_arc_cs(tm,lt,slt,clt);\n",
+   "    else\n",
+   "        m = meridian_arc(tm,lt);\n",
+   "\n",
+   "    eslt = (1.0-tm->e2*slt*slt);\n",
+   "    eta = tm->a/sqrt(eslt);\n",
+   "    rho = eta * tm->ome2 / eslt;\n",
+   "    psi = eta/rho;\n",
+   "\n",
+   "    wc = clt*dlon;\n",
+   "    wc2 = wc*wc;\n",
+   "\n",
+   "    t = slt/clt;\n",
+   "    t2 = t*t;\n",
+   "    t4 = t2*t2;\n",
+   "    t6 = t2*t4;\n",
+   "\n",
+   "    trm1 = (psi-t2)/6.0;\n",
+   "\n",
+   "    trm2 = (((4.0*(1.0-6.0*t2)*psi\n",
+   "                  + (1.0+8.0*t2))*psi\n",
+   "                  - 2.0*t2)*psi+t4)/120.0;\n",
+   "\n",
+   "    trm3 = (61 - 479.0*t2 + 179.0*t4 - t6)/5040.0;\n",
+   "\n",
+   "    gce = (tm->scalef*eta*dlon*clt)*(((trm3*wc2+trm2)*wc2+trm1)*wc2+1.0);\n",
+   "    *ce = gce*tm->rutom+tm->falsee;\n",
+   "\n",
+   "    trm1 = 1.0/2.0;\n",
+   "\n",
+   "    trm2 = ((4.0*psi+1)*psi-t2)/24.0;\n",
+   "\n",
+   "    trm3 = ((((8.0*(11.0-24.0*t2)*psi\n",
+   "                -28.0*(1.0-6.0*t2))*psi\n",
+   "                +(1.0-32.0*t2))*psi\n",
+   "                -2.0*t2)*psi\n",
+   "                +t4)/720.0;\n",
+   "\n",
+   "    trm4 = (1385.0-3111.0*t2+543.0*t4-t6)/40320.0;\n",
+   "\n",
+   "    gcn = (eta*t)*((((trm4*wc2+trm3)*wc2+trm2)*wc2+trm1)*wc2);\n",
+   "    *cn = (gcn+m-tm->om)*tm->scalef*tm->rutom+tm->falsen;\n",
+   "    }\n",
+   "\n",
+   "void tm_geod_fast( __constant const tmc *tm,\n",
+   "              double ce, double cn, double *ln, double *lt ) {\n",
+   "    double rome2 = 1.0/tm->ome2;\n",
+   "    double rasf = 1.0/(tm->a*tm->scalef);\n",
+   "    double cn1, fphi, slt, clt, rclt, eslt, psi, x, x2, t, t2, t4;\n",
+   "    double trm2, trm3, trm4;\n",
+   "\n",
+   "    cn1 = (cn - tm->falsen)*tm->utom*tm->rsf + tm->om;\n",
+   "    fphi = foot_point_lat_cs(tm, cn1, &slt, &clt);\n",
+   "\n",
+   "    eslt = (1.0-tm->e2*slt*slt);\n",
+   "    psi = eslt*rome2;\n",
+   "    x = (ce-tm->falsee)*tm->utom*sqrt(eslt)*rasf;\n",
+   "    x2 = x*x;\n",
+   "\n",
+   "    rclt = 1.0/clt;\n",
+   "    t = slt*rclt;\n",
+   "    t2 = t*t;\n",
+   "    t4 = t2*t2;\n",
+   "\n",
+   "    trm2 = ((-4.0*psi\n",
+   "                 +9.0*(1-t2))*psi\n",
+   "                 +12.0*t2)/24.0;\n",
+   "\n",
+   "    trm3 = ((((8.0*(11.0-24.0*t2)*psi\n",
+   "                  -12.0*(21.0-71.0*t2))*psi\n",
+   "                  +15.0*((15.0*t2-98.0)*t2+15))*psi\n",
+   "                  +180.0*((-3.0*t2+5.0)*t2))*psi + 360.0*t4)/720.0;\n",
+   "\n",
+   "    *lt = fphi+(t*x2*psi)*((trm2-trm3*x2)*x2-0.5);\n",
+   "\n",
+   "    trm2 = (psi+2.0*t2)/6.0;\n",
+   "\n",
+   "    trm3 = (((-4.0*(1.0-6.0*t2)*psi\n",
+   "               +(9.0-68.0*t2))*psi\n",
+   "               +72.0*t2)*psi\n",
+   "               +24.0*t4)/120.0;\n",
+   "\n",
+   "    trm4 = (((720.0*t2+1320.0)*t2+662.0)*t2+61.0)/5040.0;\n",
+   "\n",
+   "    *ln = tm->meridian - (x*rclt)*(((trm4*x2-trm3)*x2+trm2)*x2-1.0);\n",
+   "    }\n",
+   "\n",
+   "void geod_tm_fast( __constant const tmc *tm,\n",
+   "              double ln, double lt, double *ce, double *cn ) {\n",
+   "    double rome2 = 1.0/tm->ome2;\n",
+   "    double dlon, m, slt, clt, eslt, eta, psi, wc, wc2, t, t2, t4;\n",
+   "    double trm1, trm2, trm3;\n",
+   "\n",
+   "    dlon  =  ln - tm->meridian;\n",
+   "    while ( dlon > PI ) dlon -= TWOPI;\n",
+   "    while ( dlon < -PI ) dlon += TWOPI;\n",
+   "\n",
+   "    slt = sin(lt);\n",
+   "    clt = cos(lt);\n",
+   "    m = meridian_arc_cs(tm,lt,slt,clt);\n",
+   "\n",
+   "    eslt = (1.0-tm->e2*slt*slt);\n",
+   "    eta = tm->a/sqrt(eslt);\n",
+   "    psi = eslt*rome2;\n",
+   "\n",
+   "    wc = clt*dlon;\n",
+   "    wc2 = wc*wc;\n",
+   "\n",
+   "    t = slt/clt;\n",
+   "    t2 = t*t;\n",
+   "    t4 = t2*t2;\n",
+   "\n",
+   "    trm1 = (psi-t2)/6.0;\n",
+   "\n",
+   "    trm2 = (((4.0*(1.0-6.0*t2)*psi\n",
+   "                  + (1.0+8.0*t2))*psi\n",
+   "                  - 2.0*t2)*psi+t4)/120.0;\n",
+   "\n",
+   "    *ce = (tm->scalef*eta*wc)*((trm2*wc2+trm1)*wc2+1.0)*tm->rutom+tm->falsee;\n",
+   "\n",
+   "    trm2 = ((4.0*psi+1)*psi-t2)/24.0;\n",
+   "\n",
+   "    trm3 = ((((8.0*(11.0-24.0*t2)*psi\n",
+   "                -28.0*(1.0-6.0*t2))*psi\n",
+   "                +(1.0-32.0*t2))*psi\n",
+   "                -2.0*t2)*psi\n",
+   "                +t4)/720.0;\n",
+   "\n",
+   "    *cn = ((eta*t)*(((trm3*wc2+trm2)*wc2+0.5)*wc2)+m-tm->om)*\n",
+   "          tm->scalef*tm->rutom+tm->falsen;\n",
+   "    }\n",
+   "\n",
+   "void tm_geod_precise( __constant const tmc *tm,\n",
+   "              double ce, double cn, double *ln, double *lt ) {\n",
+   "    double bln, blt, fce, fcn, slt, clt, eslt, eta, s, w, t2, a, b, d, de, dn;\n",
+   "\n",
+   "    tm_geod( tm, NZTM_REDFEARN, ce, cn, &bln, &blt );\n",
+   "    geod_tm( tm, NZTM_REDFEARN, bln, blt, &fce, &fcn );\n",
+   "\n",
+   "    slt = sin(blt);\n",
+   "    clt = cos(blt);\n",
+   "    eslt = 1.0 - tm->e2*slt*slt;\n",
+   "    eta = tm->a/sqrt(eslt);\n",
+   "    s = tm->ome2/(eslt*clt);\n",
+   "    w = (bln - tm->meridian)*clt;\n",
+   "    t2 = slt*slt/(clt*clt);\n",
+   "    a = tm->scalef*eta*clt*(1.0 + 0.5*(eslt/tm->ome2 - t2)*w*w);\n",
+   "    b = tm->scalef*eta*slt*w;\n",
+   "    d = a*a + b*b;\n",
+   "    de = (ce - fce)*tm->utom;\n",
+   "    dn = (cn - fcn)*tm->utom;\n",
+   "    *lt = blt + (a*dn - b*de)/(s*d);\n",
+   "    *ln = bln + (a*de + b*dn)/d;\n",
+   "    }\n",
+   "\n",
+   "__kernel void nztm_geod_tm( __constant const tmc *tm, int method,\n",
+   "              __global const double *in, __global double *out, uint count ) {\n",
+   "    size_t i = get_global_id(0);\n",
+   "    double ce, cn;\n",
+   "\n",
+   "    if( i >= count ) return;\n",
+   "    if( method == NZTM_FAST )\n",
+   "        geod_tm_fast( tm, in[2*i+1], in[2*i], &ce, &cn );\n",
+   "    else\n",
+   "        geod_tm( tm, method, in[2*i+1], in[2*i], &ce, &cn );\n",
+   "    out[2*i] = cn;\n",
+   "    out[2*i+1] = ce;\n",
+   "    }\n",
+   "\n",
+   "__kernel void nztm_tm_geod( __constant const tmc *tm, int method,\n",
+   "              __global const double *in, __global double *out, uint count ) {\n",
+   "    size_t i = get_global_id(0);\n",
+   "    double ln, lt;\n",
+   "\n",
+   "    if( i >= count ) return;\n",
+   "    if( method == NZTM_FAST )\n",
+   "        tm_geod_fast( tm, in[2*i+1], in[2*i], &ln, &lt );\n",
+   "    else if( method == NZTM_PRECISE )\n",
+   "        tm_geod_precise( tm, in[2*i+1], in[2*i], &ln, &lt );\n",
+   "    else\n",
+   "        tm_geod( tm, method, in[2*i+1], in[2*i], &ln, &lt );\n",
+   "    out[2*i] = lt;\n",
+   "    out[2*i+1] = ln;\n",
+   "    }\n"
+   };
+
+/* Sets c from the parameters in proj, as tm_define */
+
+static void cl_define( const double proj[8], cl_tmc *c ) {
+    double a = proj[0], f = 1.0/proj[1];
+    double e2, e4, e6, n, n2, n3, n4, lt;
+
+    c->meridian = proj[2];
+    c->scalef = proj[3];
+    c->falsee = proj[5];
+    c->falsen = proj[6];
+    c->utom = proj[7];
+    c->a = a;
+    c->e2 = e2 = 2.0*f - f*f;
+    e4 = e2*e2;
+    e6 = e4*e2;
+    c->A0 = 1 - (e2/4.0) - (3.0*e4/64.0) - (5.0*e6/256.0);
+    c->A2 = (3.0/8.0) * (e2+e4/4.0+15.0*e6/128.0);
+    c->A4 = (15.0/256.0) * (e4 + 3.0*e6/4.0);
+    c->A6 = 35.0*e6/3072.0;
+    n = f/(2.0-f);
+    n2 = n*n;
+    n3 = n2*n;
+    n4 = n2*n2;
+    c->g = a*(1.0-n)*(1.0-n2)*(1+9.0*n2/4.0+225.0*n4/64.0);
+    c->p2 = 3.0*n/2.0 - 27.0*n3/32.0;
+    c->p4 = 21.0*n2/16.0 - 55.0*n4/32.0;
+    c->p6 = 151.0*n3/96.0;
+    c->p8 = 1097.0*n4/512.0;
+    c->ome2 = 1.0 - e2;
+    c->rsf = 1.0/proj[3];
+    c->rutom = 1.0/proj[7];
+    lt = proj[4];
+    c->om = a*(c->A0*lt-c->A2*sin(2*lt)+c->A4*sin(4*lt)-c->A6*sin(6*lt));
+    }
+
+/* The first GPU or accelerator with double precision, or NULL */
+
+static cl_device_id cl_find( void ) {
+    cl_platform_id platform[16];
+    cl_device_id device[16];
+    cl_device_fp_config fp;
+    cl_uint np, nd, p, d;
+
+    if( clGetPlatformIDs( 16, platform, &np ) != CL_SUCCESS ) return NULL;
+    if( np > 16 ) np = 16;
+    for( p = 0; p < np; p++ ) {
+        if( clGetDeviceIDs( platform[p],
+                CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_ACCELERATOR, 16, device,
+                &nd ) != CL_SUCCESS ) continue;
+        if( nd > 16 ) nd = 16;
+        for( d = 0; d < nd; d++ )
+            if( clGetDeviceInfo( device[d], CL_DEVICE_DOUBLE_FP_CONFIG,
+                    sizeof(fp), &fp, NULL ) == CL_SUCCESS && fp != 0 )
+                return device[d];
+        }
+    return NULL;
+    }
+
+static void cl_close( void *dev ) {
+    cl_dev *c = (cl_dev *) dev;
+    int s;
+
+    for( s = 0; s < CL_STAGES; s++ )
+        if( c->stage[s] ) {
+            if( c->map[s] ) {
+                clEnqueueUnmapMemObject( c->queue[0], c->stage[s], c->map[s],
+                    0, NULL, NULL );
+                clFinish( c->queue[0] );
+                }
+            clReleaseMemObject( c->stage[s] );
+            }
+    for( s = 0; s < 2; s++ ) {
+        if( c->done[s] ) clReleaseEvent( c->done[s] );
+        if( c->tm[s] ) clReleaseMemObject( c->tm[s] );
+        if( c->in[s] ) clReleaseMemObject( c->in[s] );
+        if( c->out[s] ) clReleaseMemObject( c->out[s] );
+        if( c->queue[s] ) clReleaseCommandQueue( c->queue[s] );
+        if( c->kernel[s] ) clReleaseKernel( c->kernel[s] );
+        }
+    if( c->program ) clReleaseProgram( c->program );
+    if( c->context ) clReleaseContext( c->context );
+    free( c );
+    }
+
+static void *cl_open( void ) {
+    size_t bytes = 2*NZTM_OFFLOAD_CHUNK*sizeof(cl_double);
+    cl_device_id device;
+    cl_dev *c;
+    cl_int err;
+    int s;
+
+    if( ! ( device = cl_find() ) ) return NULL;
+    c = (cl_dev *) calloc( 1, sizeof(cl_dev) );
+    if( ! c ) return NULL;
+
+    c->context = clCreateContext( NULL, 1, &device, NULL, NULL, &err );
+    if( err != CL_SUCCESS ) goto fail;
+    c->program = clCreateProgramWithSource( c->context,
+        sizeof(cl_source)/sizeof(cl_source[0]), cl_source, NULL, &err );
+    if( err != CL_SUCCESS ||
+            clBuildProgram( c->program, 1, &device, "", NULL, NULL ) != CL_SUCCESS )
+        goto fail;
+    c->kernel[0] = clCreateKernel( c->program, "nztm_geod_tm", &err );
+    if( err != CL_SUCCESS ) goto fail;
+    c->kernel[1] = clCreateKernel( c->program, "nztm_tm_geod", &err );
+    if( err != CL_SUCCESS ) goto fail;
+
+    for( s = 0; s < 2; s++ ) {
+        c->queue[s] = clCreateCommandQueue( c->context, device, 0, &err );
+        if( err != CL_SUCCESS ) goto fail;
+        c->tm[s] = clCreateBuffer( c->context, CL_MEM_READ_ONLY,
+            sizeof(cl_tmc), NULL, &err );
+        if( err != CL_SUCCESS ) goto fail;
+        c->in[s] = clCreateBuffer( c->context, CL_MEM_READ_ONLY, bytes, NULL, &err );
+        if( err != CL_SUCCESS ) goto fail;
+        c->out[s] = clCreateBuffer( c->context, CL_MEM_WRITE_ONLY, bytes, NULL, &err );
+        if( err != CL_SUCCESS ) goto fail;
+        }
+    return c;
+
+fail:
+    cl_close( c );
+    return NULL;
+    }
+
+static void *cl_host_alloc( void *dev, size_t bytes ) {
+    cl_dev *c = (cl_dev *) dev;
+    cl_int err;
+    int s;
+
+    for( s = 0; s < CL_STAGES && c->stage[s]; s++ );
+    if( s == CL_STAGES ) return NULL;
+    c->stage[s] = clCreateBuffer( c->context,
+        CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, NULL, &err );
+    if( err != CL_SUCCESS ) {
+        c->stage[s] = NULL;
+        return NULL;
+        }
+    c->map[s] = clEnqueueMapBuffer( c->queue[0], c->stage[s], CL_TRUE,
+        CL_MAP_READ | CL_MAP_WRITE, 0, bytes, 0, NULL, NULL, &err );
+    if( err != CL_SUCCESS ) {
+        clReleaseMemObject( c->stage[s] );
+        c->stage[s] = NULL;
+        c->map[s] = NULL;
+        return NULL;
+        }
+    return c->map[s];
+    }
+
+static void cl_host_free( void *dev, void *p ) {
+    cl_dev *c = (cl_dev *) dev;
+    int s;
+
+    for( s = 0; s < CL_STAGES; s++ )
+        if( c->stage[s] && c->map[s] == p ) {
+            clEnqueueUnmapMemObject( c->queue[0], c->stage[s], p, 0, NULL, NULL );
+            clFinish( c->queue[0] );
+            clReleaseMemObject( c->stage[s] );
+            c->stage[s] = NULL;
+            c->map[s] = NULL;
+            }
+    }
+
+static int cl_submit( void *dev, int stream, int inverse, int method,
+        const double proj[8], const double *in, double *out, size_t count ) {
+    cl_dev *c = (cl_dev *) dev;
+    cl_command_queue q = c->queue[stream];
+    cl_kernel k = c->kernel[inverse ? 1 : 0];
+    size_t bytes = 2*count*sizeof(cl_double);
+    cl_int m = method;
+    cl_uint n = (cl_uint) count;
+
+    if( method < NZTM_REDFEARN || method > NZTM_PRECISE ) return -1;
+    if( c->done[stream] ) {
+        clReleaseEvent( c->done[stream] );
+        c->done[stream] = NULL;
+        }
+    cl_define( proj, &c->tmc[stream] );
+    if( clEnqueueWriteBuffer( q, c->tm[stream], CL_FALSE, 0, sizeof(cl_tmc),
+                &c->tmc[stream], 0, NULL, NULL ) != CL_SUCCESS ||
+            clEnqueueWriteBuffer( q, c->in[stream], CL_FALSE, 0, bytes, in,
+                0, NULL, NULL ) != CL_SUCCESS ||
+            clSetKernelArg( k, 0, sizeof(cl_mem), &c->tm[stream] ) != CL_SUCCESS ||
+            clSetKernelArg( k, 1, sizeof(cl_int), &m ) != CL_SUCCESS ||
+            clSetKernelArg( k, 2, sizeof(cl_mem), &c->in[stream] ) != CL_SUCCESS ||
+            clSetKernelArg( k, 3, sizeof(cl_mem), &c->out[stream] ) != CL_SUCCESS ||
+            clSetKernelArg( k, 4, sizeof(cl_uint), &n ) != CL_SUCCESS ||
+            clEnqueueNDRangeKernel( q, k, 1, NULL, &count, NULL, 0, NULL,
+                NULL ) != CL_SUCCESS ||
+            clEnqueueReadBuffer( q, c->out[stream], CL_FALSE, 0, bytes, out,
+                0, NULL, &c->done[stream] ) != CL_SUCCESS ||
+            clFlush( q ) != CL_SUCCESS ) {
+        clFinish( q );
+        return -1;
+        }
+    return 0;
+    }
+
+static int cl_wait( void *dev, int stream ) {
+    cl_dev *c = (cl_dev *) dev;
+    cl_int status;
+
+    if( ! c->done[stream] ) return -1;
+    if( clWaitForEvents( 1, &c->done[stream] ) != CL_SUCCESS ||
+            clGetEventInfo( c->done[stream], CL_EVENT_COMMAND_EXECUTION_STATUS,
+                sizeof(status), &status, NULL ) != CL_SUCCESS ||
+            status != CL_COMPLETE )
+        return -1;
+    return 0;
+    }
+
+const nztm_offload_device nztm_offload_device_v1 = { NZTM_OFFLOAD_VERSION,
+   "opencl", cl_open, cl_close, cl_host_alloc, cl_host_free, cl_submit,
+   cl_wait };
+
+#else
+
+/* Without OpenCL there is nothing to build, but ISO C forbids an empty
+   translation unit */
+
+typedef int nztm_offload_cl_unused;
+
+#endif
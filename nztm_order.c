@@ -0,0 +1,798 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Space filling curve orderings.
+
+   An ordering is a single block
+
+      header           order_header
+      rows             uint64[n]
+      ranks            uint64[n]
+
+   written to and mapped from files as it is.
+
+   The sort is a least significant digit radix sort by bytes.  Each pass
+   counts the digits of each chunk of ORDER_CHUNK keys, turns the counts
+   into the position of the first key with each digit from each chunk
+   (all of digit 0 chunk by chunk, then all of digit 1, ...), and moves
+   the keys of each chunk to their positions, chunks on the threads of
+   the pool; as the chunks are in order and each keeps its own order,
+   the sort is stable.  A pass in which every key has the same digit is
+   skipped. */
+
+#include "nztm_order.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ORDER_MAGIC     "NZTMORD1"
+#define ORDER_VERSION   1
+#define ORDER_CHUNK     65536     /* Items per parallel work item */
+#define ORDER_RADIX     256
+#define ORDER_EXTENTS   64        /* Chunk extents held on the stack */
+
+typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t curve;
+        uint64_t n;
+        } order_header;
+
+struct nztm_order {
+        void *block;              /* Allocated, or mapped with size */
+        size_t size;
+        int mapped;
+        const nztm_allocator *al; /* Of the ordering and an allocated block */
+        const order_header *h;
+        const uint64_t *rows;
+        const uint64_t *ranks;
+        };
+
+static size_t order_bytes( uint64_t n ) {
+    return sizeof(order_header) + 2*(size_t) n*sizeof(uint64_t);
+    }
+
+static void order_layout( nztm_order *o ) {
+    o->h = (const order_header *) o->block;
+    o->rows = (const uint64_t *) (o->h + 1);
+    o->ranks = o->rows + o->h->n;
+    }
+
+static size_t order_chunks( size_t n ) {
+    return (n + ORDER_CHUNK - 1)/ORDER_CHUNK;
+    }
+
+/* Position along the Hilbert curve of order 16 of (x,y), as in
+   nztm_rtree.c */
+
+static uint32_t order_hilbert( uint32_t x, uint32_t y ) {
+    uint32_t rx, ry, s, t;
+    uint32_t d = 0;
+
+    for( s = 1u << 15; s > 0; s >>= 1 ) {
+        rx = (x & s) != 0;
+        ry = (y & s) != 0;
+        d += s*s*((3*rx) ^ ry);
+        if( ry == 0 ) {
+            if( rx ) { x = 0xffff - x; y = 0xffff - y; }
+            t = x; x = y; y = t;
+            }
+        }
+    return d;
+    }
+
+/* The low 16 bits of v moved to the even bits */
+
+static uint32_t order_spread( uint32_t v ) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ffu;
+    v = (v | (v << 4)) & 0x0f0f0f0fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+    }
+
+/*************************************************************************/
+/*                                                                       */
+/*   Keys                                                                */
+/*                                                                       */
+/*************************************************************************/
+
+typedef struct {
+        int curve;
+        const double *x0, *y0, *x1, *y1;
+        size_t n;
+        double *extent;           /* minx miny maxx maxy for each chunk */
+        double minx, miny, sx, sy;    /* Scaling to the curve's grid */
+        uint32_t *keys;
+        } order_keyjob;
+
+/* Centre of the box of item i, returning 0 if it has a NaN or infinite
+   coordinate.  The halves are added so that the centre of two large
+   coordinates cannot overflow. */
+
+static int order_centre( const order_keyjob *k, size_t i, double *x, double *y ) {
+    double x0 = k->x0[i], y0 = k->y0[i];
+    double x1 = k->x1 ? k->x1[i] : x0, y1 = k->y1 ? k->y1[i] : y0;
+
+    if( ! isfinite( x0 ) || ! isfinite( y0 ) || ! isfinite( x1 ) ||
+        ! isfinite( y1 ) ) return 0;
+    *x = 0.5*x0 + 0.5*x1;
+    *y = 0.5*y0 + 0.5*y1;
+    return 1;
+    }
+
+/* The grid column or row of an offset v scaled to [0,65535].  It is
+   clamped, as an extent too wide for a double scales to inf or NaN. */
+
+static uint32_t order_cell( double v ) {
+    return v > 0.0 ? ( v < 65535.0 ? (uint32_t) v : 65535u ) : 0;
+    }
+
+static void order_extent( void *ctx, size_t item, int thread ) {
+    order_keyjob *k = (order_keyjob *) ctx;
+    size_t i = item*ORDER_CHUNK;
+    size_t end = i + ORDER_CHUNK < k->n ? i + ORDER_CHUNK : k->n;
+    double *e = k->extent + 4*item, x, y;
+
+    (void) thread;
+    e[0] = e[1] = HUGE_VAL;
+    e[2] = e[3] = -HUGE_VAL;
+    for( ; i < end; i++ ) {
+        if( ! order_centre( k, i, &x, &y ) ) continue;
+        if( x < e[0] ) e[0] = x;
+        if( y < e[1] ) e[1] = y;
+        if( x > e[2] ) e[2] = x;
+        if( y > e[3] ) e[3] = y;
+        }
+    }
+
+static void order_key( void *ctx, size_t item, int thread ) {
+    order_keyjob *k = (order_keyjob *) ctx;
+    size_t i = item*ORDER_CHUNK;
+    size_t end = i + ORDER_CHUNK < k->n ? i + ORDER_CHUNK : k->n;
+    uint32_t gx, gy, key;
+    double x, y;
+
+    (void) thread;
+    for( ; i < end; i++ ) {
+        if( ! order_centre( k, i, &x, &y ) ) {
+            k->keys[i] = UINT32_MAX;
+            continue;
+            }
+        gx = order_cell( (x - k->minx)*k->sx );
+        gy = order_cell( (y - k->miny)*k->sy );
+        key = k->curve == NZTM_ORDER_MORTON ?
+            order_spread( gx ) | (order_spread( gy ) << 1) :
+            order_hilbert( gx, gy );
+        k->keys[i] = key == UINT32_MAX ? key - 1 : key;
+        }
+    }
+
+int nztm_order_keys( nztm_pool *pool, int curve, const double *x0,
+   const double *y0, const double *x1, const double *y1, size_t n,
+   uint32_t *keys )
+{
+   return nztm_order_keys_a( pool, curve, x0, y0, x1, y1, n, keys, NULL );
+}
+
+int nztm_order_keys_a( nztm_pool *pool, int curve, const double *x0,
+   const double *y0, const double *x1, const double *y1, size_t n,
+   uint32_t *keys, const nztm_allocator *al )
+{
+   order_keyjob k;
+   double extent[4*ORDER_EXTENTS];
+   size_t nchunk = order_chunks( n ), i;
+   double minx = HUGE_VAL, miny = HUGE_VAL, maxx = -HUGE_VAL, maxy = -HUGE_VAL;
+
+   k.curve = curve;
+   k.x0 = x0; k.y0 = y0; k.x1 = x1; k.y1 = y1;
+   k.n = n;
+   k.keys = keys;
+   k.extent = nchunk <= ORDER_EXTENTS ? extent :
+      (double *) nztm_alloc( al, 4*nchunk*sizeof(double) );
+   if( ! k.extent ) return -1;
+
+   nztm_pool_run( pool, nchunk, order_extent, &k );
+   for( i = 0; i < nchunk; i++ ) {
+      if( k.extent[4*i] < minx ) minx = k.extent[4*i];
+      if( k.extent[4*i+1] < miny ) miny = k.extent[4*i+1];
+      if( k.extent[4*i+2] > maxx ) maxx = k.extent[4*i+2];
+      if( k.extent[4*i+3] > maxy ) maxy = k.extent[4*i+3];
+      }
+   if( k.extent != extent ) nztm_free( al, k.extent );
+
+   k.minx = minx;
+   k.miny = miny;
+   k.sx = maxx > minx ? 65535.0/(maxx - minx) : 0.0;
+   k.sy = maxy > miny ? 65535.0/(maxy - miny) : 0.0;
+   nztm_pool_run( pool, nchunk, order_key, &k );
+   return 0;
+}
+
+/*************************************************************************/
+/*                                                                       */
+/*   Sorting                                                             */
+/*                                                                       */
+/*************************************************************************/
+
+typedef struct {
+        const uint32_t *keys;     /* Source of the pass */
+        const uint64_t *rows;
+        uint32_t *k2;             /* Destination */
+        uint64_t *r2;
+        size_t n;
+        int shift;
+        size_t *count;            /* ORDER_RADIX for each chunk */
+        } order_sortjob;
+
+static void order_count( void *ctx, size_t item, int thread ) {
+    order_sortjob *s = (order_sortjob *) ctx;
+    size_t i = item*ORDER_CHUNK;
+    size_t end = i + ORDER_CHUNK < s->n ? i + ORDER_CHUNK : s->n;
+    size_t *count = s->count + item*ORDER_RADIX;
+    int shift = s->shift;
+
+    (void) thread;
+    memset( count, 0, ORDER_RADIX*sizeof(size_t) );
+    for( ; i < end; i++ ) count[(s->keys[i] >> shift) & 0xff]++;
+    }
+
+static void order_move( void *ctx, size_t item, int thread ) {
+    order_sortjob *s = (order_sortjob *) ctx;
+    size_t i = item*ORDER_CHUNK;
+    size_t end = i + ORDER_CHUNK < s->n ? i + ORDER_CHUNK : s->n;
+    size_t *pos = s->count + item*ORDER_RADIX;
+    int shift = s->shift;
+    size_t t;
+
+    (void) thread;
+    for( ; i < end; i++ ) {
+        t = pos[(s->keys[i] >> shift) & 0xff]++;
+        s->k2[t] = s->keys[i];
+        s->r2[t] = s->rows[i];
+        }
+    }
+
+int nztm_order_sort( nztm_pool *pool, uint32_t *keys, uint64_t *rows,
+   size_t n )
+{
+   return nztm_order_sort_a( pool, keys, rows, n, NULL );
+}
+
+int nztm_order_sort_a( nztm_pool *pool, uint32_t *keys, uint64_t *rows,
+   size_t n, const nztm_allocator *al )
+{
+   order_sortjob s;
+   size_t nchunk = order_chunks( n ), sum, first, t, c;
+   uint32_t *k2;
+   uint64_t *r2;
+   void *swap;
+   int d, skip;
+
+   if( n < 2 ) return 0;
+   k2 = (uint32_t *) nztm_alloc( al, n*sizeof(uint32_t) );
+   r2 = (uint64_t *) nztm_alloc( al, n*sizeof(uint64_t) );
+   s.count = (size_t *) nztm_alloc( al, nchunk*ORDER_RADIX*sizeof(size_t) );
+   if( ! k2 || ! r2 || ! s.count ) {
+      nztm_free( al, k2 );
+      nztm_free( al, r2 );
+      nztm_free( al, s.count );
+      return -1;
+      }
+   s.keys = keys;
+   s.rows = rows;
+   s.k2 = k2;
+   s.r2 = r2;
+   s.n = n;
+
+   for( s.shift = 0; s.shift < 32; s.shift += 8 ) {
+      nztm_pool_run( pool, nchunk, order_count, &s );
+      for( d = 0, sum = 0, skip = 0; d < ORDER_RADIX; d++ ) {
+         first = sum;
+         for( c = 0; c < nchunk; c++ ) {
+            t = s.count[c*ORDER_RADIX + d];
+            s.count[c*ORDER_RADIX + d] = sum;
+            sum += t;
+            }
+         if( sum - first == n ) skip = 1;
+         }
+      if( skip ) continue;
+      nztm_pool_run( pool, nchunk, order_move, &s );
+      swap = (void *) s.keys; s.keys = s.k2; s.k2 = (uint32_t *) swap;
+      swap = (void *) s.rows; s.rows = s.r2; s.r2 = (uint64_t *) swap;
+      }
+
+   if( s.keys != keys ) {
+      memcpy( keys, s.keys, n*sizeof(uint32_t) );
+      memcpy( rows, s.rows, n*sizeof(uint64_t) );
+      }
+   nztm_free( al, k2 );
+   nztm_free( al, r2 );
+   nztm_free( al, s.count );
+   return 0;
+}
+
+/*************************************************************************/
+/*                                                                       */
+/*   Orderings                                                           */
+/*                                                                       */
+/*************************************************************************/
+
+typedef struct {
+        const uint64_t *rows;
+        uint64_t *ranks;
+        const char *in;
+        char *out;
+        size_t n, size;
+        } order_permjob;
+
+static void order_rank( void *ctx, size_t item, int thread ) {
+    order_permjob *p = (order_permjob *) ctx;
+    size_t i = item*ORDER_CHUNK;
+    size_t end = i + ORDER_CHUNK < p->n ? i + ORDER_CHUNK : p->n;
+
+    (void) thread;
+    for( ; i < end; i++ ) p->ranks[p->rows[i]] = i;
+    }
+
+nztm_order *nztm_order_build( nztm_pool *pool, int curve, const double *x0,
+   const double *y0, const double *x1, const double *y1, size_t n )
+{
+   return nztm_order_build_a( pool, curve, x0, y0, x1, y1, n, NULL );
+}
+
+nztm_order *nztm_order_build_a( nztm_pool *pool, int curve,
+   const double *x0, const double *y0, const double *x1, const double *y1,
+   size_t n, const nztm_allocator *al )
+{
+   order_permjob p;
+   order_header *h;
+   nztm_order *o;
+   uint32_t *keys;
+   uint64_t *rows;
+   size_t i;
+
+   o = (nztm_order *) nztm_zalloc( al, sizeof(nztm_order) );
+   keys = (uint32_t *) nztm_alloc( al, (n + 1)*sizeof(uint32_t) );
+   if( o ) o->al = al;
+   if( o ) o->size = order_bytes( n );
+   if( o ) o->block = nztm_alloc( al, o->size );
+   if( ! o || ! o->block || ! keys ) goto fail;
+
+   h = (order_header *) o->block;
+   memset( h, 0, sizeof(*h) );
+   memcpy( h->magic, ORDER_MAGIC, 8 );
+   h->version = ORDER_VERSION;
+   h->curve = (uint32_t) curve;
+   h->n = n;
+   order_layout( o );
+
+   rows = (uint64_t *) o->rows;
+   for( i = 0; i < n; i++ ) rows[i] = i;
+   if( nztm_order_keys_a( pool, curve, x0, y0, x1, y1, n, keys, al ) != 0 ||
+       nztm_order_sort_a( pool, keys, rows, n, al ) != 0 ) goto fail;
+   p.rows = o->rows;
+   p.ranks = (uint64_t *) o->ranks;
+   p.n = n;
+   nztm_pool_run( pool, order_chunks( n ), order_rank, &p );
+   nztm_free( al, keys );
+   return o;
+
+fail:
+   nztm_free( al, keys );
+   nztm_order_destroy( o );
+   return NULL;
+}
+
+void nztm_order_destroy( nztm_order *o )
+{
+   if( ! o ) return;
+   if( o->mapped ) munmap( o->block, o->size );
+   else nztm_free( o->al, o->block );
+   nztm_free( o->al, o );
+}
+
+size_t nztm_order_size( const nztm_order *o )
+{
+   return (size_t) o->h->n;
+}
+
+int nztm_order_curve( const nztm_order *o )
+{
+   return (int) o->h->curve;
+}
+
+const uint64_t *nztm_order_rows( const nztm_order *o )
+{
+   return o->rows;
+}
+
+const uint64_t *nztm_order_ranks( const nztm_order *o )
+{
+   return o->ranks;
+}
+
+/*************************************************************************/
+/*                                                                       */
+/*   Files                                                               */
+/*                                                                       */
+/*************************************************************************/
+
+int nztm_order_save( const nztm_order *o, const char *path )
+{
+   FILE *f = fopen( path, "wb" );
+   int ok;
+
+   if( ! f ) return -1;
+   ok = fwrite( o->block, 1, o->size, f ) == o->size;
+   if( fclose( f ) != 0 ) ok = 0;
+   return ok ? 0 : -1;
+}
+
+/* Checks the header of a mapped ordering, and that rows and ranks are
+   inverse permutations */
+
+static int order_check( const void *block, size_t size ) {
+    const order_header *h = (const order_header *) block;
+    const uint64_t *rows, *ranks;
+    uint64_t i;
+
+    if( size < sizeof(order_header) || memcmp( h->magic, ORDER_MAGIC, 8 ) != 0 ||
+        h->version != ORDER_VERSION || h->curve > NZTM_ORDER_MORTON ||
+        h->n > (size - sizeof(order_header))/16 || order_bytes( h->n ) != size )
+        return -1;
+    rows = (const uint64_t *) (h + 1);
+    ranks = rows + h->n;
+    for( i = 0; i < h->n; i++ )
+        if( rows[i] >= h->n || ranks[rows[i]] != i ) return -1;
+    return 0;
+    }
+
+nztm_order *nztm_order_open( const char *path )
+{
+   nztm_order *o;
+   struct stat st;
+   void *map;
+   int fd;
+
+   fd = open( path, O_RDONLY );
+   if( fd < 0 ) return NULL;
+   if( fstat( fd, &st ) != 0 || st.st_size <= 0 ) { close( fd ); return NULL; }
+   map = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+   close( fd );
+   if( map == MAP_FAILED ) return NULL;
+
+   o = (nztm_order *) calloc( 1, sizeof(nztm_order) );
+   if( ! o || order_check( map, (size_t) st.st_size ) != 0 ) {
+      free( o );
+      munmap( map, (size_t) st.st_size );
+      return NULL;
+      }
+   o->block = map;
+   o->size = (size_t) st.st_size;
+   o->mapped = 1;
+   order_layout( o );
+   return o;
+}
+
+/*************************************************************************/
+/*                                                                       */
+/*   Applying orderings                                                  */
+/*                                                                       */
+/*************************************************************************/
+
+static void order_gather( void *ctx, size_t item, int thread ) {
+    order_permjob *p = (order_permjob *) ctx;
+    size_t i = item*ORDER_CHUNK;
+    size_t end = i + ORDER_CHUNK < p->n ? i + ORDER_CHUNK : p->n;
+    const uint64_t *rows = p->rows;
+
+    (void) thread;
+    if( p->size == sizeof(double) ) {
+        for( ; i < end; i++ )
+            ((uint64_t *) p->out)[i] = ((const uint64_t *) p->in)[rows[i]];
+        }
+    else if( p->size == sizeof(uint32_t) ) {
+        for( ; i < end; i++ )
+            ((uint32_t *) p->out)[i] = ((const uint32_t *) p->in)[rows[i]];
+        }
+    else {
+        for( ; i < end; i++ )
+            memcpy( p->out + i*p->size, p->in + rows[i]*p->size, p->size );
+        }
+    }
+
+static void order_scatter( void *ctx, size_t item, int thread ) {
+    order_permjob *p = (order_permjob *) ctx;
+    size_t i = item*ORDER_CHUNK;
+    size_t end = i + ORDER_CHUNK < p->n ? i + ORDER_CHUNK : p->n;
+    const uint64_t *rows = p->rows;
+
+    (void) thread;
+    if( p->size == sizeof(double) ) {
+        for( ; i < end; i++ )
+            ((uint64_t *) p->out)[rows[i]] = ((const uint64_t *) p->in)[i];
+        }
+    else if( p->size == sizeof(uint32_t) ) {
+        for( ; i < end; i++ )
+            ((uint32_t *) p->out)[rows[i]] = ((const uint32_t *) p->in)[i];
+        }
+    else {
+        for( ; i < end; i++ )
+            memcpy( p->out + rows[i]*p->size, p->in + i*p->size, p->size );
+        }
+    }
+
+void nztm_order_gather( nztm_pool *pool, const nztm_order *o,
+   const void *in, void *out, size_t size )
+{
+   order_permjob p;
+
+   p.rows = o->rows;
+   p.in = (const char *) in;
+   p.out = (char *) out;
+   p.n = (size_t) o->h->n;
+   p.size = size;
+   nztm_pool_run( pool, order_chunks( p.n ), order_gather, &p );
+}
+
+void nztm_order_scatter( nztm_pool *pool, const nztm_order *o,
+   const void *in, void *out, size_t size )
+{
+   order_permjob p;
+
+   p.rows = o->rows;
+   p.in = (const char *) in;
+   p.out = (char *) out;
+   p.n = (size_t) o->h->n;
+   p.size = size;
+   nztm_pool_run( pool, order_chunks( p.n ), order_scatter, &p );
+}
+
+#ifdef NZTM_ORDER_TOOL
+
+/* Writes the ordering of a data set to a file.  Build with
+      cc -O2 -DNZTM_ORDER_TOOL -o nztm_order nztm_order.c nztm_pool.c \
+         nztm_tow.c nztm_coast.c nztm_csv.c nztm.c nztm_simd.c -lm -lpthread
+   and run as
+      nztm_order [-morton] [-utm zone] -csv file.csv lat lon [lat1 lon1] out.ord
+      nztm_order [-morton] -tow file.tow e n [e1 n1] out.ord
+      nztm_order [-morton] [-utm zone] -coast file.bin out.ord
+   ordering the points (or, with a second pair of columns, the
+   segments) of a CSV file, projected with NZTM or UTM, the projected
+   columns of a tow file, or the segments of a coastline, for example
+      nztm_order -utm 27 -csv spring.csv kastad_breidd kastad_lengd \
+                 hift_breidd hift_lengd spring.ord
+   The mean distance between successive items is reported in file
+   order and in curve order. */
+
+#include <time.h>
+
+#include "nztm_coast.h"
+#include "nztm_csv.h"
+#include "nztm_tow.h"
+#include "tmproj.h"
+
+static double tool_now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+    }
+
+/* Mean distance between the centres of successive items, taken in the
+   order of rows (or of the file if rows is NULL), skipping NaNs */
+
+static double tool_step( const double *x0, const double *y0,
+        const double *x1, const double *y1, const uint64_t *rows, size_t n ) {
+    double x, y, px = 0.0, py = 0.0, sum = 0.0;
+    size_t i, r, m = 0;
+    int have = 0;
+
+    for( i = 0; i < n; i++ ) {
+        r = rows ? (size_t) rows[i] : i;
+        x = x1 ? 0.5*(x0[r] + x1[r]) : x0[r];
+        y = y1 ? 0.5*(y0[r] + y1[r]) : y0[r];
+        if( ! isfinite( x ) || ! isfinite( y ) ) continue;
+        if( have ) {
+            sum += hypot( x - px, y - py );
+            m++;
+            }
+        px = x;
+        py = y;
+        have = 1;
+        }
+    return m ? sum/m : 0.0;
+    }
+
+/* Reads the ncol columns lat, lon (and lat1, lon1) of a CSV file and
+   projects them to columns of northing and easting at *xy, returning
+   the number of rows or -1 */
+
+static long tool_csv( const char *path, const tmprojection *tm,
+        const char **names, int ncol, double **xy ) {
+    nztm_csv_field f[256];
+    nztm_csv *c;
+    FILE *in;
+    double v, *nxy;
+    size_t n = 0, cap = 0, i;
+    int col[4], nf, j, k;
+
+    if( ! ( in = fopen( path, "r" ) ) ) return -1;
+    if( ! ( c = nztm_csv_open( in, 0 ) ) ) { fclose( in ); return -1; }
+    nf = nztm_csv_read( c, f, 256 );
+    for( k = 0; k < ncol; k++ ) {
+        for( col[k] = -1, j = 0; j < nf && j < 256; j++ )
+            if( f[j].len == strlen( names[k] ) &&
+                memcmp( f[j].p, names[k], f[j].len ) == 0 ) col[k] = j;
+        if( col[k] < 0 ) {
+            fprintf( stderr, "No column %s in %s\n", names[k], path );
+            return -1;
+            }
+        }
+    *xy = NULL;
+    while( ( nf = nztm_csv_read( c, f, 256 ) ) > 0 ) {
+        if( n == cap ) {
+            cap = cap ? 2*cap : 4096;
+            if( ! ( nxy = (double *) realloc( *xy, 4*cap*sizeof(double) ) ) ) return -1;
+            *xy = nxy;
+            }
+        for( k = 0; k < ncol; k++ ) {
+            if( col[k] >= nf || col[k] >= 256 ||
+                ! nztm_csv_double( f[col[k]].p, f[col[k]].len, &v ) ) v = NAN;
+            (*xy)[4*n + k] = v/rad2deg;
+            }
+        n++;
+        }
+    nztm_csv_close( c );
+    fclose( in );
+
+    /* Rows of lat lon (lat1 lon1) to columns, and those to columns of
+       northing and easting */
+
+    if( ! ( nxy = (double *) malloc( 8*(n + 1)*sizeof(double) ) ) ) return -1;
+    for( k = 0; k < ncol; k++ )
+        for( i = 0; i < n; i++ ) nxy[4*n + k*n + i] = (*xy)[4*i + k];
+    for( k = 0; k < ncol; k += 2 )
+        geod_tm_hn( tm, nxy + 4*n + k*n, nxy + 4*n + (k+1)*n, nxy + k*n,
+            nxy + (k+1)*n, n );
+    free( *xy );
+    *xy = nxy;
+    return (long) n;
+    }
+
+int main( int argc, char *argv[] ) {
+  const double *x0, *y0, *x1 = NULL, *y1 = NULL;
+  const char *mode = NULL, *out;
+  tmprojection *utm = NULL;
+  const tmprojection *tm;
+  double *xy = NULL, t0, *lt;
+  nztm_order *o;
+  nztm_pool *pool;
+  nztm_coast c;
+  nztm_tow t;
+  size_t n = 0, i, j, k;
+  long m;
+  int curve = NZTM_ORDER_HILBERT, a, nargs, col[4];
+
+  for( a = 1; a < argc && argv[a][0] == '-'; a++ ) {
+     if( strcmp( argv[a], "-morton" ) == 0 )
+        curve = NZTM_ORDER_MORTON;
+     else if( strcmp( argv[a], "-utm" ) == 0 && a + 1 < argc ) {
+        int zone = atoi( argv[++a] );
+        int south = strchr( argv[a], 's' ) || strchr( argv[a], 'S' );
+        if( zone < 1 || zone > 60 ) {
+           fprintf( stderr, "Invalid UTM zone %s\n", argv[a] );
+           return 1;
+           }
+        tm_destroy( utm );
+        utm = tm_create( NZTM_A, NZTM_RF, (6.0*zone - 183.0)/rad2deg,
+           0.9996, 0.0, 500000.0, south ? 10000000.0 : 0.0, 1.0 );
+        }
+     else {
+        mode = argv[a++];
+        break;
+        }
+     }
+  nargs = argc - a - 2;     /* Columns, between the file and the output */
+  if( ! mode || argc - a < 2 ||
+      ( strcmp( mode, "-coast" ) == 0 ? nargs != 0 :
+        ( nargs != 2 && nargs != 4 ) ) ) {
+     fprintf( stderr,
+        "Usage: nztm_order [-morton] [-utm zone] -csv file.csv lat lon [lat1 lon1] out.ord\n"
+        "       nztm_order [-morton] -tow file.tow e n [e1 n1] out.ord\n"
+        "       nztm_order [-morton] [-utm zone] -coast file.bin out.ord\n" );
+     return 1;
+     }
+  tm = utm ? utm : &nztm_projection;
+  out = argv[argc-1];
+
+  if( strcmp( mode, "-csv" ) == 0 ) {
+     if( ( m = tool_csv( argv[a], tm, (const char **) argv + a + 1, nargs, &xy ) ) < 0 ) {
+        fprintf( stderr, "Cannot read %s\n", argv[a] );
+        return 1;
+        }
+     n = (size_t) m;
+     x0 = xy + n;      /* Northing then easting columns */
+     y0 = xy;
+     if( nargs == 4 ) { x1 = xy + 3*n; y1 = xy + 2*n; }
+     }
+  else if( strcmp( mode, "-tow" ) == 0 ) {
+     if( nztm_tow_open( &t, argv[a] ) != 0 ) {
+        fprintf( stderr, "%s is not a valid tow file\n", argv[a] );
+        return 1;
+        }
+     for( k = 0; k < (size_t) nargs; k++ ) {
+        col[k] = nztm_tow_column( &t, argv[a+1+k] );
+        if( ! nztm_tow_double( &t, col[k] ) ) {
+           fprintf( stderr, "No double column %s in %s\n", argv[a+1+k], argv[a] );
+           return 1;
+           }
+        }
+     n = t.nrows;
+     x0 = nztm_tow_double( &t, col[0] );
+     y0 = nztm_tow_double( &t, col[1] );
+     if( nargs == 4 ) {
+        x1 = nztm_tow_double( &t, col[2] );
+        y1 = nztm_tow_double( &t, col[3] );
+        }
+     }
+  else if( strcmp( mode, "-coast" ) == 0 ) {
+     if( nztm_coast_open( &c, argv[a] ) != 0 ) {
+        fprintf( stderr, "%s is not a valid coastline file\n", argv[a] );
+        return 1;
+        }
+
+     /* Vertex j of a part to the next, the last back to the first */
+
+     n = c.npoints;
+     if( ! ( xy = (double *) malloc( 6*(n + 1)*sizeof(double) ) ) ) return 1;
+     lt = xy + 4*n;
+     for( i = 0, k = 0; i < (size_t) c.nparts; i++ ) {
+        for( j = 0; j < c.part[i].n; j++ ) {
+           lt[j] = c.part[i].lat[j]/rad2deg;
+           lt[n + j] = c.part[i].lon[j]/rad2deg;
+           }
+        geod_tm_hn( tm, lt, lt + n, xy + n + k, xy + k, c.part[i].n );
+        for( j = 0; j < c.part[i].n; j++ ) {
+           xy[2*n + k + j] = xy[k + (j + 1) % c.part[i].n];
+           xy[3*n + k + j] = xy[n + k + (j + 1) % c.part[i].n];
+           }
+        k += c.part[i].n;
+        }
+     n = k;
+     x0 = xy; y0 = xy + n; x1 = xy + 2*n; y1 = xy + 3*n;
+     }
+  else {
+     fprintf( stderr, "Unknown data set %s\n", mode );
+     return 1;
+     }
+
+  pool = nztm_pool_create( 0 );
+  t0 = tool_now();
+  if( ! ( o = nztm_order_build( pool, curve, x0, y0, x1, y1, n ) ) ) {
+     fprintf( stderr, "Cannot allocate memory\n" );
+     return 1;
+     }
+  printf( "%lu items ordered along the %s curve in %.3f s\n", (unsigned long) n,
+     curve == NZTM_ORDER_MORTON ? "Morton" : "Hilbert", tool_now() - t0 );
+  printf( "mean step between items: %.0f m in file order, %.0f m in curve order\n",
+     tool_step( x0, y0, x1, y1, NULL, n ),
+     tool_step( x0, y0, x1, y1, nztm_order_rows( o ), n ) );
+  if( nztm_order_save( o, out ) != 0 ) {
+     fprintf( stderr, "Cannot write %s\n", out );
+     return 1;
+     }
+  nztm_order_destroy( o );
+  nztm_pool_destroy( pool );
+  tm_destroy( utm );
+  free( xy );
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef _NZTM_ORDER_H
+#define _NZTM_ORDER_H
+
+/* Space filling curve orderings of point and segment datasets, so that
+   work visiting records in turn (R-tree and land mask probes, grid
+   accumulation, nearest neighbour searches) touches memory near the
+   last record rather than wherever the next record of the file falls.
+
+   nztm_order_build computes a key for each of n items, each a box
+   (x0,y0)-(x1,y1) in projected coordinates, for example a tow from its
+   start to its end, a coastline segment, or a point if x1 and y1 are
+   NULL: the position of the centre of the box along a Hilbert or
+   Morton (Z order) curve of order 16 over the extent of the data.  It
+   then sorts the items by key with a stable radix sort run on the
+   threads of pool (which may be NULL), so items with the same key keep
+   their order.  Items with a NaN or infinite coordinate come last, in
+   their original order.
+
+   The result is a permutation held both ways: rows, giving for each
+   position in curve order the original row, and ranks, giving for each
+   original row its position, so data reordered with nztm_order_gather
+   can always be traced back to (or scattered back into) the rows they
+   came from.  A permutation can be saved to a file, next to the data
+   set it orders, and nztm_order_open maps it back in place.
+
+   The Hilbert curve keeps successive items closer together; the Morton
+   curve is cheaper to compute and its keys can be compared as bits of
+   the two coordinates. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nztm_arena.h"
+#include "nztm_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_ORDER_HILBERT  0
+#define NZTM_ORDER_MORTON   1
+
+typedef struct nztm_order nztm_order;
+
+/* Keys of the n items, as in nztm_order_build, into keys.  Items with
+   a NaN or infinite coordinate are given key UINT32_MAX, after all
+   others.
+   Returns 0, or -1 if memory cannot be allocated. */
+
+int nztm_order_keys( nztm_pool *pool, int curve, const double *x0,
+   const double *y0, const double *x1, const double *y1, size_t n,
+   uint32_t *keys );
+
+/* Sorts the n keys into increasing order, permuting rows with them and
+   keeping the order of equal keys.  Returns 0, or -1 if memory cannot
+   be allocated. */
+
+int nztm_order_sort( nztm_pool *pool, uint32_t *keys, uint64_t *rows,
+   size_t n );
+
+/* Returns NULL if memory cannot be allocated */
+
+nztm_order *nztm_order_build( nztm_pool *pool, int curve, const double *x0,
+   const double *y0, const double *x1, const double *y1, size_t n );
+void nztm_order_destroy( nztm_order *o );
+
+/* As nztm_order_keys, nztm_order_sort and nztm_order_build, taking
+   their working memory, and the memory of the ordering built, from al
+   (nztm_arena.h), which must outlive the ordering */
+
+int nztm_order_keys_a( nztm_pool *pool, int curve, const double *x0,
+   const double *y0, const double *x1, const double *y1, size_t n,
+   uint32_t *keys, const nztm_allocator *al );
+int nztm_order_sort_a( nztm_pool *pool, uint32_t *keys, uint64_t *rows,
+   size_t n, const nztm_allocator *al );
+nztm_order *nztm_order_build_a( nztm_pool *pool, int curve,
+   const double *x0, const double *y0, const double *x1, const double *y1,
+   size_t n, const nztm_allocator *al );
+
+size_t nztm_order_size( const nztm_order *o );
+int nztm_order_curve( const nztm_order *o );
+
+/* The permutation: rows[i] is the original row of position i, and
+   ranks[r] the position of original row r */
+
+const uint64_t *nztm_order_rows( const nztm_order *o );
+const uint64_t *nztm_order_ranks( const nztm_order *o );
+
+/* Save returns 0 or -1 on error; open returns NULL if the file cannot
+   be mapped or is not a valid ordering. */
+
+int nztm_order_save( const nztm_order *o, const char *path );
+nztm_order *nztm_order_open( const char *path );
+
+/* Copies an array of nztm_order_size(o) elements of size bytes into
+   curve order (out[i] = in[rows[i]]), or back into row order
+   (out[rows[i]] = in[i]), on the threads of pool.  in and out must not
+   overlap. */
+
+void nztm_order_gather( nztm_pool *pool, const nztm_order *o,
+   const void *in, void *out, size_t size );
+void nztm_order_scatter( nztm_pool *pool, const nztm_order *o,
+   const void *in, void *out, size_t size );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
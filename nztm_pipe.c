@@ -0,0 +1,633 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Pipelined CSV reprojection.  Needs POSIX threads (link with
+   -lpthread).
+
+   The queues are rings of PIPE_QUEUE batch pointers, with the index of
+   the next to take written only by the consumer and that of the next
+   to put only by the producer, each on a cache line of its own.  A
+   queue has room for every batch of its kind and the NULL that ends
+   the stream, so putting never waits; only taking does, which is how
+   a stage that runs ahead is held back, by running out of free
+   batches.  A failing stage sets failed, after which every wait
+   returns at once and the stages stop. */
+
+#include "nztm_pipe.h"
+
+#include "tmproj.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PIPE_QUEUE    16          /* Slots in a queue, above
+                                     2*NZTM_PIPE_BATCHES */
+#define PIPE_LINE     64          /* Cache line size */
+#define PIPE_SPIN     64          /* Yields before sleeping */
+#define PIPE_SLEEP    50000       /* Nanoseconds slept at a time */
+#define PIPE_MAXCOLS  4096        /* Header fields searched for columns */
+
+#define PIPE_FREE      0          /* Queues of input blocks */
+#define PIPE_READ      1
+#define PIPE_PARSED    2
+#define PIPE_PROJECTED 3
+#define PIPE_OFREE     4          /* Queues of output blocks */
+#define PIPE_OFULL     5
+#define PIPE_NQUEUES   6
+
+typedef struct {
+        void *slot[PIPE_QUEUE];
+        size_t head;              /* Next to take, written by the consumer */
+        char pad1[PIPE_LINE - sizeof(size_t)];
+        size_t tail;              /* Next to put, written by the producer */
+        char pad2[PIPE_LINE - sizeof(size_t)];
+        } pipe_queue;
+
+/* A block of input records.  coord holds for each pair the latitudes,
+   longitudes, northings and eastings of the records, in runs of
+   NZTM_PIPE_RECORDS. */
+
+typedef struct {
+        char *text;               /* NZTM_PIPE_BLOCK bytes */
+        size_t len;
+        size_t nrec;
+        int header;               /* The first record is the header */
+        size_t *start;            /* Offset and length of each record */
+        size_t *length;
+        unsigned char *crlf;      /* Record ended with \r\n */
+        double *coord;
+        } pipe_block;
+
+typedef struct {
+        char *text;
+        size_t len;
+        size_t nrec;              /* Records in text */
+        } pipe_output;
+
+typedef struct {
+        FILE *in, *out;
+        const tmprojection *tm;
+        const nztm_csv_pair *pairs;
+        int npairs;
+        int decimals;
+        int *col;                 /* Input columns of the coordinates */
+        int maxcol;
+        int hquoted;              /* First header field was quoted */
+        size_t extra;             /* Most added to a record */
+        size_t outsize;           /* Size of an output block */
+        long nrec;
+        int failed;
+        const char *msg;
+        pipe_queue queue[PIPE_NQUEUES];
+        pipe_block block[NZTM_PIPE_BATCHES];
+        pipe_output output[NZTM_PIPE_BATCHES];
+        nztm_pipe_stage stage[NZTM_PIPE_NSTAGES];
+        } pipe_job;
+
+static const char *pipe_names[NZTM_PIPE_NSTAGES] = { "read", "parse",
+   "project", "format", "write" };
+
+static double pipe_seconds( const struct timespec *t0 ) {
+    struct timespec t1;
+
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    return (t1.tv_sec - t0->tv_sec) + 1.0e-9*(t1.tv_nsec - t0->tv_nsec);
+    }
+
+static void pipe_fail( pipe_job *p, const char *msg ) {
+    int expected = 0;
+
+    if( __atomic_compare_exchange_n( &p->failed, &expected, 1, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+        p->msg = msg;
+    }
+
+static void pipe_put( pipe_queue *q, void *v ) {
+    size_t t = q->tail;
+
+    q->slot[t % PIPE_QUEUE] = v;
+    __atomic_store_n( &q->tail, t + 1, __ATOMIC_RELEASE );
+    }
+
+/* Takes the next batch from q for stage, or returns NULL at the end of
+   the stream or on failure */
+
+static void *pipe_take( pipe_job *p, pipe_queue *q, int stage ) {
+    size_t h = q->head;
+    struct timespec t0, ts;
+    int spins = 0;
+    void *v;
+
+    while( __atomic_load_n( &q->tail, __ATOMIC_ACQUIRE ) == h ) {
+        if( __atomic_load_n( &p->failed, __ATOMIC_ACQUIRE ) ) break;
+        if( spins++ == 0 ) clock_gettime( CLOCK_MONOTONIC, &t0 );
+        if( spins < PIPE_SPIN )
+            sched_yield();
+        else {
+            ts.tv_sec = 0;
+            ts.tv_nsec = PIPE_SLEEP;
+            nanosleep( &ts, NULL );
+            }
+        }
+    if( spins ) p->stage[stage].wait += pipe_seconds( &t0 );
+    if( __atomic_load_n( &p->failed, __ATOMIC_ACQUIRE ) ) return NULL;
+    v = q->slot[h % PIPE_QUEUE];
+    __atomic_store_n( &q->head, h + 1, __ATOMIC_RELEASE );
+    return v;
+    }
+
+/* The length of the complete records at the start of the len bytes at
+   t, at most NZTM_PIPE_RECORDS of them, setting *nrec to their number.
+   Records end at line breaks outside quoted fields, as in nztm_csv;
+   at the end of the input, the rest is the last record. */
+
+static size_t pipe_cut( const char *t, size_t len, int eof, size_t *nrec ) {
+    const char *p = t, *e = t + len, *q;
+    size_t n = 0, cut = 0;
+
+    while( p < e && n < NZTM_PIPE_RECORDS ) {
+        for( ;; ) {
+            if( p < e && *p == '"' ) {
+                for( q = p + 1; ; q += 2 ) {
+                    q = (const char *) memchr( q, '"', e - q );
+                    if( ! q || q + 1 >= e || q[1] != '"' ) break;
+                    }
+                if( ! q || (q + 1 == e && ! eof) ) goto done;
+                p = q + 1;
+                }
+            while( p < e && *p != ',' && *p != '\n' ) p++;
+            if( p == e ) goto done;
+            if( *p++ == ',' ) continue;
+            n++;
+            cut = p - t;
+            break;
+            }
+        }
+
+done:
+    if( eof && cut < len && n < NZTM_PIPE_RECORDS ) {
+        n++;
+        cut = len;
+        }
+    *nrec = n;
+    return cut;
+    }
+
+/* Reads blocks of whole records.  The records after the cut, and any
+   partial record, are copied to the start of the next block. */
+
+static void pipe_read( pipe_job *p ) {
+    nztm_pipe_stage *st = p->stage + NZTM_PIPE_READ;
+    pipe_block *b, *next;
+    size_t n, cut, nrec;
+    int eof = 0;
+
+    b = (pipe_block *) pipe_take( p, p->queue + PIPE_FREE, NZTM_PIPE_READ );
+    if( ! b ) return;
+    b->len = 0;
+    for( ;; ) {
+        if( ! eof && b->len < NZTM_PIPE_BLOCK ) {
+            n = fread( b->text + b->len, 1, NZTM_PIPE_BLOCK - b->len, p->in );
+            if( n < NZTM_PIPE_BLOCK - b->len ) {
+                if( ferror( p->in ) ) { pipe_fail( p, "read error" ); return; }
+                eof = 1;
+                }
+            b->len += n;
+            st->bytes += n;
+            }
+        cut = pipe_cut( b->text, b->len, eof, &nrec );
+        if( cut == 0 ) {
+            if( eof ) break;
+            if( b->len == NZTM_PIPE_BLOCK ) {
+                pipe_fail( p, "record longer than buffer" );
+                return;
+                }
+            continue;
+            }
+        next = (pipe_block *) pipe_take( p, p->queue + PIPE_FREE,
+            NZTM_PIPE_READ );
+        if( ! next ) return;
+        memcpy( next->text, b->text + cut, b->len - cut );
+        next->len = b->len - cut;
+        b->len = cut;
+        st->batches++;
+        st->records += nrec;
+        pipe_put( p->queue + PIPE_READ, b );
+        b = next;
+        }
+    pipe_put( p->queue + PIPE_READ, NULL );
+    }
+
+/* Finds the coordinate columns in the header record */
+
+static int pipe_header( pipe_job *p, nztm_csv *c, nztm_csv_field *fields ) {
+    const char *name;
+    int nf, k, j;
+
+    nf = nztm_csv_read( c, fields, PIPE_MAXCOLS );
+    if( nf <= 0 ) {
+        pipe_fail( p, nf < 0 ? nztm_csv_error( c ) : "no header" );
+        return -1;
+        }
+    if( nf > PIPE_MAXCOLS ) { pipe_fail( p, "too many columns" ); return -1; }
+    for( k = 0; k < 2*p->npairs; k++ ) {
+        name = k % 2 ? p->pairs[k/2].lon : p->pairs[k/2].lat;
+        for( j = 0; j < nf; j++ ) {
+            if( fields[j].len == strlen( name ) &&
+                memcmp( fields[j].p, name, fields[j].len ) == 0 ) break;
+            }
+        if( j == nf ) {
+            pipe_fail( p, "coordinate column not found" );
+            return -1;
+            }
+        p->col[k] = j;
+        if( j + 1 > p->maxcol ) p->maxcol = j + 1;
+        }
+    p->hquoted = fields[0].quoted;
+    return 0;
+    }
+
+static void pipe_parse( pipe_job *p ) {
+    nztm_pipe_stage *st = p->stage + NZTM_PIPE_PARSE;
+    nztm_csv_field *fields;
+    const char *rec;
+    double *q, v;
+    pipe_block *b;
+    nztm_csv *c;
+    size_t reclen, i;
+    int first = 1, nf, k;
+
+    c = nztm_csv_open( NULL, 0 );
+    fields = (nztm_csv_field *) malloc( PIPE_MAXCOLS*sizeof(nztm_csv_field) );
+    if( ! c || ! fields ) {
+        pipe_fail( p, "out of memory" );
+        goto done;
+        }
+
+    while( ( b = (pipe_block *) pipe_take( p, p->queue + PIPE_READ,
+                NZTM_PIPE_PARSE ) ) ) {
+        nztm_csv_memory( c, b->text, b->len );
+        b->nrec = 0;
+        b->header = first;
+        for( ;; ) {
+            if( first ) {
+                if( pipe_header( p, c, fields ) != 0 ) goto done;
+                nf = 1;
+                }
+            else if( ( nf = nztm_csv_read( c, fields, p->maxcol ) ) <= 0 )
+                break;
+            if( b->nrec == NZTM_PIPE_RECORDS ) {
+                pipe_fail( p, "too many records in a block" );
+                goto done;
+                }
+            i = b->nrec++;
+            rec = nztm_csv_record( c, &reclen );
+            b->start[i] = rec - b->text;
+            b->length[i] = reclen;
+            b->crlf[i] = reclen < b->len - b->start[i] &&
+                b->text[b->start[i] + reclen] == '\r';
+            for( k = 0; k < 2*p->npairs; k++ ) {
+                q = b->coord + (4*(k/2) + k%2)*NZTM_PIPE_RECORDS;
+                if( ! first && p->col[k] < nf &&
+                    nztm_csv_double( fields[p->col[k]].p,
+                        fields[p->col[k]].len, &v ) )
+                    q[i] = v/rad2deg;
+                else
+                    q[i] = NAN;
+                }
+            if( first ) first = 0;
+            else p->nrec++;
+            }
+        if( nf < 0 ) {
+            pipe_fail( p, nztm_csv_error( c ) );
+            goto done;
+            }
+        st->batches++;
+        st->bytes += b->len;
+        st->records += b->nrec;
+        pipe_put( p->queue + PIPE_PARSED, b );
+        }
+    if( first && ! p->failed ) pipe_fail( p, "no header" );
+    pipe_put( p->queue + PIPE_PARSED, NULL );
+
+done:
+    nztm_csv_close( c );
+    free( fields );
+    }
+
+static void pipe_project( pipe_job *p ) {
+    nztm_pipe_stage *st = p->stage + NZTM_PIPE_PROJECT;
+    pipe_block *b;
+    double *q;
+    int k;
+
+    while( ( b = (pipe_block *) pipe_take( p, p->queue + PIPE_PARSED,
+                NZTM_PIPE_PROJECT ) ) ) {
+        for( k = 0; k < p->npairs; k++ ) {
+            q = b->coord + 4*k*NZTM_PIPE_RECORDS;
+            geod_tm_hn( p->tm, q, q + NZTM_PIPE_RECORDS,
+                q + 2*NZTM_PIPE_RECORDS, q + 3*NZTM_PIPE_RECORDS, b->nrec );
+            }
+        st->batches++;
+        st->bytes += b->len;
+        st->records += b->nrec;
+        pipe_put( p->queue + PIPE_PROJECTED, b );
+        }
+    pipe_put( p->queue + PIPE_PROJECTED, NULL );
+    }
+
+static void pipe_name( pipe_output *o, const char *name, int quoted ) {
+    size_t len = strlen( name );
+
+    o->text[o->len++] = ',';
+    if( quoted ) o->text[o->len++] = '"';
+    memcpy( o->text + o->len, name, len );
+    o->len += len;
+    if( quoted ) o->text[o->len++] = '"';
+    }
+
+/* Writes the records into output blocks.  An output block is passed on
+   when it may not have room for the next record. */
+
+static void pipe_format( pipe_job *p ) {
+    nztm_pipe_stage *st = p->stage + NZTM_PIPE_FORMAT;
+    pipe_output *o;
+    pipe_block *b;
+    double *q;
+    size_t i;
+    int k;
+
+    o = (pipe_output *) pipe_take( p, p->queue + PIPE_OFREE,
+        NZTM_PIPE_FORMAT );
+    if( ! o ) return;
+    o->len = 0;
+    o->nrec = 0;
+    while( ( b = (pipe_block *) pipe_take( p, p->queue + PIPE_PROJECTED,
+                NZTM_PIPE_FORMAT ) ) ) {
+        for( i = 0; i < b->nrec; i++ ) {
+            if( o->len + b->length[i] + p->extra > p->outsize ) {
+                st->bytes += o->len;
+                pipe_put( p->queue + PIPE_OFULL, o );
+                o = (pipe_output *) pipe_take( p, p->queue + PIPE_OFREE,
+                    NZTM_PIPE_FORMAT );
+                if( ! o ) return;
+                o->len = 0;
+                o->nrec = 0;
+                }
+            memcpy( o->text + o->len, b->text + b->start[i], b->length[i] );
+            o->len += b->length[i];
+            for( k = 0; k < p->npairs; k++ ) {
+                if( b->header && i == 0 ) {
+                    pipe_name( o, p->pairs[k].n, p->hquoted );
+                    pipe_name( o, p->pairs[k].e, p->hquoted );
+                    continue;
+                    }
+                q = b->coord + 4*k*NZTM_PIPE_RECORDS;
+                o->text[o->len++] = ',';
+                o->len += nztm_csv_fixed( o->text + o->len,
+                    q[2*NZTM_PIPE_RECORDS + i], p->decimals );
+                o->text[o->len++] = ',';
+                o->len += nztm_csv_fixed( o->text + o->len,
+                    q[3*NZTM_PIPE_RECORDS + i], p->decimals );
+                }
+            if( b->crlf[i] ) o->text[o->len++] = '\r';
+            o->text[o->len++] = '\n';
+            o->nrec++;
+            }
+        st->batches++;
+        st->records += b->nrec;
+        pipe_put( p->queue + PIPE_FREE, b );
+        }
+    if( o->len ) {
+        st->bytes += o->len;
+        pipe_put( p->queue + PIPE_OFULL, o );
+        }
+    pipe_put( p->queue + PIPE_OFULL, NULL );
+    }
+
+static void pipe_write( pipe_job *p ) {
+    nztm_pipe_stage *st = p->stage + NZTM_PIPE_WRITE;
+    pipe_output *o;
+
+    while( ( o = (pipe_output *) pipe_take( p, p->queue + PIPE_OFULL,
+                NZTM_PIPE_WRITE ) ) ) {
+        if( fwrite( o->text, 1, o->len, p->out ) != o->len ) {
+            pipe_fail( p, "write error" );
+            return;
+            }
+        st->batches++;
+        st->bytes += o->len;
+        st->records += o->nrec;
+        pipe_put( p->queue + PIPE_OFREE, o );
+        }
+    }
+
+static void (*const pipe_stages[NZTM_PIPE_NSTAGES])( pipe_job * ) = {
+   pipe_read, pipe_parse, pipe_project, pipe_format, pipe_write };
+
+typedef struct {
+        pipe_job *p;
+        int stage;
+        } pipe_thread;
+
+/* Runs a stage, timing it */
+
+static void *pipe_main( void *arg ) {
+    pipe_job *p = ((pipe_thread *) arg)->p;
+    int stage = ((pipe_thread *) arg)->stage;
+    struct timespec t0;
+
+    clock_gettime( CLOCK_MONOTONIC, &t0 );
+    pipe_stages[stage]( p );
+    p->stage[stage].busy = pipe_seconds( &t0 ) - p->stage[stage].wait;
+    return NULL;
+    }
+
+static void pipe_free( pipe_job *p ) {
+    int i;
+
+    for( i = 0; i < NZTM_PIPE_BATCHES; i++ ) {
+        free( p->block[i].text );
+        free( p->block[i].start );
+        free( p->block[i].length );
+        free( p->block[i].crlf );
+        free( p->block[i].coord );
+        free( p->output[i].text );
+        }
+    free( p->col );
+    free( p );
+    }
+
+long nztm_pipe_project( FILE *in, FILE *out, const tmprojection *tm,
+   const nztm_csv_pair *pairs, int npairs, int decimals,
+   nztm_pipe_stats *stats, const char **err )
+{
+   pthread_t threads[NZTM_PIPE_NSTAGES];
+   pipe_thread args[NZTM_PIPE_NSTAGES];
+   struct timespec t0;
+   size_t names = 2;
+   pipe_job *p;
+   long nrec;
+   int i, k, started;
+
+   clock_gettime( CLOCK_MONOTONIC, &t0 );
+   if( ! ( p = (pipe_job *) calloc( 1, sizeof(pipe_job) ) ) ) {
+      if( err ) *err = "out of memory";
+      return -1;
+      }
+   p->in = in;
+   p->out = out;
+   p->tm = tm;
+   p->pairs = pairs;
+   p->npairs = npairs;
+   p->decimals = decimals < 0 ? 0 : decimals;
+   for( k = 0; k < npairs; k++ )
+      names += strlen( pairs[k].n ) + strlen( pairs[k].e ) + 6;
+   p->extra = 2*npairs*(NZTM_CSV_FIXEDLEN + 1) + 2;
+   if( names > p->extra ) p->extra = names;
+   p->outsize = NZTM_PIPE_BLOCK + p->extra;
+   p->col = (int *) malloc( 2*npairs*sizeof(int) + 1 );
+   for( i = 0; i < NZTM_PIPE_BATCHES; i++ ) {
+      pipe_block *b = p->block + i;
+      b->text = (char *) malloc( NZTM_PIPE_BLOCK );
+      b->start = (size_t *) malloc( NZTM_PIPE_RECORDS*sizeof(size_t) );
+      b->length = (size_t *) malloc( NZTM_PIPE_RECORDS*sizeof(size_t) );
+      b->crlf = (unsigned char *) malloc( NZTM_PIPE_RECORDS );
+      b->coord = (double *)
+         malloc( 4*npairs*NZTM_PIPE_RECORDS*sizeof(double) + 1 );
+      p->output[i].text = (char *) malloc( p->outsize );
+      if( ! b->text || ! b->start || ! b->length || ! b->crlf || ! b->coord ||
+          ! p->output[i].text ) break;
+      pipe_put( p->queue + PIPE_FREE, b );
+      pipe_put( p->queue + PIPE_OFREE, p->output + i );
+      }
+   if( i < NZTM_PIPE_BATCHES || ! p->col ) {
+      pipe_free( p );
+      if( err ) *err = "out of memory";
+      return -1;
+      }
+
+   /* Run the stages, the last in this thread */
+
+   for( started = 0; started < NZTM_PIPE_NSTAGES - 1; started++ ) {
+      args[started].p = p;
+      args[started].stage = started;
+      if( pthread_create( threads + started, NULL, pipe_main,
+             args + started ) != 0 ) {
+         pipe_fail( p, "cannot start threads" );
+         break;
+         }
+      }
+   if( started == NZTM_PIPE_NSTAGES - 1 ) {
+      args[started].p = p;
+      args[started].stage = started;
+      pipe_main( args + started );
+      }
+   for( i = 0; i < started; i++ ) pthread_join( threads[i], NULL );
+
+   if( stats ) {
+      stats->elapsed = pipe_seconds( &t0 );
+      for( i = 0; i < NZTM_PIPE_NSTAGES; i++ ) {
+         stats->stage[i] = p->stage[i];
+         stats->stage[i].name = pipe_names[i];
+         }
+      }
+   if( err ) *err = p->failed ? p->msg : NULL;
+   nrec = p->failed ? -1 : p->nrec;
+   pipe_free( p );
+   return nrec;
+}
+
+void nztm_pipe_report( FILE *f, const nztm_pipe_stats *stats )
+{
+   const nztm_pipe_stage *s;
+   int i;
+
+   fprintf( f, "%-8s %8s %10s %10s %9s %9s %10s\n", "stage", "batches",
+      "records", "MB", "busy s", "wait s", "MB/s busy" );
+   for( i = 0; i < NZTM_PIPE_NSTAGES; i++ ) {
+      s = stats->stage + i;
+      fprintf( f, "%-8s %8lu %10lu %10.1f %9.3f %9.3f %10.1f\n", s->name,
+         (unsigned long) s->batches, (unsigned long) s->records,
+         s->bytes*1.0e-6, s->busy, s->wait,
+         s->busy > 0.0 ? s->bytes*1.0e-6/s->busy : 0.0 );
+      }
+   fprintf( f, "elapsed %.3f s\n", stats->elapsed );
+}
+
+#ifdef NZTM_PIPE_TOOL
+
+/* Pipelined command line reprojector.  Build with
+      cc -O2 -DNZTM_PIPE_TOOL -o nztm_pipe nztm_pipe.c nztm_csv.c nztm.c \
+         nztm_simd.c -lm -lpthread
+   and run as nztm_csv (nztm_csv.c), with -s to report the stages on
+   standard error, for example
+      nztm_pipe -s -utm 27 kastad_breidd,kastad_lengd,kastad_n,kastad_e \
+                           hift_breidd,hift_lengd,hift_n,hift_e */
+
+int main( int argc, char *argv[] ) {
+  nztm_csv_pair pairs[64];
+  nztm_pipe_stats stats;
+  char *spec[64];
+  int npairs = 0;
+  int decimals = 3;
+  int report = 0;
+  const tmprojection *tm = &nztm_projection;
+  tmprojection *utm = NULL;
+  const char *err;
+  long n;
+  int i;
+
+  for( i = 1; i < argc; i++ ) {
+     if( strcmp( argv[i], "-d" ) == 0 && i + 1 < argc ) {
+        decimals = atoi( argv[++i] );
+        }
+     else if( strcmp( argv[i], "-s" ) == 0 ) {
+        report = 1;
+        }
+     else if( strcmp( argv[i], "-utm" ) == 0 && i + 1 < argc ) {
+        int zone = atoi( argv[++i] );
+        int south = strchr( argv[i], 's' ) || strchr( argv[i], 'S' );
+        if( zone < 1 || zone > 60 ) {
+           fprintf( stderr, "Invalid UTM zone %s\n", argv[i] );
+           return 1;
+           }
+        tm_destroy( utm );
+        tm = utm = tm_create( NZTM_A, NZTM_RF, (6.0*zone - 183.0)/rad2deg,
+           0.9996, 0.0, 500000.0, south ? 10000000.0 : 0.0, 1.0 );
+        }
+     else if( npairs < 64 ) {
+        spec[npairs] = argv[i];
+        pairs[npairs].lat = strtok( spec[npairs], "," );
+        pairs[npairs].lon = strtok( NULL, "," );
+        pairs[npairs].n = strtok( NULL, "," );
+        pairs[npairs].e = strtok( NULL, "," );
+        if( ! pairs[npairs].e ) {
+           fprintf( stderr, "Column pairs are given as lat,lon,n,e\n" );
+           return 1;
+           }
+        npairs++;
+        }
+     }
+  if( npairs == 0 || ! tm ) {
+     fprintf( stderr, "Usage: nztm_pipe [-s] [-utm zone[s]] [-d decimals] "
+        "lat,lon,n,e ...\n" );
+     return 1;
+     }
+
+  n = nztm_pipe_project( stdin, stdout, tm, pairs, npairs, decimals,
+     &stats, &err );
+  tm_destroy( utm );
+  if( report ) nztm_pipe_report( stderr, &stats );
+  if( n < 0 ) {
+     fprintf( stderr, "nztm_pipe: %s\n", err );
+     return 1;
+     }
+  return 0;
+  }
+
+#endif
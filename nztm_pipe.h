@@ -0,0 +1,86 @@
+#ifndef _NZTM_PIPE_H
+#define _NZTM_PIPE_H
+
+/* Pipelined CSV reprojection, as nztm_csv_project but with reading,
+   parsing, projection, formatting and writing overlapped.
+
+   Each of the NZTM_PIPE_NSTAGES stages runs in a thread of its own and
+   passes fixed size batches to the next through a bounded single
+   producer, single consumer queue, without locks:
+
+      read      reads the input in blocks of NZTM_PIPE_BLOCK bytes and
+                cuts each at the end of its last complete record (at
+                most NZTM_PIPE_RECORDS), carrying the rest to the next
+      parse     splits the records of a block with nztm_csv and parses
+                their coordinates
+      project   converts them with geod_tm_hn
+      format    writes each record and its projected columns into
+                output blocks
+      write     writes the output blocks
+
+   The batches are allocated once, when the pipeline starts, and go
+   back to the first stage of their loop when the last is done with
+   them (input blocks from format to read, output blocks from write to
+   format), so the pipeline allocates nothing while it runs and holds at
+   most NZTM_PIPE_BATCHES of each.  A stage with no batch to take, or
+   no room to pass one on, spins briefly and then sleeps, so a stage
+   waiting on the disk costs the others nothing.  Reads and writes are
+   the ordinary blocking calls of the stdio streams, made by threads
+   that do nothing else.
+
+   The output is byte for byte that of nztm_csv_project.  The time each
+   stage spends working and waiting, and the amount it handles, are
+   returned in an nztm_pipe_stats, so that the stage limiting the rate
+   can be seen. */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "nztm.h"
+#include "nztm_csv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_PIPE_BLOCK     (1 << 20)     /* Bytes per input block */
+#define NZTM_PIPE_RECORDS   4096          /* Records per input block */
+#define NZTM_PIPE_BATCHES   8             /* Blocks of each kind */
+
+#define NZTM_PIPE_READ      0
+#define NZTM_PIPE_PARSE     1
+#define NZTM_PIPE_PROJECT   2
+#define NZTM_PIPE_FORMAT    3
+#define NZTM_PIPE_WRITE     4
+#define NZTM_PIPE_NSTAGES   5
+
+typedef struct {
+        const char *name;
+        double busy;              /* Seconds working */
+        double wait;              /* Seconds waiting for batches or room */
+        size_t batches;           /* Batches handled */
+        size_t bytes;             /* Bytes read, parsed, ... written */
+        size_t records;           /* Records handled */
+        } nztm_pipe_stage;
+
+typedef struct {
+        double elapsed;           /* Seconds from start to finish */
+        nztm_pipe_stage stage[NZTM_PIPE_NSTAGES];
+        } nztm_pipe_stats;
+
+/* As nztm_csv_project, filling in *stats if it is not NULL.  A record
+   must fit in NZTM_PIPE_BLOCK bytes. */
+
+long nztm_pipe_project( FILE *in, FILE *out, const tmprojection *tm,
+   const nztm_csv_pair *pairs, int npairs, int decimals,
+   nztm_pipe_stats *stats, const char **err );
+
+/* Writes stats to f as a table, with the rate of each stage */
+
+void nztm_pipe_report( FILE *f, const nztm_pipe_stats *stats );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,156 @@
+/* Thread pool used by the bulk routines.  Needs POSIX threads
+   (link with -lpthread). */
+
+#include "nztm_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct nztm_pool {
+        int nthread;              /* Threads including the caller */
+        pthread_t *threads;       /* The nthread-1 workers */
+
+        pthread_mutex_t run;      /* Serialises nztm_pool_run */
+        pthread_mutex_t lock;     /* Guards the fields below */
+        pthread_cond_t start;     /* Signalled when a job is posted */
+        pthread_cond_t done;      /* Signalled when workers finish */
+        unsigned long job;        /* Incremented for each job */
+        int active;               /* Workers still on the current job */
+        int quit;                 /* Set to stop the workers */
+
+        nztm_pool_fn fn;          /* The current job */
+        void *ctx;
+        size_t nitems;
+        size_t next;              /* Next item, claimed atomically */
+        };
+
+/* Claim and run items of the current job until none are left */
+
+static void pool_work( nztm_pool *pool, int thread ) {
+    size_t item;
+
+    while( (item = __atomic_fetch_add( &pool->next, 1, __ATOMIC_RELAXED ))
+              < pool->nitems ) {
+        pool->fn( pool->ctx, item, thread );
+        }
+    }
+
+typedef struct {
+        nztm_pool *pool;
+        int thread;
+        } pool_worker;
+
+static void *pool_main( void *arg ) {
+    nztm_pool *pool = ((pool_worker *) arg)->pool;
+    int thread = ((pool_worker *) arg)->thread;
+    unsigned long seen = 0;
+
+    free( arg );
+    pthread_mutex_lock( &pool->lock );
+    for( ;; ) {
+        while( pool->job == seen && ! pool->quit )
+            pthread_cond_wait( &pool->start, &pool->lock );
+        if( pool->quit ) break;
+        seen = pool->job;
+        pthread_mutex_unlock( &pool->lock );
+
+        pool_work( pool, thread );
+
+        pthread_mutex_lock( &pool->lock );
+        if( --pool->active == 0 ) pthread_cond_signal( &pool->done );
+        }
+    pthread_mutex_unlock( &pool->lock );
+    return NULL;
+    }
+
+nztm_pool *nztm_pool_create( int nthread )
+{
+   nztm_pool *pool;
+   pool_worker *w;
+   int i;
+
+   if( nthread <= 0 ) nthread = (int) sysconf( _SC_NPROCESSORS_ONLN );
+   if( nthread <= 0 ) nthread = 1;
+
+   pool = (nztm_pool *) calloc( 1, sizeof(nztm_pool) );
+   if( ! pool ) return NULL;
+   pool->threads = (pthread_t *) calloc( nthread, sizeof(pthread_t) );
+   if( ! pool->threads ) { free( pool ); return NULL; }
+
+   pthread_mutex_init( &pool->run, NULL );
+   pthread_mutex_init( &pool->lock, NULL );
+   pthread_cond_init( &pool->start, NULL );
+   pthread_cond_init( &pool->done, NULL );
+
+   /* Start the workers, keeping however many could be created */
+
+   pool->nthread = 1;
+   for( i = 1; i < nthread; i++ ) {
+       w = (pool_worker *) malloc( sizeof(pool_worker) );
+       if( ! w ) break;
+       w->pool = pool;
+       w->thread = i;
+       if( pthread_create( &pool->threads[i-1], NULL, pool_main, w ) != 0 ) {
+           free( w );
+           break;
+           }
+       pool->nthread++;
+       }
+   return pool;
+}
+
+void nztm_pool_destroy( nztm_pool *pool )
+{
+   int i;
+
+   if( ! pool ) return;
+   pthread_mutex_lock( &pool->lock );
+   pool->quit = 1;
+   pthread_cond_broadcast( &pool->start );
+   pthread_mutex_unlock( &pool->lock );
+   for( i = 1; i < pool->nthread; i++ ) pthread_join( pool->threads[i-1], NULL );
+
+   pthread_cond_destroy( &pool->done );
+   pthread_cond_destroy( &pool->start );
+   pthread_mutex_destroy( &pool->lock );
+   pthread_mutex_destroy( &pool->run );
+   free( pool->threads );
+   free( pool );
+}
+
+int nztm_pool_size( const nztm_pool *pool )
+{
+   return pool ? pool->nthread : 1;
+}
+
+void nztm_pool_run( nztm_pool *pool, size_t nitems,
+   nztm_pool_fn fn, void *ctx )
+{
+   size_t i;
+
+   if( ! pool || pool->nthread == 1 || nitems <= 1 ) {
+      for( i = 0; i < nitems; i++ ) fn( ctx, i, 0 );
+      return;
+      }
+
+   pthread_mutex_lock( &pool->run );
+
+   pthread_mutex_lock( &pool->lock );
+   pool->fn = fn;
+   pool->ctx = ctx;
+   pool->nitems = nitems;
+   pool->next = 0;
+   pool->active = pool->nthread - 1;
+   pool->job++;
+   pthread_cond_broadcast( &pool->start );
+   pthread_mutex_unlock( &pool->lock );
+
+   pool_work( pool, 0 );
+
+   pthread_mutex_lock( &pool->lock );
+   while( pool->active > 0 ) pthread_cond_wait( &pool->done, &pool->lock );
+   pthread_mutex_unlock( &pool->lock );
+
+   pthread_mutex_unlock( &pool->run );
+}
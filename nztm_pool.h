@@ -0,0 +1,39 @@
+#ifndef _NZTM_POOL_H
+#define _NZTM_POOL_H
+
+/* A fixed pool of worker threads for running loops over independent
+   work items in parallel.
+
+   nztm_pool_create starts nthread-1 workers (nthread 0 uses one per
+   online processor); the thread calling nztm_pool_run is used as the
+   remaining one.  nztm_pool_run calls fn( ctx, item, thread ) once for
+   each item in [0,nitems) and returns when all have completed.  Items
+   are claimed dynamically, one at a time, so threads that finish early
+   take over the remaining work.  thread is in [0,nztm_pool_size) and
+   identifies the calling thread, so fn can keep per-thread state.
+
+   Runs from different threads are serialised.  fn must not itself call
+   nztm_pool_run on the same pool.  A NULL pool runs the items in the
+   calling thread, as thread 0. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct nztm_pool nztm_pool;
+
+typedef void (*nztm_pool_fn)( void *ctx, size_t item, int thread );
+
+nztm_pool *nztm_pool_create( int nthread );
+void nztm_pool_destroy( nztm_pool *pool );
+int nztm_pool_size( const nztm_pool *pool );
+void nztm_pool_run( nztm_pool *pool, size_t nitems,
+   nztm_pool_fn fn, void *ctx );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
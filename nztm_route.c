@@ -0,0 +1,777 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Sea route distance fields.  The reader needs POSIX mmap.
+
+   A file is laid out as
+
+      header                 route_header
+      ports                  easting, northing of each (doubles)
+      names                  NZTM_ROUTE_NAMELEN bytes for each port
+      fields                 nx*ny floats for each port
+
+   The fields hold the distance at the centre of each cell, NaN for land
+   and infinity for sea that cannot be reached from the port.
+
+   The fast marching method accepts cells in order of increasing
+   distance from a binary heap.  Each sea cell next to an accepted one
+   takes the upwind solution of |grad T| = 1 from its accepted
+   neighbours in each axis: with a = min(T(west),T(east)) and
+   b = min(T(south),T(north)), T = min(a,b) + h if |a - b| >= h, and
+   otherwise the root of (T - a)^2 + (T - b)^2 = h^2. */
+
+#include "nztm_route.h"
+
+#include "nztm_land.h"
+#include "tmproj.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ROUTE_MAGIC    "NZTMSEA1"
+#define ROUTE_VERSION  2
+
+#define ROUTE_SEED     2          /* Cells about a port's sea cell taken
+                                     exactly */
+#define ROUTE_BLOCK    1024       /* Ring points projected at a time */
+
+/* Cells of the mask */
+
+#define ROUTE_LAND     0
+#define ROUTE_WATER    1          /* Outside the rings */
+#define ROUTE_SEA      2          /* And connected to the edge of the box */
+
+/* Bytes of the ports and their names */
+
+#define ROUTE_PORTS(n) ((size_t) (n)*(2*sizeof(double) + NZTM_ROUTE_NAMELEN))
+
+/* Heap positions of cells not in the heap */
+
+#define ROUTE_FAR      -1
+#define ROUTE_KNOWN    -2
+
+typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t nports;
+        uint32_t nx, ny;
+        double x0, y0;
+        double cell;
+        double proj[8];           /* a, rf, cm, sf, lto, fe, fn, utom */
+        } route_header;
+
+/* A build, shared by the pool threads */
+
+typedef struct {
+        int nx, ny;
+        double x0, y0, cell;
+        const unsigned char *mask;
+        const double *pe, *pn;
+        int nports;
+        int fd;
+        int failed;
+        } route_job;
+
+/* Fast marching state of one port */
+
+typedef struct {
+        double *t;                /* Distance of each cell */
+        int32_t *pos;             /* Heap position, ROUTE_FAR or ROUTE_KNOWN */
+        uint32_t *heap;           /* Cells, by increasing t */
+        size_t n;
+        } route_march;
+
+/* Projects the points of the rings of c, extending box */
+
+static void route_extent( const nztm_coast *c, const tmprojection *tm,
+   double box[4] ) {
+    double lt[ROUTE_BLOCK], ln[ROUTE_BLOCK], n[ROUTE_BLOCK], e[ROUTE_BLOCK];
+    size_t i, j, m;
+    int p;
+
+    box[0] = box[1] = HUGE_VAL;
+    box[2] = box[3] = -HUGE_VAL;
+    for( p = 0; p < c->nparts; p++ ) {
+        for( i = 0; i < c->part[p].n; i += m ) {
+            m = c->part[p].n - i < ROUTE_BLOCK ? c->part[p].n - i : ROUTE_BLOCK;
+            for( j = 0; j < m; j++ ) {
+                lt[j] = c->part[p].lat[i+j]/rad2deg;
+                ln[j] = c->part[p].lon[i+j]/rad2deg;
+                }
+            geod_tm_hn( tm, lt, ln, n, e, m );
+            for( j = 0; j < m; j++ ) {
+                if( e[j] < box[0] ) box[0] = e[j];
+                if( n[j] < box[1] ) box[1] = n[j];
+                if( e[j] > box[2] ) box[2] = e[j];
+                if( n[j] > box[3] ) box[3] = n[j];
+                }
+            }
+        }
+    }
+
+/* Classifies the cells as land or water by their centres, then marks
+   the water connected to the edge of the grid as sea.  Returns 0, or -1
+   if memory cannot be allocated. */
+
+static int route_mask( const nztm_coast *c, const tmprojection *tm,
+   route_job *job, unsigned char *mask ) {
+    int nx = job->nx, ny = job->ny;
+    size_t ncells = (size_t) nx*ny;
+    double *n = (double *) malloc( 4*nx*sizeof(double) );
+    double *e = n + nx, *lt = e + nx, *ln = lt + nx;
+    uint32_t *stack = (uint32_t *) malloc( ncells*sizeof(uint32_t) );
+    nztm_land *land = nztm_land_create( c, 0 );
+    size_t top = 0, k;
+    int i, j, status = -1;
+
+    if( ! n || ! stack || ! land ) goto done;
+    for( j = 0; j < ny; j++ ) {
+        for( i = 0; i < nx; i++ ) {
+            e[i] = job->x0 + i*job->cell;
+            n[i] = job->y0 + j*job->cell;
+            }
+        tm_geod_hn( tm, n, e, lt, ln, nx );
+        for( i = 0; i < nx; i++ ) {
+            lt[i] *= rad2deg;
+            ln[i] *= rad2deg;
+            }
+        nztm_land_test( land, lt, ln, mask + (size_t) j*nx, nx );
+        for( i = 0; i < nx; i++ )
+            mask[(size_t) j*nx + i] =
+                mask[(size_t) j*nx + i] ? ROUTE_LAND : ROUTE_WATER;
+        }
+
+    /* Flood fill from the edge, four connected as the marching */
+
+    for( k = 0; k < ncells; k++ ) {
+        i = (int) (k % nx);
+        j = (int) (k / nx);
+        if( ( i == 0 || j == 0 || i == nx - 1 || j == ny - 1 ) &&
+            mask[k] == ROUTE_WATER ) {
+            mask[k] = ROUTE_SEA;
+            stack[top++] = (uint32_t) k;
+            }
+        }
+    while( top > 0 ) {
+        k = stack[--top];
+        i = (int) (k % nx);
+        if( i > 0 && mask[k-1] == ROUTE_WATER ) {
+            mask[k-1] = ROUTE_SEA;
+            stack[top++] = (uint32_t) (k - 1);
+            }
+        if( i < nx - 1 && mask[k+1] == ROUTE_WATER ) {
+            mask[k+1] = ROUTE_SEA;
+            stack[top++] = (uint32_t) (k + 1);
+            }
+        if( k >= (size_t) nx && mask[k-nx] == ROUTE_WATER ) {
+            mask[k-nx] = ROUTE_SEA;
+            stack[top++] = (uint32_t) (k - nx);
+            }
+        if( k + nx < ncells && mask[k+nx] == ROUTE_WATER ) {
+            mask[k+nx] = ROUTE_SEA;
+            stack[top++] = (uint32_t) (k + nx);
+            }
+        }
+    status = 0;
+
+done:
+    nztm_land_destroy( land );
+    free( stack );
+    free( n );
+    return status;
+    }
+
+static void route_up( route_march *m, size_t i ) {
+    uint32_t k = m->heap[i];
+    size_t p;
+
+    while( i > 0 && m->t[m->heap[p = (i - 1)/2]] > m->t[k] ) {
+        m->heap[i] = m->heap[p];
+        m->pos[m->heap[i]] = (int32_t) i;
+        i = p;
+        }
+    m->heap[i] = k;
+    m->pos[k] = (int32_t) i;
+    }
+
+static void route_down( route_march *m, size_t i ) {
+    uint32_t k = m->heap[i];
+    size_t c;
+
+    while( ( c = 2*i + 1 ) < m->n ) {
+        if( c + 1 < m->n && m->t[m->heap[c+1]] < m->t[m->heap[c]] ) c++;
+        if( m->t[m->heap[c]] >= m->t[k] ) break;
+        m->heap[i] = m->heap[c];
+        m->pos[m->heap[i]] = (int32_t) i;
+        i = c;
+        }
+    m->heap[i] = k;
+    m->pos[k] = (int32_t) i;
+    }
+
+/* Lowers the distance of cell k to t, adding it to the heap if needed */
+
+static void route_push( route_march *m, uint32_t k, double t ) {
+    if( t >= m->t[k] ) return;
+    m->t[k] = t;
+    if( m->pos[k] == ROUTE_FAR ) {
+        m->heap[m->n] = k;
+        route_up( m, m->n++ );
+        }
+    else route_up( m, (size_t) m->pos[k] );
+    }
+
+/* The upwind solution at cell k = (i,j) from its known neighbours */
+
+static double route_solve( const route_job *job, const route_march *m,
+   size_t k, int i, int j ) {
+    double h = job->cell;
+    double a = HUGE_VAL, b = HUGE_VAL, d;
+
+    if( i > 0 && m->pos[k-1] == ROUTE_KNOWN ) a = m->t[k-1];
+    if( i < job->nx - 1 && m->pos[k+1] == ROUTE_KNOWN && m->t[k+1] < a )
+        a = m->t[k+1];
+    if( j > 0 && m->pos[k-job->nx] == ROUTE_KNOWN ) b = m->t[k-job->nx];
+    if( j < job->ny - 1 && m->pos[k+job->nx] == ROUTE_KNOWN &&
+        m->t[k+job->nx] < b )
+        b = m->t[k+job->nx];
+    if( a > b ) { d = a; a = b; b = d; }
+    if( b - a >= h ) return a + h;
+    return 0.5*(a + b + sqrt( 2.0*h*h - (b - a)*(b - a) ));
+    }
+
+/* Computes the field of port item and writes it to the file */
+
+static void route_port( void *ctx, size_t item, int thread ) {
+    route_job *job = (route_job *) ctx;
+    int nx = job->nx, ny = job->ny;
+    size_t ncells = (size_t) nx*ny;
+    double pe = job->pe[item], pn = job->pn[item];
+    double fx = (pe - job->x0)/job->cell, fy = (pn - job->y0)/job->cell;
+    route_march m;
+    float *out;
+    double d, best = HUGE_VAL;
+    size_t k, done, off;
+    int ci, cj, i, j, bi = -1, bj = -1;
+    ssize_t w;
+
+    (void) thread;
+    m.t = (double *) malloc( ncells*sizeof(double) );
+    m.pos = (int32_t *) malloc( ncells*sizeof(int32_t) );
+    m.heap = (uint32_t *) malloc( ncells*sizeof(uint32_t) );
+    out = (float *) malloc( ncells*sizeof(float) );
+    m.n = 0;
+    if( ! m.t || ! m.pos || ! m.heap || ! out ) goto fail;
+    for( k = 0; k < ncells; k++ ) {
+        m.t[k] = HUGE_VAL;
+        m.pos[k] = job->mask[k] == ROUTE_SEA ? ROUTE_FAR : ROUTE_KNOWN;
+        }
+
+    /* The nearest sea cell, and the sea cells about it */
+
+    ci = (int) floor( fx + 0.5 );
+    cj = (int) floor( fy + 0.5 );
+    for( j = cj - NZTM_ROUTE_SNAP; j <= cj + NZTM_ROUTE_SNAP; j++ )
+        for( i = ci - NZTM_ROUTE_SNAP; i <= ci + NZTM_ROUTE_SNAP; i++ ) {
+            if( i < 0 || j < 0 || i >= nx || j >= ny ||
+                job->mask[(size_t) j*nx + i] != ROUTE_SEA ) continue;
+            d = (i - fx)*(i - fx) + (j - fy)*(j - fy);
+            if( d < best ) { best = d; bi = i; bj = j; }
+            }
+    if( bi < 0 ) goto fail;
+    for( j = bj - ROUTE_SEED; j <= bj + ROUTE_SEED; j++ )
+        for( i = bi - ROUTE_SEED; i <= bi + ROUTE_SEED; i++ ) {
+            if( i < 0 || j < 0 || i >= nx || j >= ny ) continue;
+            k = (size_t) j*nx + i;
+            if( job->mask[k] == ROUTE_SEA )
+                route_push( &m, (uint32_t) k,
+                    job->cell*hypot( i - fx, j - fy ) );
+            }
+
+    /* March */
+
+    while( m.n > 0 ) {
+        k = m.heap[0];
+        m.pos[k] = ROUTE_KNOWN;
+        if( --m.n > 0 ) {
+            m.heap[0] = m.heap[m.n];
+            route_down( &m, 0 );
+            }
+        i = (int) (k % nx);
+        j = (int) (k / nx);
+        if( i > 0 && m.pos[k-1] != ROUTE_KNOWN )
+            route_push( &m, (uint32_t) (k - 1),
+                route_solve( job, &m, k - 1, i - 1, j ) );
+        if( i < nx - 1 && m.pos[k+1] != ROUTE_KNOWN )
+            route_push( &m, (uint32_t) (k + 1),
+                route_solve( job, &m, k + 1, i + 1, j ) );
+        if( j > 0 && m.pos[k-nx] != ROUTE_KNOWN )
+            route_push( &m, (uint32_t) (k - nx),
+                route_solve( job, &m, k - nx, i, j - 1 ) );
+        if( j < ny - 1 && m.pos[k+nx] != ROUTE_KNOWN )
+            route_push( &m, (uint32_t) (k + nx),
+                route_solve( job, &m, k + nx, i, j + 1 ) );
+        }
+
+    for( k = 0; k < ncells; k++ )
+        out[k] = job->mask[k] == ROUTE_SEA ? (float) m.t[k] : NAN;
+
+    off = sizeof(route_header) + ROUTE_PORTS( job->nports )
+        + item*ncells*sizeof(float);
+    for( done = 0; done < ncells*sizeof(float); done += (size_t) w ) {
+        w = pwrite( job->fd, (const char *) out + done,
+            ncells*sizeof(float) - done, (off_t) (off + done) );
+        if( w <= 0 ) goto fail;
+        }
+    goto done;
+
+fail:
+    job->failed = 1;
+done:
+    free( m.t );
+    free( m.pos );
+    free( m.heap );
+    free( out );
+    }
+
+int nztm_route_build( const nztm_coast *c, const tmprojection *tm,
+   const double *box, double cell, const double *pe, const double *pn,
+   const char *const *names, int nports, nztm_pool *pool,
+   const char *path )
+{
+   unsigned char *mask = NULL;
+   double *ports = NULL;
+   char *name;
+   double b[4], fx, fy;
+   route_header hdr;
+   route_job job;
+   size_t len, done;
+   ssize_t w;
+   int i, status = -1;
+
+   if( ! tm ) tm = &nztm_projection;
+   if( cell == 0.0 ) cell = NZTM_ROUTE_CELL;
+   if( nports < 1 || ! ( cell > 0.0 ) ) return -1;
+   if( box ) memcpy( b, box, sizeof(b) );
+   else {
+      route_extent( c, tm, b );
+      b[0] -= NZTM_ROUTE_MARGIN;
+      b[1] -= NZTM_ROUTE_MARGIN;
+      b[2] += NZTM_ROUTE_MARGIN;
+      b[3] += NZTM_ROUTE_MARGIN;
+      }
+   fx = ceil( (b[2] - b[0])/cell );
+   fy = ceil( (b[3] - b[1])/cell );
+   if( ! ( fx >= 2.0 && fy >= 2.0 && fx*fy <= NZTM_ROUTE_MAXCELLS ) ) return -1;
+
+   memset( &job, 0, sizeof(job) );
+   job.nx = (int) fx;
+   job.ny = (int) fy;
+   job.x0 = b[0] + 0.5*cell;
+   job.y0 = b[1] + 0.5*cell;
+   job.cell = cell;
+   job.pe = pe;
+   job.pn = pn;
+   job.nports = nports;
+   job.fd = -1;
+
+   mask = (unsigned char *) malloc( (size_t) job.nx*job.ny );
+   ports = (double *) calloc( 1, ROUTE_PORTS( nports ) );
+   if( ! mask || ! ports || route_mask( c, tm, &job, mask ) != 0 ) goto done;
+   job.mask = mask;
+
+   memset( &hdr, 0, sizeof(hdr) );
+   memcpy( hdr.magic, ROUTE_MAGIC, 8 );
+   hdr.version = ROUTE_VERSION;
+   hdr.nports = (uint32_t) nports;
+   hdr.nx = (uint32_t) job.nx;
+   hdr.ny = (uint32_t) job.ny;
+   hdr.x0 = job.x0;
+   hdr.y0 = job.y0;
+   hdr.cell = cell;
+   hdr.proj[0] = tm->a;
+   hdr.proj[1] = tm->rf;
+   hdr.proj[2] = tm->meridian;
+   hdr.proj[3] = tm->scalef;
+   hdr.proj[4] = tm->orglat;
+   hdr.proj[5] = tm->falsee;
+   hdr.proj[6] = tm->falsen;
+   hdr.proj[7] = tm->utom;
+   name = (char *) (ports + 2*nports);
+   for( i = 0; i < nports; i++ ) {
+      ports[2*i] = pe[i];
+      ports[2*i+1] = pn[i];
+      if( names && names[i] )
+         strncpy( name + (size_t) i*NZTM_ROUTE_NAMELEN, names[i],
+            NZTM_ROUTE_NAMELEN - 1 );
+      }
+
+   job.fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+   if( job.fd < 0 ) goto done;
+   if( pwrite( job.fd, &hdr, sizeof(hdr), 0 ) != (ssize_t) sizeof(hdr) )
+      goto done;
+   len = ROUTE_PORTS( nports );
+   for( done = 0; done < len; done += (size_t) w ) {
+      w = pwrite( job.fd, (const char *) ports + done, len - done,
+         (off_t) (sizeof(hdr) + done) );
+      if( w <= 0 ) goto done;
+      }
+
+   nztm_pool_run( pool, (size_t) nports, route_port, &job );
+   if( ! job.failed ) status = 0;
+
+done:
+   if( job.fd >= 0 && close( job.fd ) != 0 ) status = -1;
+   free( mask );
+   free( ports );
+   return status;
+}
+
+/*************************************************************************/
+/*                                                                       */
+/*   Reading                                                             */
+/*                                                                       */
+/*************************************************************************/
+
+#define ROUTE_HDR(r)   ((const route_header *) (r)->hdr)
+
+int nztm_route_open( nztm_route *r, const char *path )
+{
+   const route_header *h;
+   struct stat st;
+   uint64_t need;
+   void *map;
+   int fd, i;
+
+   memset( r, 0, sizeof(nztm_route) );
+   fd = open( path, O_RDONLY );
+   if( fd < 0 ) return -1;
+   if( fstat( fd, &st ) != 0 || (size_t) st.st_size < sizeof(route_header) ) {
+      close( fd );
+      return -1;
+      }
+   map = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+   close( fd );
+   if( map == MAP_FAILED ) return -1;
+
+   h = (const route_header *) map;
+   need = sizeof(route_header) + (uint64_t) ROUTE_PORTS( h->nports )
+        + (uint64_t) h->nports*h->nx*h->ny*sizeof(float);
+   if( memcmp( h->magic, ROUTE_MAGIC, 8 ) != 0 || h->version != ROUTE_VERSION ||
+       h->nports == 0 || h->nx < 2 || h->ny < 2 ||
+       (uint64_t) h->nx*h->ny > NZTM_ROUTE_MAXCELLS || ! ( h->cell > 0.0 ) ||
+       need != (uint64_t) st.st_size ) {
+      munmap( map, (size_t) st.st_size );
+      return -1;
+      }
+   r->map = map;
+   r->size = (size_t) st.st_size;
+   r->hdr = h;
+   r->nx = (int) h->nx;
+   r->ny = (int) h->ny;
+   r->nports = (int) h->nports;
+   r->x0 = h->x0;
+   r->y0 = h->y0;
+   r->cell = h->cell;
+   r->port = (const double *) (h + 1);
+   r->names = (const char *) (r->port + 2*h->nports);
+   r->dist = (const float *)
+      (r->names + (size_t) h->nports*NZTM_ROUTE_NAMELEN);
+   for( i = 0; i < r->nports; i++ )
+      if( r->names[(size_t) (i + 1)*NZTM_ROUTE_NAMELEN - 1] ) {
+         nztm_route_close( r );
+         return -1;
+         }
+   return 0;
+}
+
+void nztm_route_close( nztm_route *r )
+{
+   if( r->map ) munmap( r->map, r->size );
+   memset( r, 0, sizeof(nztm_route) );
+}
+
+const char *nztm_route_name( const nztm_route *r, int port )
+{
+   if( port < 0 || port >= r->nports ) return "";
+   return r->names + (size_t) port*NZTM_ROUTE_NAMELEN;
+}
+
+tmprojection *nztm_route_projection( const nztm_route *r )
+{
+   const double *p = ROUTE_HDR( r )->proj;
+
+   return tm_create( p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7] );
+}
+
+static double route_sample( const nztm_route *r, const float *f,
+   double e, double n ) {
+    double fx = (e - r->x0)/r->cell;
+    double fy = (n - r->y0)/r->cell;
+    double u, v, w, s = 0.0, ws = 0.0;
+    const float *p;
+    int i, j;
+
+    if( ! ( fx >= 0.0 && fx <= r->nx - 1 && fy >= 0.0 && fy <= r->ny - 1 ) )
+        return NAN;
+    i = (int) fx;
+    j = (int) fy;
+    if( i == r->nx - 1 ) i--;
+    if( j == r->ny - 1 ) j--;
+    u = fx - i;
+    v = fy - j;
+    p = f + (size_t) j*r->nx + i;
+    if( isfinite( p[0] ) ) { w = (1.0 - u)*(1.0 - v); s += w*p[0]; ws += w; }
+    if( isfinite( p[1] ) ) { w = u*(1.0 - v); s += w*p[1]; ws += w; }
+    if( isfinite( p[r->nx] ) ) { w = (1.0 - u)*v; s += w*p[r->nx]; ws += w; }
+    if( isfinite( p[r->nx+1] ) ) { w = u*v; s += w*p[r->nx+1]; ws += w; }
+    return ws > 0.0 ? s/ws : NAN;
+    }
+
+double nztm_route_distance( const nztm_route *r, int port, double e,
+   double n )
+{
+   if( port < 0 || port >= r->nports ) return NAN;
+   return route_sample( r, r->dist + (size_t) port*r->nx*r->ny, e, n );
+}
+
+void nztm_route_distances( const nztm_route *r, int port, const double *e,
+   const double *n, double *out, size_t count )
+{
+   const float *f;
+   size_t i;
+
+   if( port < 0 || port >= r->nports ) {
+      for( i = 0; i < count; i++ ) out[i] = NAN;
+      return;
+      }
+   f = r->dist + (size_t) port*r->nx*r->ny;
+   for( i = 0; i < count; i++ ) out[i] = route_sample( r, f, e[i], n[i] );
+}
+
+#ifdef NZTM_ROUTE_TOOL
+
+/* Builds and samples distance fields.  Build with
+      cc -O2 -DNZTM_ROUTE_TOOL -o nztm_route nztm_route.c nztm_land.c \
+         nztm_coast.c nztm_csv.c nztm_pool.c nztm.c nztm_simd.c -lm -lpthread
+   and run as
+      nztm_route -b [-cell size] [-utm zone[s]] coast.bin out.sea < ports.csv
+   to build the fields of the ports (columns name, latitude and
+   longitude), for example with -utm 27 for island.bin, or as
+      nztm_route file.sea lat lon < in.csv
+   to write the distance in kilometres from each port, in a column
+   named after it, to the point in the columns lat and lon of each
+   record of in.csv, for example kastad_breidd and kastad_lengd of
+   spring.csv. */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "nztm_csv.h"
+
+/* Whether field f is the column called name */
+
+static int route_column( const nztm_csv_field *f, const char *name ) {
+    return f->len == strlen( name ) && memcmp( f->p, name, f->len ) == 0;
+    }
+
+/* Reads the named columns (decimal degrees, as radians) of CSV from in,
+   NaN where missing, and with names non-NULL the column called
+   namecol (NULL for none) into *names, NZTM_ROUTE_NAMELEN bytes for
+   each record.  Returns the number of records, or -1. */
+
+static long route_csv( FILE *in, const char *latname, const char *lonname,
+   const char *namecol, double **lat, double **lon, char **names ) {
+    nztm_csv_field f[256];
+    nztm_csv *csv = nztm_csv_open( in, 0 );
+    size_t n = 0, max = 0, len;
+    int nf, i, ilat = -1, ilon = -1, iname = -1;
+    double *p;
+    char *q;
+
+    *lat = *lon = NULL;
+    if( names ) *names = NULL;
+    if( ! csv || ( nf = nztm_csv_read( csv, f, 256 ) ) <= 0 ) goto fail;
+    for( i = 0; i < nf && i < 256; i++ ) {
+        if( route_column( &f[i], latname ) ) ilat = i;
+        if( route_column( &f[i], lonname ) ) ilon = i;
+        if( namecol && route_column( &f[i], namecol ) ) iname = i;
+        }
+    if( ilat < 0 || ilon < 0 ) goto fail;
+    while( ( nf = nztm_csv_read( csv, f, 256 ) ) > 0 ) {
+        if( nf <= ilat || nf <= ilon ) goto fail;
+        if( n == max ) {
+            max = max ? 2*max : 4096;
+            p = (double *) realloc( *lat, max*sizeof(double) );
+            if( ! p ) goto fail;
+            *lat = p;
+            p = (double *) realloc( *lon, max*sizeof(double) );
+            if( ! p ) goto fail;
+            *lon = p;
+            if( names ) {
+                q = (char *) realloc( *names, max*NZTM_ROUTE_NAMELEN );
+                if( ! q ) goto fail;
+                *names = q;
+                }
+            }
+        if( ! nztm_csv_double( f[ilat].p, f[ilat].len, &(*lat)[n] ) )
+            (*lat)[n] = NAN;
+        if( ! nztm_csv_double( f[ilon].p, f[ilon].len, &(*lon)[n] ) )
+            (*lon)[n] = NAN;
+        (*lat)[n] /= rad2deg;
+        (*lon)[n] /= rad2deg;
+        if( names ) {
+            q = *names + n*NZTM_ROUTE_NAMELEN;
+            len = iname >= 0 && iname < nf ? f[iname].len : 0;
+            if( len > NZTM_ROUTE_NAMELEN - 1 ) len = NZTM_ROUTE_NAMELEN - 1;
+            if( len ) memcpy( q, f[iname].p, len );
+            q[len] = 0;
+            }
+        n++;
+        }
+    if( nf < 0 ) goto fail;
+    nztm_csv_close( csv );
+    return (long) n;
+
+fail:
+    if( csv ) nztm_csv_close( csv );
+    free( *lat );
+    free( *lon );
+    *lat = *lon = NULL;
+    if( names ) {
+        free( *names );
+        *names = NULL;
+        }
+    return -1;
+    }
+
+static double route_elapsed( struct timespec *t0 ) {
+    struct timespec t1;
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    return (t1.tv_sec - t0->tv_sec) + 1.0e-9*(t1.tv_nsec - t0->tv_nsec);
+    }
+
+int main( int argc, char *argv[] ) {
+  tmprojection *utm = NULL;
+  double *lat, *lon, *n, *e, *d;
+  const char *name;
+  double cell = 0.0;
+  struct timespec t0;
+  nztm_route r;
+  long count, i;
+  int a, p;
+
+  if( argc > 1 && strcmp( argv[1], "-b" ) == 0 ) {
+     nztm_coast c;
+     nztm_pool *pool;
+     const char **names;
+     char *portname;
+     for( a = 2; a + 1 < argc && argv[a][0] == '-'; a += 2 ) {
+        if( strcmp( argv[a], "-cell" ) == 0 ) cell = atof( argv[a+1] );
+        else if( strcmp( argv[a], "-utm" ) == 0 ) {
+           int zone = atoi( argv[a+1] );
+           int south = strchr( argv[a+1], 's' ) || strchr( argv[a+1], 'S' );
+           if( zone < 1 || zone > 60 ) {
+              fprintf( stderr, "Invalid UTM zone %s\n", argv[a+1] );
+              return 1;
+              }
+           tm_destroy( utm );
+           utm = tm_create( NZTM_A, NZTM_RF, (6.0*zone - 183.0)/rad2deg,
+              0.9996, 0.0, 500000.0, south ? 10000000.0 : 0.0, 1.0 );
+           }
+        else break;
+        }
+     if( a + 2 != argc ) {
+        fprintf( stderr, "Usage: nztm_route -b [-cell size] [-utm zone[s]] "
+           "coast.bin out.sea < ports.csv\n" );
+        return 1;
+        }
+     if( nztm_coast_open( &c, argv[a] ) != 0 ) {
+        fprintf( stderr, "nztm_route: cannot read %s\n", argv[a] );
+        return 1;
+        }
+     count = route_csv( stdin, "latitude", "longitude", "name", &lat, &lon,
+        &portname );
+     if( count <= 0 ) {
+        fprintf( stderr, "nztm_route: cannot read the ports\n" );
+        return 1;
+        }
+     n = (double *) malloc( 2*count*sizeof(double) );
+     e = n + count;
+     names = (const char **) malloc( count*sizeof(const char *) );
+     for( i = 0; i < count; i++ ) names[i] = portname + i*NZTM_ROUTE_NAMELEN;
+     geod_tm_hn( utm ? utm : &nztm_projection, lat, lon, n, e,
+        (size_t) count );
+     pool = nztm_pool_create( 0 );
+     clock_gettime( CLOCK_MONOTONIC, &t0 );
+     if( nztm_route_build( &c, utm, NULL, cell, e, n, names, (int) count,
+            pool, argv[a+1] ) != 0 ) {
+        fprintf( stderr, "nztm_route: cannot build the fields\n" );
+        return 1;
+        }
+     fprintf( stderr, "%ld ports in %.2f s\n", count, route_elapsed( &t0 ) );
+     nztm_pool_destroy( pool );
+     nztm_coast_close( &c );
+     tm_destroy( utm );
+     free( n );
+     free( lat );
+     free( lon );
+     free( names );
+     free( portname );
+     return 0;
+     }
+
+  if( argc != 4 ) {
+     fprintf( stderr, "Usage: nztm_route -b [-cell size] [-utm zone[s]] "
+        "coast.bin out.sea < ports.csv\n"
+        "       nztm_route file.sea lat lon < in.csv\n" );
+     return 1;
+     }
+  if( nztm_route_open( &r, argv[1] ) != 0 ) {
+     fprintf( stderr, "nztm_route: %s is not a valid fields file\n",
+        argv[1] );
+     return 1;
+     }
+  count = route_csv( stdin, argv[2], argv[3], NULL, &lat, &lon, NULL );
+  if( count < 0 ) {
+     fprintf( stderr, "nztm_route: cannot read columns %s and %s\n",
+        argv[2], argv[3] );
+     return 1;
+     }
+  utm = nztm_route_projection( &r );
+  n = (double *) malloc( ( 2 + (size_t) r.nports )*( count + 1 )
+     *sizeof(double) );
+  e = n + count;
+  d = e + count;
+  geod_tm_hn( utm, lat, lon, n, e, (size_t) count );
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  for( p = 0; p < r.nports; p++ )
+     nztm_route_distances( &r, p, e, n, d + (size_t) p*count,
+        (size_t) count );
+  fprintf( stderr, "%ld points, %d ports, %.1f Mlookup/s\n", count, r.nports,
+     count*r.nports/route_elapsed( &t0 )*1.0e-6 );
+
+  for( p = 0; p < r.nports; p++ ) {
+     if( p ) printf( "," );
+     name = nztm_route_name( &r, p );
+     if( *name ) printf( "%s", name );
+     else printf( "port%d", p );
+     }
+  printf( "\n" );
+  for( i = 0; i < count; i++ )
+     for( p = 0; p < r.nports; p++ )
+        printf( "%.3f%c", d[(size_t) p*count + i]*1.0e-3,
+           p == r.nports - 1 ? '\n' : ',' );
+  tm_destroy( utm );
+  nztm_route_close( &r );
+  free( n );
+  free( lat );
+  free( lon );
+  return 0;
+  }
+
+#endif
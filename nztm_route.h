@@ -0,0 +1,102 @@
+#ifndef _NZTM_ROUTE_H
+#define _NZTM_ROUTE_H
+
+/* Distances by sea from ports, going around the coastline rings of an
+   nztm_coast file (island.bin or newzealand.bin) rather than across
+   them.
+
+   nztm_route_build rasterises a box of a TM projection into square
+   cells, a cell being sea if its centre is outside the rings (by
+   nztm_land) and it is connected to the edge of the box through other
+   sea cells, so that enclosed water is treated as land.  For each port
+   it then solves the eikonal equation over the sea cells by the fast
+   marching method, from the sea cells about the nearest one to the
+   port (within NZTM_ROUTE_SNAP cells), giving the length of the
+   shortest path by sea to the centre of every cell.  This is more
+   accurate than Dijkstra's algorithm on the grid graph, whose paths
+   are limited to the directions of the grid.  The ports are solved in
+   parallel on a pool and the fields written to one file.
+
+   nztm_route_open maps the file read only, and the distance from a
+   port to any point is a bilinear sample of its field: a few memory
+   reads with no path search, so many millions of stations can be
+   costed per second.  Distances are in projection units, measured in
+   the plane of the projection.  The first order method and the
+   rasterisation give errors of up to a few cells over long paths.  As
+   with nztm_tow, the nztm_route structure is owned by the caller. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nztm.h"
+#include "nztm_coast.h"
+#include "nztm_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_ROUTE_CELL      500.0       /* Default cell size */
+#define NZTM_ROUTE_MARGIN    200000.0    /* Default margin about the rings */
+#define NZTM_ROUTE_MAXCELLS  (1 << 25)
+#define NZTM_ROUTE_SNAP      20          /* Cells searched for a port's sea */
+#define NZTM_ROUTE_NAMELEN   32          /* Bytes of a port name and NUL */
+
+typedef struct {
+        void *map;
+        size_t size;
+        int nx, ny;
+        int nports;
+        double x0, y0;            /* Easting, northing of centre of cell 0 */
+        double cell;              /* Size of the cells */
+        const double *port;       /* Easting, northing of each port */
+        const char *names;        /* NZTM_ROUTE_NAMELEN bytes for each port */
+        const float *dist;        /* Fields of nx*ny, row by row from the
+                                     south west, NaN on land */
+        const void *hdr;
+        } nztm_route;
+
+/* Writes the distance fields of the nports ports at (pe[i],pn[i]),
+   named names[i] (names or an entry NULL for none, longer names cut to
+   NZTM_ROUTE_NAMELEN - 1 bytes), to path, over box (minimum easting,
+   minimum northing, maximum easting, maximum northing) of tm (NULL for
+   NZTM) in cells of size cell.  box NULL takes the extent of the rings
+   with a margin of NZTM_ROUTE_MARGIN, and cell 0 NZTM_ROUTE_CELL.
+   Returns 0, or -1 if the arguments are invalid, there would be more
+   than NZTM_ROUTE_MAXCELLS cells, a port is not near the sea, memory
+   cannot be allocated or the file cannot be written. */
+
+int nztm_route_build( const nztm_coast *c, const tmprojection *tm,
+   const double *box, double cell, const double *pe, const double *pn,
+   const char *const *names, int nports, nztm_pool *pool,
+   const char *path );
+
+/* Returns 0, or -1 if the file cannot be mapped or is not valid */
+
+int nztm_route_open( nztm_route *r, const char *path );
+void nztm_route_close( nztm_route *r );
+
+/* The name of port, "" if it has none */
+
+const char *nztm_route_name( const nztm_route *r, int port );
+
+/* The projection of the fields, created with tm_create (free with
+   tm_destroy) */
+
+tmprojection *nztm_route_projection( const nztm_route *r );
+
+/* Distance by sea from port to the point (e,n), or to each of count
+   points.  Neighbouring cells on land are left out of the bilinear
+   sample; a point with none of its four cells at sea, or outside the
+   cell centres, gives NaN. */
+
+double nztm_route_distance( const nztm_route *r, int port, double e,
+   double n );
+void nztm_route_distances( const nztm_route *r, int port, const double *e,
+   const double *n, double *out, size_t count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,706 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Static packed R-tree (Hilbert packed, in the layout of flatbush).
+
+   The tree is a single block
+
+      header           rtree_header
+      boxes            double[4*nboxes], minx miny maxx maxy
+      index            uint64[nboxes]
+
+   holding the leaves (one per item, in Hilbert order) and then each
+   level of nodes up to the root, which is the last box.  levels[l] is
+   the end of level l in the arrays, level 0 being the leaves.  The
+   index of a leaf is its item; that of a node is the position of its
+   first child, its children being the next nodesize boxes of the level
+   below (fewer for the last node of a level).  The same block is
+   written to and mapped from files. */
+
+#include "nztm_rtree.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RTREE_MAGIC     "NZTMRTR1"
+#define RTREE_VERSION   1
+#define RTREE_MAXLEVELS 64
+#define RTREE_MAXNODE   64        /* Largest node size */
+#define RTREE_STACK     1024      /* Bounds (maxnode-1)*levels + 1 */
+#define RTREE_CHUNK     65536     /* Items per parallel work item */
+
+typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t nodesize;
+        uint64_t nitems;
+        uint64_t nboxes;
+        uint32_t nlevels;
+        uint32_t pad;
+        uint64_t levels[RTREE_MAXLEVELS];
+        } rtree_header;
+
+struct nztm_rtree {
+        void *block;              /* Allocated, or mapped with size */
+        size_t size;
+        int mapped;
+        const nztm_allocator *al; /* Of the tree and an allocated block */
+        const rtree_header *h;
+        const double *boxes;
+        const uint64_t *index;
+        };
+
+static size_t rtree_bytes( uint64_t nboxes ) {
+    return sizeof(rtree_header) + (size_t) nboxes*(4*sizeof(double) + sizeof(uint64_t));
+    }
+
+/* Sets the pointers of t into its block */
+
+static void rtree_layout( nztm_rtree *t ) {
+    t->h = (const rtree_header *) t->block;
+    t->boxes = (const double *) (t->h + 1);
+    t->index = (const uint64_t *) (t->boxes + 4*t->h->nboxes);
+    }
+
+/* Position along the Hilbert curve of order 16 of (x,y) */
+
+static uint32_t rtree_hilbert( uint32_t x, uint32_t y ) {
+    uint32_t rx, ry, s, t;
+    uint32_t d = 0;
+
+    for( s = 1u << 15; s > 0; s >>= 1 ) {
+        rx = (x & s) != 0;
+        ry = (y & s) != 0;
+        d += s*s*((3*rx) ^ ry);
+        if( ry == 0 ) {
+            if( rx ) { x = 0xffff - x; y = 0xffff - y; }
+            t = x; x = y; y = t;
+            }
+        }
+    return d;
+    }
+
+/*************************************************************************/
+/*                                                                       */
+/*   Bulk loading                                                        */
+/*                                                                       */
+/*************************************************************************/
+
+typedef struct {
+        const double *x0, *y0, *x1, *y1;
+        const uint64_t *ids;      /* Items kept */
+        uint32_t *keys;
+        size_t n;
+        double minx, miny, sx, sy;    /* Scaling to the Hilbert grid */
+        double *boxes;
+        uint64_t *index;
+        size_t start, end, nodesize;  /* Level being built */
+        } rtree_build;
+
+static void rtree_item_box( const rtree_build *b, uint64_t id, double *box ) {
+    box[0] = b->x0[id];
+    box[1] = b->y0[id];
+    box[2] = b->x1 ? b->x1[id] : box[0];
+    box[3] = b->y1 ? b->y1[id] : box[1];
+    if( box[2] < box[0] ) { double t = box[0]; box[0] = box[2]; box[2] = t; }
+    if( box[3] < box[1] ) { double t = box[1]; box[1] = box[3]; box[3] = t; }
+    }
+
+static void rtree_keys( void *ctx, size_t item, int thread ) {
+    rtree_build *b = (rtree_build *) ctx;
+    size_t i = item*RTREE_CHUNK;
+    size_t end = i + RTREE_CHUNK < b->n ? i + RTREE_CHUNK : b->n;
+    double box[4];
+
+    (void) thread;
+    for( ; i < end; i++ ) {
+        rtree_item_box( b, b->ids[i], box );
+        b->keys[i] = rtree_hilbert(
+            (uint32_t) ((0.5*(box[0] + box[2]) - b->minx)*b->sx),
+            (uint32_t) ((0.5*(box[1] + box[3]) - b->miny)*b->sy) );
+        }
+    }
+
+static void rtree_leaves( void *ctx, size_t item, int thread ) {
+    rtree_build *b = (rtree_build *) ctx;
+    size_t i = item*RTREE_CHUNK;
+    size_t end = i + RTREE_CHUNK < b->n ? i + RTREE_CHUNK : b->n;
+
+    (void) thread;
+    for( ; i < end; i++ ) {
+        rtree_item_box( b, b->ids[i], b->boxes + 4*i );
+        b->index[i] = b->ids[i];
+        }
+    }
+
+/* Nodes of the level above [start,end), RTREE_CHUNK children at a time */
+
+static void rtree_nodes( void *ctx, size_t item, int thread ) {
+    rtree_build *b = (rtree_build *) ctx;
+    size_t ns = b->nodesize;
+    size_t c = b->start + item*(RTREE_CHUNK/ns)*ns;
+    size_t last = c + (RTREE_CHUNK/ns)*ns < b->end ? c + (RTREE_CHUNK/ns)*ns : b->end;
+    size_t p = b->end + (c - b->start)/ns;
+    size_t e;
+    double *box;
+    const double *cb;
+
+    (void) thread;
+    for( ; c < last; c = e, p++ ) {
+        e = c + ns < last ? c + ns : last;
+        box = b->boxes + 4*p;
+        cb = b->boxes + 4*c;
+        box[0] = cb[0]; box[1] = cb[1]; box[2] = cb[2]; box[3] = cb[3];
+        for( cb += 4; cb < b->boxes + 4*e; cb += 4 ) {
+            if( cb[0] < box[0] ) box[0] = cb[0];
+            if( cb[1] < box[1] ) box[1] = cb[1];
+            if( cb[2] > box[2] ) box[2] = cb[2];
+            if( cb[3] > box[3] ) box[3] = cb[3];
+            }
+        b->index[p] = c;
+        }
+    }
+
+/* Sorts ids by keys (least significant digit radix sort) */
+
+static int rtree_sort( uint32_t *keys, uint64_t *ids, size_t n,
+   const nztm_allocator *al ) {
+    uint32_t *k2 = (uint32_t *) nztm_alloc( al, (n + 1)*sizeof(uint32_t) );
+    uint64_t *i2 = (uint64_t *) nztm_alloc( al, (n + 1)*sizeof(uint64_t) );
+    size_t count[256];
+    size_t i, sum, t;
+    uint32_t *kt;
+    uint64_t *it;
+    int shift;
+
+    if( ! k2 || ! i2 ) { nztm_free( al, k2 ); nztm_free( al, i2 ); return -1; }
+    for( shift = 0; shift < 32; shift += 8 ) {
+        memset( count, 0, sizeof(count) );
+        for( i = 0; i < n; i++ ) count[(keys[i] >> shift) & 0xff]++;
+        for( i = 0, sum = 0; i < 256; i++ ) { t = count[i]; count[i] = sum; sum += t; }
+        for( i = 0; i < n; i++ ) {
+            t = count[(keys[i] >> shift) & 0xff]++;
+            k2[t] = keys[i];
+            i2[t] = ids[i];
+            }
+        kt = keys; keys = k2; k2 = kt;
+        it = ids; ids = i2; i2 = it;
+        }
+
+    /* After an even number of passes the sorted data is back in the
+       callers' arrays */
+
+    nztm_free( al, k2 );
+    nztm_free( al, i2 );
+    return 0;
+    }
+
+nztm_rtree *nztm_rtree_build( nztm_pool *pool, const double *x0,
+   const double *y0, const double *x1, const double *y1, size_t n,
+   int nodesize )
+{
+   return nztm_rtree_build_a( pool, x0, y0, x1, y1, n, nodesize, NULL );
+}
+
+nztm_rtree *nztm_rtree_build_a( nztm_pool *pool, const double *x0,
+   const double *y0, const double *x1, const double *y1, size_t n,
+   int nodesize, const nztm_allocator *al )
+{
+   rtree_build b;
+   rtree_header *h;
+   nztm_rtree *t;
+   uint64_t levels[RTREE_MAXLEVELS];
+   uint64_t *ids;
+   size_t nlevels, nboxes, m, i, k;
+   double box[4];
+   double minx = HUGE_VAL, miny = HUGE_VAL, maxx = -HUGE_VAL, maxy = -HUGE_VAL;
+
+   if( nodesize <= 0 ) nodesize = NZTM_RTREE_NODESIZE;
+   if( nodesize < 2 ) nodesize = 2;
+   if( nodesize > RTREE_MAXNODE ) nodesize = RTREE_MAXNODE;
+
+   memset( &b, 0, sizeof(b) );
+   b.x0 = x0; b.y0 = y0; b.x1 = x1; b.y1 = y1;
+
+   /* Keep the items with valid boxes and find their extent */
+
+   ids = (uint64_t *) nztm_alloc( al, (n + 1)*sizeof(uint64_t) );
+   if( ! ids ) return NULL;
+   for( i = 0, k = 0; i < n; i++ ) {
+      rtree_item_box( &b, i, box );
+      if( isnan( box[0] ) || isnan( box[1] ) || isnan( box[2] ) || isnan( box[3] ) )
+         continue;
+      if( box[0] < minx ) minx = box[0];
+      if( box[1] < miny ) miny = box[1];
+      if( box[2] > maxx ) maxx = box[2];
+      if( box[3] > maxy ) maxy = box[3];
+      ids[k++] = i;
+      }
+   n = k;
+
+   nlevels = 0;
+   nboxes = n;
+   if( n > 0 ) {
+      levels[nlevels++] = n;
+      m = n;
+      do {
+         m = (m + nodesize - 1)/nodesize;
+         nboxes += m;
+         levels[nlevels++] = nboxes;
+         } while( m != 1 );
+      }
+
+   t = (nztm_rtree *) nztm_zalloc( al, sizeof(nztm_rtree) );
+   b.keys = (uint32_t *) nztm_alloc( al, (n + 1)*sizeof(uint32_t) );
+   if( t ) t->al = al;
+   if( t ) t->size = rtree_bytes( nboxes );
+   if( t ) t->block = nztm_zalloc( al, t->size );
+   if( ! t || ! t->block || ! b.keys ) goto fail;
+
+   h = (rtree_header *) t->block;
+   memcpy( h->magic, RTREE_MAGIC, 8 );
+   h->version = RTREE_VERSION;
+   h->nodesize = (uint32_t) nodesize;
+   h->nitems = n;
+   h->nboxes = nboxes;
+   h->nlevels = (uint32_t) nlevels;
+   for( i = 0; i < nlevels; i++ ) h->levels[i] = levels[i];
+   rtree_layout( t );
+   if( n == 0 ) { nztm_free( al, b.keys ); nztm_free( al, ids ); return t; }
+
+   /* Order the items along the Hilbert curve of their centres */
+
+   b.ids = ids;
+   b.n = n;
+   b.minx = minx;
+   b.miny = miny;
+   b.sx = maxx > minx ? 65535.0/(maxx - minx) : 0.0;
+   b.sy = maxy > miny ? 65535.0/(maxy - miny) : 0.0;
+   nztm_pool_run( pool, (n + RTREE_CHUNK - 1)/RTREE_CHUNK, rtree_keys, &b );
+   if( rtree_sort( b.keys, ids, n, al ) != 0 ) goto fail;
+
+   /* Fill in the leaves, then each level from the one below */
+
+   b.boxes = (double *) t->boxes;
+   b.index = (uint64_t *) t->index;
+   nztm_pool_run( pool, (n + RTREE_CHUNK - 1)/RTREE_CHUNK, rtree_leaves, &b );
+   b.nodesize = (size_t) nodesize;
+   for( i = 1; i < nlevels; i++ ) {
+      b.start = i > 1 ? (size_t) levels[i-2] : 0;
+      b.end = (size_t) levels[i-1];
+      k = (RTREE_CHUNK/nodesize)*nodesize;
+      nztm_pool_run( pool, (b.end - b.start + k - 1)/k, rtree_nodes, &b );
+      }
+   nztm_free( al, b.keys );
+   nztm_free( al, ids );
+   return t;
+
+fail:
+   nztm_free( al, b.keys );
+   nztm_free( al, ids );
+   nztm_rtree_destroy( t );
+   return NULL;
+}
+
+void nztm_rtree_destroy( nztm_rtree *t )
+{
+   if( ! t ) return;
+   if( t->mapped ) munmap( t->block, t->size );
+   else nztm_free( t->al, t->block );
+   nztm_free( t->al, t );
+}
+
+size_t nztm_rtree_size( const nztm_rtree *t )
+{
+   return (size_t) t->h->nitems;
+}
+
+/*************************************************************************/
+/*                                                                       */
+/*   Files                                                               */
+/*                                                                       */
+/*************************************************************************/
+
+int nztm_rtree_save( const nztm_rtree *t, const char *path )
+{
+   FILE *f = fopen( path, "wb" );
+   int ok;
+
+   if( ! f ) return -1;
+   ok = fwrite( t->block, 1, t->size, f ) == t->size;
+   if( fclose( f ) != 0 ) ok = 0;
+   return ok ? 0 : -1;
+}
+
+/* Checks the header and level structure of a mapped tree */
+
+static int rtree_check( const void *block, size_t size ) {
+    const rtree_header *h = (const rtree_header *) block;
+    uint64_t m, total;
+    uint32_t l;
+
+    if( size < sizeof(rtree_header) || memcmp( h->magic, RTREE_MAGIC, 8 ) != 0 ||
+        h->version != RTREE_VERSION || h->nodesize < 2 ||
+        h->nodesize > RTREE_MAXNODE || h->nlevels > RTREE_MAXLEVELS ||
+        h->nboxes > (size - sizeof(rtree_header))/40 ||
+        rtree_bytes( h->nboxes ) != size ) return -1;
+    if( h->nitems == 0 ) return h->nboxes == 0 && h->nlevels == 0 ? 0 : -1;
+
+    /* The levels must be those built for nitems */
+
+    if( h->nlevels < 2 || h->levels[0] != h->nitems ) return -1;
+    m = total = h->nitems;
+    for( l = 1; l < h->nlevels; l++ ) {
+        m = (m + h->nodesize - 1)/h->nodesize;
+        total += m;
+        if( h->levels[l] != total ) return -1;
+        }
+    return m == 1 && total == h->nboxes ? 0 : -1;
+    }
+
+nztm_rtree *nztm_rtree_open( const char *path )
+{
+   nztm_rtree *t;
+   struct stat st;
+   void *map;
+   int fd;
+
+   fd = open( path, O_RDONLY );
+   if( fd < 0 ) return NULL;
+   if( fstat( fd, &st ) != 0 || st.st_size <= 0 ) { close( fd ); return NULL; }
+   map = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+   close( fd );
+   if( map == MAP_FAILED ) return NULL;
+
+   t = (nztm_rtree *) calloc( 1, sizeof(nztm_rtree) );
+   if( ! t || rtree_check( map, (size_t) st.st_size ) != 0 ) {
+      free( t );
+      munmap( map, (size_t) st.st_size );
+      return NULL;
+      }
+   t->block = map;
+   t->size = (size_t) st.st_size;
+   t->mapped = 1;
+   rtree_layout( t );
+   return t;
+}
+
+/*************************************************************************/
+/*                                                                       */
+/*   Queries                                                             */
+/*                                                                       */
+/*************************************************************************/
+
+/* Squared distance from (x,y) to box b */
+
+static double rtree_dist2( const double *b, double x, double y ) {
+    double dx = x < b[0] ? b[0] - x : x > b[2] ? x - b[2] : 0.0;
+    double dy = y < b[1] ? b[1] - y : y > b[3] ? y - b[3] : 0.0;
+
+    return dx*dx + dy*dy;
+    }
+
+/* Level of the node at position pos */
+
+static int rtree_level( const rtree_header *h, uint64_t pos ) {
+    int l = 0;
+
+    while( pos >= h->levels[l] ) l++;
+    return l;
+    }
+
+/* Calls fn for the items whose boxes intersect q and, if r2 >= 0, are
+   within sqrt(r2) of (x,y) */
+
+static size_t rtree_query( const nztm_rtree *t, const double *q,
+   double x, double y, double r2, nztm_rtree_fn fn, void *ctx ) {
+    const rtree_header *h = t->h;
+    uint64_t stack[RTREE_STACK];
+    int depth[RTREE_STACK];
+    uint64_t c, end;
+    const double *b;
+    size_t found = 0;
+    int sp = 0;
+    int level;
+
+    if( h->nitems == 0 ) return 0;
+    b = t->boxes + 4*(h->nboxes - 1);
+    if( b[0] > q[2] || b[2] < q[0] || b[1] > q[3] || b[3] < q[1] ) return 0;
+    stack[sp] = h->nboxes - 1;
+    depth[sp++] = (int) h->nlevels - 1;
+
+    while( sp > 0 ) {
+        sp--;
+        level = depth[sp] - 1;
+        c = t->index[stack[sp]];
+        end = c + h->nodesize < h->levels[level] ? c + h->nodesize : h->levels[level];
+        for( ; c < end; c++ ) {
+            b = t->boxes + 4*c;
+            if( b[0] > q[2] || b[2] < q[0] || b[1] > q[3] || b[3] < q[1] ) continue;
+            if( level > 0 ) {
+                stack[sp] = c;
+                depth[sp++] = level;
+                }
+            else if( r2 < 0.0 || rtree_dist2( b, x, y ) <= r2 ) {
+                found++;
+                if( fn && fn( ctx, (size_t) t->index[c] ) ) return found;
+                }
+            }
+        }
+    return found;
+    }
+
+size_t nztm_rtree_search( const nztm_rtree *t, double x0, double y0,
+   double x1, double y1, nztm_rtree_fn fn, void *ctx )
+{
+   double q[4];
+
+   q[0] = x0 < x1 ? x0 : x1;
+   q[1] = y0 < y1 ? y0 : y1;
+   q[2] = x0 < x1 ? x1 : x0;
+   q[3] = y0 < y1 ? y1 : y0;
+   return rtree_query( t, q, 0.0, 0.0, -1.0, fn, ctx );
+}
+
+size_t nztm_rtree_radius( const nztm_rtree *t, double x, double y,
+   double r, nztm_rtree_fn fn, void *ctx )
+{
+   double q[4];
+
+   if( ! ( r >= 0.0 ) ) return 0;
+   q[0] = x - r;
+   q[1] = y - r;
+   q[2] = x + r;
+   q[3] = y + r;
+   return rtree_query( t, q, x, y, r*r, fn, ctx );
+}
+
+/* Binary min heap of boxes by distance, for nztm_rtree_nearest */
+
+typedef struct {
+        double d2;
+        uint64_t pos;
+        } rtree_entry;
+
+#define RTREE_HEAP 256            /* Entries of the heap on the stack */
+
+typedef struct {
+        rtree_entry *e;           /* stack, or from al once it is full */
+        size_t n, max;
+        rtree_entry stack[RTREE_HEAP];
+        const nztm_allocator *al;
+        } rtree_heap;
+
+static int rtree_push( rtree_heap *q, double d2, uint64_t pos ) {
+    rtree_entry *e;
+    size_t i, p;
+
+    if( q->n == q->max ) {
+        e = (rtree_entry *) nztm_alloc( q->al, 2*q->max*sizeof(rtree_entry) );
+        if( ! e ) return -1;
+        memcpy( e, q->e, q->n*sizeof(rtree_entry) );
+        if( q->e != q->stack ) nztm_free( q->al, q->e );
+        q->e = e;
+        q->max *= 2;
+        }
+    for( i = q->n++; i > 0; i = p ) {
+        p = (i - 1)/2;
+        if( q->e[p].d2 <= d2 ) break;
+        q->e[i] = q->e[p];
+        }
+    q->e[i].d2 = d2;
+    q->e[i].pos = pos;
+    return 0;
+    }
+
+static rtree_entry rtree_pop( rtree_heap *q ) {
+    rtree_entry top = q->e[0];
+    rtree_entry last = q->e[--q->n];
+    size_t i = 0, c;
+
+    for( ;; ) {
+        c = 2*i + 1;
+        if( c >= q->n ) break;
+        if( c + 1 < q->n && q->e[c+1].d2 < q->e[c].d2 ) c++;
+        if( last.d2 <= q->e[c].d2 ) break;
+        q->e[i] = q->e[c];
+        i = c;
+        }
+    if( q->n > 0 ) q->e[i] = last;
+    return top;
+    }
+
+long nztm_rtree_nearest( const nztm_rtree *t, double x, double y,
+   size_t k, double maxdist, size_t *items, double *dist )
+{
+   return nztm_rtree_nearest_a( t, x, y, k, maxdist, items, dist, NULL );
+}
+
+long nztm_rtree_nearest_a( const nztm_rtree *t, double x, double y,
+   size_t k, double maxdist, size_t *items, double *dist,
+   const nztm_allocator *al )
+{
+   const rtree_header *h = t->h;
+   double max2 = maxdist*maxdist;
+   rtree_heap q;
+   rtree_entry top;
+   uint64_t c, end;
+   size_t found = 0;
+   double d2;
+   int level;
+
+   if( h->nitems == 0 || k == 0 || ! ( maxdist >= 0.0 ) ) return 0;
+   q.n = 0;
+   q.max = RTREE_HEAP;
+   q.e = q.stack;
+   q.al = al;
+   rtree_push( &q, 0.0, h->nboxes - 1 );
+
+   /* Boxes come off the heap in order of distance, so each item popped
+      is nearer than anything not yet found */
+
+   while( q.n > 0 && found < k ) {
+      top = rtree_pop( &q );
+      if( top.d2 > max2 ) break;
+      if( top.pos < h->nitems ) {
+         items[found] = (size_t) t->index[top.pos];
+         if( dist ) dist[found] = sqrt( top.d2 );
+         found++;
+         continue;
+         }
+      level = rtree_level( h, top.pos ) - 1;
+      c = t->index[top.pos];
+      end = c + h->nodesize < h->levels[level] ? c + h->nodesize : h->levels[level];
+      for( ; c < end; c++ ) {
+         d2 = rtree_dist2( t->boxes + 4*c, x, y );
+         if( d2 <= max2 && rtree_push( &q, d2, c ) != 0 ) {
+            if( q.e != q.stack ) nztm_free( al, q.e );
+            return -1;
+            }
+         }
+      }
+   if( q.e != q.stack ) nztm_free( al, q.e );
+   return (long) found;
+}
+
+#ifdef TEST_NZTM_RTREE
+
+/* Checks queries against linear scans over random points and boxes,
+   and times them */
+
+#include <time.h>
+
+static double test_now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+    }
+
+static double test_rand( void ) {
+    return rand()/(RAND_MAX + 1.0);
+    }
+
+static int test_mark( void *ctx, size_t item ) {
+    ((char *) ctx)[item]++;
+    return 0;
+    }
+
+int main( int argc, char *argv[] ) {
+  size_t n = argc > 1 ? (size_t) atol( argv[1] ) : 200000;
+  double *x0 = (double *) malloc( 4*n*sizeof(double) );
+  double *y0 = x0 + n, *x1 = y0 + n, *y1 = x1 + n;
+  char *mark = (char *) calloc( n, 1 );
+  size_t items[100], nbad = 0, i, j, got;
+  double dist[100], b[4], qx, qy, r, t0, d2;
+  nztm_pool *pool = nztm_pool_create( 0 );
+  nztm_rtree *t, *tf;
+  int pass;
+  long k;
+
+  for( i = 0; i < n; i++ ) {
+     x0[i] = 1.0e6 + 5.0e5*test_rand();
+     y0[i] = 7.0e6 + 4.0e5*test_rand();
+     x1[i] = x0[i] + 2.0e3*test_rand();
+     y1[i] = y0[i] + 2.0e3*test_rand();
+     }
+  x0[n/2] = NAN;
+
+  for( pass = 0; pass < 2; pass++ ) {
+     t0 = test_now();
+     t = nztm_rtree_build( pool, x0, y0, pass ? x1 : NULL, pass ? y1 : NULL, n, 0 );
+     printf( "%s: built over %lu items in %.3f s\n", pass ? "boxes" : "points",
+        (unsigned long) nztm_rtree_size( t ), test_now() - t0 );
+     nztm_rtree_save( t, "test_rtree.bin" );
+     tf = nztm_rtree_open( "test_rtree.bin" );
+     if( ! tf ) { printf( "cannot reopen saved tree\n" ); return 1; }
+     nztm_rtree_destroy( t );
+     t = tf;
+
+     t0 = test_now();
+     for( j = 0; j < 200; j++ ) {
+        qx = 1.0e6 + 5.0e5*test_rand();
+        qy = 7.0e6 + 4.0e5*test_rand();
+        r = 2.0e4*test_rand();
+        memset( mark, 0, n );
+        nztm_rtree_search( t, qx - r, qy - r, qx + r, qy + r, test_mark, mark );
+        for( i = 0; i < n; i++ ) {
+           b[0] = x0[i]; b[1] = y0[i];
+           b[2] = pass ? x1[i] : x0[i]; b[3] = pass ? y1[i] : y0[i];
+           if( isnan( b[0] ) ) { if( mark[i] ) nbad++; continue; }
+           if( mark[i] != ( !( b[0] > qx + r || b[2] < qx - r ||
+                               b[1] > qy + r || b[3] < qy - r ) ) ) nbad++;
+           }
+        memset( mark, 0, n );
+        nztm_rtree_radius( t, qx, qy, r, test_mark, mark );
+        for( i = 0; i < n; i++ ) {
+           b[0] = x0[i]; b[1] = y0[i];
+           b[2] = pass ? x1[i] : x0[i]; b[3] = pass ? y1[i] : y0[i];
+           if( isnan( b[0] ) ) { if( mark[i] ) nbad++; continue; }
+           if( mark[i] != ( rtree_dist2( b, qx, qy ) <= r*r ) ) nbad++;
+           }
+        k = nztm_rtree_nearest( t, qx, qy, 100, HUGE_VAL, items, dist );
+        for( i = 0, got = 0; i < n; i++ ) {
+           b[0] = x0[i]; b[1] = y0[i];
+           b[2] = pass ? x1[i] : x0[i]; b[3] = pass ? y1[i] : y0[i];
+           if( isnan( b[0] ) ) continue;
+           d2 = rtree_dist2( b, qx, qy );
+           if( k > 0 && d2 < dist[k-1]*dist[k-1] ) got++;
+           }
+        if( k != (long) ( nztm_rtree_size( t ) < 100 ? nztm_rtree_size( t ) : 100 ) ||
+            got > (size_t) k ) nbad++;
+        }
+     printf( "  200 box, radius and 100-nearest queries checked: %lu errors\n",
+        (unsigned long) nbad );
+
+     t0 = test_now();
+     for( j = 0, got = 0; j < 100000; j++ ) {
+        qx = 1.0e6 + 5.0e5*test_rand();
+        qy = 7.0e6 + 4.0e5*test_rand();
+        got += nztm_rtree_search( t, qx - 1.0e3, qy - 1.0e3, qx + 1.0e3, qy + 1.0e3,
+           NULL, NULL );
+        }
+     printf( "  box queries: %.2f us each (%.1f found)\n",
+        (test_now() - t0)*10.0, got/1.0e5 );
+     t0 = test_now();
+     for( j = 0; j < 100000; j++ ) {
+        qx = 1.0e6 + 5.0e5*test_rand();
+        qy = 7.0e6 + 4.0e5*test_rand();
+        nztm_rtree_nearest( t, qx, qy, 10, HUGE_VAL, items, dist );
+        }
+     printf( "  10-nearest queries: %.2f us each\n", (test_now() - t0)*10.0 );
+     nztm_rtree_destroy( t );
+     }
+  remove( "test_rtree.bin" );
+  nztm_pool_destroy( pool );
+  free( x0 );
+  free( mark );
+  return nbad != 0;
+  }
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef _NZTM_RTREE_H
+#define _NZTM_RTREE_H
+
+/* Static packed R-tree over projected positions or boxes.
+
+   nztm_rtree_build bulk loads a tree over n items, each a box
+   (x0,y0)-(x1,y1) in projected coordinates (easting, northing), for
+   example the bounding box of a tow from its start to its end, or a
+   point if x1 and y1 are NULL.  Items are ordered along a Hilbert
+   curve over the extent of the data and packed nodesize to a node
+   (0 for NZTM_RTREE_NODESIZE), level by level, so the tree is stored
+   as two flat arrays and queries take logarithmic time.  The sort keys
+   and node boxes are computed on the threads of pool, which may be
+   NULL.  Items with a NaN coordinate are left out.
+
+   The tree can be saved to a file, for example next to the columnar
+   tow file it indexes, and nztm_rtree_open maps it back in place. */
+
+#include <stddef.h>
+
+#include "nztm_arena.h"
+#include "nztm_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_RTREE_NODESIZE 16
+
+typedef struct nztm_rtree nztm_rtree;
+
+/* Called for each item found; returning non zero stops the search */
+
+typedef int (*nztm_rtree_fn)( void *ctx, size_t item );
+
+nztm_rtree *nztm_rtree_build( nztm_pool *pool, const double *x0,
+   const double *y0, const double *x1, const double *y1, size_t n,
+   int nodesize );
+void nztm_rtree_destroy( nztm_rtree *t );
+
+/* As nztm_rtree_build, taking the memory of the tree and of the build
+   from al (nztm_arena.h), which must outlive the tree */
+
+nztm_rtree *nztm_rtree_build_a( nztm_pool *pool, const double *x0,
+   const double *y0, const double *x1, const double *y1, size_t n,
+   int nodesize, const nztm_allocator *al );
+
+/* Number of items indexed (excluding those left out) */
+
+size_t nztm_rtree_size( const nztm_rtree *t );
+
+/* Save returns 0 or -1 on error; open returns NULL if the file cannot
+   be mapped or is not a valid tree. */
+
+int nztm_rtree_save( const nztm_rtree *t, const char *path );
+nztm_rtree *nztm_rtree_open( const char *path );
+
+/* Calls fn for each item whose box intersects the box (x0,y0)-(x1,y1)
+   or lies within distance r of (x,y).  Return the number of items
+   found. */
+
+size_t nztm_rtree_search( const nztm_rtree *t, double x0, double y0,
+   double x1, double y1, nztm_rtree_fn fn, void *ctx );
+size_t nztm_rtree_radius( const nztm_rtree *t, double x, double y,
+   double r, nztm_rtree_fn fn, void *ctx );
+
+/* Finds the (up to) k items nearest (x,y) and within maxdist of it,
+   storing them by increasing distance in items and, if dist is not
+   NULL, their distances.  Use maxdist HUGE_VAL for no limit.  Returns
+   the number found, or -1 if memory cannot be allocated. */
+
+long nztm_rtree_nearest( const nztm_rtree *t, double x, double y,
+   size_t k, double maxdist, size_t *items, double *dist );
+
+/* As nztm_rtree_nearest, taking from al (nztm_arena.h) the memory of
+   searches that outgrow the stack */
+
+long nztm_rtree_nearest_a( const nztm_rtree *t, double x, double y,
+   size_t k, double maxdist, size_t *items, double *dist,
+   const nztm_allocator *al );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
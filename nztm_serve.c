@@ -0,0 +1,944 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE           /* syscall, for the futex */
+
+/* Conversion server.
+
+   The shared memory segment is a serve_head, padded to SERVE_HEAD
+   bytes, followed by the slots.  A client claims a slot by setting its
+   owner from 0 (or the id of a process that has gone) to its process
+   id, and a slot then goes IDLE -> READY (client) -> DONE (server) ->
+   IDLE (client, once it has the results).  A client about to sleep
+   sets waiting and then looks at state once more, and the server sets
+   state and then looks at waiting; as both use sequentially consistent
+   operations one of them sees the other, so a wakeup is never lost.
+   The sleeping flag of the server and the doorbell a client rings after
+   marking its slot ready work in the same way.  Sleeps have a timeout,
+   so the server notices nztm_server_stop and a client notices a server
+   that has gone.
+
+   On a socket, each connection has a thread of its own, with a buffer
+   holding x, y, the reply header and o1 and o2 in turn, so each reply
+   is a single write.  Reads and writes time out every SERVE_POLL
+   milliseconds to check for nztm_server_stop, so a client that stops
+   reading a reply cannot hold up the server's exit. */
+
+#include "nztm_serve.h"
+
+#include "nztm_bulk.h"
+#include "tmproj.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define SERVE_MAGIC   0x314d48534d545a4eull       /* "NZTMSHM1" */
+#define SERVE_VERSION 1
+#define SERVE_HEAD    4096        /* Bytes before the first slot */
+#define SERVE_PROJS   32          /* Projections kept */
+#define SERVE_SPIN    100.0e-6    /* Seconds spinning before sleeping */
+#define SERVE_POLL    200         /* Milliseconds between checks for stop */
+#define SERVE_NAME    256
+
+#define SLOT_IDLE     0
+#define SLOT_READY    1
+#define SLOT_DONE     2
+
+typedef struct {
+        uint64_t magic;           /* SERVE_MAGIC, set last */
+        uint32_t version, nslots, points;
+        uint32_t server;          /* Process id of the server */
+        uint32_t doorbell;        /* Rung by clients after a request */
+        uint32_t sleeping;        /* The server is asleep on the doorbell */
+        } serve_head;
+
+typedef struct {
+        uint32_t owner;           /* Process id of the client, or 0 */
+        uint32_t state;
+        uint32_t waiting;         /* The client is asleep on state */
+        uint32_t op, method, count;
+        int32_t status;
+        uint32_t pad;
+        double proj[8];
+        double data[4*NZTM_SERVE_POINTS];      /* x, y, o1, o2 */
+        } serve_slot;
+
+typedef struct {
+        double proj[8];
+        tmprojection *tm;
+        } serve_proj;
+
+struct nztm_server {
+        const nztm_land *land;
+        nztm_pool *pool;
+        int stop;
+        pthread_mutex_t lock;     /* Guards proj and nproj */
+        serve_proj proj[SERVE_PROJS];
+        int nproj;
+
+        char shmname[SERVE_NAME];
+        serve_head *shm;          /* NULL if not serving shared memory */
+        size_t shmsize;
+        pthread_t shmthread;
+
+        int listenfd;             /* -1 if not serving a socket */
+        char path[SERVE_NAME];    /* Unix domain socket to remove, or "" */
+        pthread_t acceptthread;
+        int conns;                /* Connection threads running */
+        };
+
+struct nztm_client {
+        serve_head *shm;          /* Shared memory, or NULL */
+        size_t shmsize;
+        serve_slot *slot;
+        int fd;                   /* Socket, or -1 */
+        char *buf;
+        size_t bufsize;
+        };
+
+typedef struct {
+        nztm_server *s;
+        int fd;
+        } serve_conn;
+
+static double serve_now( void ) {
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + 1.0e-9*t.tv_nsec;
+    }
+
+/* Sleeps while *addr is value, for at most SERVE_POLL milliseconds, and
+   wakes a sleeper on addr.  The futex is not private, as the waiter and
+   waker may be different processes. */
+
+static void serve_wait( uint32_t *addr, uint32_t value ) {
+#ifdef __linux__
+    struct timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = SERVE_POLL*1000000L;
+    syscall( SYS_futex, addr, FUTEX_WAIT, value, &ts, NULL, 0 );
+#else
+    struct timespec ts;
+    (void) addr;
+    (void) value;
+    ts.tv_sec = 0;
+    ts.tv_nsec = 50000;
+    nanosleep( &ts, NULL );
+#endif
+    }
+
+static void serve_wake( uint32_t *addr ) {
+#ifdef __linux__
+    syscall( SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+#else
+    (void) addr;
+#endif
+    }
+
+/* True if process pid has gone */
+
+static int serve_gone( uint32_t pid ) {
+    return kill( (pid_t) pid, 0 ) != 0 && errno == ESRCH;
+    }
+
+static serve_slot *serve_slots( serve_head *h ) {
+    return (serve_slot *) ((char *) h + SERVE_HEAD);
+    }
+
+static size_t serve_shmsize( void ) {
+    return SERVE_HEAD + NZTM_SERVE_SLOTS*sizeof(serve_slot);
+    }
+
+/* The name of shared memory segment shm, with the leading / shm_open
+   wants.  Returns -1 if it is too long. */
+
+static int serve_shmname( const char *shm, char *name ) {
+    if( strlen( shm ) + 2 > SERVE_NAME ) return -1;
+    name[0] = '/';
+    strcpy( name + (shm[0] == '/' ? 0 : 1), shm );
+    return 0;
+    }
+
+static void serve_params( const tmprojection *tm, double proj[8] ) {
+    proj[0] = tm->a;
+    proj[1] = tm->rf;
+    proj[2] = tm->meridian;
+    proj[3] = tm->scalef;
+    proj[4] = tm->orglat;
+    proj[5] = tm->falsee;
+    proj[6] = tm->falsen;
+    proj[7] = tm->utom;
+    }
+
+/* The projection with parameters proj, created and kept if it is not
+   yet known.  When SERVE_PROJS are kept, a new one is created for the
+   request only and *temp set.  Returns NULL for invalid parameters. */
+
+static const tmprojection *serve_projection( nztm_server *s,
+        const double proj[8], int *temp ) {
+    double nz[8];
+    tmprojection *tm = NULL;
+    int i;
+
+    *temp = 0;
+    serve_params( &nztm_projection, nz );
+    if( memcmp( proj, nz, sizeof(nz) ) == 0 ) return &nztm_projection;
+    for( i = 0; i < 8; i++ ) if( ! isfinite( proj[i] ) ) return NULL;
+    if( proj[0] <= 0.0 || proj[1] <= 1.0 || proj[3] <= 0.0 || proj[7] <= 0.0 )
+        return NULL;
+
+    pthread_mutex_lock( &s->lock );
+    for( i = 0; i < s->nproj; i++ ) {
+        if( memcmp( proj, s->proj[i].proj, sizeof(nz) ) == 0 ) {
+            tm = s->proj[i].tm;
+            break;
+            }
+        }
+    if( ! tm ) {
+        tm = tm_create( proj[0], proj[1], proj[2], proj[3], proj[4],
+            proj[5], proj[6], proj[7] );
+        if( tm && s->nproj < SERVE_PROJS ) {
+            memcpy( s->proj[s->nproj].proj, proj, sizeof(nz) );
+            s->proj[s->nproj++].tm = tm;
+            }
+        else
+            *temp = tm != NULL;
+        }
+    pthread_mutex_unlock( &s->lock );
+    return tm;
+    }
+
+/* Runs a request, returning its status */
+
+static int serve_run( nztm_server *s, uint32_t op, uint32_t method,
+        const double proj[8], const double *x, const double *y,
+        double *o1, double *o2, size_t count ) {
+    const tmprojection *tm;
+    int temp;
+
+    if( op == NZTM_SERVE_LAND ) {
+        if( ! s->land ) return -1;
+        nztm_land_test( s->land, x, y, (unsigned char *) o1, count );
+        return 0;
+        }
+    if( ( op != NZTM_SERVE_GEOD_TM && op != NZTM_SERVE_TM_GEOD ) ||
+        method > NZTM_PRECISE ) return -1;
+    if( ! ( tm = serve_projection( s, proj, &temp ) ) ) return -1;
+    if( op == NZTM_SERVE_GEOD_TM )
+        geod_tm_bulk( s->pool, tm, (int) method, NZTM_ISA_BEST, x, y, 1,
+            o1, o2, 1, count );
+    else
+        tm_geod_bulk( s->pool, tm, (int) method, NZTM_ISA_BEST, x, y, 1,
+            o1, o2, 1, count );
+    if( temp ) tm_destroy( (tmprojection *) tm );
+    return 0;
+    }
+
+/* Serves the slots marked ready, returning the number served.  The
+   client can write its slot at any time, so the request is copied out
+   once, past a compiler barrier, and only the copy is checked and
+   used. */
+
+static int serve_scan( nztm_server *s ) {
+    serve_slot *slot = serve_slots( s->shm );
+    uint32_t op, method, count;
+    double proj[8], *d;
+    int i, n = 0;
+
+    for( i = 0; i < NZTM_SERVE_SLOTS; i++, slot++ ) {
+        if( __atomic_load_n( &slot->state, __ATOMIC_ACQUIRE ) != SLOT_READY )
+            continue;
+        op = __atomic_load_n( &slot->op, __ATOMIC_RELAXED );
+        method = __atomic_load_n( &slot->method, __ATOMIC_RELAXED );
+        count = __atomic_load_n( &slot->count, __ATOMIC_RELAXED );
+        memcpy( proj, slot->proj, sizeof(proj) );
+        __atomic_signal_fence( __ATOMIC_SEQ_CST );
+        d = slot->data;
+        slot->status = count > NZTM_SERVE_POINTS ? -1 :
+            serve_run( s, op, method, proj, d,
+                d + NZTM_SERVE_POINTS, d + 2*NZTM_SERVE_POINTS,
+                d + 3*NZTM_SERVE_POINTS, count );
+        __atomic_store_n( &slot->state, SLOT_DONE, __ATOMIC_SEQ_CST );
+        if( __atomic_load_n( &slot->waiting, __ATOMIC_SEQ_CST ) )
+            serve_wake( &slot->state );
+        n++;
+        }
+    return n;
+    }
+
+static void *serve_shm_main( void *arg ) {
+    nztm_server *s = (nztm_server *) arg;
+    serve_head *h = s->shm;
+    double idle = serve_now();
+    uint32_t bell;
+
+    while( ! __atomic_load_n( &s->stop, __ATOMIC_ACQUIRE ) ) {
+        if( serve_scan( s ) ) {
+            idle = serve_now();
+            continue;
+            }
+        if( serve_now() - idle < SERVE_SPIN ) {
+            sched_yield();
+            continue;
+            }
+        __atomic_store_n( &h->sleeping, 1, __ATOMIC_SEQ_CST );
+        bell = __atomic_load_n( &h->doorbell, __ATOMIC_SEQ_CST );
+        if( ! serve_scan( s ) ) serve_wait( &h->doorbell, bell );
+        __atomic_store_n( &h->sleeping, 0, __ATOMIC_SEQ_CST );
+        idle = serve_now();
+        }
+    return NULL;
+    }
+
+static int serve_shm_start( nztm_server *s, const char *shm ) {
+    serve_head *h;
+    int fd;
+
+    if( serve_shmname( shm, s->shmname ) != 0 ) return -1;
+    s->shmsize = serve_shmsize();
+    fd = shm_open( s->shmname, O_RDWR | O_CREAT | O_TRUNC, 0600 );
+    if( fd < 0 ) return -1;
+    if( ftruncate( fd, (off_t) s->shmsize ) != 0 ) {
+        close( fd );
+        shm_unlink( s->shmname );
+        return -1;
+        }
+    h = (serve_head *) mmap( NULL, s->shmsize, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0 );
+    close( fd );
+    if( h == (serve_head *) MAP_FAILED ) {
+        shm_unlink( s->shmname );
+        return -1;
+        }
+    h->version = SERVE_VERSION;
+    h->nslots = NZTM_SERVE_SLOTS;
+    h->points = NZTM_SERVE_POINTS;
+    h->server = (uint32_t) getpid();
+    s->shm = h;
+    if( pthread_create( &s->shmthread, NULL, serve_shm_main, s ) != 0 ) {
+        munmap( h, s->shmsize );
+        shm_unlink( s->shmname );
+        s->shm = NULL;
+        return -1;
+        }
+    __atomic_store_n( &h->magic, SERVE_MAGIC, __ATOMIC_RELEASE );
+    return 0;
+    }
+
+/* Opens a socket listening on, or connected to, addr: host:port for TCP
+   (an empty host for 127.0.0.1, or * when listening for all
+   interfaces), otherwise the path of a Unix domain socket.  Returns
+   -1 on failure. */
+
+static int serve_socket( const char *addr, int listening ) {
+    struct addrinfo hints, *res, *ai;
+    struct sockaddr_un un;
+    struct stat st;
+    char host[SERVE_NAME];
+    const char *port;
+    int fd = -1, one = 1;
+
+    if( ! ( port = strrchr( addr, ':' ) ) ) {
+        if( strlen( addr ) >= sizeof(un.sun_path) ) return -1;
+        memset( &un, 0, sizeof(un) );
+        un.sun_family = AF_UNIX;
+        strcpy( un.sun_path, addr );
+        if( ( fd = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 ) return -1;
+        if( listening && stat( addr, &st ) == 0 && S_ISSOCK( st.st_mode ) )
+            unlink( addr );
+        if( listening ? bind( fd, (struct sockaddr *) &un, sizeof(un) ) != 0 ||
+                listen( fd, SOMAXCONN ) != 0 :
+            connect( fd, (struct sockaddr *) &un, sizeof(un) ) != 0 ) {
+            close( fd );
+            return -1;
+            }
+        return fd;
+        }
+
+    if( (size_t) (port - addr) >= sizeof(host) ) return -1;
+    memcpy( host, addr, port - addr );
+    host[port - addr] = 0;
+    port++;
+    memset( &hints, 0, sizeof(hints) );
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    if( getaddrinfo( ! host[0] ? "127.0.0.1" : strcmp( host, "*" ) == 0 ?
+            NULL : host, port, &hints, &res ) != 0 )
+        return -1;
+    for( ai = res; ai; ai = ai->ai_next ) {
+        if( ( fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol ) ) < 0 )
+            continue;
+        if( listening ) {
+            setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+            if( bind( fd, ai->ai_addr, ai->ai_addrlen ) == 0 &&
+                listen( fd, SOMAXCONN ) == 0 ) break;
+            }
+        else if( connect( fd, ai->ai_addr, ai->ai_addrlen ) == 0 ) {
+            setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) );
+            break;
+            }
+        close( fd );
+        fd = -1;
+        }
+    freeaddrinfo( res );
+    return fd;
+    }
+
+/* Reads or writes len bytes, returning -1 at the end of the stream, on
+   an error, or (with stop not NULL) when *stop is set */
+
+static int serve_read( int fd, void *p, size_t len, const int *stop ) {
+    ssize_t r;
+
+    while( len > 0 ) {
+        r = recv( fd, p, len, 0 );
+        if( r > 0 ) {
+            p = (char *) p + r;
+            len -= (size_t) r;
+            }
+        else if( r == 0 )
+            return -1;
+        else if( errno == EAGAIN || errno == EWOULDBLOCK ) {
+            if( stop && __atomic_load_n( stop, __ATOMIC_ACQUIRE ) ) return -1;
+            }
+        else if( errno != EINTR )
+            return -1;
+        }
+    return 0;
+    }
+
+static int serve_write( int fd, const void *p, size_t len, const int *stop ) {
+    ssize_t r;
+
+    while( len > 0 ) {
+        r = send( fd, p, len, MSG_NOSIGNAL );
+        if( r >= 0 ) {
+            p = (const char *) p + r;
+            len -= (size_t) r;
+            }
+        else if( errno == EAGAIN || errno == EWOULDBLOCK ) {
+            if( stop && __atomic_load_n( stop, __ATOMIC_ACQUIRE ) ) return -1;
+            }
+        else if( errno != EINTR )
+            return -1;
+        }
+    return 0;
+    }
+
+static void *serve_conn_main( void *arg ) {
+    serve_conn *conn = (serve_conn *) arg;
+    nztm_server *s = conn->s;
+    nztm_serve_request req;
+    nztm_serve_reply *rep;
+    double *buf = NULL, *nbuf, *o1;
+    size_t n, cap = 0, len;
+    struct timeval tv;
+
+    tv.tv_sec = 0;
+    tv.tv_usec = SERVE_POLL*1000L;
+    setsockopt( conn->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv) );
+    setsockopt( conn->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv) );
+    while( serve_read( conn->fd, &req, sizeof(req), &s->stop ) == 0 ) {
+        if( req.magic != NZTM_SERVE_MAGIC || req.count > NZTM_SERVE_MAXPOINTS )
+            break;
+        n = req.count;
+        if( 4*n + 1 > cap ) {
+            if( ! ( nbuf = (double *) realloc( buf, (4*n + 1)*sizeof(double) ) ) )
+                break;
+            buf = nbuf;
+            cap = 4*n + 1;
+            }
+        if( serve_read( conn->fd, buf, 2*n*sizeof(double), &s->stop ) != 0 )
+            break;
+        rep = (nztm_serve_reply *) (buf + 2*n);
+        o1 = buf + 2*n + 1;
+        rep->status = serve_run( s, req.op, req.method, req.proj, buf,
+            buf + n, o1, o1 + n, n );
+        rep->count = req.count;
+        len = sizeof(*rep);
+        if( rep->status == 0 )
+            len += req.op == NZTM_SERVE_LAND ? n : 2*n*sizeof(double);
+        if( serve_write( conn->fd, rep, len, &s->stop ) != 0 ) break;
+        }
+    close( conn->fd );
+    free( buf );
+    free( conn );
+    __atomic_sub_fetch( &s->conns, 1, __ATOMIC_RELEASE );
+    return NULL;
+    }
+
+static void *serve_accept_main( void *arg ) {
+    nztm_server *s = (nztm_server *) arg;
+    struct pollfd pf;
+    pthread_attr_t attr;
+    pthread_t t;
+    serve_conn *conn;
+    int fd, one = 1;
+
+    pthread_attr_init( &attr );
+    pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+    while( ! __atomic_load_n( &s->stop, __ATOMIC_ACQUIRE ) ) {
+        pf.fd = s->listenfd;
+        pf.events = POLLIN;
+        if( poll( &pf, 1, SERVE_POLL ) <= 0 ) continue;
+        if( ( fd = accept( s->listenfd, NULL, NULL ) ) < 0 ) continue;
+        if( __atomic_load_n( &s->conns, __ATOMIC_ACQUIRE ) >= NZTM_SERVE_CONNS ) {
+            close( fd );
+            continue;
+            }
+        if( ! s->path[0] )
+            setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) );
+        if( ! ( conn = (serve_conn *) malloc( sizeof(serve_conn) ) ) ) {
+            close( fd );
+            continue;
+            }
+        conn->s = s;
+        conn->fd = fd;
+        __atomic_add_fetch( &s->conns, 1, __ATOMIC_ACQ_REL );
+        if( pthread_create( &t, &attr, serve_conn_main, conn ) != 0 ) {
+            __atomic_sub_fetch( &s->conns, 1, __ATOMIC_ACQ_REL );
+            close( fd );
+            free( conn );
+            }
+        }
+    pthread_attr_destroy( &attr );
+    return NULL;
+    }
+
+static int serve_socket_start( nztm_server *s, const char *addr ) {
+    if( ( s->listenfd = serve_socket( addr, 1 ) ) < 0 ) return -1;
+    if( ! strchr( addr, ':' ) ) strcpy( s->path, addr );
+    if( pthread_create( &s->acceptthread, NULL, serve_accept_main, s ) != 0 ) {
+        close( s->listenfd );
+        s->listenfd = -1;
+        if( s->path[0] ) unlink( s->path );
+        s->path[0] = 0;
+        return -1;
+        }
+    return 0;
+    }
+
+nztm_server *nztm_server_start( const char *shm, const char *addr,
+   const nztm_land *land, nztm_pool *pool )
+{
+   nztm_server *s = (nztm_server *) calloc( 1, sizeof(nztm_server) );
+
+   if( ! s ) return NULL;
+   s->land = land;
+   s->pool = pool;
+   s->listenfd = -1;
+   pthread_mutex_init( &s->lock, NULL );
+   if( shm ) serve_shm_start( s, shm );
+   if( addr ) serve_socket_start( s, addr );
+   if( ! s->shm && s->listenfd < 0 ) {
+      pthread_mutex_destroy( &s->lock );
+      free( s );
+      return NULL;
+      }
+   return s;
+}
+
+void nztm_server_stop( nztm_server *s )
+{
+   struct timespec ts;
+   int i;
+
+   if( ! s ) return;
+   __atomic_store_n( &s->stop, 1, __ATOMIC_RELEASE );
+   if( s->shm ) {
+      __atomic_add_fetch( &s->shm->doorbell, 1, __ATOMIC_SEQ_CST );
+      serve_wake( &s->shm->doorbell );
+      pthread_join( s->shmthread, NULL );
+      munmap( s->shm, s->shmsize );
+      shm_unlink( s->shmname );
+      }
+   if( s->listenfd >= 0 ) {
+      pthread_join( s->acceptthread, NULL );
+      close( s->listenfd );
+      if( s->path[0] ) unlink( s->path );
+      }
+   ts.tv_sec = 0;
+   ts.tv_nsec = 1000000;
+   while( __atomic_load_n( &s->conns, __ATOMIC_ACQUIRE ) > 0 )
+      nanosleep( &ts, NULL );
+   for( i = 0; i < s->nproj; i++ ) tm_destroy( s->proj[i].tm );
+   pthread_mutex_destroy( &s->lock );
+   free( s );
+}
+
+nztm_client *nztm_client_shm( const char *shm )
+{
+   nztm_client *c;
+   serve_head *h;
+   serve_slot *slot;
+   struct stat st;
+   char name[SERVE_NAME];
+   uint32_t owner, state, pid = (uint32_t) getpid();
+   int fd, i;
+
+   if( serve_shmname( shm, name ) != 0 ) return NULL;
+   if( ( fd = shm_open( name, O_RDWR, 0 ) ) < 0 ) return NULL;
+   if( fstat( fd, &st ) != 0 || (size_t) st.st_size < serve_shmsize() ) {
+      close( fd );
+      return NULL;
+      }
+   h = (serve_head *) mmap( NULL, serve_shmsize(), PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd, 0 );
+   close( fd );
+   if( h == (serve_head *) MAP_FAILED ) return NULL;
+   if( __atomic_load_n( &h->magic, __ATOMIC_ACQUIRE ) != SERVE_MAGIC ||
+       h->version != SERVE_VERSION ||
+       h->nslots != NZTM_SERVE_SLOTS || h->points != NZTM_SERVE_POINTS ||
+       ! ( c = (nztm_client *) calloc( 1, sizeof(nztm_client) ) ) ) {
+      munmap( h, serve_shmsize() );
+      return NULL;
+      }
+
+   /* Claim a free slot, or one whose owner has gone without a request
+      the server may still be working on */
+
+   for( i = 0, slot = serve_slots( h ); i < NZTM_SERVE_SLOTS; i++, slot++ ) {
+      owner = __atomic_load_n( &slot->owner, __ATOMIC_ACQUIRE );
+      state = __atomic_load_n( &slot->state, __ATOMIC_ACQUIRE );
+      if( owner && ( state == SLOT_READY || ! serve_gone( owner ) ) ) continue;
+      if( __atomic_compare_exchange_n( &slot->owner, &owner, pid, 0,
+             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ) break;
+      }
+   if( i == NZTM_SERVE_SLOTS ) {
+      munmap( h, serve_shmsize() );
+      free( c );
+      return NULL;
+      }
+   slot->waiting = 0;
+   __atomic_store_n( &slot->state, SLOT_IDLE, __ATOMIC_RELEASE );
+   c->shm = h;
+   c->shmsize = serve_shmsize();
+   c->slot = slot;
+   c->fd = -1;
+   return c;
+}
+
+nztm_client *nztm_client_connect( const char *addr )
+{
+   nztm_client *c;
+   int fd;
+
+   if( ( fd = serve_socket( addr, 0 ) ) < 0 ) return NULL;
+   if( ! ( c = (nztm_client *) calloc( 1, sizeof(nztm_client) ) ) ) {
+      close( fd );
+      return NULL;
+      }
+   c->fd = fd;
+   return c;
+}
+
+void nztm_client_close( nztm_client *c )
+{
+   if( ! c ) return;
+   if( c->slot ) {
+      __atomic_store_n( &c->slot->owner, 0, __ATOMIC_RELEASE );
+      munmap( c->shm, c->shmsize );
+      }
+   if( c->fd >= 0 ) close( c->fd );
+   free( c->buf );
+   free( c );
+}
+
+/* Runs a request of m points through the client's slot, waiting for
+   it, and returns its status.  o1 takes m bytes for NZTM_SERVE_LAND. */
+
+static int client_slot( nztm_client *c, uint32_t op, int method,
+        const double proj[8], const double *x, const double *y, void *o1,
+        double *o2, size_t m ) {
+    serve_slot *slot = c->slot;
+    double *d = slot->data, t0;
+
+    slot->op = op;
+    slot->method = (uint32_t) method;
+    slot->count = (uint32_t) m;
+    memcpy( slot->proj, proj, sizeof(slot->proj) );
+    memcpy( d, x, m*sizeof(double) );
+    memcpy( d + NZTM_SERVE_POINTS, y, m*sizeof(double) );
+    __atomic_store_n( &slot->state, SLOT_READY, __ATOMIC_SEQ_CST );
+    __atomic_add_fetch( &c->shm->doorbell, 1, __ATOMIC_SEQ_CST );
+    if( __atomic_load_n( &c->shm->sleeping, __ATOMIC_SEQ_CST ) )
+        serve_wake( &c->shm->doorbell );
+
+    t0 = serve_now();
+    while( __atomic_load_n( &slot->state, __ATOMIC_ACQUIRE ) != SLOT_DONE ) {
+        if( serve_now() - t0 < SERVE_SPIN ) {
+            sched_yield();
+            continue;
+            }
+        __atomic_store_n( &slot->waiting, 1, __ATOMIC_SEQ_CST );
+        if( __atomic_load_n( &slot->state, __ATOMIC_SEQ_CST ) == SLOT_READY )
+            serve_wait( &slot->state, SLOT_READY );
+        __atomic_store_n( &slot->waiting, 0, __ATOMIC_SEQ_CST );
+        if( __atomic_load_n( &slot->state, __ATOMIC_ACQUIRE ) == SLOT_READY &&
+            serve_gone( c->shm->server ) ) return -1;
+        }
+
+    if( slot->status == 0 ) {
+        memcpy( o1, d + 2*NZTM_SERVE_POINTS,
+            op == NZTM_SERVE_LAND ? m : m*sizeof(double) );
+        if( o2 ) memcpy( o2, d + 3*NZTM_SERVE_POINTS, m*sizeof(double) );
+        }
+    __atomic_store_n( &slot->state, SLOT_IDLE, __ATOMIC_RELEASE );
+    return slot->status;
+    }
+
+/* As client_slot, over the client's socket */
+
+static int client_socket( nztm_client *c, uint32_t op, int method,
+        const double proj[8], const double *x, const double *y, void *o1,
+        double *o2, size_t m ) {
+    nztm_serve_request *req;
+    nztm_serve_reply rep;
+    size_t len = sizeof(*req) + 2*m*sizeof(double), outlen;
+    char *nbuf;
+
+    outlen = sizeof(rep) + ( op == NZTM_SERVE_LAND ? m : 2*m*sizeof(double) );
+    if( outlen > len ) len = outlen;
+    if( len > c->bufsize ) {
+        if( ! ( nbuf = (char *) realloc( c->buf, len ) ) ) return -1;
+        c->buf = nbuf;
+        c->bufsize = len;
+        }
+    req = (nztm_serve_request *) c->buf;
+    req->magic = NZTM_SERVE_MAGIC;
+    req->op = op;
+    req->method = (uint32_t) method;
+    req->count = (uint32_t) m;
+    memcpy( req->proj, proj, sizeof(req->proj) );
+    memcpy( req + 1, x, m*sizeof(double) );
+    memcpy( (double *) (req + 1) + m, y, m*sizeof(double) );
+    if( serve_write( c->fd, c->buf, sizeof(*req) + 2*m*sizeof(double),
+            NULL ) != 0 ||
+        serve_read( c->fd, &rep, sizeof(rep), NULL ) != 0 ) return -1;
+    if( rep.status != 0 ) return rep.status;
+    if( rep.count != m || serve_read( c->fd, c->buf, outlen - sizeof(rep), NULL ) != 0 )
+        return -1;
+    if( op == NZTM_SERVE_LAND )
+        memcpy( o1, c->buf, m );
+    else {
+        memcpy( o1, c->buf, m*sizeof(double) );
+        memcpy( o2, c->buf + m*sizeof(double), m*sizeof(double) );
+        }
+    return 0;
+    }
+
+static long client_call( nztm_client *c, uint32_t op, int method,
+        const tmprojection *tm, const double *x, const double *y, void *o1,
+        double *o2, size_t count ) {
+    double proj[8];
+    size_t i, m, max = c->slot ? NZTM_SERVE_POINTS : NZTM_SERVE_MAXPOINTS;
+    size_t size = op == NZTM_SERVE_LAND ? 1 : sizeof(double);
+    int status;
+
+    if( method < 0 ) return -1;
+    memset( proj, 0, sizeof(proj) );
+    if( op != NZTM_SERVE_LAND ) serve_params( tm ? tm : &nztm_projection, proj );
+    for( i = 0; i < count; i += m ) {
+        m = count - i < max ? count - i : max;
+        status = c->slot ?
+            client_slot( c, op, method, proj, x + i, y + i,
+                (char *) o1 + i*size, o2 ? o2 + i : NULL, m ) :
+            client_socket( c, op, method, proj, x + i, y + i,
+                (char *) o1 + i*size, o2 ? o2 + i : NULL, m );
+        if( status != 0 ) return -1;
+        }
+    return (long) count;
+    }
+
+long nztm_client_geod_tm( nztm_client *c, const tmprojection *tm,
+   int method, const double *lt, const double *ln, double *n, double *e,
+   size_t count )
+{
+   return client_call( c, NZTM_SERVE_GEOD_TM, method, tm, lt, ln, n, e, count );
+}
+
+long nztm_client_tm_geod( nztm_client *c, const tmprojection *tm,
+   int method, const double *n, const double *e, double *lt, double *ln,
+   size_t count )
+{
+   return client_call( c, NZTM_SERVE_TM_GEOD, method, tm, n, e, lt, ln, count );
+}
+
+long nztm_client_land( nztm_client *c, const double *lat,
+   const double *lon, unsigned char *out, size_t count )
+{
+   size_t i;
+   long on = 0;
+
+   if( client_call( c, NZTM_SERVE_LAND, 0, NULL, lat, lon, out, NULL, count ) < 0 )
+      return -1;
+   for( i = 0; i < count; i++ ) on += out[i];
+   return on;
+}
+
+#ifdef NZTM_SERVE_TOOL
+
+/* The server, and a client measuring its round trip time.  Build with
+      cc -O2 -DNZTM_SERVE_TOOL -o nztm_serve nztm_serve.c nztm_bulk.c \
+         nztm_pool.c nztm_land.c nztm_coast.c nztm.c nztm_simd.c \
+         -lm -lpthread -lrt
+   and run as
+      nztm_serve [-shm name] [-socket addr] [-coast file] [-threads n]
+   to serve until interrupted, or as
+      nztm_serve -ping shm:name|addr [points [rounds]]
+   to time rounds of requests converting points from geodetic to NZTM
+   (and, if the server has a coastline, testing them for land), checking
+   the results against those computed locally. */
+
+#include <stdio.h>
+
+static int ping_cmp( const void *a, const void *b ) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+    }
+
+static int ping( const char *where, size_t npt, int rounds ) {
+  nztm_client *c;
+  double *lt, *ln, *n, *e, *n0, *e0, *t, t0, err = 0.0;
+  unsigned char *land;
+  size_t i;
+  long on = -1;
+  int r, bad = 0;
+
+  c = strncmp( where, "shm:", 4 ) == 0 ? nztm_client_shm( where + 4 ) :
+     nztm_client_connect( where );
+  if( ! c ) {
+     fprintf( stderr, "Cannot reach the server at %s\n", where );
+     return 1;
+     }
+  lt = (double *) malloc( 6*npt*sizeof(double) );
+  t = (double *) malloc( rounds*sizeof(double) );
+  land = (unsigned char *) malloc( npt );
+  if( ! lt || ! t || ! land ) return 1;
+  ln = lt + npt;
+  n = ln + npt;
+  e = n + npt;
+  n0 = e + npt;
+  e0 = n0 + npt;
+  for( i = 0; i < npt; i++ ) {
+     lt[i] = (-47.0 + 12.0*(i % 97)/96.0)/rad2deg;
+     ln[i] = (166.5 + 12.0*(i % 89)/88.0)/rad2deg;
+     }
+  geod_tm_hn( &nztm_projection, lt, ln, n0, e0, npt );
+
+  for( r = 0; r < rounds; r++ ) {
+     t0 = serve_now();
+     if( nztm_client_geod_tm( c, NULL, NZTM_REDFEARN, lt, ln, n, e, npt ) < 0 ) {
+        fprintf( stderr, "Request failed\n" );
+        return 1;
+        }
+     t[r] = serve_now() - t0;
+     }
+  for( i = 0; i < npt; i++ ) {
+     if( fabs( n[i] - n0[i] ) > err ) err = fabs( n[i] - n0[i] );
+     if( fabs( e[i] - e0[i] ) > err ) err = fabs( e[i] - e0[i] );
+     }
+  for( i = 0; i < npt; i++ ) {
+     lt[i] *= rad2deg;
+     ln[i] *= rad2deg;
+     }
+  on = nztm_client_land( c, lt, ln, land, npt );
+
+  qsort( t, rounds, sizeof(double), ping_cmp );
+  printf( "%s, %lu points: median %.1f us, 99%% %.1f us, max %.1f us\n",
+     where, (unsigned long) npt, t[rounds/2]*1.0e6,
+     t[(size_t) (0.99*(rounds - 1))]*1.0e6, t[rounds - 1]*1.0e6 );
+  printf( "largest difference from local conversion %.3g m\n", err );
+  if( on >= 0 ) printf( "%ld of %lu on land\n", on, (unsigned long) npt );
+  if( err > 1.0e-6 ) {
+     puts( "RESULTS DIFFER" );
+     bad = 1;
+     }
+  nztm_client_close( c );
+  free( lt );
+  free( t );
+  free( land );
+  return bad;
+  }
+
+int main( int argc, char *argv[] ) {
+  const char *shm = NULL, *addr = NULL, *coast = NULL;
+  nztm_server *s;
+  nztm_coast c;
+  nztm_land *land = NULL;
+  nztm_pool *pool;
+  sigset_t set;
+  int i, sig, nthread = 0;
+
+  if( argc >= 3 && strcmp( argv[1], "-ping" ) == 0 )
+     return ping( argv[2], argc > 3 ? (size_t) atol( argv[3] ) : 1,
+        argc > 4 ? atoi( argv[4] ) : 10000 );
+
+  for( i = 1; i < argc - 1; i += 2 ) {
+     if( strcmp( argv[i], "-shm" ) == 0 ) shm = argv[i+1];
+     else if( strcmp( argv[i], "-socket" ) == 0 ) addr = argv[i+1];
+     else if( strcmp( argv[i], "-coast" ) == 0 ) coast = argv[i+1];
+     else if( strcmp( argv[i], "-threads" ) == 0 ) nthread = atoi( argv[i+1] );
+     else break;
+     }
+  if( i != argc || ( ! shm && ! addr ) ) {
+     fprintf( stderr,
+        "Usage: nztm_serve [-shm name] [-socket addr] [-coast file] [-threads n]\n"
+        "       nztm_serve -ping shm:name|addr [points [rounds]]\n" );
+     return 1;
+     }
+  if( coast ) {
+     if( nztm_coast_open( &c, coast ) != 0 || ! ( land = nztm_land_create( &c, 0 ) ) ) {
+        fprintf( stderr, "Cannot load coastline %s\n", coast );
+        return 1;
+        }
+     }
+  pool = nztm_pool_create( nthread );
+
+  /* Block the signals before any thread starts, so that all inherit
+     the mask and only sigwait takes them */
+
+  sigemptyset( &set );
+  sigaddset( &set, SIGINT );
+  sigaddset( &set, SIGTERM );
+  pthread_sigmask( SIG_BLOCK, &set, NULL );
+  if( ! ( s = nztm_server_start( shm, addr, land, pool ) ) ) {
+     fprintf( stderr, "Cannot serve\n" );
+     return 1;
+     }
+  sigwait( &set, &sig );
+  nztm_server_stop( s );
+  nztm_pool_destroy( pool );
+  if( land ) {
+     nztm_land_destroy( land );
+     nztm_coast_close( &c );
+     }
+  return 0;
+  }
+
+#endif
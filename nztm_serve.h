@@ -0,0 +1,128 @@
+#ifndef _NZTM_SERVE_H
+#define _NZTM_SERVE_H
+
+/* A long lived conversion server, so that scripts converting a few
+   points at a time need not start a program, create projections and
+   build a land mask for each.
+
+   nztm_server_start serves requests in threads of the calling process
+   until nztm_server_stop, keeping the projections it has been asked
+   for, the land mask and the thread pool between requests.  It listens
+   on either or both of
+
+      a shared memory segment (shm_open), of NZTM_SERVE_SLOTS slots of
+      NZTM_SERVE_POINTS points each, for clients on the same machine.
+      A client holds a slot while it is open, writes the points of a
+      request into it, marks it ready and waits for it to be marked
+      done, with the results in place, so nothing is copied or encoded
+      on the way.  Both sides spin for a short time before sleeping
+      (on a futex on Linux), so a request to a busy server is answered
+      within microseconds, and an idle server uses no processor.
+
+      a socket, a path for a Unix domain socket or host:port for TCP,
+      for remote clients, with the binary protocol below.  An empty
+      host (:port) is the loopback address 127.0.0.1; the server listens on
+      all interfaces only if host is *.  At most NZTM_SERVE_CONNS
+      connections are served at a time, each holding a buffer for its
+      largest request so far (up to 32 bytes a point); further
+      connections are closed at once.
+
+   Requests are an operation on count points given as two arrays x
+   and y, with results in two arrays o1 and o2:
+
+      NZTM_SERVE_GEOD_TM   x, y latitude and longitude (radians) to
+                           o1, o2 northing and easting
+      NZTM_SERVE_TM_GEOD   x, y northing and easting to o1, o2
+                           latitude and longitude (radians)
+      NZTM_SERVE_LAND      x, y latitude and longitude (degrees) to
+                           o1 as count bytes, 1 on land, as
+                           nztm_land_test
+
+   with the projection given by its parameters and the method by its
+   NZTM_ value.  Requests larger than a slot are split by the client.
+
+   On a socket, a request is an nztm_serve_request followed by the
+   count values of x and then of y, as doubles; the reply is an
+   nztm_serve_reply followed, if status is 0, by the count values of o1
+   and then of o2, or by count bytes for NZTM_SERVE_LAND.  Values are
+   in the byte order of the server (little endian on all supported
+   platforms).  A connection may carry any number of requests.
+
+   Needs POSIX threads, shared memory and sockets (link with -lpthread,
+   and -lrt on older C libraries). */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nztm.h"
+#include "nztm_land.h"
+#include "nztm_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_SERVE_SLOTS      32
+#define NZTM_SERVE_POINTS     4096
+#define NZTM_SERVE_MAXPOINTS  (1 << 22)   /* Points per socket request */
+#define NZTM_SERVE_CONNS      16          /* Socket connections at a time */
+#define NZTM_SERVE_MAGIC      0x4d545a4eu /* "NZTM" */
+
+#define NZTM_SERVE_GEOD_TM    1
+#define NZTM_SERVE_TM_GEOD    2
+#define NZTM_SERVE_LAND       3
+
+typedef struct {
+        uint32_t magic;           /* NZTM_SERVE_MAGIC */
+        uint32_t op;
+        uint32_t method;
+        uint32_t count;
+        double proj[8];           /* a, rf, cm, sf, lto, fe, fn, utom */
+        } nztm_serve_request;
+
+typedef struct {
+        int32_t status;           /* 0, or -1 for an invalid request */
+        uint32_t count;
+        } nztm_serve_reply;
+
+typedef struct nztm_server nztm_server;
+
+/* Serves on the shared memory segment named shm and the socket addr,
+   either of which may be NULL, with land (NULL for none) for
+   NZTM_SERVE_LAND and pool (which may be NULL) for large requests.
+   land and pool must outlive the server.  Returns NULL if neither can
+   be set up. */
+
+nztm_server *nztm_server_start( const char *shm, const char *addr,
+   const nztm_land *land, nztm_pool *pool );
+void nztm_server_stop( nztm_server *s );
+
+typedef struct nztm_client nztm_client;
+
+/* Opens a slot of the shared memory segment shm, or connects to the
+   socket addr.  Returns NULL if the server cannot be reached or, for
+   shared memory, has no free slot.  A client is used by one thread at
+   a time. */
+
+nztm_client *nztm_client_shm( const char *shm );
+nztm_client *nztm_client_connect( const char *addr );
+void nztm_client_close( nztm_client *c );
+
+/* Requests to the server, with tm NULL for NZTM.  Each returns count,
+   or for nztm_client_land the number on land, or -1 if the request is
+   invalid or the server cannot be reached. */
+
+long nztm_client_geod_tm( nztm_client *c, const tmprojection *tm,
+   int method, const double *lt, const double *ln, double *n, double *e,
+   size_t count );
+long nztm_client_tm_geod( nztm_client *c, const tmprojection *tm,
+   int method, const double *n, const double *e, double *lt, double *ln,
+   size_t count );
+long nztm_client_land( nztm_client *c, const double *lat,
+   const double *lon, unsigned char *out, size_t count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,347 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* SIMD versions of the TM projection batch conversions.
+
+   The kernels themselves are in nztm_simd.h, which is included once for
+   each instruction set with the vector operations mapped onto that
+   set's intrinsics.  Each kernel is compiled with a function level
+   target attribute, so this file needs no special compiler flags and
+   one binary runs on any processor in the family; tm_simd_isa selects
+   the best kernel at run time.
+
+   AVX2 (with FMA) and AVX-512F kernels are built on x86-64, and NEON on
+   AArch64, where it is always available.  With other compilers or
+   processors only the scalar code in nztm.c is used. */
+
+#include "tmproj.h"
+
+/* Constants for vsincos.  SC_DP1..3 sum to pi/2, with DP1 and DP2
+   having trailing zero bits so that their products with the quadrant
+   number are exact.  SC_S and SC_C are the Cephes sin and cos
+   coefficients. */
+
+#define SC_2PI  6.36619772367581343076E-1
+#define SC_DP1  1.57079625129699707031E0
+#define SC_DP2  7.54978941586159635336E-8
+#define SC_DP3  5.39030285815811905290E-15
+
+#define SC_S0   1.58962301576546568060E-10
+#define SC_S1  -2.50507477628578072866E-8
+#define SC_S2   2.75573136213857245213E-6
+#define SC_S3  -1.98412698295895385996E-4
+#define SC_S4   8.33333333332211858878E-3
+#define SC_S5  -1.66666666666666307295E-1
+
+#define SC_C0  -1.13585365213876817300E-11
+#define SC_C1   2.08757008419747316778E-9
+#define SC_C2  -2.75573141792967388112E-7
+#define SC_C3   2.48015872888517045348E-5
+#define SC_C4  -1.38888888888730564116E-3
+#define SC_C5   4.16666666666665929218E-2
+
+#if defined(__GNUC__) && defined(__x86_64__)
+
+#include <immintrin.h>
+
+#define NZTM_HAVE_X86
+
+/* AVX2 + FMA, 4 lanes */
+
+#define VW              4
+#define VD              __m256d
+#define VM              __m256d
+#define VFN(f)          f##_avx2
+#define VTARGET         __attribute__((target("avx2,fma")))
+#define V1(x)           _mm256_set1_pd(x)
+#define VLD(p)          _mm256_loadu_pd(p)
+#define VST(p,v)        _mm256_storeu_pd(p,v)
+#define VADD(a,b)       _mm256_add_pd(a,b)
+#define VSUB(a,b)       _mm256_sub_pd(a,b)
+#define VMUL(a,b)       _mm256_mul_pd(a,b)
+#define VDIV(a,b)       _mm256_div_pd(a,b)
+#define VSQRT(a)        _mm256_sqrt_pd(a)
+#define VRINT(a)        _mm256_round_pd(a,_MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC)
+#define VFLOOR(a)       _mm256_floor_pd(a)
+#define VCEIL(a)        _mm256_ceil_pd(a)
+#define VMAX(a,b)       _mm256_max_pd(a,b)
+#define VCMPEQ(a,b)     _mm256_cmp_pd(a,b,_CMP_EQ_OQ)
+#define VCMPGT(a,b)     _mm256_cmp_pd(a,b,_CMP_GT_OQ)
+#define VMAND(a,b)      _mm256_and_pd(a,b)
+#define VMOR(a,b)       _mm256_or_pd(a,b)
+#define VSEL(m,a,b)     _mm256_blendv_pd(b,a,m)
+
+#include "nztm_simd.h"
+
+#undef VW
+#undef VD
+#undef VM
+#undef VFN
+#undef VTARGET
+#undef V1
+#undef VLD
+#undef VST
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VRINT
+#undef VFLOOR
+#undef VCEIL
+#undef VMAX
+#undef VCMPEQ
+#undef VCMPGT
+#undef VMAND
+#undef VMOR
+#undef VSEL
+
+/* AVX-512F, 8 lanes */
+
+#define VW              8
+#define VD              __m512d
+#define VM              __mmask8
+#define VFN(f)          f##_avx512
+#define VTARGET         __attribute__((target("avx512f")))
+#define V1(x)           _mm512_set1_pd(x)
+#define VLD(p)          _mm512_loadu_pd(p)
+#define VST(p,v)        _mm512_storeu_pd(p,v)
+#define VADD(a,b)       _mm512_add_pd(a,b)
+#define VSUB(a,b)       _mm512_sub_pd(a,b)
+#define VMUL(a,b)       _mm512_mul_pd(a,b)
+#define VDIV(a,b)       _mm512_div_pd(a,b)
+#define VSQRT(a)        _mm512_sqrt_pd(a)
+#define VRINT(a)        _mm512_roundscale_pd(a,_MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC)
+#define VFLOOR(a)       _mm512_roundscale_pd(a,_MM_FROUND_TO_NEG_INF|_MM_FROUND_NO_EXC)
+#define VCEIL(a)        _mm512_roundscale_pd(a,_MM_FROUND_TO_POS_INF|_MM_FROUND_NO_EXC)
+#define VMAX(a,b)       _mm512_max_pd(a,b)
+#define VCMPEQ(a,b)     _mm512_cmp_pd_mask(a,b,_CMP_EQ_OQ)
+#define VCMPGT(a,b)     _mm512_cmp_pd_mask(a,b,_CMP_GT_OQ)
+#define VMAND(a,b)      ((__mmask8)((a)&(b)))
+#define VMOR(a,b)       ((__mmask8)((a)|(b)))
+#define VSEL(m,a,b)     _mm512_mask_blend_pd(m,b,a)
+
+#include "nztm_simd.h"
+
+#undef VW
+#undef VD
+#undef VM
+#undef VFN
+#undef VTARGET
+#undef V1
+#undef VLD
+#undef VST
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VRINT
+#undef VFLOOR
+#undef VCEIL
+#undef VMAX
+#undef VCMPEQ
+#undef VCMPGT
+#undef VMAND
+#undef VMOR
+#undef VSEL
+
+#endif
+
+
+#if defined(__GNUC__) && defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#define NZTM_HAVE_NEON
+
+/* NEON, 2 lanes */
+
+#define VW              2
+#define VD              float64x2_t
+#define VM              uint64x2_t
+#define VFN(f)          f##_neon
+#define VTARGET
+#define V1(x)           vdupq_n_f64(x)
+#define VLD(p)          vld1q_f64(p)
+#define VST(p,v)        vst1q_f64(p,v)
+#define VADD(a,b)       vaddq_f64(a,b)
+#define VSUB(a,b)       vsubq_f64(a,b)
+#define VMUL(a,b)       vmulq_f64(a,b)
+#define VDIV(a,b)       vdivq_f64(a,b)
+#define VSQRT(a)        vsqrtq_f64(a)
+#define VRINT(a)        vrndnq_f64(a)
+#define VFLOOR(a)       vrndmq_f64(a)
+#define VCEIL(a)        vrndpq_f64(a)
+#define VMAX(a,b)       vmaxq_f64(a,b)
+#define VCMPEQ(a,b)     vceqq_f64(a,b)
+#define VCMPGT(a,b)     vcgtq_f64(a,b)
+#define VMAND(a,b)      vandq_u64(a,b)
+#define VMOR(a,b)       vorrq_u64(a,b)
+#define VSEL(m,a,b)     vbslq_f64(m,a,b)
+
+#include "nztm_simd.h"
+
+#endif
+
+
+int tm_simd_isa( void )
+{
+#if defined(NZTM_HAVE_X86)
+   if( __builtin_cpu_supports("avx512f") ) return NZTM_ISA_AVX512;
+   if( __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") )
+       return NZTM_ISA_AVX2;
+#elif defined(NZTM_HAVE_NEON)
+   return NZTM_ISA_NEON;
+#endif
+   return NZTM_ISA_SCALAR;
+}
+
+int tm_isa_supported( int isa )
+{
+   switch( isa ) {
+   case NZTM_ISA_SCALAR:
+      return 1;
+#if defined(NZTM_HAVE_X86)
+   case NZTM_ISA_AVX512:
+      return __builtin_cpu_supports("avx512f");
+   case NZTM_ISA_AVX2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+#if defined(NZTM_HAVE_NEON)
+   case NZTM_ISA_NEON:
+      return 1;
+#endif
+   default:
+      return 0;
+      }
+}
+
+void tm_geod_simd( int isa, int method, const tmprojection *tm,
+   const double *ce, const double *cn, size_t instride,
+   double *ln, double *lt, size_t outstride, size_t count )
+{
+   switch( isa ) {
+#if defined(NZTM_HAVE_X86)
+   case NZTM_ISA_AVX512:
+      tm_geod_v_avx512( tm, method, ce, cn, instride,
+          ln, lt, outstride, count );
+      return;
+   case NZTM_ISA_AVX2:
+      tm_geod_v_avx2( tm, method, ce, cn, instride,
+          ln, lt, outstride, count );
+      return;
+#endif
+#if defined(NZTM_HAVE_NEON)
+   case NZTM_ISA_NEON:
+      tm_geod_v_neon( tm, method, ce, cn, instride,
+          ln, lt, outstride, count );
+      return;
+#endif
+   default:
+      tm_geod_batch( tm, method, ce, cn, instride,
+          ln, lt, outstride, count );
+      }
+}
+
+void geod_tm_simd( int isa, int method, const tmprojection *tm,
+   const double *ln, const double *lt, size_t instride,
+   double *ce, double *cn, size_t outstride, size_t count )
+{
+   switch( isa ) {
+#if defined(NZTM_HAVE_X86)
+   case NZTM_ISA_AVX512:
+      geod_tm_v_avx512( tm, method, ln, lt, instride,
+          ce, cn, outstride, count );
+      return;
+   case NZTM_ISA_AVX2:
+      geod_tm_v_avx2( tm, method, ln, lt, instride,
+          ce, cn, outstride, count );
+      return;
+#endif
+#if defined(NZTM_HAVE_NEON)
+   case NZTM_ISA_NEON:
+      geod_tm_v_neon( tm, method, ln, lt, instride,
+          ce, cn, outstride, count );
+      return;
+#endif
+   default:
+      geod_tm_batch( tm, method, ln, lt, instride,
+          ce, cn, outstride, count );
+      }
+}
+
+#ifdef TEST_NZTM_SIMD
+
+/* Compares each available kernel and method with the scalar Redfearn
+   code over random points covering the NZTM domain, reporting the
+   largest difference and the conversion rate.  Build with
+      cc -O2 -DTEST_NZTM_SIMD nztm_simd.c nztm.c -lm  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+static double elapsed( struct timespec *t0 ) {
+    struct timespec t1;
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    return (t1.tv_sec - t0->tv_sec) + 1.0e-9*(t1.tv_nsec - t0->tv_nsec);
+    }
+
+int main( int argc, char *argv[] ) {
+  static const char *isas[] = { "scalar", "neon", "avx2", "avx512" };
+  static const char *methods[] = { "redfearn", "clenshaw", "fast", "precise" };
+  size_t count = 1000000;
+  size_t i;
+  int isa;
+  int method;
+  const tmprojection *tm = &nztm_projection;
+  double *buf = malloc( 10*count*sizeof(double) );
+  double *n = buf, *e = n + count;
+  double *lt = e + count, *ln = lt + count, *rlt = ln + count, *rln = rlt + count;
+  double *cn = rln + count, *ce = cn + count, *rcn = ce + count, *rce = rcn + count;
+  struct timespec t0;
+  double t, dl, dn;
+
+  srand( 1 );
+  for( i = 0; i < count; i++ ) {
+     n[i] = 4700000.0 + 1600000.0*rand()/RAND_MAX;
+     e[i] = 1000000.0 + 1200000.0*rand()/RAND_MAX;
+     }
+
+  tm_geod_isa( NZTM_ISA_SCALAR, NZTM_REDFEARN, tm,
+     e, n, 1, rln, rlt, 1, count );
+  geod_tm_isa( NZTM_ISA_SCALAR, NZTM_REDFEARN, tm,
+     rln, rlt, 1, rce, rcn, 1, count );
+
+  for( method = NZTM_REDFEARN; method <= NZTM_PRECISE; method++ )
+  for( isa = NZTM_ISA_SCALAR; isa <= NZTM_ISA_AVX512; isa++ ) {
+     if( ! tm_isa_supported( isa ) ) continue;
+
+     clock_gettime( CLOCK_MONOTONIC, &t0 );
+     tm_geod_isa( isa, method, tm, e, n, 1, ln, lt, 1, count );
+     t = elapsed( &t0 );
+     dl = 0.0;
+     for( i = 0; i < count; i++ ) {
+        if( fabs(lt[i]-rlt[i]) > dl ) dl = fabs(lt[i]-rlt[i]);
+        if( fabs(ln[i]-rln[i]) > dl ) dl = fabs(ln[i]-rln[i]);
+        }
+     printf("%-7s %s tm_geod %8.2f Mpt/s  max diff %.3g rad (%.3g m)\n",
+        isas[isa], methods[method], count/t*1.0e-6, dl, dl*NZTM_A);
+
+     clock_gettime( CLOCK_MONOTONIC, &t0 );
+     geod_tm_isa( isa, method, tm, rln, rlt, 1, ce, cn, 1, count );
+     t = elapsed( &t0 );
+     dn = 0.0;
+     for( i = 0; i < count; i++ ) {
+        if( fabs(cn[i]-rcn[i]) > dn ) dn = fabs(cn[i]-rcn[i]);
+        if( fabs(ce[i]-rce[i]) > dn ) dn = fabs(ce[i]-rce[i]);
+        }
+     printf("%-7s %s geod_tm %8.2f Mpt/s  max diff %.3g m\n",
+        isas[isa], methods[method], count/t*1.0e-6, dn);
+     }
+  free( buf );
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,619 @@
+/* SIMD kernel template for the TM projection.
+
+   This file is included once per instruction set by nztm_simd.c, which
+   first defines the vector type and operations below.  It is not a
+   header in its own right and has no include guard.
+
+     VD, VM          vector of VW doubles and matching comparison mask
+     VFN(name)       name with the instruction set suffix appended
+     VTARGET         function attribute enabling the instruction set
+     V1(x)           broadcast x to all lanes
+     VLD, VST        unaligned load and store
+     VADD, VSUB, VMUL, VDIV, VSQRT
+     VRINT, VFLOOR, VCEIL, VMAX
+     VCMPEQ, VCMPGT  lane comparisons returning a mask
+     VMAND, VMOR     mask and, or
+     VSEL(m,a,b)     a where m is set, otherwise b
+
+   The arithmetic follows tm_geod and geod_tm in nztm.c term for term,
+   so the results agree with the scalar code to rounding error. */
+
+
+/***************************************************************************/
+/*                                                                         */
+/*   vsincos                                                               */
+/*                                                                         */
+/*   Sine and cosine of each lane.  The argument is reduced to            */
+/*   [-pi/4,pi/4] by a three part Cody-Waite subtraction of multiples of   */
+/*   pi/2, then evaluated with the minimax polynomials from the Cephes    */
+/*   library, which are accurate to about 1 ulp on that interval.  The     */
+/*   reduction is exact for the arguments met in the projection (less     */
+/*   than about 4*pi).                                                     */
+/*                                                                         */
+/***************************************************************************/
+
+
+static inline VTARGET void VFN(vsincos)( VD x, VD *s, VD *c ) {
+    VD j;
+    VD jm;
+    VD r;
+    VD z;
+    VD ps;
+    VD pc;
+    VD sr;
+    VD cr;
+    VM odd;
+    VM sneg;
+    VM cneg;
+
+    j = VRINT( VMUL(x, V1(SC_2PI)) );
+    r = VSUB( x, VMUL(j, V1(SC_DP1)) );
+    r = VSUB( r, VMUL(j, V1(SC_DP2)) );
+    r = VSUB( r, VMUL(j, V1(SC_DP3)) );
+    z = VMUL( r, r );
+
+    ps = VADD( VMUL(V1(SC_S0), z), V1(SC_S1) );
+    ps = VADD( VMUL(ps, z), V1(SC_S2) );
+    ps = VADD( VMUL(ps, z), V1(SC_S3) );
+    ps = VADD( VMUL(ps, z), V1(SC_S4) );
+    ps = VADD( VMUL(ps, z), V1(SC_S5) );
+    sr = VADD( r, VMUL(VMUL(r, z), ps) );
+
+    pc = VADD( VMUL(V1(SC_C0), z), V1(SC_C1) );
+    pc = VADD( VMUL(pc, z), V1(SC_C2) );
+    pc = VADD( VMUL(pc, z), V1(SC_C3) );
+    pc = VADD( VMUL(pc, z), V1(SC_C4) );
+    pc = VADD( VMUL(pc, z), V1(SC_C5) );
+    cr = VADD( VSUB(V1(1.0), VMUL(V1(0.5), z)), VMUL(VMUL(z, z), pc) );
+
+    /* Quadrant j mod 4 selects and signs the results */
+
+    jm = VSUB( j, VMUL(V1(4.0), VFLOOR(VMUL(j, V1(0.25)))) );
+    odd = VMOR( VCMPEQ(jm, V1(1.0)), VCMPEQ(jm, V1(3.0)) );
+    sneg = VCMPGT( jm, V1(1.5) );
+    cneg = VMAND( VCMPGT(jm, V1(0.5)), VCMPGT(V1(2.5), jm) );
+
+    *s = VSEL( odd, cr, sr );
+    *c = VSEL( odd, sr, cr );
+    *s = VSEL( sneg, VSUB(V1(0.0), *s), *s );
+    *c = VSEL( cneg, VSUB(V1(0.0), *c), *c );
+    }
+
+static inline VTARGET VD VFN(vsin)( VD x ) {
+    VD s;
+    VD c;
+
+    VFN(vsincos)( x, &s, &c );
+    return s;
+    }
+
+
+/***************************************************************************/
+/*                                                                         */
+/*   tm_geod_block, geod_tm_block                                          */
+/*                                                                         */
+/*   Convert VW contiguous points using the projection k and method       */
+/*   (NZTM_REDFEARN or NZTM_CLENSHAW).                                     */
+/*                                                                         */
+/***************************************************************************/
+
+
+static inline VTARGET void VFN(tm_geod_block)( const tmprojection *k,
+              int method, const double *ce, const double *cn,
+              double *ln, double *lt ) {
+    VD sf = V1(k->scalef);
+    VD e2 = V1(k->e2);
+    VD cn1;
+    VD sig;
+    VD ssig;
+    VD csig;
+    VD y;
+    VD b1;
+    VD b2;
+    VD b3;
+    VD d;
+    VD d2;
+    VD sd;
+    VD cd;
+    VD fphi;
+    VD slt;
+    VD clt;
+    VD eslt;
+    VD eta;
+    VD rho;
+    VD psi;
+    VD E;
+    VD x;
+    VD x2;
+    VD t;
+    VD t2;
+    VD t4;
+    VD trm1;
+    VD trm2;
+    VD trm3;
+    VD trm4;
+
+    cn1 = VADD( VMUL(VMUL(VSUB(VLD(cn), V1(k->falsen)), V1(k->utom)),
+                     V1(k->rsf)), V1(k->om) );
+
+    sig = VDIV( cn1, V1(k->g) );
+
+    if( method == NZTM_CLENSHAW ) {
+
+        /* foot_point_lat_cs */
+
+        VFN(vsincos)( sig, &ssig, &csig );
+        y = VMUL( V1(2.0), VMUL(VSUB(csig, ssig), VADD(csig, ssig)) );
+        b3 = VADD( V1(k->p6), VMUL(y, V1(k->p8)) );
+        b2 = VSUB( VADD(V1(k->p4), VMUL(y, b3)), V1(k->p8) );
+        b1 = VSUB( VADD(V1(k->p2), VMUL(y, b2)), b3 );
+        d = VMUL( b1, VMUL(V1(2.0), VMUL(ssig, csig)) );
+
+        d2 = VMUL( d, d );
+        sd = VMUL( d, VSUB(V1(1.0), VMUL(VMUL(d2, V1(1.0/6.0)),
+                   VSUB(V1(1.0), VMUL(d2, V1(1.0/20.0))))) );
+        cd = VSUB( V1(1.0), VMUL(VMUL(d2, V1(0.5)),
+                   VSUB(V1(1.0), VMUL(VMUL(d2, V1(1.0/12.0)),
+                        VSUB(V1(1.0), VMUL(d2, V1(1.0/30.0)))))) );
+        slt = VADD( VMUL(ssig, cd), VMUL(csig, sd) );
+        clt = VSUB( VMUL(csig, cd), VMUL(ssig, sd) );
+        fphi = VADD( sig, d );
+        }
+    else {
+
+        /* foot_point_lat */
+
+        fphi = VADD( sig, VMUL(V1(k->p2), VFN(vsin)(VMUL(V1(2.0), sig))) );
+        fphi = VADD( fphi, VMUL(V1(k->p4), VFN(vsin)(VMUL(V1(4.0), sig))) );
+        fphi = VADD( fphi, VMUL(V1(k->p6), VFN(vsin)(VMUL(V1(6.0), sig))) );
+        fphi = VADD( fphi, VMUL(V1(k->p8), VFN(vsin)(VMUL(V1(8.0), sig))) );
+
+        VFN(vsincos)( fphi, &slt, &clt );
+        }
+
+    eslt = VSUB( V1(1.0), VMUL(VMUL(e2, slt), slt) );
+    eta = VDIV( V1(k->a), VSQRT(eslt) );
+    rho = VDIV( VMUL(eta, V1(k->ome2)), eslt );
+    psi = VDIV( eta, rho );
+
+    E = VMUL( VSUB(VLD(ce), V1(k->falsee)), V1(k->utom) );
+    x = VDIV( E, VMUL(eta, sf) );
+    x2 = VMUL( x, x );
+
+    t = VDIV( slt, clt );
+    t2 = VMUL( t, t );
+    t4 = VMUL( t2, t2 );
+
+    trm1 = V1(1.0/2.0);
+
+    trm2 = VMUL( VADD(VMUL(VADD(VMUL(V1(-4.0), psi),
+                                VMUL(V1(9.0), VSUB(V1(1.0), t2))), psi),
+                      VMUL(V1(12.0), t2)), V1(1.0/24.0) );
+
+    trm3 = VMUL( VSUB(V1(8.0*11.0), VMUL(V1(8.0*24.0), t2)), psi );
+    trm3 = VMUL( VSUB(trm3, VMUL(V1(12.0),
+                 VSUB(V1(21.0), VMUL(V1(71.0), t2)))), psi );
+    trm3 = VMUL( VADD(trm3, VMUL(V1(15.0),
+                 VADD(VMUL(VSUB(VMUL(V1(15.0), t2), V1(98.0)), t2),
+                      V1(15.0)))), psi );
+    trm3 = VMUL( VADD(trm3, VMUL(V1(180.0),
+                 VMUL(VADD(VMUL(V1(-3.0), t2), V1(5.0)), t2))), psi );
+    trm3 = VMUL( VADD(trm3, VMUL(V1(360.0), t4)), V1(1.0/720.0) );
+
+    trm4 = VADD( VMUL(V1(1575.0), t2), V1(4095.0) );
+    trm4 = VADD( VMUL(trm4, t2), V1(3633.0) );
+    trm4 = VMUL( VADD(VMUL(trm4, t2), V1(1385.0)), V1(1.0/40320.0) );
+
+    trm4 = VSUB( VMUL(VADD(VMUL(VSUB(VMUL(trm4, x2), trm3), x2), trm2),
+                      x2), trm1 );
+    VST( lt, VADD(fphi, VMUL(VDIV(VMUL(VMUL(t, x), E), VMUL(sf, rho)),
+                             trm4)) );
+
+    trm1 = V1(1.0);
+
+    trm2 = VMUL( VADD(psi, VMUL(V1(2.0), t2)), V1(1.0/6.0) );
+
+    trm3 = VMUL( VMUL(V1(-4.0), VSUB(V1(1.0), VMUL(V1(6.0), t2))), psi );
+    trm3 = VMUL( VADD(trm3, VSUB(V1(9.0), VMUL(V1(68.0), t2))), psi );
+    trm3 = VMUL( VADD(trm3, VMUL(V1(72.0), t2)), psi );
+    trm3 = VMUL( VADD(trm3, VMUL(V1(24.0), t4)), V1(1.0/120.0) );
+
+    trm4 = VADD( VMUL(V1(720.0), t2), V1(1320.0) );
+    trm4 = VADD( VMUL(trm4, t2), V1(662.0) );
+    trm4 = VMUL( VADD(VMUL(trm4, t2), V1(61.0)), V1(1.0/5040.0) );
+
+    trm4 = VSUB( VMUL(VADD(VMUL(VSUB(VMUL(trm4, x2), trm3), x2), trm2),
+                      x2), trm1 );
+    VST( ln, VSUB(V1(k->meridian), VMUL(VDIV(x, clt), trm4)) );
+    }
+
+
+static inline VTARGET void VFN(geod_tm_block)( const tmprojection *k,
+              int method, const double *ln, const double *lt,
+              double *ce, double *cn ) {
+    VD e2 = V1(k->e2);
+    VD vlt;
+    VD dlon;
+    VD m;
+    VD y;
+    VD b1;
+    VD b2;
+    VD slt;
+    VD clt;
+    VD eslt;
+    VD eta;
+    VD rho;
+    VD psi;
+    VD wc;
+    VD wc2;
+    VD t;
+    VD t2;
+    VD t4;
+    VD t6;
+    VD trm1;
+    VD trm2;
+    VD trm3;
+    VD trm4;
+    VD gce;
+    VD gcn;
+
+    /* Wrap dlon into [-PI,PI] taking as many whole turns as the
+       while loops in geod_tm would */
+
+    dlon = VSUB( VLD(ln), V1(k->meridian) );
+    dlon = VSUB( dlon, VMUL(V1(TWOPI), VMAX(V1(0.0),
+               VCEIL(VDIV(VSUB(dlon, V1(PI)), V1(TWOPI))))) );
+    dlon = VADD( dlon, VMUL(V1(TWOPI), VMAX(V1(0.0),
+               VCEIL(VDIV(VSUB(V1(-PI), dlon), V1(TWOPI))))) );
+
+    vlt = VLD(lt);
+    VFN(vsincos)( vlt, &slt, &clt );
+
+    if( method == NZTM_CLENSHAW ) {
+
+        /* meridian_arc_cs */
+
+        y = VMUL( V1(2.0), VMUL(VSUB(clt, slt), VADD(clt, slt)) );
+        b2 = VSUB( V1(k->A4), VMUL(y, V1(k->A6)) );
+        b1 = VADD( VSUB(VMUL(y, b2), V1(k->A2)), V1(k->A6) );
+        m = VADD( VMUL(V1(k->A0), vlt),
+                  VMUL(b1, VMUL(V1(2.0), VMUL(slt, clt))) );
+        }
+    else {
+
+        /* meridian_arc */
+
+        m = VSUB( VMUL(V1(k->A0), vlt),
+                  VMUL(V1(k->A2), VFN(vsin)(VMUL(V1(2.0), vlt))) );
+        m = VADD( m, VMUL(V1(k->A4), VFN(vsin)(VMUL(V1(4.0), vlt))) );
+        m = VSUB( m, VMUL(V1(k->A6), VFN(vsin)(VMUL(V1(6.0), vlt))) );
+        }
+    m = VMUL( V1(k->a), m );
+
+    eslt = VSUB( V1(1.0), VMUL(VMUL(e2, slt), slt) );
+    eta = VDIV( V1(k->a), VSQRT(eslt) );
+    rho = VDIV( VMUL(eta, V1(k->ome2)), eslt );
+    psi = VDIV( eta, rho );
+
+    wc = VMUL( clt, dlon );
+    wc2 = VMUL( wc, wc );
+
+    t = VDIV( slt, clt );
+    t2 = VMUL( t, t );
+    t4 = VMUL( t2, t2 );
+    t6 = VMUL( t2, t4 );
+
+    trm1 = VMUL( VSUB(psi, t2), V1(1.0/6.0) );
+
+    trm2 = VMUL( VMUL(V1(4.0), VSUB(V1(1.0), VMUL(V1(6.0), t2))), psi );
+    trm2 = VMUL( VADD(trm2, VADD(V1(1.0), VMUL(V1(8.0), t2))), psi );
+    trm2 = VMUL( VSUB(trm2, VMUL(V1(2.0), t2)), psi );
+    trm2 = VMUL( VADD(trm2, t4), V1(1.0/120.0) );
+
+    trm3 = VADD( VSUB(V1(61.0), VMUL(V1(479.0), t2)), VMUL(V1(179.0), t4) );
+    trm3 = VMUL( VSUB(trm3, t6), V1(1.0/5040.0) );
+
+    gce = VMUL( VMUL(VMUL(VMUL(V1(k->scalef), eta), dlon), clt),
+                VADD(VMUL(VADD(VMUL(VADD(VMUL(trm3, wc2), trm2), wc2),
+                               trm1), wc2), V1(1.0)) );
+    VST( ce, VADD(VMUL(gce, V1(k->rutom)), V1(k->falsee)) );
+
+    trm1 = V1(1.0/2.0);
+
+    trm2 = VMUL( VSUB(VMUL(VADD(VMUL(V1(4.0), psi), V1(1.0)), psi), t2),
+                 V1(1.0/24.0) );
+
+    trm3 = VMUL( VSUB(V1(8.0*11.0), VMUL(V1(8.0*24.0), t2)), psi );
+    trm3 = VMUL( VSUB(trm3, VMUL(V1(28.0),
+                 VSUB(V1(1.0), VMUL(V1(6.0), t2)))), psi );
+    trm3 = VMUL( VADD(trm3, VSUB(V1(1.0), VMUL(V1(32.0), t2))), psi );
+    trm3 = VMUL( VSUB(trm3, VMUL(V1(2.0), t2)), psi );
+    trm3 = VMUL( VADD(trm3, t4), V1(1.0/720.0) );
+
+    trm4 = VADD( VSUB(V1(1385.0), VMUL(V1(3111.0), t2)),
+                 VMUL(V1(543.0), t4) );
+    trm4 = VMUL( VSUB(trm4, t6), V1(1.0/40320.0) );
+
+    gcn = VMUL( VMUL(eta, t),
+                VMUL(VADD(VMUL(VADD(VMUL(VADD(VMUL(trm4, wc2), trm3), wc2),
+                                    trm2), wc2), trm1), wc2) );
+    VST( cn, VADD(VMUL(VMUL(VSUB(VADD(gcn, m), V1(k->om)), V1(k->scalef)),
+                       V1(k->rutom)), V1(k->falsen)) );
+    }
+
+
+/***************************************************************************/
+/*                                                                         */
+/*   tm_geod_fast_block, geod_tm_fast_block                                */
+/*                                                                         */
+/*   The NZTM_FAST method, following tm_geod_fast and geod_tm_fast.        */
+/*                                                                         */
+/***************************************************************************/
+
+
+static inline VTARGET void VFN(foot_point_cs)( const tmprojection *k,
+              VD cn1, VD *fphi, VD *slt, VD *clt ) {
+    VD sig;
+    VD ssig;
+    VD csig;
+    VD y;
+    VD b1;
+    VD b2;
+    VD b3;
+    VD d;
+    VD d2;
+    VD sd;
+    VD cd;
+
+    sig = VDIV( cn1, V1(k->g) );
+    VFN(vsincos)( sig, &ssig, &csig );
+    y = VMUL( V1(2.0), VMUL(VSUB(csig, ssig), VADD(csig, ssig)) );
+    b3 = VADD( V1(k->p6), VMUL(y, V1(k->p8)) );
+    b2 = VSUB( VADD(V1(k->p4), VMUL(y, b3)), V1(k->p8) );
+    b1 = VSUB( VADD(V1(k->p2), VMUL(y, b2)), b3 );
+    d = VMUL( b1, VMUL(V1(2.0), VMUL(ssig, csig)) );
+
+    d2 = VMUL( d, d );
+    sd = VMUL( d, VSUB(V1(1.0), VMUL(VMUL(d2, V1(1.0/6.0)),
+               VSUB(V1(1.0), VMUL(d2, V1(1.0/20.0))))) );
+    cd = VSUB( V1(1.0), VMUL(VMUL(d2, V1(0.5)),
+               VSUB(V1(1.0), VMUL(VMUL(d2, V1(1.0/12.0)),
+                    VSUB(V1(1.0), VMUL(d2, V1(1.0/30.0)))))) );
+    *slt = VADD( VMUL(ssig, cd), VMUL(csig, sd) );
+    *clt = VSUB( VMUL(csig, cd), VMUL(ssig, sd) );
+    *fphi = VADD( sig, d );
+    }
+
+
+static inline VTARGET void VFN(tm_geod_fast_block)( const tmprojection *k,
+              const double *ce, const double *cn, double *ln, double *lt ) {
+    VD cn1;
+    VD fphi;
+    VD slt;
+    VD clt;
+    VD rclt;
+    VD eslt;
+    VD psi;
+    VD x;
+    VD x2;
+    VD t;
+    VD t2;
+    VD t4;
+    VD trm2;
+    VD trm3;
+    VD trm4;
+
+    cn1 = VADD( VMUL(VMUL(VSUB(VLD(cn), V1(k->falsen)), V1(k->utom)),
+                     V1(k->rsf)), V1(k->om) );
+    VFN(foot_point_cs)( k, cn1, &fphi, &slt, &clt );
+
+    eslt = VSUB( V1(1.0), VMUL(VMUL(V1(k->e2), slt), slt) );
+    psi = VMUL( eslt, V1(1.0/k->ome2) );
+    x = VMUL( VMUL(VSUB(VLD(ce), V1(k->falsee)), V1(k->utom)),
+              VMUL(VSQRT(eslt), V1(1.0/(k->a*k->scalef))) );
+    x2 = VMUL( x, x );
+
+    rclt = VDIV( V1(1.0), clt );
+    t = VMUL( slt, rclt );
+    t2 = VMUL( t, t );
+    t4 = VMUL( t2, t2 );
+
+    trm2 = VMUL( VADD(VMUL(VADD(VMUL(V1(-4.0), psi),
+                                VMUL(V1(9.0), VSUB(V1(1.0), t2))), psi),
+                      VMUL(V1(12.0), t2)), V1(1.0/24.0) );
+
+    trm3 = VMUL( VSUB(V1(8.0*11.0), VMUL(V1(8.0*24.0), t2)), psi );
+    trm3 = VMUL( VSUB(trm3, VMUL(V1(12.0),
+                 VSUB(V1(21.0), VMUL(V1(71.0), t2)))), psi );
+    trm3 = VMUL( VADD(trm3, VMUL(V1(15.0),
+                 VADD(VMUL(VSUB(VMUL(V1(15.0), t2), V1(98.0)), t2),
+                      V1(15.0)))), psi );
+    trm3 = VMUL( VADD(trm3, VMUL(V1(180.0),
+                 VMUL(VADD(VMUL(V1(-3.0), t2), V1(5.0)), t2))), psi );
+    trm3 = VMUL( VADD(trm3, VMUL(V1(360.0), t4)), V1(1.0/720.0) );
+
+    trm4 = VSUB( VMUL(VSUB(trm2, VMUL(trm3, x2)), x2), V1(0.5) );
+    VST( lt, VADD(fphi, VMUL(VMUL(VMUL(t, x2), psi), trm4)) );
+
+    trm2 = VMUL( VADD(psi, VMUL(V1(2.0), t2)), V1(1.0/6.0) );
+
+    trm3 = VMUL( VMUL(V1(-4.0), VSUB(V1(1.0), VMUL(V1(6.0), t2))), psi );
+    trm3 = VMUL( VADD(trm3, VSUB(V1(9.0), VMUL(V1(68.0), t2))), psi );
+    trm3 = VMUL( VADD(trm3, VMUL(V1(72.0), t2)), psi );
+    trm3 = VMUL( VADD(trm3, VMUL(V1(24.0), t4)), V1(1.0/120.0) );
+
+    trm4 = VADD( VMUL(V1(720.0), t2), V1(1320.0) );
+    trm4 = VADD( VMUL(trm4, t2), V1(662.0) );
+    trm4 = VMUL( VADD(VMUL(trm4, t2), V1(61.0)), V1(1.0/5040.0) );
+
+    trm4 = VSUB( VMUL(VADD(VMUL(VSUB(VMUL(trm4, x2), trm3), x2), trm2),
+                      x2), V1(1.0) );
+    VST( ln, VSUB(V1(k->meridian), VMUL(VMUL(x, rclt), trm4)) );
+    }
+
+
+static inline VTARGET void VFN(geod_tm_fast_block)( const tmprojection *k,
+              const double *ln, const double *lt, double *ce, double *cn ) {
+    VD vlt;
+    VD dlon;
+    VD m;
+    VD y;
+    VD b1;
+    VD b2;
+    VD slt;
+    VD clt;
+    VD eslt;
+    VD eta;
+    VD psi;
+    VD wc;
+    VD wc2;
+    VD t;
+    VD t2;
+    VD t4;
+    VD trm1;
+    VD trm2;
+    VD trm3;
+
+    dlon = VSUB( VLD(ln), V1(k->meridian) );
+    dlon = VSUB( dlon, VMUL(V1(TWOPI), VMAX(V1(0.0),
+               VCEIL(VDIV(VSUB(dlon, V1(PI)), V1(TWOPI))))) );
+    dlon = VADD( dlon, VMUL(V1(TWOPI), VMAX(V1(0.0),
+               VCEIL(VDIV(VSUB(V1(-PI), dlon), V1(TWOPI))))) );
+
+    vlt = VLD(lt);
+    VFN(vsincos)( vlt, &slt, &clt );
+
+    y = VMUL( V1(2.0), VMUL(VSUB(clt, slt), VADD(clt, slt)) );
+    b2 = VSUB( V1(k->A4), VMUL(y, V1(k->A6)) );
+    b1 = VADD( VSUB(VMUL(y, b2), V1(k->A2)), V1(k->A6) );
+    m = VMUL( V1(k->a), VADD(VMUL(V1(k->A0), vlt),
+              VMUL(b1, VMUL(V1(2.0), VMUL(slt, clt)))) );
+
+    eslt = VSUB( V1(1.0), VMUL(VMUL(V1(k->e2), slt), slt) );
+    eta = VDIV( V1(k->a), VSQRT(eslt) );
+    psi = VMUL( eslt, V1(1.0/k->ome2) );
+
+    wc = VMUL( clt, dlon );
+    wc2 = VMUL( wc, wc );
+
+    t = VDIV( slt, clt );
+    t2 = VMUL( t, t );
+    t4 = VMUL( t2, t2 );
+
+    trm1 = VMUL( VSUB(psi, t2), V1(1.0/6.0) );
+
+    trm2 = VMUL( VMUL(V1(4.0), VSUB(V1(1.0), VMUL(V1(6.0), t2))), psi );
+    trm2 = VMUL( VADD(trm2, VADD(V1(1.0), VMUL(V1(8.0), t2))), psi );
+    trm2 = VMUL( VSUB(trm2, VMUL(V1(2.0), t2)), psi );
+    trm2 = VMUL( VADD(trm2, t4), V1(1.0/120.0) );
+
+    VST( ce, VADD(VMUL(VMUL(VMUL(V1(k->scalef*k->rutom), eta), wc),
+                       VADD(VMUL(VADD(VMUL(trm2, wc2), trm1), wc2), V1(1.0))),
+                  V1(k->falsee)) );
+
+    trm2 = VMUL( VSUB(VMUL(VADD(VMUL(V1(4.0), psi), V1(1.0)), psi), t2),
+                 V1(1.0/24.0) );
+
+    trm3 = VMUL( VSUB(V1(8.0*11.0), VMUL(V1(8.0*24.0), t2)), psi );
+    trm3 = VMUL( VSUB(trm3, VMUL(V1(28.0),
+                 VSUB(V1(1.0), VMUL(V1(6.0), t2)))), psi );
+    trm3 = VMUL( VADD(trm3, VSUB(V1(1.0), VMUL(V1(32.0), t2))), psi );
+    trm3 = VMUL( VSUB(trm3, VMUL(V1(2.0), t2)), psi );
+    trm3 = VMUL( VADD(trm3, t4), V1(1.0/720.0) );
+
+    y = VMUL( VMUL(eta, t),
+              VMUL(VADD(VMUL(VADD(VMUL(trm3, wc2), trm2), wc2), V1(0.5)), wc2) );
+    VST( cn, VADD(VMUL(VSUB(VADD(y, m), V1(k->om)), V1(k->scalef*k->rutom)),
+                  V1(k->falsen)) );
+    }
+
+
+/***************************************************************************/
+/*                                                                         */
+/*   tm_geod_v, geod_tm_v                                                  */
+/*                                                                         */
+/*   Convert count points.  Unit stride data is processed directly; the   */
+/*   strided case and the final partial vector are staged through local   */
+/*   buffers, padding unused lanes with the last point.  As in the scalar */
+/*   batch code the projection is copied so its constants stay in         */
+/*   registers.                                                           */
+/*                                                                         */
+/***************************************************************************/
+
+
+static VTARGET void VFN(tm_geod_v)( const tmprojection *tm, int method,
+              const double *ce, const double *cn, size_t instride,
+              double *ln, double *lt, size_t outstride, size_t count ) {
+    tmprojection k = *tm;
+    double bce[VW];
+    double bcn[VW];
+    double bln[VW];
+    double blt[VW];
+    size_t i = 0;
+    size_t j;
+    size_t nb;
+
+    if( instride == 1 && outstride == 1 ) {
+        for( ; i + VW <= count; i += VW ) {
+            if( method == NZTM_FAST )
+                VFN(tm_geod_fast_block)( &k, ce+i, cn+i, ln+i, lt+i );
+            else
+                VFN(tm_geod_block)( &k, method, ce+i, cn+i, ln+i, lt+i );
+            }
+        }
+
+    for( ; i < count; i += nb ) {
+        nb = count - i < VW ? count - i : VW;
+        for( j = 0; j < VW; j++ ) {
+            bce[j] = ce[(i + (j < nb ? j : nb-1))*instride];
+            bcn[j] = cn[(i + (j < nb ? j : nb-1))*instride];
+            }
+        if( method == NZTM_FAST )
+            VFN(tm_geod_fast_block)( &k, bce, bcn, bln, blt );
+        else
+            VFN(tm_geod_block)( &k, method, bce, bcn, bln, blt );
+        for( j = 0; j < nb; j++ ) {
+            ln[(i+j)*outstride] = bln[j];
+            lt[(i+j)*outstride] = blt[j];
+            }
+        }
+    }
+
+
+static VTARGET void VFN(geod_tm_v)( const tmprojection *tm, int method,
+              const double *ln, const double *lt, size_t instride,
+              double *ce, double *cn, size_t outstride, size_t count ) {
+    tmprojection k = *tm;
+    double bln[VW];
+    double blt[VW];
+    double bce[VW];
+    double bcn[VW];
+    size_t i = 0;
+    size_t j;
+    size_t nb;
+
+    if( instride == 1 && outstride == 1 ) {
+        for( ; i + VW <= count; i += VW ) {
+            if( method == NZTM_FAST )
+                VFN(geod_tm_fast_block)( &k, ln+i, lt+i, ce+i, cn+i );
+            else
+                VFN(geod_tm_block)( &k, method, ln+i, lt+i, ce+i, cn+i );
+            }
+        }
+
+    for( ; i < count; i += nb ) {
+        nb = count - i < VW ? count - i : VW;
+        for( j = 0; j < VW; j++ ) {
+            bln[j] = ln[(i + (j < nb ? j : nb-1))*instride];
+            blt[j] = lt[(i + (j < nb ? j : nb-1))*instride];
+            }
+        if( method == NZTM_FAST )
+            VFN(geod_tm_fast_block)( &k, bln, blt, bce, bcn );
+        else
+            VFN(geod_tm_block)( &k, method, bln, blt, bce, bcn );
+        for( j = 0; j < nb; j++ ) {
+            ce[(i+j)*outstride] = bce[j];
+            cn[(i+j)*outstride] = bcn[j];
+            }
+        }
+    }
@@ -0,0 +1,368 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Instrumentation counters.  Recording is compiled only with
+   NZTM_STATS; it needs thread local storage (GCC __thread) and the
+   GCC __atomic builtins. */
+
+#include "nztm_stats.h"
+
+#include "tmproj.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *stats_names[NZTM_STAT_NCALLS] = {
+   "geod_tm", "tm_geod", "geod_tm_n", "tm_geod_n"
+   };
+
+#ifdef NZTM_STATS
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#include <x86intrin.h>
+#define STATS_TSC
+#endif
+
+/* The counts of one thread, written only by it.  Blocks are linked
+   into stats_head when first used and never freed, so the counts of
+   threads that exit are kept. */
+
+typedef struct stats_block {
+        nztm_stat_call call[NZTM_STAT_NCALLS];
+        uint64_t wraps;
+        uint64_t outside;
+        struct stats_block *next;
+        } stats_block;
+
+static stats_block *stats_head;
+static __thread stats_block *stats_mine;
+
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static double stats_tick;
+
+static uint64_t stats_ticks( void ) {
+#if defined(STATS_TSC)
+    return __rdtsc();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    uint64_t v;
+    __asm__ __volatile__( "mrs %0, cntvct_el0" : "=r" (v) );
+    return v;
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t) ts.tv_sec*1000000000u + (uint64_t) ts.tv_nsec;
+#endif
+    }
+
+static double stats_seconds( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec*1.0e-9;
+    }
+
+/* Estimates the length of a tick against the monotonic clock over
+   about 20 ms */
+
+static void stats_calibrate( void ) {
+    double t0 = stats_seconds(), t1;
+    uint64_t k0 = stats_ticks(), k1;
+
+    do {
+        t1 = stats_seconds();
+        k1 = stats_ticks();
+        } while( t1 - t0 < 0.02 );
+    stats_tick = k1 > k0 ? (t1 - t0)/(double) (k1 - k0) : 1.0e-9;
+    }
+
+static stats_block *stats_self( void ) {
+    stats_block *b = stats_mine;
+
+    if( ! b ) {
+        b = (stats_block *) calloc( 1, sizeof(stats_block) );
+        if( ! b ) return NULL;
+        b->next = __atomic_load_n( &stats_head, __ATOMIC_RELAXED );
+        while( ! __atomic_compare_exchange_n( &stats_head, &b->next, b, 1,
+                    __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+        stats_mine = b;
+        }
+    return b;
+    }
+
+/* Adds v to a count of this thread's block.  Only the owning thread
+   writes it, so a plain load and an atomic store suffice. */
+
+static void stats_add( uint64_t *p, uint64_t v ) {
+    __atomic_store_n( p, *p + v, __ATOMIC_RELAXED );
+    }
+
+uint64_t tm_stats_start( void )
+{
+   return stats_ticks();
+}
+
+void tm_stats_call( int call, size_t count, uint64_t start )
+{
+   uint64_t t = stats_ticks() - start;
+   stats_block *b = stats_self();
+   nztm_stat_call *c;
+   int k;
+
+   if( ! b ) return;
+   c = &b->call[call];
+   k = 63 - __builtin_clzll( t | 1 );
+   if( k >= NZTM_STAT_NBUCKETS ) k = NZTM_STAT_NBUCKETS - 1;
+   stats_add( &c->calls, 1 );
+   stats_add( &c->points, count );
+   stats_add( &c->ticks, t );
+   stats_add( &c->hist[k], 1 );
+}
+
+/* The checks repeat the wrap around loops of geod_tm to count their
+   iterations; infinite longitudes, on which those loops do not end,
+   are only counted as outside. */
+
+void tm_stats_forward( const tmprojection *tm, const double *ln,
+   const double *lt, size_t stride, size_t count )
+{
+   double maxlat = NZTM_STATS_MAXLAT/rad2deg;
+   double maxdlon = NZTM_STATS_MAXDLON/rad2deg;
+   uint64_t wraps = 0, outside = 0;
+   stats_block *b = stats_self();
+   double dlon, w;
+   size_t i;
+
+   if( ! b ) return;
+   for( i = 0; i < count; i++ ) {
+      dlon = ln[i*stride] - tm->meridian;
+
+      /* The iterations of geod_tm's loops, counted without running them */
+
+      if( dlon > PI && dlon < HUGE_VAL ) {
+         w = ceil( (dlon - PI)/TWOPI );
+         dlon -= w*TWOPI;
+         wraps += (uint64_t) w;
+         }
+      else if( dlon < -PI && dlon > -HUGE_VAL ) {
+         w = ceil( (-PI - dlon)/TWOPI );
+         dlon += w*TWOPI;
+         wraps += (uint64_t) w;
+         }
+      outside += ! ( fabs( lt[i*stride] ) <= maxlat && fabs( dlon ) <= maxdlon );
+      }
+   if( wraps ) stats_add( &b->wraps, wraps );
+   if( outside ) stats_add( &b->outside, outside );
+}
+
+void tm_stats_inverse( const tmprojection *tm, const double *ce,
+   const double *cn, size_t stride, size_t count )
+{
+   double maxm = tm_meridian_arc( tm, NZTM_STATS_MAXLAT/rad2deg );
+   double maxx = tm->a*NZTM_STATS_MAXDLON/rad2deg;
+   double k = tm->utom*tm->rsf;
+   uint64_t outside = 0;
+   stats_block *b = stats_self();
+   size_t i;
+
+   if( ! b ) return;
+   for( i = 0; i < count; i++ )
+      outside += ! ( fabs( (ce[i*stride] - tm->falsee)*k ) <= maxx &&
+                     fabs( (cn[i*stride] - tm->falsen)*k + tm->om ) <= maxm );
+   if( outside ) stats_add( &b->outside, outside );
+}
+
+#endif
+
+int nztm_stats_enabled( void )
+{
+#ifdef NZTM_STATS
+   return 1;
+#else
+   return 0;
+#endif
+}
+
+void nztm_stats_read( nztm_stats *s )
+{
+#ifdef NZTM_STATS
+   const stats_block *b;
+   int c, k;
+#endif
+
+   memset( s, 0, sizeof(nztm_stats) );
+#ifdef NZTM_STATS
+   pthread_once( &stats_once, stats_calibrate );
+   s->tick = stats_tick;
+   for( b = __atomic_load_n( &stats_head, __ATOMIC_ACQUIRE ); b; b = b->next ) {
+      for( c = 0; c < NZTM_STAT_NCALLS; c++ ) {
+         s->call[c].calls += __atomic_load_n( &b->call[c].calls, __ATOMIC_RELAXED );
+         s->call[c].points += __atomic_load_n( &b->call[c].points, __ATOMIC_RELAXED );
+         s->call[c].ticks += __atomic_load_n( &b->call[c].ticks, __ATOMIC_RELAXED );
+         for( k = 0; k < NZTM_STAT_NBUCKETS; k++ )
+            s->call[c].hist[k] += __atomic_load_n( &b->call[c].hist[k], __ATOMIC_RELAXED );
+         }
+      s->wraps += __atomic_load_n( &b->wraps, __ATOMIC_RELAXED );
+      s->outside += __atomic_load_n( &b->outside, __ATOMIC_RELAXED );
+      s->threads++;
+      }
+#endif
+}
+
+const char *nztm_stats_name( int call )
+{
+   return call >= 0 && call < NZTM_STAT_NCALLS ? stats_names[call] : NULL;
+}
+
+/* Appends to the text being written by nztm_stats_prometheus, keeping
+   the full length even once the buffer is full */
+
+static void stats_print( char *buf, size_t size, size_t *len,
+   const char *fmt, ... ) {
+    va_list ap;
+    int n;
+
+    va_start( ap, fmt );
+    n = vsnprintf( *len < size ? buf + *len : NULL,
+                   *len < size ? size - *len : 0, fmt, ap );
+    va_end( ap );
+    if( n > 0 ) *len += (size_t) n;
+    }
+
+size_t nztm_stats_prometheus( char *buf, size_t size )
+{
+   static const char *counters[3][2] = {
+      { "nztm_calls_total", "Calls of the conversion entry points" },
+      { "nztm_points_total", "Points converted by the entry points" },
+      { "nztm_seconds_total", "Time spent in the entry points" },
+      };
+   nztm_stats s;
+   uint64_t cum;
+   size_t len = 0;
+   double v;
+   int c, k, m;
+
+   if( size > 0 ) buf[0] = '\0';
+   nztm_stats_read( &s );
+   for( m = 0; m < 3; m++ ) {
+      stats_print( buf, size, &len, "# HELP %s %s\n# TYPE %s counter\n",
+         counters[m][0], counters[m][1], counters[m][0] );
+      for( c = 0; c < NZTM_STAT_NCALLS; c++ ) {
+         v = m == 0 ? (double) s.call[c].calls : m == 1 ?
+             (double) s.call[c].points : s.call[c].ticks*s.tick;
+         stats_print( buf, size, &len, "%s{call=\"%s\"} %.17g\n",
+            counters[m][0], stats_names[c], v );
+         }
+      }
+
+   stats_print( buf, size, &len, "# HELP nztm_call_ticks Ticks per call of the"
+      " entry points\n# TYPE nztm_call_ticks histogram\n" );
+   for( c = 0; c < NZTM_STAT_NCALLS; c++ ) {
+      for( k = 0, cum = 0; k < NZTM_STAT_NBUCKETS; k++ ) {
+         cum += s.call[c].hist[k];
+         stats_print( buf, size, &len, "nztm_call_ticks_bucket{call=\"%s\","
+            "le=\"%.0f\"} %llu\n", stats_names[c], ldexp( 1.0, k + 1 ),
+            (unsigned long long) cum );
+         }
+      stats_print( buf, size, &len, "nztm_call_ticks_bucket{call=\"%s\","
+         "le=\"+Inf\"} %llu\n", stats_names[c], (unsigned long long) cum );
+      stats_print( buf, size, &len, "nztm_call_ticks_sum{call=\"%s\"} %llu\n"
+         "nztm_call_ticks_count{call=\"%s\"} %llu\n",
+         stats_names[c], (unsigned long long) s.call[c].ticks,
+         stats_names[c], (unsigned long long) s.call[c].calls );
+      }
+
+   stats_print( buf, size, &len,
+      "# HELP nztm_dlon_wraps_total Iterations of the longitude wrap around loops\n"
+      "# TYPE nztm_dlon_wraps_total counter\n"
+      "nztm_dlon_wraps_total %llu\n"
+      "# HELP nztm_outside_points_total Points outside the domain of the series\n"
+      "# TYPE nztm_outside_points_total counter\n"
+      "nztm_outside_points_total %llu\n"
+      "# HELP nztm_threads Threads that have recorded counts\n"
+      "# TYPE nztm_threads gauge\n"
+      "nztm_threads %llu\n"
+      "# HELP nztm_tick_seconds Seconds per tick\n"
+      "# TYPE nztm_tick_seconds gauge\n"
+      "nztm_tick_seconds %.6g\n",
+      (unsigned long long) s.wraps, (unsigned long long) s.outside,
+      (unsigned long long) s.threads, s.tick );
+   return len;
+}
+
+#ifdef TEST_NZTM_STATS
+
+/* Converts points in place, which must count no wraps and no points
+   outside the domain, then on several threads, a few of them outside
+   the domain or given longitudes needing wrapping, and prints the
+   counts.  Build with
+      cc -O2 -DNZTM_STATS -DTEST_NZTM_STATS nztm_stats.c nztm.c nztm_simd.c \
+         nztm_pool.c -lm -lpthread */
+
+#include "nztm_pool.h"
+
+#define TEST_N 100000
+
+static void test_run( void *ctx, size_t item, int thread ) {
+    static double lt[TEST_N], ln[TEST_N];
+    double n[TEST_N], e[TEST_N], a, b;
+    size_t i;
+
+    (void) ctx;
+    (void) thread;
+    for( i = 0; i < TEST_N; i++ ) {
+        lt[i] = (-47.0 + 13.0*i/TEST_N)/rad2deg;
+        ln[i] = (166.0 + 12.0*i/TEST_N)/rad2deg;
+        }
+    geod_nztm_n( lt, ln, n, e, TEST_N );
+    nztm_geod_n( n, e, lt, ln, TEST_N );
+    for( i = 0; i < 1000; i++ ) {
+        geod_nztm( -41.0/rad2deg, (item % 2 ? 173.0 - 360.0 : 173.0)/rad2deg, &a, &b );
+        nztm_geod( a, b, &a, &b );
+        }
+    }
+
+/* Converts four points forward and back in place, returning the wraps
+   and points outside the domain counted */
+
+static uint64_t test_inplace( void ) {
+    double a[4] = { -36.8, -41.3, -43.5, -46.4 };
+    double b[4] = { 174.8, 174.8, 172.6, 168.3 };
+    nztm_stats s0, s1;
+    int i;
+
+    for( i = 0; i < 4; i++ ) {
+        a[i] /= rad2deg;
+        b[i] /= rad2deg;
+        }
+    nztm_stats_read( &s0 );
+    geod_nztm_n( a, b, a, b, 4 );
+    nztm_geod_n( a, b, a, b, 4 );
+    nztm_stats_read( &s1 );
+    return (s1.wraps - s0.wraps) + (s1.outside - s0.outside);
+    }
+
+int main( void ) {
+  static char text[65536];
+  nztm_pool *pool = nztm_pool_create( 4 );
+  double lt = 0.0, ln = 60.0/rad2deg, n, e;
+  uint64_t inplace;
+  size_t len;
+
+  inplace = test_inplace();
+  nztm_pool_run( pool, 16, test_run, NULL );
+  geod_nztm( lt, ln, &n, &e );
+  nztm_pool_destroy( pool );
+  len = nztm_stats_prometheus( text, sizeof(text) );
+  fputs( text, stdout );
+  printf( "# %lu bytes, enabled %d\n", (unsigned long) len,
+     nztm_stats_enabled() );
+  printf( "# in place: %lu wraps or points outside\n",
+     (unsigned long) inplace );
+  return inplace != 0;
+  }
+
+#endif
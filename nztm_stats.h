@@ -0,0 +1,90 @@
+#ifndef _NZTM_STATS_H
+#define _NZTM_STATS_H
+
+/* Instrumentation counters for the conversions of nztm.h.
+
+   When the library is compiled with -DNZTM_STATS, every single point
+   conversion (geod_nztm, nztm_geod, geod_tm_h, tm_geod_h) and every
+   batch call (the _n, _s, _m, _hn and _hm functions, and so the bulk
+   engine and the modules built on them) records
+
+      the number of calls and points, and the time taken in ticks of
+      the processor's counter with a histogram of ticks per call in
+      powers of two,
+      the number of iterations of the longitude wrap around loops of
+      geod_tm, that is of longitudes given more than pi from the
+      central meridian, and
+      the number of points outside the domain of the series: NaN, at a
+      latitude beyond NZTM_STATS_MAXLAT or further than
+      NZTM_STATS_MAXDLON from the central meridian (for the inverse,
+      at an easting equivalent to that or a northing beyond the arc to
+      NZTM_STATS_MAXLAT).
+
+   The counts are kept per thread, in a block written only by that
+   thread, so recording needs no atomic read-modify-write and no locks,
+   and nztm_stats_read sums the blocks of all threads that have used
+   the library, including those that have since exited.  Without
+   NZTM_STATS nothing is recorded and the conversions are compiled
+   exactly as before; these functions still exist but report zeros, so
+   an exporter can be linked either way. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Instrumented entry points */
+
+#define NZTM_STAT_GEOD_TM    0    /* Single point forward */
+#define NZTM_STAT_TM_GEOD    1    /* Single point inverse */
+#define NZTM_STAT_GEOD_TM_N  2    /* Batch forward */
+#define NZTM_STAT_TM_GEOD_N  3    /* Batch inverse */
+#define NZTM_STAT_NCALLS     4
+
+#define NZTM_STAT_NBUCKETS   40   /* hist[k]: calls of [2^k,2^k+1) ticks */
+
+#define NZTM_STATS_MAXLAT    84.0 /* Degrees */
+#define NZTM_STATS_MAXDLON   6.0  /* Degrees */
+
+typedef struct {
+        uint64_t calls;
+        uint64_t points;
+        uint64_t ticks;
+        uint64_t hist[NZTM_STAT_NBUCKETS];
+        } nztm_stat_call;
+
+typedef struct {
+        nztm_stat_call call[NZTM_STAT_NCALLS];
+        uint64_t wraps;           /* Iterations of the dlon loops */
+        uint64_t outside;         /* Points outside the domain */
+        uint64_t threads;         /* Threads that have recorded */
+        double tick;              /* Seconds per tick (estimated) */
+        } nztm_stats;
+
+/* Non zero if the library was compiled with NZTM_STATS */
+
+int nztm_stats_enabled( void );
+
+/* Sums the counts of all threads into s.  The counts of other threads
+   are read while they may be changing, so each is exact as of some
+   moment during the call but not all of the same moment. */
+
+void nztm_stats_read( nztm_stats *s );
+
+/* Name of entry point call, for example "geod_tm_n" */
+
+const char *nztm_stats_name( int call );
+
+/* Writes the counts in the Prometheus text format to buf (of size
+   bytes) and returns the length of the text, as snprintf: if it is
+   size or more the text was truncated. */
+
+size_t nztm_stats_prometheus( char *buf, size_t size );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
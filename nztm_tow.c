@@ -0,0 +1,765 @@
+/* Columnar binary tow files.  The reader needs POSIX mmap.
+
+   A file is laid out as
+
+      header                 tow_header
+      column directory       tow_column[ncols]
+      groups                 tow_group[ngroups], by increasing key
+      column data            each starting on an 8 byte boundary
+
+   Integer columns are packed into 64 bit words, least significant bit
+   first, bits bits per row.  A TOW_FOR column stores value - base.  A
+   TOW_DELTA column stores, for rows not at the start of a block of
+   NZTM_TOW_BLOCK rows, value - previous value - base, followed by the
+   values at the start of each block (as int64) so that decoding can
+   start at any block.  The key column (TOW_RUNS) has no data of its
+   own; its values are those of the groups. */
+
+#include "nztm_tow.h"
+
+#include "tmproj.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TOW_MAGIC    "NZTMTOW1"
+#define TOW_VERSION  1
+
+#define TOW_RAW      0            /* Array of doubles */
+#define TOW_FOR      1            /* Offsets from base, bit packed */
+#define TOW_DELTA    2            /* Differences, bit packed */
+#define TOW_RUNS     3            /* The key, from the group table */
+
+#define TOW_PROJECTED 1           /* Header flag: proj is set */
+
+typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t ncols;
+        uint64_t nrows;
+        uint64_t ngroups;
+        uint32_t keycol;
+        uint32_t flags;
+        double proj[8];           /* a, rf, cm, sf, lto, fe, fn, utom */
+        } tow_header;
+
+typedef struct {
+        char name[NZTM_TOW_NAMELEN];
+        uint32_t type;            /* NZTM_TOW_INT or NZTM_TOW_DOUBLE */
+        uint32_t enc;             /* TOW_ encoding */
+        uint32_t bits;            /* Bits per packed value */
+        uint32_t pad;
+        int64_t base;
+        uint64_t offset;          /* Data, from the start of the file */
+        uint64_t size;            /* Bytes of data */
+        uint64_t blocks;          /* Block start values of TOW_DELTA */
+        } tow_column;
+
+typedef struct {
+        int64_t key;
+        uint64_t first;
+        uint64_t count;
+        } tow_group;
+
+/* Number of bits needed to hold r */
+
+static uint32_t tow_bits( uint64_t r ) {
+    uint32_t b = 0;
+
+    while( b < 64 && (r >> b) != 0 ) b++;
+    return b;
+    }
+
+/* Words of packed data for n values of b bits, including a spare word
+   so that values can always be read as two words */
+
+static size_t tow_words( size_t n, uint32_t b ) {
+    return (size_t) (((uint64_t) n*b + 63)/64) + 1;
+    }
+
+static void tow_put( uint64_t *w, uint32_t b, size_t i, uint64_t v ) {
+    uint64_t pos = (uint64_t) i*b;
+    size_t k = (size_t) (pos >> 6);
+    unsigned sh = (unsigned) (pos & 63);
+
+    if( b == 0 ) return;
+    w[k] |= v << sh;
+    if( sh + b > 64 ) w[k+1] |= v >> (64 - sh);
+    }
+
+static uint64_t tow_get( const uint64_t *w, uint32_t b, size_t i ) {
+    uint64_t pos = (uint64_t) i*b;
+    size_t k = (size_t) (pos >> 6);
+    unsigned sh = (unsigned) (pos & 63);
+    uint64_t v;
+
+    if( b == 0 ) return 0;
+    v = w[k] >> sh;
+    if( sh + b > 64 ) v |= w[k+1] << (64 - sh);
+    return b == 64 ? v : v & ((((uint64_t) 1) << b) - 1);
+    }
+
+/*************************************************************************/
+/*                                                                       */
+/*   Conversion                                                          */
+/*                                                                       */
+/*************************************************************************/
+
+typedef struct {
+        char name[NZTM_TOW_NAMELEN];
+        double *v;                /* Values, in input order */
+        int isint;                /* All values are whole numbers */
+        } tow_input;
+
+/* A row in the sort by key */
+
+typedef struct {
+        int64_t key;
+        size_t row;
+        } tow_order;
+
+static int tow_cmp( const void *a, const void *b ) {
+    const tow_order *p = (const tow_order *) a;
+    const tow_order *q = (const tow_order *) b;
+
+    if( p->key != q->key ) return p->key < q->key ? -1 : 1;
+    return p->row < q->row ? -1 : p->row > q->row;
+    }
+
+/* Fills in the directory entry of integer column v (in sorted order)
+   choosing the smaller encoding */
+
+static void tow_plan_int( tow_column *c, const int64_t *v, size_t n ) {
+    int64_t lo, hi, dlo, dhi, d;
+    uint32_t fbits, dbits;
+    size_t i;
+
+    lo = hi = n ? v[0] : 0;
+    dlo = dhi = 0;
+    for( i = 1; i < n; i++ ) {
+        if( v[i] < lo ) lo = v[i];
+        if( v[i] > hi ) hi = v[i];
+        if( i % NZTM_TOW_BLOCK == 0 ) continue;
+        d = v[i] - v[i-1];
+        if( i == 1 || d < dlo ) dlo = d;
+        if( i == 1 || d > dhi ) dhi = d;
+        }
+    fbits = tow_bits( (uint64_t) hi - (uint64_t) lo );
+    dbits = tow_bits( (uint64_t) dhi - (uint64_t) dlo );
+
+    c->type = NZTM_TOW_INT;
+    if( dbits < fbits ) {
+        c->enc = TOW_DELTA;
+        c->bits = dbits;
+        c->base = dlo;
+        c->size = tow_words( n, dbits )*8 +
+            ((n + NZTM_TOW_BLOCK - 1)/NZTM_TOW_BLOCK)*8;
+        }
+    else {
+        c->enc = TOW_FOR;
+        c->bits = fbits;
+        c->base = lo;
+        c->size = tow_words( n, fbits )*8;
+        }
+    }
+
+/* Writes the data of integer column v as planned by tow_plan_int */
+
+static int tow_write_int( FILE *f, const tow_column *c, const int64_t *v,
+   size_t n ) {
+    size_t nw = tow_words( n, c->bits );
+    size_t nb = (n + NZTM_TOW_BLOCK - 1)/NZTM_TOW_BLOCK;
+    uint64_t *w;
+    size_t i;
+    int ok;
+
+    w = (uint64_t *) calloc( nw + (c->enc == TOW_DELTA ? nb : 0), 8 );
+    if( ! w ) return -1;
+    for( i = 0; i < n; i++ ) {
+        if( c->enc == TOW_FOR )
+            tow_put( w, c->bits, i, (uint64_t) v[i] - (uint64_t) c->base );
+        else if( i % NZTM_TOW_BLOCK == 0 )
+            ((int64_t *) w)[nw + i/NZTM_TOW_BLOCK] = v[i];
+        else
+            tow_put( w, c->bits, i,
+                (uint64_t) (v[i] - v[i-1]) - (uint64_t) c->base );
+        }
+    ok = fwrite( w, 1, (size_t) c->size, f ) == (size_t) c->size;
+    free( w );
+    return ok ? 0 : -1;
+    }
+
+/* Reads the CSV into one array per column.  Returns the number of
+   rows, or -1 with *err set. */
+
+static long tow_read( FILE *in, tow_input **cols, int *ncols, int extra,
+   const char **err ) {
+    nztm_csv_field f[256];
+    tow_input *c = NULL;
+    nztm_csv *csv;
+    size_t nrows = 0;
+    size_t max = 0;
+    double v;
+    int nf, i;
+
+    *cols = NULL;
+    *ncols = 0;
+    if( ! ( csv = nztm_csv_open( in, 0 ) ) ) {
+        *err = "out of memory";
+        return -1;
+        }
+
+    nf = nztm_csv_read( csv, f, 256 );
+    if( nf <= 0 || nf > 256 ) {
+        *err = nf < 0 ? nztm_csv_error( csv ) :
+               nf == 0 ? "no header record" : "too many columns";
+        nztm_csv_close( csv );
+        return -1;
+        }
+    c = (tow_input *) calloc( nf + extra, sizeof(tow_input) );
+    if( ! c ) { *err = "out of memory"; nztm_csv_close( csv ); return -1; }
+    *cols = c;
+    *ncols = nf;
+    for( i = 0; i < nf; i++ ) {
+        if( f[i].len >= NZTM_TOW_NAMELEN ) {
+            *err = "column name too long";
+            goto fail;
+            }
+        memcpy( c[i].name, f[i].p, f[i].len );
+        c[i].isint = 1;
+        }
+
+    while( ( i = nztm_csv_read( csv, f, 256 ) ) > 0 ) {
+        if( i != nf ) {
+            *err = "record has the wrong number of fields";
+            goto fail;
+            }
+        if( nrows == max ) {
+            max = max ? 2*max : 4096;
+            for( i = 0; i < nf; i++ ) {
+                double *p = (double *) realloc( c[i].v,
+                    (max + 1)*sizeof(double) );
+                if( ! p ) { *err = "out of memory"; goto fail; }
+                c[i].v = p;
+                }
+            }
+        for( i = 0; i < nf; i++ ) {
+            if( f[i].len == 0 ||
+                (f[i].len == 2 && memcmp( f[i].p, "NA", 2 ) == 0) ) {
+                v = NAN;
+                c[i].isint = 0;
+                }
+            else if( ! nztm_csv_double( f[i].p, f[i].len, &v ) ) {
+                *err = "non numeric value";
+                goto fail;
+                }
+            else if( v != floor( v ) || fabs( v ) > 9007199254740992.0 )
+                c[i].isint = 0;
+            c[i].v[nrows] = v;
+            }
+        nrows++;
+        }
+    if( i < 0 ) { *err = nztm_csv_error( csv ); goto fail; }
+    nztm_csv_close( csv );
+    return (long) nrows;
+
+fail:
+    nztm_csv_close( csv );
+    return -1;
+    }
+
+long nztm_tow_convert( FILE *in, const char *path, const char *key,
+   const tmprojection *tm, const nztm_csv_pair *pairs, int npairs,
+   const char **err )
+{
+   const char *e = NULL;
+   tow_input *in_cols = NULL;
+   tow_column *dir = NULL;
+   tow_group *groups = NULL;
+   tow_header hdr;
+   tow_order *order = NULL;
+   double *buf = NULL;
+   double *p;
+   int64_t *ibuf = NULL;
+   size_t nrows, ngroups, i;
+   uint64_t offset;
+   FILE *out = NULL;
+   int ncols, nin, keycol, j, k;
+   long n;
+
+   if( ! tm ) npairs = 0;
+   n = tow_read( in, &in_cols, &nin, 2*npairs, &e );
+   if( n < 0 ) goto done;
+   nrows = (size_t) n;
+   ncols = nin;
+
+   /* Project the column pairs, in input order */
+
+   for( k = 0; k < npairs; k++ ) {
+      int lat = -1, lon = -1;
+      for( j = 0; j < nin; j++ ) {
+         if( strcmp( in_cols[j].name, pairs[k].lat ) == 0 ) lat = j;
+         if( strcmp( in_cols[j].name, pairs[k].lon ) == 0 ) lon = j;
+         }
+      if( lat < 0 || lon < 0 ) {
+         e = "projected column not found"; n = -1; goto done;
+         }
+      if( strlen( pairs[k].n ) >= NZTM_TOW_NAMELEN ||
+          strlen( pairs[k].e ) >= NZTM_TOW_NAMELEN ) {
+         e = "column name too long"; n = -1; goto done;
+         }
+      strcpy( in_cols[ncols].name, pairs[k].n );
+      strcpy( in_cols[ncols+1].name, pairs[k].e );
+      in_cols[ncols].v = (double *) malloc( (nrows + 1)*sizeof(double) );
+      in_cols[ncols+1].v = (double *) malloc( (nrows + 1)*sizeof(double) );
+      p = (double *) realloc( buf, (2*nrows + 1)*sizeof(double) );
+      if( p ) buf = p;
+      ncols += 2;
+      if( ! in_cols[ncols-2].v || ! in_cols[ncols-1].v || ! p ) {
+         e = "out of memory"; n = -1; goto done;
+         }
+      for( i = 0; i < nrows; i++ ) {
+         buf[i] = in_cols[lat].v[i]/rad2deg;
+         buf[nrows+i] = in_cols[lon].v[i]/rad2deg;
+         }
+      geod_tm_hn( tm, buf, buf + nrows, in_cols[ncols-2].v,
+         in_cols[ncols-1].v, nrows );
+      for( i = 0; i < nrows; i++ ) {
+         if( isnan( buf[i] ) || isnan( buf[nrows+i] ) )
+            in_cols[ncols-2].v[i] = in_cols[ncols-1].v[i] = NAN;
+         }
+      }
+
+   keycol = -1;
+   for( j = 0; j < nin; j++ )
+      if( strcmp( in_cols[j].name, key ) == 0 ) keycol = j;
+   if( keycol < 0 ) { e = "key column not found"; n = -1; goto done; }
+   if( ! in_cols[keycol].isint ) {
+      e = "key column is not integer"; n = -1; goto done;
+      }
+
+   /* Sort the rows by key, keeping the input order within a key */
+
+   order = (tow_order *) malloc( (nrows + 1)*sizeof(tow_order) );
+   dir = (tow_column *) calloc( ncols, sizeof(tow_column) );
+   groups = (tow_group *) calloc( nrows + 1, sizeof(tow_group) );
+   p = (double *) realloc( buf, (nrows + 1)*sizeof(double) );
+   if( p ) buf = p;
+   ibuf = (int64_t *) malloc( (nrows + 1)*sizeof(int64_t) );
+   if( ! order || ! dir || ! groups || ! p || ! ibuf ) {
+      e = "out of memory"; n = -1; goto done;
+      }
+   for( i = 0; i < nrows; i++ ) {
+      order[i].key = (int64_t) in_cols[keycol].v[i];
+      order[i].row = i;
+      }
+   qsort( order, nrows, sizeof(tow_order), tow_cmp );
+
+   ngroups = 0;
+   for( i = 0; i < nrows; i++ ) {
+      int64_t kv = order[i].key;
+      if( ngroups == 0 || groups[ngroups-1].key != kv ) {
+         groups[ngroups].key = kv;
+         groups[ngroups].first = i;
+         ngroups++;
+         }
+      groups[ngroups-1].count++;
+      }
+
+   /* Plan the directory */
+
+   offset = sizeof(tow_header) + ncols*sizeof(tow_column)
+      + ngroups*sizeof(tow_group);
+   for( j = 0; j < ncols; j++ ) {
+      strcpy( dir[j].name, in_cols[j].name );
+      if( j == keycol ) {
+         dir[j].type = NZTM_TOW_INT;
+         dir[j].enc = TOW_RUNS;
+         }
+      else if( in_cols[j].isint ) {
+         for( i = 0; i < nrows; i++ )
+            ibuf[i] = (int64_t) in_cols[j].v[order[i].row];
+         tow_plan_int( &dir[j], ibuf, nrows );
+         }
+      else {
+         dir[j].type = NZTM_TOW_DOUBLE;
+         dir[j].enc = TOW_RAW;
+         dir[j].size = nrows*sizeof(double);
+         }
+      dir[j].offset = offset;
+      if( dir[j].enc == TOW_DELTA )
+         dir[j].blocks = offset + tow_words( nrows, dir[j].bits )*8;
+      offset += dir[j].size;
+      }
+
+   memset( &hdr, 0, sizeof(hdr) );
+   memcpy( hdr.magic, TOW_MAGIC, 8 );
+   hdr.version = TOW_VERSION;
+   hdr.ncols = (uint32_t) ncols;
+   hdr.nrows = nrows;
+   hdr.ngroups = ngroups;
+   hdr.keycol = (uint32_t) keycol;
+   if( npairs > 0 ) {
+      hdr.flags = TOW_PROJECTED;
+      hdr.proj[0] = tm->a;
+      hdr.proj[1] = tm->rf;
+      hdr.proj[2] = tm->meridian;
+      hdr.proj[3] = tm->scalef;
+      hdr.proj[4] = tm->orglat;
+      hdr.proj[5] = tm->falsee;
+      hdr.proj[6] = tm->falsen;
+      hdr.proj[7] = tm->utom;
+      }
+
+   if( ! ( out = fopen( path, "wb" ) ) ) {
+      e = "cannot create output file"; n = -1; goto done;
+      }
+   if( fwrite( &hdr, sizeof(hdr), 1, out ) != 1 ||
+       fwrite( dir, sizeof(tow_column), ncols, out ) != (size_t) ncols ||
+       fwrite( groups, sizeof(tow_group), ngroups, out ) != ngroups ) {
+      e = "write error"; n = -1; goto done;
+      }
+   for( j = 0; j < ncols; j++ ) {
+      if( dir[j].enc == TOW_RUNS ) continue;
+      if( dir[j].type == NZTM_TOW_INT ) {
+         for( i = 0; i < nrows; i++ )
+            ibuf[i] = (int64_t) in_cols[j].v[order[i].row];
+         if( tow_write_int( out, &dir[j], ibuf, nrows ) != 0 ) {
+            e = "write error"; n = -1; goto done;
+            }
+         }
+      else {
+         for( i = 0; i < nrows; i++ ) buf[i] = in_cols[j].v[order[i].row];
+         if( fwrite( buf, sizeof(double), nrows, out ) != nrows ) {
+            e = "write error"; n = -1; goto done;
+            }
+         }
+      }
+   if( fclose( out ) != 0 ) { e = "write error"; n = -1; }
+   out = NULL;
+
+done:
+   if( out ) fclose( out );
+   if( in_cols ) for( j = 0; j < nin + 2*npairs; j++ ) free( in_cols[j].v );
+   free( in_cols );
+   free( dir );
+   free( groups );
+   free( order );
+   free( buf );
+   free( ibuf );
+   if( err ) *err = e;
+   return n;
+}
+
+/*************************************************************************/
+/*                                                                       */
+/*   Reading                                                             */
+/*                                                                       */
+/*************************************************************************/
+
+#define TOW_HDR(t)     ((const tow_header *) (t)->hdr)
+#define TOW_COL(t,i)   ((const tow_column *) (t)->cols + (i))
+#define TOW_GROUP(t,i) ((const tow_group *) (t)->groups + (i))
+
+/* Checks the structure of the mapped file */
+
+static int tow_check( const nztm_tow *t ) {
+    const tow_header *h = TOW_HDR( t );
+    const tow_column *c;
+    uint64_t rows = 0;
+    uint64_t end, need;
+    size_t i;
+
+    /* Bound ngroups by the file before multiplying; with only the key
+       column no column data bounds nrows */
+
+    if( h->ncols == 0 || h->ncols > 65536 || h->keycol >= h->ncols )
+        return -1;
+    end = sizeof(tow_header) + (uint64_t) h->ncols*sizeof(tow_column);
+    if( end > t->size || h->ngroups > (t->size - end)/sizeof(tow_group) ||
+        h->ngroups > h->nrows + 1 ) return -1;
+
+    for( i = 0; i < h->ncols; i++ ) {
+        c = TOW_COL( t, i );
+        if( c->name[NZTM_TOW_NAMELEN-1] != '\0' || c->offset % 8 != 0 ||
+            c->offset > t->size || c->size > t->size - c->offset ||
+            c->bits > 64 ) return -1;
+        switch( c->enc ) {
+            case TOW_RAW: need = h->nrows*8; break;
+            case TOW_FOR: need = tow_words( h->nrows, c->bits )*8; break;
+            case TOW_DELTA:
+                need = tow_words( h->nrows, c->bits )*8 +
+                    ((h->nrows + NZTM_TOW_BLOCK - 1)/NZTM_TOW_BLOCK)*8;
+                if( c->blocks != c->offset + tow_words( h->nrows, c->bits )*8 )
+                    return -1;
+                break;
+            case TOW_RUNS: need = 0; if( i != h->keycol ) return -1; break;
+            default: return -1;
+            }
+        if( c->size != need ||
+            c->type != (c->enc == TOW_RAW ? NZTM_TOW_DOUBLE : NZTM_TOW_INT) )
+            return -1;
+        }
+    if( TOW_COL( t, h->keycol )->enc != TOW_RUNS ) return -1;
+
+    for( i = 0; i < h->ngroups; i++ ) {
+        if( TOW_GROUP( t, i )->first != rows ||
+            TOW_GROUP( t, i )->count > h->nrows - rows ) return -1;
+        if( i > 0 && TOW_GROUP( t, i )->key <= TOW_GROUP( t, i-1 )->key )
+            return -1;
+        rows += TOW_GROUP( t, i )->count;
+        }
+    return rows == h->nrows ? 0 : -1;
+    }
+
+int nztm_tow_open( nztm_tow *t, const char *path )
+{
+   const tow_header *h;
+   struct stat st;
+   void *map;
+   int fd;
+
+   memset( t, 0, sizeof(nztm_tow) );
+   fd = open( path, O_RDONLY );
+   if( fd < 0 ) return -1;
+   if( fstat( fd, &st ) != 0 || (size_t) st.st_size < sizeof(tow_header) ) {
+      close( fd );
+      return -1;
+      }
+   map = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+   close( fd );
+   if( map == MAP_FAILED ) return -1;
+
+   h = (const tow_header *) map;
+   t->map = map;
+   t->size = (size_t) st.st_size;
+   t->hdr = h;
+   t->cols = h + 1;
+   t->groups = (const tow_column *) t->cols + h->ncols;
+   if( memcmp( h->magic, TOW_MAGIC, 8 ) != 0 || h->version != TOW_VERSION ||
+       tow_check( t ) != 0 ) {
+      munmap( map, t->size );
+      memset( t, 0, sizeof(nztm_tow) );
+      return -1;
+      }
+   t->nrows = (size_t) h->nrows;
+   t->ncols = (int) h->ncols;
+   t->ngroups = (size_t) h->ngroups;
+   t->keycol = (int) h->keycol;
+   return 0;
+}
+
+void nztm_tow_close( nztm_tow *t )
+{
+   if( t->map ) munmap( t->map, t->size );
+   memset( t, 0, sizeof(nztm_tow) );
+}
+
+int nztm_tow_column( const nztm_tow *t, const char *name )
+{
+   int i;
+
+   for( i = 0; i < t->ncols; i++ )
+      if( strcmp( TOW_COL( t, i )->name, name ) == 0 ) return i;
+   return -1;
+}
+
+const char *nztm_tow_name( const nztm_tow *t, int col )
+{
+   return col >= 0 && col < t->ncols ? TOW_COL( t, col )->name : NULL;
+}
+
+int nztm_tow_type( const nztm_tow *t, int col )
+{
+   return col >= 0 && col < t->ncols ? (int) TOW_COL( t, col )->type : -1;
+}
+
+const double *nztm_tow_double( const nztm_tow *t, int col )
+{
+   if( col < 0 || col >= t->ncols || TOW_COL( t, col )->enc != TOW_RAW )
+      return NULL;
+   return (const double *) ((const char *) t->map + TOW_COL( t, col )->offset);
+}
+
+long nztm_tow_int( const nztm_tow *t, int col, size_t first, size_t count,
+   int64_t *out )
+{
+   const tow_column *c;
+   const uint64_t *w;
+   const int64_t *blocks;
+   size_t i, end, g, lo, hi;
+   int64_t v;
+
+   if( col < 0 || col >= t->ncols ) return -1;
+   c = TOW_COL( t, col );
+   if( c->type != NZTM_TOW_INT ) return -1;
+   if( first >= t->nrows ) return 0;
+   if( count > t->nrows - first ) count = t->nrows - first;
+   end = first + count;
+   w = (const uint64_t *) ((const char *) t->map + c->offset);
+
+   switch( c->enc ) {
+      case TOW_FOR:
+         for( i = first; i < end; i++ )
+            out[i-first] =
+               (int64_t) (tow_get( w, c->bits, i ) + (uint64_t) c->base);
+         break;
+
+      case TOW_DELTA:
+         blocks = (const int64_t *) ((const char *) t->map + c->blocks);
+         i = first - first % NZTM_TOW_BLOCK;
+         v = blocks[i/NZTM_TOW_BLOCK];
+         for( ; i < end; ) {
+            if( i >= first ) out[i-first] = v;
+            if( ++i % NZTM_TOW_BLOCK == 0 ) {
+               if( i < end ) v = blocks[i/NZTM_TOW_BLOCK];
+               }
+            else if( i < end )
+               v += (int64_t) (tow_get( w, c->bits, i ) + (uint64_t) c->base);
+            }
+         break;
+
+      case TOW_RUNS:
+         lo = 0;
+         hi = t->ngroups;
+         while( hi - lo > 1 ) {
+            g = (lo + hi)/2;
+            if( TOW_GROUP( t, g )->first <= first ) lo = g; else hi = g;
+            }
+         for( i = first, g = lo; i < end; i++ ) {
+            while( i >= TOW_GROUP( t, g )->first + TOW_GROUP( t, g )->count )
+               g++;
+            out[i-first] = TOW_GROUP( t, g )->key;
+            }
+         break;
+      }
+   return (long) count;
+}
+
+void nztm_tow_group( const nztm_tow *t, size_t i, int64_t *key,
+   size_t *first, size_t *count )
+{
+   const tow_group *g = TOW_GROUP( t, i );
+
+   if( key ) *key = g->key;
+   if( first ) *first = (size_t) g->first;
+   if( count ) *count = (size_t) g->count;
+}
+
+long nztm_tow_find( const nztm_tow *t, int64_t key )
+{
+   size_t lo = 0, hi = t->ngroups, g;
+
+   while( lo < hi ) {
+      g = (lo + hi)/2;
+      if( TOW_GROUP( t, g )->key < key ) lo = g + 1; else hi = g;
+      }
+   return lo < t->ngroups && TOW_GROUP( t, lo )->key == key ? (long) lo : -1;
+}
+
+tmprojection *nztm_tow_projection( const nztm_tow *t )
+{
+   const double *p = TOW_HDR( t )->proj;
+
+   if( ! ( TOW_HDR( t )->flags & TOW_PROJECTED ) ) return NULL;
+   return tm_create( p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7] );
+}
+
+#ifdef NZTM_TOW_TOOL
+
+/* Converter and lister.  Build with
+      cc -O2 -DNZTM_TOW_TOOL -o nztm_tow nztm_tow.c nztm_csv.c nztm.c \
+         nztm_simd.c -lm
+   and run as
+      nztm_tow [-key column] [-utm zone[s]] [lat,lon,n,e ...] out.tow < in.csv
+   to convert (with key reitur by default), for example for spring.csv
+      nztm_tow -utm 27 kastad_breidd,kastad_lengd,kastad_n,kastad_e \
+         hift_breidd,hift_lengd,hift_n,hift_e spring.tow < spring.csv
+   or as
+      nztm_tow -l file.tow
+   to list the columns of a file. */
+
+static const char *tow_encname[] = { "raw", "offset", "delta", "groups" };
+
+int main( int argc, char *argv[] ) {
+  nztm_csv_pair pairs[64];
+  char *spec[64];
+  int npairs = 0;
+  const char *key = "reitur";
+  const char *path = NULL;
+  tmprojection *utm = NULL;
+  const char *err;
+  long n;
+  int i;
+
+  if( argc == 3 && strcmp( argv[1], "-l" ) == 0 ) {
+     nztm_tow t;
+     if( nztm_tow_open( &t, argv[2] ) != 0 ) {
+        fprintf( stderr, "nztm_tow: %s is not a valid tow file\n", argv[2] );
+        return 1;
+        }
+     printf( "%lu rows, %lu groups of %s\n", (unsigned long) t.nrows,
+        (unsigned long) t.ngroups, nztm_tow_name( &t, t.keycol ) );
+     for( i = 0; i < t.ncols; i++ ) {
+        const tow_column *c = TOW_COL( &t, i );
+        printf( "  %-24s %-6s %-6s %2u bits %9lu bytes\n", c->name,
+           c->type == NZTM_TOW_INT ? "int" : "double", tow_encname[c->enc],
+           (unsigned) (c->enc == TOW_RAW ? 64 : c->bits),
+           (unsigned long) c->size );
+        }
+     nztm_tow_close( &t );
+     return 0;
+     }
+
+  for( i = 1; i < argc; i++ ) {
+     if( strcmp( argv[i], "-key" ) == 0 && i + 1 < argc ) {
+        key = argv[++i];
+        }
+     else if( strcmp( argv[i], "-utm" ) == 0 && i + 1 < argc ) {
+        int zone = atoi( argv[++i] );
+        int south = strchr( argv[i], 's' ) || strchr( argv[i], 'S' );
+        if( zone < 1 || zone > 60 ) {
+           fprintf( stderr, "Invalid UTM zone %s\n", argv[i] );
+           return 1;
+           }
+        tm_destroy( utm );
+        utm = tm_create( NZTM_A, NZTM_RF, (6.0*zone - 183.0)/rad2deg,
+           0.9996, 0.0, 500000.0, south ? 10000000.0 : 0.0, 1.0 );
+        }
+     else if( strchr( argv[i], ',' ) && npairs < 64 ) {
+        spec[npairs] = argv[i];
+        pairs[npairs].lat = strtok( spec[npairs], "," );
+        pairs[npairs].lon = strtok( NULL, "," );
+        pairs[npairs].n = strtok( NULL, "," );
+        pairs[npairs].e = strtok( NULL, "," );
+        if( ! pairs[npairs].e ) {
+           fprintf( stderr, "Column pairs are given as lat,lon,n,e\n" );
+           return 1;
+           }
+        npairs++;
+        }
+     else path = argv[i];
+     }
+  if( ! path ) {
+     fprintf( stderr, "Usage: nztm_tow [-key column] [-utm zone[s]] "
+        "[lat,lon,n,e ...] out.tow < in.csv\n"
+        "       nztm_tow -l file.tow\n" );
+     return 1;
+     }
+
+  n = nztm_tow_convert( stdin, path, key,
+     utm ? utm : ( npairs ? &nztm_projection : NULL ), pairs, npairs, &err );
+  tm_destroy( utm );
+  if( n < 0 ) {
+     fprintf( stderr, "nztm_tow: %s\n", err );
+     return 1;
+     }
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef _NZTM_TOW_H
+#define _NZTM_TOW_H
+
+/* Columnar binary files of survey tows, such as spring.csv.
+
+   nztm_tow_convert reads a CSV file with a header record and writes
+   each numeric column as a typed array, with the rows stably sorted by
+   a key column (such as reitur, the statistical rectangle).  The key
+   is dictionary encoded as a table of groups, one for each distinct
+   value, giving the range of rows having it.  Columns whose values are
+   all whole numbers are stored as integers, bit packed either as
+   offsets from the column minimum or, when smaller, as differences
+   between successive rows.  Other columns are stored as doubles, with
+   NaN for missing values (empty or NA), and can be used in place.
+   Optionally, northing and easting columns projected from pairs of
+   latitude and longitude columns are added, with the projection
+   recorded in the file.
+
+   nztm_tow_open maps a file read only, so only the pages of the
+   columns actually used are read.  The nztm_tow structure is owned by
+   the caller.  Files are in the byte order of the machine that wrote
+   them (little endian on all supported platforms); nztm_tow_open
+   rejects files in the other order. */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "nztm.h"
+#include "nztm_csv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZTM_TOW_NAMELEN  48      /* Maximum column name length + 1 */
+#define NZTM_TOW_BLOCK    1024    /* Rows per difference coded block */
+
+/* Column types */
+
+#define NZTM_TOW_INT      0
+#define NZTM_TOW_DOUBLE   1
+
+typedef struct {
+        void *map;
+        size_t size;
+        size_t nrows;
+        int ncols;
+        size_t ngroups;
+        int keycol;               /* Column of the key */
+        const void *hdr;          /* Parts of the mapping */
+        const void *cols;
+        const void *groups;
+        } nztm_tow;
+
+/* Converts CSV from in to the file path, sorting and grouping by the
+   column key and, if tm is not NULL, adding the npairs projected
+   column pairs as nztm_csv_project.  The whole table is held in memory
+   during conversion.  Returns the number of rows, or -1 on error with
+   *err (if not NULL) set to a description. */
+
+long nztm_tow_convert( FILE *in, const char *path, const char *key,
+   const tmprojection *tm, const nztm_csv_pair *pairs, int npairs,
+   const char **err );
+
+/* Maps the file path.  Returns 0, or -1 if it cannot be mapped or is
+   not a valid tow file. */
+
+int nztm_tow_open( nztm_tow *t, const char *path );
+void nztm_tow_close( nztm_tow *t );
+
+/* Index of the column named name, or -1 */
+
+int nztm_tow_column( const nztm_tow *t, const char *name );
+const char *nztm_tow_name( const nztm_tow *t, int col );
+int nztm_tow_type( const nztm_tow *t, int col );
+
+/* The nrows values of a double column, in place, or NULL if col is
+   not a double column */
+
+const double *nztm_tow_double( const nztm_tow *t, int col );
+
+/* Decodes count values of an integer column from row first into out.
+   Returns the number decoded (less than count at the end of the
+   table), or -1 if col is not an integer column. */
+
+long nztm_tow_int( const nztm_tow *t, int col, size_t first, size_t count,
+   int64_t *out );
+
+/* Group i: its key value and range of rows.  nztm_tow_find returns the
+   group with key value key, or -1. */
+
+void nztm_tow_group( const nztm_tow *t, size_t i, int64_t *key,
+   size_t *first, size_t *count );
+long nztm_tow_find( const nztm_tow *t, int64_t key );
+
+/* The projection of the projected columns, created with tm_create
+   (free with tm_destroy), or NULL if there are none */
+
+tmprojection *nztm_tow_projection( const nztm_tow *t );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,739 @@
+#define _POSIX_C_SOURCE 200809L
+
+/* Append only sets of tow files.  Needs POSIX mmap.
+
+   The manifest base.tws is a tws_header followed by a tws_segment for
+   each segment.  It is replaced, never modified in place, by writing
+   base.tws.tmp and renaming it, so a failed ingest leaves the set as it
+   was.  Derived caches are written the same way.
+
+   A derived cache is laid out as
+
+      header                 drv_header
+      columns                n0, e0, n1, e1 and length, nrows doubles each
+      aggregates             count (uint64), sum and m2, ncells of each
+
+   Checksums are 64 bit FNV-1a. */
+
+#include "nztm_towset.h"
+
+#include "tmproj.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TWS_MAGIC     "NZTMTWS1"
+#define DRV_MAGIC     "NZTMDRV1"
+#define TWS_VERSION   1
+
+#define TWS_BUFSIZE   65536       /* Bytes read at a time */
+#define TWS_MAXHEADER 65536       /* Longest header record */
+#define TWS_PATHLEN   4096
+
+#define FNV_OFFSET    0xcbf29ce484222325ULL
+#define FNV_PRIME     0x100000001b3ULL
+
+typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t nsegs;
+        uint64_t header;          /* Checksum of the header record */
+        uint64_t end;             /* Bytes of the source ingested */
+        char key[NZTM_TOW_NAMELEN];
+        } tws_header;
+
+typedef struct {
+        uint64_t rows;
+        uint64_t start, end;      /* Bytes of the source */
+        uint64_t checksum;        /* Of those bytes */
+        } tws_segment;
+
+typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t nkeys;
+        uint64_t nrows;
+        uint64_t checksum;        /* Of the segment */
+        uint64_t key;             /* Of the projection and spec */
+        int64_t min[NZTM_AGG_MAXKEYS];
+        int64_t dim[NZTM_AGG_MAXKEYS];
+        uint64_t ncells;
+        } drv_header;
+
+struct nztm_towset {
+        char *base;
+        tws_header hdr;
+        tws_segment *seg;
+        nztm_tow *tow;
+        };
+
+const nztm_towset_spec nztm_towset_spring = {
+   "kastad_breidd", "kastad_lengd", "hift_breidd", "hift_lengd",
+   { "reitur", "smareitur", NULL, NULL }, 2, "catch" };
+
+static uint64_t tws_hash( uint64_t h, const void *p, size_t n ) {
+    const unsigned char *c = (const unsigned char *) p;
+    size_t i;
+
+    for( i = 0; i < n; i++ ) h = (h ^ c[i])*FNV_PRIME;
+    return h;
+    }
+
+/* Reads the manifest of base.  Returns 0, 1 if there is none, or -1 if
+   it is not valid. */
+
+static int tws_load( const char *base, tws_header *h, tws_segment **seg ) {
+    char path[TWS_PATHLEN];
+    FILE *f;
+    int status = -1;
+
+    *seg = NULL;
+    snprintf( path, sizeof(path), "%s.tws", base );
+    if( ! ( f = fopen( path, "rb" ) ) ) return 1;
+    if( fread( h, sizeof(*h), 1, f ) == 1 &&
+        memcmp( h->magic, TWS_MAGIC, 8 ) == 0 && h->version == TWS_VERSION &&
+        h->key[NZTM_TOW_NAMELEN-1] == '\0' && h->nsegs < 1000000 &&
+        ( *seg = (tws_segment *) malloc( ( h->nsegs + 1 )*sizeof(tws_segment) ) ) &&
+        fread( *seg, sizeof(tws_segment), h->nsegs, f ) == h->nsegs )
+        status = 0;
+    fclose( f );
+    if( status != 0 ) { free( *seg ); *seg = NULL; }
+    return status;
+    }
+
+static int tws_save( const char *base, const tws_header *h,
+   const tws_segment *seg ) {
+    char path[TWS_PATHLEN], tmp[TWS_PATHLEN];
+    FILE *f;
+    int ok;
+
+    snprintf( path, sizeof(path), "%s.tws", base );
+    snprintf( tmp, sizeof(tmp), "%s.tws.tmp", base );
+    if( ! ( f = fopen( tmp, "wb" ) ) ) return -1;
+    ok = fwrite( h, sizeof(*h), 1, f ) == 1 &&
+         fwrite( seg, sizeof(tws_segment), h->nsegs, f ) == h->nsegs;
+    if( fclose( f ) != 0 ) ok = 0;
+    if( ! ok || rename( tmp, path ) != 0 ) { remove( tmp ); return -1; }
+    return 0;
+    }
+
+/* Checksum of n bytes of f from offset start, or 0 with *ok cleared if
+   they cannot be read */
+
+static uint64_t tws_sum( FILE *f, uint64_t start, uint64_t n, int *ok ) {
+    char buf[TWS_BUFSIZE];
+    uint64_t h = FNV_OFFSET;
+    size_t m;
+
+    if( fseeko( f, (off_t) start, SEEK_SET ) != 0 ) { *ok = 0; return 0; }
+    while( n > 0 ) {
+        m = n < sizeof(buf) ? (size_t) n : sizeof(buf);
+        if( fread( buf, 1, m, f ) != m ) { *ok = 0; return 0; }
+        h = tws_hash( h, buf, m );
+        n -= m;
+        }
+    return h;
+    }
+
+/* Removes segment i of base and its derived caches, base.i.*.drv */
+
+static void tws_remove( const char *base, uint32_t i ) {
+    char path[TWS_PATHLEN], dir[TWS_PATHLEN], prefix[TWS_PATHLEN];
+    const char *name = strrchr( base, '/' );
+    struct dirent *ent;
+    size_t len;
+    DIR *dp;
+
+    snprintf( path, sizeof(path), "%s.%u.tow", base, (unsigned) i );
+    remove( path );
+    if( name ) {
+        snprintf( dir, sizeof(dir), "%.*s", (int) ( name - base ), base );
+        if( dir[0] == '\0' ) strcpy( dir, "/" );
+        name++;
+        }
+    else {
+        strcpy( dir, "." );
+        name = base;
+        }
+    snprintf( prefix, sizeof(prefix), "%s.%u.", name, (unsigned) i );
+    len = strlen( prefix );
+    if( ! ( dp = opendir( dir ) ) ) return;
+    while( ( ent = readdir( dp ) ) ) {
+        if( strncmp( ent->d_name, prefix, len ) != 0 ||
+            strlen( ent->d_name ) != len + 20 ||
+            strcmp( ent->d_name + len + 16, ".drv" ) != 0 ) continue;
+        snprintf( path, sizeof(path), "%s/%s", dir, ent->d_name );
+        remove( path );
+        }
+    closedir( dp );
+    }
+
+long nztm_towset_ingest( const char *base, const char *csv, const char *key,
+   const char **err )
+{
+   char path[TWS_PATHLEN];
+   char *hdr = NULL, *buf = NULL;
+   const char *e = NULL, *note = NULL;
+   FILE *in = NULL, *tmp = NULL;
+   tws_segment *seg = NULL, *p;
+   tws_header h;
+   uint64_t hh, hr, hc, pos, start, end;
+   size_t hlen = 0, m, k;
+   long rows = -1;
+   uint32_t i, nsegs;
+   int c, ok, loaded;
+
+   if( ! key ) key = "reitur";
+   if( ! ( in = fopen( csv, "rb" ) ) ) { e = "cannot open the source"; goto done; }
+   hdr = (char *) malloc( TWS_MAXHEADER );
+   buf = (char *) malloc( TWS_BUFSIZE );
+   if( ! hdr || ! buf ) { e = "out of memory"; goto done; }
+
+   /* The header record */
+
+   while( ( c = getc( in ) ) != EOF ) {
+      if( hlen == TWS_MAXHEADER ) { e = "header record too long"; goto done; }
+      hdr[hlen++] = (char) c;
+      if( c == '\n' ) break;
+      }
+   if( c != '\n' ) { e = "no header record"; goto done; }
+   hh = tws_hash( FNV_OFFSET, hdr, hlen );
+
+   loaded = tws_load( base, &h, &seg );
+   if( loaded < 0 ) { e = "invalid manifest"; goto done; }
+   if( loaded == 0 ) {
+      if( h.header != hh ) { e = "the header record has changed"; goto done; }
+
+      /* Segments from the first whose bytes have changed (or are no
+         longer there) are dropped, with their caches, and their records
+         ingested again.  The shortened manifest is saved first, so the
+         set stays consistent if the ingest then fails. */
+
+      for( i = 0; i < h.nsegs; i++ ) {
+         ok = 1;
+         p = &seg[i];
+         if( tws_sum( in, p->start, p->end - p->start, &ok ) != p->checksum || ! ok )
+            break;
+         }
+      if( i < h.nsegs ) {
+         nsegs = h.nsegs;
+         h.nsegs = i;
+         h.end = i > 0 ? seg[i-1].end : hlen;
+         if( tws_save( base, &h, seg ) != 0 ) {
+            e = "cannot write the manifest";
+            goto done;
+            }
+         for( ; i < nsegs; i++ ) tws_remove( base, i );
+         note = "records already ingested have changed; their segments were rebuilt";
+         }
+      start = h.end;
+      }
+   else {
+      if( strlen( key ) >= NZTM_TOW_NAMELEN ) { e = "key name too long"; goto done; }
+      memset( &h, 0, sizeof(h) );
+      memcpy( h.magic, TWS_MAGIC, 8 );
+      h.version = TWS_VERSION;
+      h.header = hh;
+      strcpy( h.key, key );
+      if( ! ( seg = (tws_segment *) malloc( sizeof(tws_segment) ) ) ) {
+         e = "out of memory";
+         goto done;
+         }
+      start = hlen;
+      }
+
+   /* Copy the new complete lines after the header record */
+
+   if( fseeko( in, (off_t) start, SEEK_SET ) != 0 ||
+       ! ( tmp = tmpfile() ) || fwrite( hdr, 1, hlen, tmp ) != hlen ) {
+      e = "cannot copy the new records";
+      goto done;
+      }
+   hr = hc = FNV_OFFSET;
+   pos = end = start;
+   while( ( m = fread( buf, 1, TWS_BUFSIZE, in ) ) > 0 ) {
+      for( k = 0; k < m; k++ ) {
+         hr = (hr ^ (unsigned char) buf[k])*FNV_PRIME;
+         if( buf[k] == '\n' ) { hc = hr; end = pos + k + 1; }
+         }
+      if( fwrite( buf, 1, m, tmp ) != m ) { e = "cannot copy the new records"; goto done; }
+      pos += m;
+      }
+   if( end == start ) { rows = 0; e = note; goto done; }
+   if( fflush( tmp ) != 0 ||
+       ftruncate( fileno( tmp ), (off_t) (hlen + (end - start)) ) != 0 ) {
+      e = "cannot copy the new records";
+      goto done;
+      }
+   rewind( tmp );
+
+   snprintf( path, sizeof(path), "%s.%u.tow", base, (unsigned) h.nsegs );
+   rows = nztm_tow_convert( tmp, path, h.key, NULL, NULL, 0, &e );
+   if( rows < 0 ) goto done;
+
+   if( ! ( p = (tws_segment *) realloc( seg, ( h.nsegs + 1 )*sizeof(tws_segment) ) ) ) {
+      e = "out of memory";
+      rows = -1;
+      goto done;
+      }
+   seg = p;
+   seg[h.nsegs].rows = (uint64_t) rows;
+   seg[h.nsegs].start = start;
+   seg[h.nsegs].end = end;
+   seg[h.nsegs].checksum = hc;
+   h.nsegs++;
+   h.end = end;
+   if( tws_save( base, &h, seg ) != 0 ) {
+      e = "cannot write the manifest";
+      rows = -1;
+      }
+   else e = note;
+
+done:
+   if( in ) fclose( in );
+   if( tmp ) fclose( tmp );
+   free( hdr );
+   free( buf );
+   free( seg );
+   if( err ) *err = e;
+   return rows;
+}
+
+nztm_towset *nztm_towset_open( const char *base )
+{
+   char path[TWS_PATHLEN];
+   nztm_towset *s;
+   uint32_t i;
+
+   if( ! ( s = (nztm_towset *) calloc( 1, sizeof(nztm_towset) ) ) ) return NULL;
+   if( tws_load( base, &s->hdr, &s->seg ) != 0 ||
+       ! ( s->base = strdup( base ) ) ||
+       ! ( s->tow = (nztm_tow *) calloc( s->hdr.nsegs + 1, sizeof(nztm_tow) ) ) ) {
+      nztm_towset_close( s );
+      return NULL;
+      }
+   for( i = 0; i < s->hdr.nsegs; i++ ) {
+      snprintf( path, sizeof(path), "%s.%u.tow", base, (unsigned) i );
+      if( nztm_tow_open( &s->tow[i], path ) != 0 ||
+          s->tow[i].nrows != s->seg[i].rows ) {
+         nztm_towset_close( s );
+         return NULL;
+         }
+      }
+   return s;
+}
+
+void nztm_towset_close( nztm_towset *s )
+{
+   uint32_t i;
+
+   if( ! s ) return;
+   if( s->tow ) for( i = 0; i < s->hdr.nsegs; i++ ) nztm_tow_close( &s->tow[i] );
+   free( s->tow );
+   free( s->seg );
+   free( s->base );
+   free( s );
+}
+
+int nztm_towset_segments( const nztm_towset *s )
+{
+   return (int) s->hdr.nsegs;
+}
+
+size_t nztm_towset_rows( const nztm_towset *s )
+{
+   size_t n = 0;
+   uint32_t i;
+
+   for( i = 0; i < s->hdr.nsegs; i++ ) n += (size_t) s->seg[i].rows;
+   return n;
+}
+
+const nztm_tow *nztm_towset_segment( const nztm_towset *s, int i )
+{
+   return i >= 0 && (uint32_t) i < s->hdr.nsegs ? &s->tow[i] : NULL;
+}
+
+/*************************************************************************/
+/*                                                                       */
+/*   Derived data                                                        */
+/*                                                                       */
+/*************************************************************************/
+
+/* Key of the derived data of a segment for tm and spec */
+
+static uint64_t drv_key( uint64_t checksum, const tmprojection *tm,
+   const nztm_towset_spec *spec ) {
+    double proj[8];
+    uint64_t h = tws_hash( FNV_OFFSET, &checksum, sizeof(checksum) );
+    const char *names[4 + NZTM_AGG_MAXKEYS + 1];
+    int i, n = 0;
+
+    proj[0] = tm->a;
+    proj[1] = tm->rf;
+    proj[2] = tm->meridian;
+    proj[3] = tm->scalef;
+    proj[4] = tm->orglat;
+    proj[5] = tm->falsee;
+    proj[6] = tm->falsen;
+    proj[7] = tm->utom;
+    h = tws_hash( h, proj, sizeof(proj) );
+    names[n++] = spec->lat0;
+    names[n++] = spec->lon0;
+    names[n++] = spec->lat1;
+    names[n++] = spec->lon1;
+    for( i = 0; i < spec->nkeys; i++ ) names[n++] = spec->keys[i];
+    names[n++] = spec->value;
+    for( i = 0; i < n; i++ ) h = tws_hash( h, names[i], strlen( names[i] ) + 1 );
+    return h;
+    }
+
+/* Maps the cache path if it is valid for the segment and key */
+
+static int drv_map( const char *path, uint64_t checksum, uint64_t key,
+   uint64_t nrows, nztm_towset_derived *d ) {
+    const drv_header *h;
+    struct stat st;
+    uint64_t need;
+    void *map;
+    int fd, k;
+
+    memset( d, 0, sizeof(*d) );
+    if( ( fd = open( path, O_RDONLY ) ) < 0 ) return -1;
+    if( fstat( fd, &st ) != 0 || (size_t) st.st_size < sizeof(drv_header) ) {
+        close( fd );
+        return -1;
+        }
+    map = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( map == MAP_FAILED ) return -1;
+    h = (const drv_header *) map;
+    need = sizeof(drv_header) + 5*h->nrows*sizeof(double)
+         + h->ncells*(sizeof(uint64_t) + 2*sizeof(double));
+    if( memcmp( h->magic, DRV_MAGIC, 8 ) != 0 || h->version != TWS_VERSION ||
+        h->checksum != checksum || h->key != key || h->nrows != nrows ||
+        h->nkeys < 1 || h->nkeys > NZTM_AGG_MAXKEYS ||
+        h->ncells > NZTM_AGG_MAXCELLS || need != (uint64_t) st.st_size ) {
+        munmap( map, (size_t) st.st_size );
+        return -1;
+        }
+    d->map = map;
+    d->size = (size_t) st.st_size;
+    d->nrows = (size_t) h->nrows;
+    d->n0 = (const double *) (h + 1);
+    d->e0 = d->n0 + d->nrows;
+    d->n1 = d->e0 + d->nrows;
+    d->e1 = d->n1 + d->nrows;
+    d->length = d->e1 + d->nrows;
+    d->nkeys = (int) h->nkeys;
+    for( k = 0; k < d->nkeys; k++ ) {
+        d->min[k] = h->min[k];
+        d->dim[k] = h->dim[k];
+        }
+    d->ncells = (size_t) h->ncells;
+    d->count = (const uint64_t *) (d->length + d->nrows);
+    d->sum = (const double *) (d->count + d->ncells);
+    d->m2 = d->sum + d->ncells;
+    return 0;
+    }
+
+/* Copies column name of t into out as doubles.  Returns the column, or
+   -1 if there is none. */
+
+static int drv_column( const nztm_tow *t, const char *name, double *out,
+   int64_t *ibuf ) {
+    int col = nztm_tow_column( t, name );
+    const double *d;
+    size_t i, j, n;
+
+    if( col < 0 ) return -1;
+    if( ( d = nztm_tow_double( t, col ) ) ) {
+        memcpy( out, d, t->nrows*sizeof(double) );
+        return col;
+        }
+    for( i = 0; i < t->nrows; i += n ) {
+        n = t->nrows - i < NZTM_TOW_BLOCK ? t->nrows - i : NZTM_TOW_BLOCK;
+        nztm_tow_int( t, col, i, n, ibuf );
+        for( j = 0; j < n; j++ ) out[i+j] = (double) ibuf[j];
+        }
+    return col;
+    }
+
+/* Computes the derived data of t and writes it to path */
+
+static int drv_build( const nztm_tow *t, const tmprojection *tm,
+   const nztm_towset_spec *spec, uint64_t checksum, uint64_t key,
+   const char *path ) {
+    char tmp[TWS_PATHLEN + 8];
+    size_t n = t->nrows, i, c;
+    double *v = (double *) malloc( ( 9*n + 1 )*sizeof(double) );
+    double *lt0 = v, *ln0 = v + n, *lt1 = v + 2*n, *ln1 = v + 3*n;
+    double *cols = v + 4*n;       /* n0 e0 n1 e1 length */
+    int64_t ibuf[NZTM_TOW_BLOCK];
+    int keys[NZTM_AGG_MAXKEYS];
+    drv_header h;
+    nztm_agg a;
+    FILE *f = NULL;
+    int value, k, ok = 0, have = 0;
+    double m2;
+
+    if( ! v ) return -1;
+    if( drv_column( t, spec->lat0, lt0, ibuf ) < 0 ||
+        drv_column( t, spec->lon0, ln0, ibuf ) < 0 ||
+        drv_column( t, spec->lat1, lt1, ibuf ) < 0 ||
+        drv_column( t, spec->lon1, ln1, ibuf ) < 0 ) goto done;
+    for( i = 0; i < 4*n; i++ ) v[i] /= rad2deg;
+    geod_tm_hn( tm, lt0, ln0, cols, cols + n, n );
+    geod_tm_hn( tm, lt1, ln1, cols + 2*n, cols + 3*n, n );
+    for( i = 0; i < n; i++ )
+        cols[4*n+i] = hypot( cols[2*n+i] - cols[i], cols[3*n+i] - cols[n+i] );
+
+    for( k = 0; k < spec->nkeys; k++ )
+        if( ( keys[k] = nztm_tow_column( t, spec->keys[k] ) ) < 0 ) goto done;
+    if( ( value = nztm_tow_column( t, spec->value ) ) < 0 ||
+        nztm_agg_run( &a, t, keys, spec->nkeys, value, NULL ) != 0 ) goto done;
+    have = 1;
+
+    memset( &h, 0, sizeof(h) );
+    memcpy( h.magic, DRV_MAGIC, 8 );
+    h.version = TWS_VERSION;
+    h.nkeys = (uint32_t) a.nkeys;
+    h.nrows = n;
+    h.checksum = checksum;
+    h.key = key;
+    for( k = 0; k < a.nkeys; k++ ) {
+        h.min[k] = a.min[k];
+        h.dim[k] = a.dim[k];
+        }
+    h.ncells = a.ncells;
+
+    snprintf( tmp, sizeof(tmp), "%s.tmp", path );
+    if( ! ( f = fopen( tmp, "wb" ) ) ) goto done;
+    ok = fwrite( &h, sizeof(h), 1, f ) == 1 &&
+         fwrite( cols, sizeof(double), 5*n, f ) == 5*n &&
+         fwrite( a.count, sizeof(uint64_t), a.ncells, f ) == a.ncells &&
+         fwrite( a.sum, sizeof(double), a.ncells, f ) == a.ncells;
+    for( c = 0; c < a.ncells && ok; c++ ) {
+        m2 = a.count[c] > 1 ? a.var[c]*(a.count[c] - 1) : 0.0;
+        ok = fwrite( &m2, sizeof(double), 1, f ) == 1;
+        }
+    if( fclose( f ) != 0 ) ok = 0;
+    if( ! ok || rename( tmp, path ) != 0 ) {
+        remove( tmp );
+        ok = 0;
+        }
+
+done:
+    if( have ) nztm_agg_free( &a );
+    free( v );
+    return ok ? 0 : -1;
+    }
+
+int nztm_towset_derive( nztm_towset *s, int i, const tmprojection *tm,
+   const nztm_towset_spec *spec, nztm_towset_derived *d )
+{
+   char path[TWS_PATHLEN];
+   uint64_t key;
+
+   memset( d, 0, sizeof(*d) );
+   if( ! tm ) tm = &nztm_projection;
+   if( ! spec ) spec = &nztm_towset_spring;
+   if( i < 0 || (uint32_t) i >= s->hdr.nsegs ||
+       spec->nkeys < 1 || spec->nkeys > NZTM_AGG_MAXKEYS ) return -1;
+   key = drv_key( s->seg[i].checksum, tm, spec );
+   snprintf( path, sizeof(path), "%s.%d.%016llx.drv", s->base, i,
+      (unsigned long long) key );
+   if( drv_map( path, s->seg[i].checksum, key, s->seg[i].rows, d ) == 0 )
+      return 0;
+   if( drv_build( &s->tow[i], tm, spec, s->seg[i].checksum, key, path ) != 0 )
+      return -1;
+   return drv_map( path, s->seg[i].checksum, key, s->seg[i].rows, d );
+}
+
+void nztm_towset_release( nztm_towset_derived *d )
+{
+   if( d->map ) munmap( d->map, d->size );
+   memset( d, 0, sizeof(*d) );
+}
+
+int nztm_towset_aggregate( nztm_towset *s, const tmprojection *tm,
+   const nztm_towset_spec *spec, nztm_agg *a )
+{
+   nztm_towset_derived d;
+   int64_t key[NZTM_AGG_MAXKEYS], hi[NZTM_AGG_MAXKEYS], v;
+   double *m2, delta;
+   uint64_t na, nb;
+   size_t nc, c, u, q;
+   uint32_t i;
+   int k, nkeys = spec ? spec->nkeys : nztm_towset_spring.nkeys;
+
+   memset( a, 0, sizeof(*a) );
+   if( nkeys < 1 || nkeys > NZTM_AGG_MAXKEYS ) return -1;
+   a->nkeys = nkeys;
+   for( k = 0; k < nkeys; k++ ) {
+      a->min[k] = INT64_MAX;
+      hi[k] = INT64_MIN;
+      }
+
+   /* The union of the cells of the segments */
+
+   for( i = 0; i < s->hdr.nsegs; i++ ) {
+      if( nztm_towset_derive( s, (int) i, tm, spec, &d ) != 0 ) return -1;
+      for( k = 0; k < nkeys && d.ncells > 0; k++ ) {
+         if( d.min[k] < a->min[k] ) a->min[k] = d.min[k];
+         if( d.min[k] + d.dim[k] - 1 > hi[k] ) hi[k] = d.min[k] + d.dim[k] - 1;
+         }
+      nztm_towset_release( &d );
+      }
+   nc = 1;
+   for( k = 0; k < nkeys; k++ ) {
+      if( a->min[k] > hi[k] ) { a->min[k] = 0; hi[k] = -1; }
+      a->dim[k] = hi[k] - a->min[k] + 1;
+      if( a->dim[k] > NZTM_AGG_MAXCELLS ) return -1;
+      nc *= (size_t) a->dim[k];
+      if( nc > NZTM_AGG_MAXCELLS ) return -1;
+      }
+   a->ncells = nc;
+   a->count = (uint64_t *) calloc( nc + 1, sizeof(uint64_t) );
+   a->sum = (double *) calloc( 3*nc + 1, sizeof(double) );
+   if( ! a->count || ! a->sum ) {
+      nztm_agg_free( a );
+      return -1;
+      }
+   a->mean = a->sum + nc;
+   a->var = m2 = a->mean + nc;
+
+   /* Merge, with m2 held in var until the end */
+
+   for( i = 0; i < s->hdr.nsegs; i++ ) {
+      if( nztm_towset_derive( s, (int) i, tm, spec, &d ) != 0 ) {
+         nztm_agg_free( a );
+         return -1;
+         }
+      for( c = 0; c < d.ncells; c++ ) {
+         if( ( nb = d.count[c] ) == 0 ) continue;
+         for( k = nkeys - 1, q = c; k >= 0; k-- ) {
+            key[k] = d.min[k] + (int64_t) (q % (size_t) d.dim[k]);
+            q /= (size_t) d.dim[k];
+            }
+         for( k = 0, u = 0; k < nkeys; k++ ) {
+            v = key[k] - a->min[k];
+            u = u*(size_t) a->dim[k] + (size_t) v;
+            }
+         na = a->count[u];
+         if( na == 0 ) {
+            a->mean[u] = d.sum[c]/nb;
+            m2[u] = d.m2[c];
+            }
+         else {
+            delta = d.sum[c]/nb - a->mean[u];
+            a->mean[u] += delta*nb/(na + nb);
+            m2[u] += d.m2[c] + delta*delta*((double) na*nb/(na + nb));
+            }
+         a->count[u] = na + nb;
+         a->sum[u] += d.sum[c];
+         }
+      nztm_towset_release( &d );
+      }
+   for( c = 0; c < nc; c++ ) {
+      if( a->count[c] == 0 ) a->mean[c] = NAN;
+      a->var[c] = a->count[c] > 1 ? m2[c]/(a->count[c] - 1) : NAN;
+      }
+   return 0;
+}
+
+#ifdef NZTM_TOWSET_TOOL
+
+/* Ingests and aggregates.  Build with
+      cc -O2 -DNZTM_TOWSET_TOOL -o nztm_towset nztm_towset.c nztm_agg.c \
+         nztm_tow.c nztm_csv.c nztm_pool.c nztm.c nztm_simd.c -lm -lpthread
+   and run as
+      nztm_towset -i base in.csv
+   to ingest the new records of in.csv, or as
+      nztm_towset [-utm zone[s]] base
+   to derive the segments (from their caches where valid) and write the
+   catch by reitur and smareitur as CSV, as nztm_agg. */
+
+#include <time.h>
+
+static double tws_elapsed( struct timespec *t0 ) {
+    struct timespec t1;
+    clock_gettime( CLOCK_MONOTONIC, &t1 );
+    return (t1.tv_sec - t0->tv_sec) + 1.0e-9*(t1.tv_nsec - t0->tv_nsec);
+    }
+
+int main( int argc, char *argv[] ) {
+  tmprojection *utm = NULL;
+  int64_t key[NZTM_AGG_MAXKEYS];
+  struct timespec t0;
+  nztm_towset *s;
+  const char *err;
+  nztm_agg a;
+  long n;
+  size_t c;
+  int k;
+
+  if( argc == 4 && strcmp( argv[1], "-i" ) == 0 ) {
+     clock_gettime( CLOCK_MONOTONIC, &t0 );
+     if( ( n = nztm_towset_ingest( argv[2], argv[3], NULL, &err ) ) < 0 ) {
+        fprintf( stderr, "nztm_towset: %s\n", err );
+        return 1;
+        }
+     if( err ) fprintf( stderr, "nztm_towset: %s\n", err );
+     fprintf( stderr, "%ld rows ingested in %.3f ms\n", n,
+        tws_elapsed( &t0 )*1.0e3 );
+     return 0;
+     }
+  if( argc == 4 && strcmp( argv[1], "-utm" ) == 0 ) {
+     int zone = atoi( argv[2] );
+     if( zone < 1 || zone > 60 ) {
+        fprintf( stderr, "Invalid UTM zone %s\n", argv[2] );
+        return 1;
+        }
+     utm = tm_create( NZTM_A, NZTM_RF, (6.0*zone - 183.0)/rad2deg, 0.9996,
+        0.0, 500000.0, strchr( argv[2], 's' ) || strchr( argv[2], 'S' ) ?
+        10000000.0 : 0.0, 1.0 );
+     argv += 2;
+     argc -= 2;
+     }
+  if( argc != 2 ) {
+     fprintf( stderr, "Usage: nztm_towset -i base in.csv\n"
+        "       nztm_towset [-utm zone[s]] base\n" );
+     return 1;
+     }
+  if( ! ( s = nztm_towset_open( argv[1] ) ) ) {
+     fprintf( stderr, "nztm_towset: cannot open %s\n", argv[1] );
+     return 1;
+     }
+  clock_gettime( CLOCK_MONOTONIC, &t0 );
+  if( nztm_towset_aggregate( s, utm, NULL, &a ) != 0 ) {
+     fprintf( stderr, "nztm_towset: cannot derive %s\n", argv[1] );
+     return 1;
+     }
+  fprintf( stderr, "%d segments, %lu rows, aggregated in %.3f ms\n",
+     nztm_towset_segments( s ), (unsigned long) nztm_towset_rows( s ),
+     tws_elapsed( &t0 )*1.0e3 );
+
+  for( k = 0; k < a.nkeys; k++ ) printf( "%s,", nztm_towset_spring.keys[k] );
+  printf( "count,sum,mean,var\n" );
+  for( c = 0; c < a.ncells; c++ ) {
+     if( a.count[c] == 0 ) continue;
+     nztm_agg_key( &a, c, key );
+     for( k = 0; k < a.nkeys; k++ ) printf( "%ld,", (long) key[k] );
+     printf( "%lu,%.10g,%.10g,%.10g\n", (unsigned long) a.count[c], a.sum[c],
+        a.mean[c], a.var[c] );
+     }
+  nztm_agg_free( &a );
+  nztm_towset_close( s );
+  tm_destroy( utm );
+  return 0;
+  }
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef _NZTM_TOWSET_H
+#define _NZTM_TOWSET_H
+
+/* Append only sets of tow files, for CSV sources such as spring.csv
+   that grow by new records at their end.
+
+   A set with base name base is a manifest, base.tws, and one tow file
+   (nztm_tow.h) for each ingest, base.0.tow, base.1.tow, ..., called the
+   segments.  nztm_towset_ingest converts only the records of the source
+   after those already ingested into a new segment and appends it to the
+   manifest.  The manifest records the source bytes of each segment and
+   their checksum; before appending, the header record and the bytes of
+   every segment are checked against the source, so that a source whose
+   earlier records were edited is reported rather than silently mixed.
+   A changed header record is an error.  Otherwise the first segment
+   whose bytes have changed and all the segments after it are dropped,
+   their files and derived caches removed, and their records ingested
+   again as one new segment.  Only complete lines are ingested.
+
+   Derived data of a segment - the projected start and end of each tow,
+   its length, and aggregates of a value over the rectangles of key
+   columns (nztm_agg.h) - are cached in a file of their own,
+   base.i.hash.drv, named and checked by the segment's checksum, the
+   projection parameters and the column names used.  nztm_towset_derive
+   maps the cache if it is valid and otherwise computes and writes it,
+   so after an ingest only the new segment is derived, and a new
+   projection or column choice rebuilds only what it needs, when it is
+   first used.  nztm_towset_aggregate merges the aggregates of the
+   segments (by the method of Chan, Golub and LeVeque for the
+   variances) without reading the rows of any cached segment. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nztm.h"
+#include "nztm_agg.h"
+#include "nztm_tow.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Columns used for derived data */
+
+typedef struct {
+        const char *lat0, *lon0;  /* Start of the tow (degrees) */
+        const char *lat1, *lon1;  /* End of the tow (degrees) */
+        const char *keys[NZTM_AGG_MAXKEYS];
+        int nkeys;
+        const char *value;        /* Column aggregated */
+        } nztm_towset_spec;
+
+/* kastad_ and hift_ breidd and lengd, catch over reitur and smareitur */
+
+extern const nztm_towset_spec nztm_towset_spring;
+
+typedef struct nztm_towset nztm_towset;
+
+/* Derived data of a segment, in a read only mapping of its cache */
+
+typedef struct {
+        void *map;
+        size_t size;
+        size_t nrows;
+        const double *n0, *e0;    /* Projected start */
+        const double *n1, *e1;    /* Projected end, NaN if missing */
+        const double *length;     /* In projection units */
+        int nkeys;                /* Aggregates, as nztm_agg */
+        int64_t min[NZTM_AGG_MAXKEYS];
+        int64_t dim[NZTM_AGG_MAXKEYS];
+        size_t ncells;
+        const uint64_t *count;
+        const double *sum;
+        const double *m2;         /* Sum of squared differences from the mean */
+        } nztm_towset_derived;
+
+/* Ingests the new complete records of the CSV file csv into the set
+   base, creating it if needed with key column key (NULL for reitur).
+   Returns the number of rows ingested, 0 if there were none, or -1 on
+   error with *err (if not NULL) set to a description.  On success *err
+   is NULL, or a note that segments were dropped and rebuilt. */
+
+long nztm_towset_ingest( const char *base, const char *csv, const char *key,
+   const char **err );
+
+/* Opens the set base.  Returns NULL if it cannot be read. */
+
+nztm_towset *nztm_towset_open( const char *base );
+void nztm_towset_close( nztm_towset *s );
+
+int nztm_towset_segments( const nztm_towset *s );
+size_t nztm_towset_rows( const nztm_towset *s );
+const nztm_tow *nztm_towset_segment( const nztm_towset *s, int i );
+
+/* Maps the derived data of segment i for tm (NULL for NZTM) and spec
+   (NULL for nztm_towset_spring), computing and caching it if needed.
+   Returns 0, or -1 if a column is missing or invalid or a file cannot
+   be written or mapped. */
+
+int nztm_towset_derive( nztm_towset *s, int i, const tmprojection *tm,
+   const nztm_towset_spec *spec, nztm_towset_derived *d );
+void nztm_towset_release( nztm_towset_derived *d );
+
+/* The aggregates of the whole set, as nztm_agg_run over all its rows
+   (free with nztm_agg_free).  Returns 0 or -1 as nztm_towset_derive. */
+
+int nztm_towset_aggregate( nztm_towset *s, const tmprojection *tm,
+   const nztm_towset_spec *spec, nztm_agg *a );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
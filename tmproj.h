@@ -0,0 +1,136 @@
+#ifndef _TMPROJ_H
+#define _TMPROJ_H
+
+/* Internal definitions shared by the modules implementing the TM
+   projection (nztm.c, nztm_simd.c).  Not part of the public interface
+   in nztm.h. */
+
+#include "nztm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defines PI (from Abramowitz and Stegun Table 1.1) */
+
+#define PI 3.1415926535898
+#define TWOPI (2.0*PI)
+#define rad2deg (180/PI)
+
+/* Structure used to define a TM projection */
+
+struct tmprojection {
+	    double meridian;          /* Central meridian */
+	    double scalef;            /* Scale factor */
+	    double orglat;            /* Origin latitude */
+	    double falsee;            /* False easting */
+	    double falsen;            /* False northing */
+	    double utom;              /* Unit to metre conversion */
+
+	    double a, rf, f, e2, ep2;     /* Ellipsoid parameters */
+	    double om;                /* Intermediate calculation */
+
+	    /* Coefficients depending only on the ellipsoid, derived
+	       once by define_tmprojection */
+	    double A0, A2, A4, A6;    /* Meridian arc series */
+	    double g;                 /* Foot point rectifying radius */
+	    double p2, p4, p6, p8;    /* Foot point latitude series */
+	    double ome2;              /* 1 - e2 */
+	    double rsf;               /* 1/scalef */
+	    double rutom;             /* 1/utom */
+	    };
+
+/* Defines a projection in storage owned by the caller, as tm_create.
+   Defined in nztm.c. */
+
+void tm_define( tmprojection *tm, double a, double rf, double cm, double sf,
+   double lto, double fe, double fn, double utom );
+
+/* Batch conversions using the instruction set isa and method (the
+   NZTM_ISA_ and NZTM_REDFEARN/NZTM_CLENSHAW values in nztm.h).
+   Defined in nztm.c. */
+
+void tm_geod_isa( int isa, int method, const tmprojection *tm,
+   const double *ce, const double *cn, size_t instride,
+   double *ln, double *lt, size_t outstride, size_t count );
+void geod_tm_isa( int isa, int method, const tmprojection *tm,
+   const double *ln, const double *lt, size_t instride,
+   double *ce, double *cn, size_t outstride, size_t count );
+
+/* The meridional arc (metres) to latitude lt and the foot point
+   latitude of meridional arc m (radians), as used by the conversions.
+   Exported for benchmarking; defined in nztm.c. */
+
+double tm_meridian_arc( const tmprojection *tm, double lt );
+double tm_foot_point_lat( const tmprojection *tm, double m );
+
+/* Instrumentation hooks (nztm_stats.h), defined in nztm_stats.c.  With
+   NZTM_STATS undefined they expand to nothing.  TM_STATS_BEGIN is a
+   declaration and must start a block; TM_STATS_START starts the clock
+   that TM_STATS_END reads.  TM_STATS_FORWARD and TM_STATS_INVERSE
+   classify the inputs, so they must come before the conversion, which
+   may overwrite them, and before TM_STATS_START, so that their time is
+   not charged to the call. */
+
+#ifdef NZTM_STATS
+
+#include <stdint.h>
+
+#include "nztm_stats.h"
+
+uint64_t tm_stats_start( void );
+void tm_stats_call( int call, size_t count, uint64_t start );
+void tm_stats_forward( const tmprojection *tm, const double *ln,
+   const double *lt, size_t stride, size_t count );
+void tm_stats_inverse( const tmprojection *tm, const double *ce,
+   const double *cn, size_t stride, size_t count );
+
+#define TM_STATS_BEGIN            uint64_t tm_stats_t0;
+#define TM_STATS_START            tm_stats_t0 = tm_stats_start()
+#define TM_STATS_END(call,count)  tm_stats_call( call, count, tm_stats_t0 )
+#define TM_STATS_FORWARD(tm,ln,lt,stride,count) \
+           tm_stats_forward( tm, ln, lt, stride, count )
+#define TM_STATS_INVERSE(tm,ce,cn,stride,count) \
+           tm_stats_inverse( tm, ce, cn, stride, count )
+
+#else
+
+#define TM_STATS_BEGIN
+#define TM_STATS_START                          ((void) 0)
+#define TM_STATS_END(call,count)                ((void) 0)
+#define TM_STATS_FORWARD(tm,ln,lt,stride,count) ((void) 0)
+#define TM_STATS_INVERSE(tm,ce,cn,stride,count) ((void) 0)
+
+#endif
+
+/* Scalar batch kernels, defined in nztm.c.  Unlike tm_geod_isa and
+   geod_tm_isa they record nothing, so kernels falling back to them are
+   not counted twice. */
+
+void tm_geod_batch( const tmprojection *tm, int method,
+   const double *ce, const double *cn, size_t instride,
+   double *ln, double *lt, size_t outstride, size_t count );
+void geod_tm_batch( const tmprojection *tm, int method,
+   const double *ln, const double *lt, size_t instride,
+   double *ce, double *cn, size_t outstride, size_t count );
+
+/* SIMD kernels, defined in nztm_simd.c.  tm_simd_isa returns the best
+   instruction set supported by the running processor, and
+   tm_isa_supported whether it supports isa; the kernels must only be
+   called with an isa it supports. */
+
+int tm_simd_isa( void );
+int tm_isa_supported( int isa );
+
+void tm_geod_simd( int isa, int method, const tmprojection *tm,
+   const double *ce, const double *cn, size_t instride,
+   double *ln, double *lt, size_t outstride, size_t count );
+void geod_tm_simd( int isa, int method, const tmprojection *tm,
+   const double *ln, const double *lt, size_t instride,
+   double *ce, double *cn, size_t outstride, size_t count );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif